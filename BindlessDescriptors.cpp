@@ -0,0 +1,188 @@
+#include "BindlessDescriptors.h"
+#include "PipelineLayoutCache.h"
+
+#include "VulkanBase/VulkanDevice.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+
+bool BindlessDescriptors::enableFeatures(vks::VulkanDevice* device, uint32_t apiVersion, std::vector<const char*>& extensions, VkPhysicalDeviceVulkan12Features& vulkan12Features, void*& pNextChain)
+{
+	const bool core = apiVersion >= VK_API_VERSION_1_2;
+	if (!core && !device->extensionSupported(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME))
+	{
+		return false;
+	}
+
+	// The promoted structures can be queried on Vulkan 1.2 devices as well
+	VkPhysicalDeviceDescriptorIndexingFeatures supportedFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES };
+	VkPhysicalDeviceFeatures2 deviceFeatures2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+	deviceFeatures2.pNext = &supportedFeatures;
+	vkGetPhysicalDeviceFeatures2(device->physicalDevice, &deviceFeatures2);
+	VkPhysicalDeviceProperties2 deviceProperties2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+	deviceProperties2.pNext = &m_descriptorIndexingProperties;
+	vkGetPhysicalDeviceProperties2(device->physicalDevice, &deviceProperties2);
+
+	// Runtime sized arrays of textures and samplers, indexed with values that differ within a draw, partially written and updated while bound
+	if (!supportedFeatures.runtimeDescriptorArray || !supportedFeatures.shaderSampledImageArrayNonUniformIndexing
+		|| !supportedFeatures.descriptorBindingPartiallyBound || !supportedFeatures.descriptorBindingSampledImageUpdateAfterBind)
+	{
+		return false;
+	}
+	// Without it storage buffers in the set can only be written while it isn't bound
+	m_storageBufferUpdateAfterBind = supportedFeatures.descriptorBindingStorageBufferUpdateAfterBind;
+
+	if (core)
+	{
+		vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+		vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+		vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+		vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind = m_storageBufferUpdateAfterBind;
+	}
+	else
+	{
+		// VkPhysicalDeviceVulkan12Features must not be chained along with this structure
+		m_enabledDescriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+		m_enabledDescriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+		m_enabledDescriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+		m_enabledDescriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		m_enabledDescriptorIndexingFeatures.descriptorBindingStorageBufferUpdateAfterBind = m_storageBufferUpdateAfterBind;
+		extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+		m_enabledDescriptorIndexingFeatures.pNext = pNextChain;
+		pNextChain = &m_enabledDescriptorIndexingFeatures;
+	}
+	return true;
+}
+
+void BindlessDescriptors::create(VkDevice device, PipelineLayoutCache& layoutCache, const std::vector<VkDescriptorSetLayoutBinding>& bindings, uint32_t arrayCapacity)
+{
+	m_device = device;
+
+	std::vector<VkDescriptorSetLayoutBinding> layoutBindings = bindings;
+	std::vector<VkDescriptorBindingFlags> bindingFlags;
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	for (VkDescriptorSetLayoutBinding& binding : layoutBindings)
+	{
+		VkDescriptorBindingFlags flags = isUpdateAfterBindSupported(binding.descriptorType) ? VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT : 0;
+		if (binding.descriptorCount == 0)
+		{
+			binding.descriptorCount = std::min(arrayCapacity, getMaxDescriptorCount(binding.descriptorType));
+			// The shaders only access the elements that have been written
+			flags |= VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+		}
+		bindingFlags.push_back(flags);
+		poolSizes.push_back({ binding.descriptorType, binding.descriptorCount });
+		m_bindings.push_back({ binding.binding, binding.descriptorType, binding.descriptorCount, 0 });
+	}
+	m_setLayout = layoutCache.getSetLayout(layoutBindings, VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT, bindingFlags);
+
+	// Sets with update after bind bindings need a pool of their own
+	VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+	descriptorPoolCI.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	VK_CHECK_RESULT(vkCreateDescriptorPool(m_device, &descriptorPoolCI, nullptr, &m_pool));
+
+	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(m_pool, &m_setLayout, 1);
+	VK_CHECK_RESULT(vkAllocateDescriptorSets(m_device, &allocInfo, &m_set));
+}
+
+void BindlessDescriptors::destroy()
+{
+	// The set layout belongs to the layout cache
+	if (m_pool != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorPool(m_device, m_pool, nullptr);
+	}
+	m_pool = VK_NULL_HANDLE;
+	m_set = VK_NULL_HANDLE;
+	m_setLayout = VK_NULL_HANDLE;
+	m_bindings.clear();
+}
+
+uint32_t BindlessDescriptors::addImage(uint32_t binding, const VkDescriptorImageInfo& imageInfo)
+{
+	Binding& target = allocate(binding);
+	VkWriteDescriptorSet writeDescriptorSet{};
+	writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeDescriptorSet.dstSet = m_set;
+	writeDescriptorSet.dstBinding = binding;
+	writeDescriptorSet.dstArrayElement = target.count;
+	writeDescriptorSet.descriptorCount = 1;
+	writeDescriptorSet.descriptorType = target.descriptorType;
+	writeDescriptorSet.pImageInfo = &imageInfo;
+	vkUpdateDescriptorSets(m_device, 1, &writeDescriptorSet, 0, nullptr);
+	return target.count++;
+}
+
+uint32_t BindlessDescriptors::addBuffer(uint32_t binding, const VkDescriptorBufferInfo& bufferInfo)
+{
+	Binding& target = allocate(binding);
+	VkWriteDescriptorSet writeDescriptorSet{};
+	writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeDescriptorSet.dstSet = m_set;
+	writeDescriptorSet.dstBinding = binding;
+	writeDescriptorSet.dstArrayElement = target.count;
+	writeDescriptorSet.descriptorCount = 1;
+	writeDescriptorSet.descriptorType = target.descriptorType;
+	writeDescriptorSet.pBufferInfo = &bufferInfo;
+	vkUpdateDescriptorSets(m_device, 1, &writeDescriptorSet, 0, nullptr);
+	return target.count++;
+}
+
+uint32_t BindlessDescriptors::getCount(uint32_t binding) const
+{
+	auto it = std::find_if(m_bindings.begin(), m_bindings.end(), [binding](const Binding& b) { return b.binding == binding; });
+	return (it != m_bindings.end()) ? it->count : 0;
+}
+
+BindlessDescriptors::Binding& BindlessDescriptors::allocate(uint32_t binding)
+{
+	auto it = std::find_if(m_bindings.begin(), m_bindings.end(), [binding](const Binding& b) { return b.binding == binding; });
+	if (it == m_bindings.end())
+	{
+		throw std::runtime_error("The bindless descriptor set has no binding " + std::to_string(binding));
+	}
+	if (it->count == it->capacity)
+	{
+		throw std::runtime_error("Binding " + std::to_string(binding) + " of the bindless descriptor set is full (" + std::to_string(it->capacity) + " descriptors)");
+	}
+	return *it;
+}
+
+bool BindlessDescriptors::isUpdateAfterBindSupported(VkDescriptorType descriptorType) const
+{
+	switch (descriptorType)
+	{
+	case VK_DESCRIPTOR_TYPE_SAMPLER:
+	case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+	case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+		return true;
+	case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+		return m_storageBufferUpdateAfterBind;
+	default:
+		return false;
+	}
+}
+
+uint32_t BindlessDescriptors::getMaxDescriptorCount(VkDescriptorType descriptorType) const
+{
+	const VkPhysicalDeviceDescriptorIndexingProperties& properties = m_descriptorIndexingProperties;
+	switch (descriptorType)
+	{
+	case VK_DESCRIPTOR_TYPE_SAMPLER:
+		return std::min(properties.maxPerStageDescriptorUpdateAfterBindSamplers, properties.maxDescriptorSetUpdateAfterBindSamplers);
+	case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+		return std::min(properties.maxPerStageDescriptorUpdateAfterBindSampledImages, properties.maxDescriptorSetUpdateAfterBindSampledImages);
+	case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+		return std::min({ properties.maxPerStageDescriptorUpdateAfterBindSamplers, properties.maxDescriptorSetUpdateAfterBindSamplers,
+			properties.maxPerStageDescriptorUpdateAfterBindSampledImages, properties.maxDescriptorSetUpdateAfterBindSampledImages });
+	case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+		return std::min(properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers, properties.maxDescriptorSetUpdateAfterBindStorageBuffers);
+	case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+		return std::min(properties.maxPerStageDescriptorUpdateAfterBindUniformBuffers, properties.maxDescriptorSetUpdateAfterBindUniformBuffers);
+	default:
+		return properties.maxPerStageUpdateAfterBindResources;
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "vulkan/vulkan.h"
+
+class PipelineLayoutCache;
+
+namespace vks
+{
+    struct VulkanDevice;
+}
+
+
+// A single descriptor set holding every texture, sampler and storage buffer the materials use (bindless resources)
+// Shaders index the descriptor arrays of the set with the indices stored in the material of the object they draw, so the set is bound once per pass
+// and switching materials between draws (or between the objects of one instanced or indirect draw) costs no descriptor binds
+// Built on descriptor indexing (VK_EXT_descriptor_indexing, core in Vulkan 1.2): the arrays are runtime sized in the shaders and only partially
+// written, and the set is created with update after bind, so new descriptors can be added while command buffers using the set are pending
+class BindlessDescriptors
+{
+public:
+    // Enables the descriptor indexing features, through vulkan12Features on Vulkan 1.2 devices (the caller chains it into the device create info),
+    // otherwise through VK_EXT_descriptor_indexing. False if the device lacks a feature the bindless set needs, called before the device is created
+    bool enableFeatures(vks::VulkanDevice* device, uint32_t apiVersion, std::vector<const char*>& extensions, VkPhysicalDeviceVulkan12Features& vulkan12Features, void*& pNextChain);
+
+    // Creates the set from the reflected bindings of its set number. Runtime sized arrays (descriptorCount 0) get arrayCapacity elements, or
+    // fewer if the device limits are lower. The set layout comes from layoutCache, which also owns it
+    void create(VkDevice device, PipelineLayoutCache& layoutCache, const std::vector<VkDescriptorSetLayoutBinding>& bindings, uint32_t arrayCapacity);
+    void destroy();
+
+    VkDescriptorSetLayout getSetLayout() const { return m_setLayout; }
+    VkDescriptorSet getSet() const { return m_set; }
+
+    // Write a descriptor to the next free element of binding and return its index, which is what the shaders index the array with
+    // An image info is used for sampled images and samplers. Throws if the array is full
+    uint32_t addImage(uint32_t binding, const VkDescriptorImageInfo& imageInfo);
+    uint32_t addBuffer(uint32_t binding, const VkDescriptorBufferInfo& bufferInfo);
+    // Number of descriptors written to binding
+    uint32_t getCount(uint32_t binding) const;
+
+private:
+    struct Binding {
+        uint32_t binding;
+        VkDescriptorType descriptorType;
+        uint32_t capacity;
+        uint32_t count;
+    };
+
+    Binding& allocate(uint32_t binding);
+    // Descriptors of type can be written while the set is bound (with the enabled features)
+    bool isUpdateAfterBindSupported(VkDescriptorType descriptorType) const;
+    // The most descriptors of type the set can hold
+    uint32_t getMaxDescriptorCount(VkDescriptorType descriptorType) const;
+
+    VkDevice m_device{ VK_NULL_HANDLE };
+    VkDescriptorSetLayout m_setLayout{ VK_NULL_HANDLE };
+    VkDescriptorPool m_pool{ VK_NULL_HANDLE };
+    VkDescriptorSet m_set{ VK_NULL_HANDLE };
+    std::vector<Binding> m_bindings;
+
+    bool m_storageBufferUpdateAfterBind{ false };
+    VkPhysicalDeviceDescriptorIndexingFeatures m_enabledDescriptorIndexingFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES };
+    VkPhysicalDeviceDescriptorIndexingProperties m_descriptorIndexingProperties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES };
+};
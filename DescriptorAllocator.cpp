@@ -0,0 +1,128 @@
+#include "DescriptorAllocator.h"
+
+#include "VulkanBase/VulkanTools.h"
+
+#include <algorithm>
+
+
+void DescriptorAllocator::init(VkDevice device, uint32_t setsPerPool, const std::vector<PoolSizeRatio>& poolSizeRatios)
+{
+	m_device = device;
+	m_setsPerPool = std::max(setsPerPool, 1u);
+	m_poolSizeRatios = poolSizeRatios;
+}
+
+void DescriptorAllocator::destroy()
+{
+	for (VkDescriptorPool pool : m_fullPools)
+	{
+		vkDestroyDescriptorPool(m_device, pool, nullptr);
+	}
+	for (VkDescriptorPool pool : m_readyPools)
+	{
+		vkDestroyDescriptorPool(m_device, pool, nullptr);
+	}
+	if (m_currentPool != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorPool(m_device, m_currentPool, nullptr);
+	}
+	m_fullPools.clear();
+	m_readyPools.clear();
+	m_currentPool = VK_NULL_HANDLE;
+	m_allocationCount = 0;
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout setLayout)
+{
+	if (m_currentPool == VK_NULL_HANDLE)
+	{
+		m_currentPool = getPool();
+	}
+
+	VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
+	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(m_currentPool, &setLayout, 1);
+	VkResult result = vkAllocateDescriptorSets(m_device, &allocInfo, &descriptorSet);
+	if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+	{
+		// The pool stays in the chain until the next reset, a set never spans pools so a fresh one always has room
+		m_fullPools.push_back(m_currentPool);
+		m_currentPool = getPool();
+		allocInfo.descriptorPool = m_currentPool;
+		result = vkAllocateDescriptorSets(m_device, &allocInfo, &descriptorSet);
+	}
+	VK_CHECK_RESULT(result);
+	m_allocationCount++;
+	return descriptorSet;
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout setLayout, VkDescriptorUpdateTemplate updateTemplate, const void* data)
+{
+	VkDescriptorSet descriptorSet = allocate(setLayout);
+	vkUpdateDescriptorSetWithTemplate(m_device, descriptorSet, updateTemplate, data);
+	return descriptorSet;
+}
+
+void DescriptorAllocator::reset()
+{
+	if (m_currentPool != VK_NULL_HANDLE)
+	{
+		m_fullPools.push_back(m_currentPool);
+		m_currentPool = VK_NULL_HANDLE;
+	}
+	for (VkDescriptorPool pool : m_fullPools)
+	{
+		VK_CHECK_RESULT(vkResetDescriptorPool(m_device, pool, 0));
+		m_readyPools.push_back(pool);
+	}
+	m_fullPools.clear();
+	m_allocationCount = 0;
+}
+
+VkDescriptorUpdateTemplateEntry DescriptorAllocator::templateEntry(uint32_t binding, VkDescriptorType type, size_t offset, uint32_t count, size_t stride)
+{
+	VkDescriptorUpdateTemplateEntry entry{};
+	entry.dstBinding = binding;
+	entry.dstArrayElement = 0;
+	entry.descriptorCount = count;
+	entry.descriptorType = type;
+	entry.offset = offset;
+	entry.stride = stride;
+	return entry;
+}
+
+VkDescriptorUpdateTemplate DescriptorAllocator::createUpdateTemplate(VkDevice device, VkDescriptorSetLayout setLayout, const std::vector<VkDescriptorUpdateTemplateEntry>& entries)
+{
+	VkDescriptorUpdateTemplateCreateInfo templateCI{};
+	templateCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+	templateCI.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+	templateCI.pDescriptorUpdateEntries = entries.data();
+	templateCI.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+	templateCI.descriptorSetLayout = setLayout;
+	VkDescriptorUpdateTemplate updateTemplate{ VK_NULL_HANDLE };
+	VK_CHECK_RESULT(vkCreateDescriptorUpdateTemplate(device, &templateCI, nullptr, &updateTemplate));
+	return updateTemplate;
+}
+
+VkDescriptorPool DescriptorAllocator::getPool()
+{
+	if (!m_readyPools.empty())
+	{
+		VkDescriptorPool pool = m_readyPools.back();
+		m_readyPools.pop_back();
+		return pool;
+	}
+
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	for (const PoolSizeRatio& poolSizeRatio : m_poolSizeRatios)
+	{
+		const uint32_t descriptorCount = std::max(static_cast<uint32_t>(poolSizeRatio.ratio * m_setsPerPool), 1u);
+		poolSizes.push_back(vks::initializers::descriptorPoolSize(poolSizeRatio.type, descriptorCount));
+	}
+	VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, m_setsPerPool);
+	VkDescriptorPool pool{ VK_NULL_HANDLE };
+	VK_CHECK_RESULT(vkCreateDescriptorPool(m_device, &descriptorPoolCI, nullptr, &pool));
+
+	// The next pool is half as large again, a chain that keeps running dry settles on a few large pools
+	m_setsPerPool = std::min(m_setsPerPool + m_setsPerPool / 2 + 1, MAX_SETS_PER_POOL);
+	return pool;
+}
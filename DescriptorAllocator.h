@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "vulkan/vulkan.h"
+
+
+// Allocates descriptor sets from a chain of descriptor pools
+// When the current pool is exhausted (VK_ERROR_OUT_OF_POOL_MEMORY or VK_ERROR_FRAGMENTED_POOL) the allocator moves on to a new pool, each one
+// larger than the last, so allocations never fail for lack of pool space and the pool sizes don't have to be known up front
+// Sets are never freed one by one. A transient allocator, one per frame in flight, is reset as a whole once the GPU is done with its frame, which
+// returns all of its sets with a single vkResetDescriptorPool per pool and keeps the pools for the next frame
+class DescriptorAllocator
+{
+public:
+    // Descriptors of type reserved per set of a pool, e.g. { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8.0f } sizes a pool of 16 sets for 128 storage buffers
+    struct PoolSizeRatio {
+        VkDescriptorType type;
+        float ratio;
+    };
+
+    // setsPerPool is the size of the first pool, the following ones grow up to MAX_SETS_PER_POOL
+    void init(VkDevice device, uint32_t setsPerPool, const std::vector<PoolSizeRatio>& poolSizeRatios);
+    void destroy();
+
+    VkDescriptorSet allocate(VkDescriptorSetLayout setLayout);
+    // Allocates a set and writes all of its descriptors from data, a packed struct of descriptor infos laid out as updateTemplate describes
+    // (see createUpdateTemplate), the whole set costs one vkUpdateDescriptorSetWithTemplate
+    VkDescriptorSet allocate(VkDescriptorSetLayout setLayout, VkDescriptorUpdateTemplate updateTemplate, const void* data);
+    // Returns all sets to their pools, none of them may still be used by a pending command buffer
+    void reset();
+
+    uint32_t getPoolCount() const { return static_cast<uint32_t>(m_fullPools.size() + m_readyPools.size()) + (m_currentPool != VK_NULL_HANDLE ? 1 : 0); }
+    // Sets allocated since the last reset
+    uint32_t getAllocationCount() const { return m_allocationCount; }
+
+    // Template entry of count descriptors of type at binding, read from offset in the packed struct (and stride bytes apart for arrays)
+    static VkDescriptorUpdateTemplateEntry templateEntry(uint32_t binding, VkDescriptorType type, size_t offset, uint32_t count = 1, size_t stride = 0);
+    // Update template writing the descriptor sets of setLayout from a packed struct, destroyed with vkDestroyDescriptorUpdateTemplate
+    static VkDescriptorUpdateTemplate createUpdateTemplate(VkDevice device, VkDescriptorSetLayout setLayout, const std::vector<VkDescriptorUpdateTemplateEntry>& entries);
+
+    static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+private:
+    // A reset pool if there is one, otherwise a new pool larger than the last one created
+    VkDescriptorPool getPool();
+
+    VkDevice m_device{ VK_NULL_HANDLE };
+    std::vector<PoolSizeRatio> m_poolSizeRatios;
+    uint32_t m_setsPerPool{ 0 };    // Of the next pool created
+    VkDescriptorPool m_currentPool{ VK_NULL_HANDLE };
+    std::vector<VkDescriptorPool> m_fullPools;
+    std::vector<VkDescriptorPool> m_readyPools;
+    uint32_t m_allocationCount{ 0 };
+};
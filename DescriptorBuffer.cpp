@@ -0,0 +1,192 @@
+#include "DescriptorBuffer.h"
+
+#include "VulkanBase/VulkanDevice.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+
+bool DescriptorBuffer::enableFeatures(vks::VulkanDevice* device, uint32_t apiVersion, std::vector<const char*>& extensions, VkPhysicalDeviceVulkan12Features& vulkan12Features, void*& pNextChain)
+{
+	// Buffer device address and descriptor indexing come with Vulkan 1.2, synchronization 2 is an extension up to Vulkan 1.3
+	if (apiVersion < VK_API_VERSION_1_2 || !device->extensionSupported(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME) || !device->extensionSupported(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME))
+	{
+		return false;
+	}
+
+	VkPhysicalDeviceDescriptorBufferFeaturesEXT supportedDescriptorBufferFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT };
+	VkPhysicalDeviceVulkan12Features supportedVulkan12Features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+	supportedVulkan12Features.pNext = &supportedDescriptorBufferFeatures;
+	VkPhysicalDeviceFeatures2 deviceFeatures2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+	deviceFeatures2.pNext = &supportedVulkan12Features;
+	vkGetPhysicalDeviceFeatures2(device->physicalDevice, &deviceFeatures2);
+	// Buffer descriptors are written from device addresses, as is the buffer binding
+	if (!supportedDescriptorBufferFeatures.descriptorBuffer || !supportedVulkan12Features.bufferDeviceAddress)
+	{
+		return false;
+	}
+
+	vulkan12Features.bufferDeviceAddress = VK_TRUE;
+	if (std::find_if(extensions.begin(), extensions.end(), [](const char* name) { return strcmp(name, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME) == 0; }) == extensions.end())
+	{
+		extensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+	}
+	extensions.push_back(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+	m_enabledDescriptorBufferFeatures.descriptorBuffer = VK_TRUE;
+	m_enabledDescriptorBufferFeatures.pNext = pNextChain;
+	pNextChain = &m_enabledDescriptorBufferFeatures;
+	return true;
+}
+
+void DescriptorBuffer::create(vks::VulkanDevice* device, VkDeviceSize regionSize, uint32_t regionCount)
+{
+	m_device = device->logicalDevice;
+	auto load = [this](auto& command, const char* name) {
+		command = reinterpret_cast<std::remove_reference_t<decltype(command)>>(vkGetDeviceProcAddr(m_device, name));
+	};
+	load(m_vkGetDescriptorSetLayoutSizeEXT, "vkGetDescriptorSetLayoutSizeEXT");
+	load(m_vkGetDescriptorSetLayoutBindingOffsetEXT, "vkGetDescriptorSetLayoutBindingOffsetEXT");
+	load(m_vkGetDescriptorEXT, "vkGetDescriptorEXT");
+	load(m_vkCmdBindDescriptorBuffersEXT, "vkCmdBindDescriptorBuffersEXT");
+	load(m_vkCmdSetDescriptorBufferOffsetsEXT, "vkCmdSetDescriptorBufferOffsetsEXT");
+
+	VkPhysicalDeviceProperties2 deviceProperties2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+	deviceProperties2.pNext = &m_properties;
+	vkGetPhysicalDeviceProperties2(device->physicalDevice, &deviceProperties2);
+
+	// Every region starts at a valid set offset
+	const VkDeviceSize alignment = m_properties.descriptorBufferOffsetAlignment;
+	m_regionSize = (regionSize + alignment - 1) / alignment * alignment;
+	m_regionUsed.assign(regionCount, 0);
+	m_regionSetCounts.assign(regionCount, 0);
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &m_buffer, m_regionSize * regionCount));
+	// Stays mapped, descriptors are written to it while command buffers are recorded
+	VK_CHECK_RESULT(m_buffer.map());
+
+	VkBufferDeviceAddressInfo addressInfo{ VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO };
+	addressInfo.buffer = m_buffer.buffer;
+	m_bufferAddress = vkGetBufferDeviceAddress(m_device, &addressInfo);
+}
+
+void DescriptorBuffer::destroy()
+{
+	m_buffer.destroy();
+	m_bufferAddress = 0;
+	m_regionUsed.clear();
+	m_regionSetCounts.clear();
+}
+
+DescriptorBuffer::SetLayout DescriptorBuffer::getSetLayout(VkDescriptorSetLayout setLayout, uint32_t bindingCount) const
+{
+	SetLayout layout;
+	layout.setLayout = setLayout;
+	m_vkGetDescriptorSetLayoutSizeEXT(m_device, setLayout, &layout.size);
+	const VkDeviceSize alignment = m_properties.descriptorBufferOffsetAlignment;
+	layout.size = (layout.size + alignment - 1) / alignment * alignment;
+	layout.bindingOffsets.resize(bindingCount);
+	for (uint32_t binding = 0; binding < bindingCount; binding++)
+	{
+		m_vkGetDescriptorSetLayoutBindingOffsetEXT(m_device, setLayout, binding, &layout.bindingOffsets[binding]);
+	}
+	return layout;
+}
+
+VkDeviceSize DescriptorBuffer::allocate(uint32_t region, const SetLayout& setLayout)
+{
+	if (m_regionUsed[region] + setLayout.size > m_regionSize)
+	{
+		throw std::runtime_error("Region " + std::to_string(region) + " of the descriptor buffer is full (" + std::to_string(m_regionSize) + " bytes)");
+	}
+	const VkDeviceSize setOffset = region * m_regionSize + m_regionUsed[region];
+	m_regionUsed[region] += setLayout.size;
+	m_regionSetCounts[region]++;
+	return setOffset;
+}
+
+void DescriptorBuffer::reset(uint32_t region)
+{
+	m_regionUsed[region] = 0;
+	m_regionSetCounts[region] = 0;
+}
+
+void DescriptorBuffer::writeImage(VkDeviceSize setOffset, const SetLayout& setLayout, uint32_t binding, VkDescriptorType descriptorType, const VkDescriptorImageInfo& imageInfo)
+{
+	VkDescriptorGetInfoEXT getInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT };
+	getInfo.type = descriptorType;
+	switch (descriptorType)
+	{
+	case VK_DESCRIPTOR_TYPE_SAMPLER:
+		getInfo.data.pSampler = &imageInfo.sampler;
+		break;
+	case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+		getInfo.data.pCombinedImageSampler = &imageInfo;
+		break;
+	case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+		getInfo.data.pStorageImage = &imageInfo;
+		break;
+	default:
+		getInfo.data.pSampledImage = &imageInfo;
+		break;
+	}
+	uint8_t* destination = static_cast<uint8_t*>(m_buffer.mapped) + setOffset + setLayout.bindingOffsets[binding];
+	m_vkGetDescriptorEXT(m_device, &getInfo, getDescriptorSize(descriptorType), destination);
+}
+
+void DescriptorBuffer::writeBuffer(VkDeviceSize setOffset, const SetLayout& setLayout, uint32_t binding, VkDescriptorType descriptorType, VkDeviceAddress address, VkDeviceSize range)
+{
+	VkDescriptorAddressInfoEXT addressInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT };
+	addressInfo.address = address;
+	addressInfo.range = range;
+	VkDescriptorGetInfoEXT getInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT };
+	getInfo.type = descriptorType;
+	if (descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+	{
+		getInfo.data.pUniformBuffer = &addressInfo;
+	}
+	else
+	{
+		getInfo.data.pStorageBuffer = &addressInfo;
+	}
+	uint8_t* destination = static_cast<uint8_t*>(m_buffer.mapped) + setOffset + setLayout.bindingOffsets[binding];
+	m_vkGetDescriptorEXT(m_device, &getInfo, getDescriptorSize(descriptorType), destination);
+}
+
+void DescriptorBuffer::bind(VkCommandBuffer commandBuffer) const
+{
+	VkDescriptorBufferBindingInfoEXT bindingInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT };
+	bindingInfo.address = m_bufferAddress;
+	bindingInfo.usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT;
+	m_vkCmdBindDescriptorBuffersEXT(commandBuffer, 1, &bindingInfo);
+}
+
+void DescriptorBuffer::bindSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t firstSet, uint32_t setCount, const VkDeviceSize* setOffsets) const
+{
+	// All sets are in the one bound buffer (index 0)
+	constexpr uint32_t maxSetCount = 8;
+	const uint32_t bufferIndices[maxSetCount]{};
+	assert(setCount <= maxSetCount);
+	m_vkCmdSetDescriptorBufferOffsetsEXT(commandBuffer, bindPoint, layout, firstSet, setCount, bufferIndices, setOffsets);
+}
+
+size_t DescriptorBuffer::getDescriptorSize(VkDescriptorType descriptorType) const
+{
+	switch (descriptorType)
+	{
+	case VK_DESCRIPTOR_TYPE_SAMPLER:
+		return m_properties.samplerDescriptorSize;
+	case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+		return m_properties.combinedImageSamplerDescriptorSize;
+	case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+		return m_properties.sampledImageDescriptorSize;
+	case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+		return m_properties.storageImageDescriptorSize;
+	case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+		return m_properties.uniformBufferDescriptorSize;
+	default:
+		return m_properties.storageBufferDescriptorSize;
+	}
+}
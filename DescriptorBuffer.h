@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "vulkan/vulkan.h"
+
+#include "VulkanBase/VulkanBuffer.h"
+
+namespace vks
+{
+    struct VulkanDevice;
+}
+
+
+// Descriptors written straight into a host visible buffer (VK_EXT_descriptor_buffer) instead of descriptor sets allocated from pools
+// A "set" is a range of the buffer laid out as its set layout says (vkGetDescriptorSetLayoutSizeEXT / vkGetDescriptorSetLayoutBindingOffsetEXT),
+// each descriptor is fetched with vkGetDescriptorEXT and copied to its binding offset, and binding the set only records its offset in the buffer
+// The buffer is split into regions (one per frame in flight) that are suballocated linearly and reset as a whole, like DescriptorAllocator
+// Set layouts have to be created with VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT and the pipelines using them with
+// VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT, such a pipeline can't use descriptor sets at all
+class DescriptorBuffer
+{
+public:
+    // Size and binding offsets of a set layout inside the buffer, queried once per layout
+    struct SetLayout {
+        VkDescriptorSetLayout setLayout{ VK_NULL_HANDLE };
+        VkDeviceSize size{ 0 };                     // Rounded up to the set offset alignment
+        std::vector<VkDeviceSize> bindingOffsets;   // Indexed by binding number
+    };
+
+    // Enables the extension and its dependencies (buffer device address through vulkan12Features, the caller chains it into the device create info)
+    // False if the device doesn't support it, called before the device is created
+    bool enableFeatures(vks::VulkanDevice* device, uint32_t apiVersion, std::vector<const char*>& extensions, VkPhysicalDeviceVulkan12Features& vulkan12Features, void*& pNextChain);
+
+    // Loads the commands and creates the buffer with regionCount regions of regionSize bytes, only valid on a device the extension is enabled on
+    void create(vks::VulkanDevice* device, VkDeviceSize regionSize, uint32_t regionCount);
+    void destroy();
+
+    // setLayout has to be created with VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT, bindingCount is its highest binding number + 1
+    SetLayout getSetLayout(VkDescriptorSetLayout setLayout, uint32_t bindingCount) const;
+
+    // Reserves a set in region and returns its offset in the buffer, throws if the region is full
+    VkDeviceSize allocate(uint32_t region, const SetLayout& setLayout);
+    // Releases all sets of region, none of them may still be used by a pending command buffer
+    void reset(uint32_t region);
+
+    // Write the descriptor of binding of the set at setOffset, straight to the mapped buffer
+    void writeImage(VkDeviceSize setOffset, const SetLayout& setLayout, uint32_t binding, VkDescriptorType descriptorType, const VkDescriptorImageInfo& imageInfo);
+    void writeBuffer(VkDeviceSize setOffset, const SetLayout& setLayout, uint32_t binding, VkDescriptorType descriptorType, VkDeviceAddress address, VkDeviceSize range);
+
+    // Binds the buffer, once per command buffer before any set offsets are set
+    void bind(VkCommandBuffer commandBuffer) const;
+    // Points sets firstSet to firstSet + setCount - 1 of layout at the sets at setOffsets
+    void bindSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t firstSet, uint32_t setCount, const VkDeviceSize* setOffsets) const;
+
+    // Bytes of region in use and sets allocated from it since its last reset
+    VkDeviceSize getUsedSize(uint32_t region) const { return m_regionUsed[region]; }
+    uint32_t getSetCount(uint32_t region) const { return m_regionSetCounts[region]; }
+
+private:
+    size_t getDescriptorSize(VkDescriptorType descriptorType) const;
+
+    VkDevice m_device{ VK_NULL_HANDLE };
+    vks::Buffer m_buffer;
+    VkDeviceAddress m_bufferAddress{ 0 };
+    VkDeviceSize m_regionSize{ 0 };
+    std::vector<VkDeviceSize> m_regionUsed;
+    std::vector<uint32_t> m_regionSetCounts;
+
+    VkPhysicalDeviceDescriptorBufferFeaturesEXT m_enabledDescriptorBufferFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT };
+    VkPhysicalDeviceDescriptorBufferPropertiesEXT m_properties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT };
+
+    PFN_vkGetDescriptorSetLayoutSizeEXT m_vkGetDescriptorSetLayoutSizeEXT{ nullptr };
+    PFN_vkGetDescriptorSetLayoutBindingOffsetEXT m_vkGetDescriptorSetLayoutBindingOffsetEXT{ nullptr };
+    PFN_vkGetDescriptorEXT m_vkGetDescriptorEXT{ nullptr };
+    PFN_vkCmdBindDescriptorBuffersEXT m_vkCmdBindDescriptorBuffersEXT{ nullptr };
+    PFN_vkCmdSetDescriptorBufferOffsetsEXT m_vkCmdSetDescriptorBufferOffsetsEXT{ nullptr };
+};
@@ -0,0 +1,22 @@
+#include "EmbeddedShaders.h"
+
+// Without the generated file nothing is embedded and the shaders are read from disk
+#if __has_include("EmbeddedShaders.generated.h")
+#include "EmbeddedShaders.generated.h"
+#define EMBEDDED_SHADERS
+#endif
+
+
+std::span<const uint32_t> findEmbeddedShader([[maybe_unused]] std::string_view name)
+{
+#ifdef EMBEDDED_SHADERS
+	for (const EmbeddedShader& shader : embeddedShaders)
+	{
+		if (shader.name == name)
+		{
+			return shader.code;
+		}
+	}
+#endif
+	return {};
+}
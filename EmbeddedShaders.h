@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+
+// SPIR-V of the shaders compiled into the executable, so the renderer doesn't read the shaders from the working directory at startup
+// shadercompile.bat writes the code to EmbeddedShaders.generated.h (with shaderembed.ps1) after compiling the shaders, as 16 byte aligned
+// constexpr uint32_t arrays and a table of them by file name
+struct EmbeddedShader {
+    std::string_view name;              // File name of the SPIR-V, e.g. "triangle.vert.spv"
+    std::span<const uint32_t> code;
+};
+
+// The embedded code of a SPIR-V file, empty if it isn't embedded (or the executable was built before EmbeddedShaders.generated.h existed)
+std::span<const uint32_t> findEmbeddedShader(std::string_view name);
@@ -0,0 +1,423 @@
+#include "FrustumCulling.h"
+#include "JobSystem.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define FRUSTUM_CULLING_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC allows AVX2 intrinsics in any function, GCC and Clang need the target enabled per function
+#if defined(FRUSTUM_CULLING_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+
+Frustum Frustum::fromMatrix(const glm::mat4& viewProjection)
+{
+	// Gribb/Hartmann plane extraction, glm matrices are column major so matrix[column][row]
+	const glm::mat4& m = viewProjection;
+	const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	Frustum frustum;
+	frustum.planes[0] = row3 + row0;
+	frustum.planes[1] = row3 - row0;
+	frustum.planes[2] = row3 + row1;
+	frustum.planes[3] = row3 - row1;
+	frustum.planes[4] = row3 + row2;
+	frustum.planes[5] = row3 - row2;
+
+	// Normalize, so the plane distances can be compared against radii
+	for (glm::vec4& plane : frustum.planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+
+namespace
+{
+	// Objects per job of the parallel cull, a multiple of the SIMD widths
+	constexpr uint32_t CULL_BATCH_SIZE = 16384;
+
+	// Read-only view of the culler's arrays, shared by the per instruction set kernels
+	// radius is either the sphere radius or null for AABB tests
+	struct BoundsView {
+		const float* centerX;
+		const float* centerY;
+		const float* centerZ;
+		const float* extentX;
+		const float* extentY;
+		const float* extentZ;
+		const float* radius;
+	};
+
+	// Each kernel tests the objects [begin, end) and appends the visible indices to out, returning the number written
+	uint32_t cullScalar(const BoundsView& bounds, uint32_t begin, uint32_t end, const Frustum& frustum, uint32_t* out)
+	{
+		uint32_t count = 0;
+		for (uint32_t i = begin; i < end; i++)
+		{
+			bool visible = true;
+			for (const glm::vec4& plane : frustum.planes)
+			{
+				const float distance = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] + plane.z * bounds.centerZ[i] + plane.w;
+				// Projected radius of the box onto the plane normal (or the sphere radius)
+				const float radius = bounds.radius ? bounds.radius[i] : std::abs(plane.x) * bounds.extentX[i] + std::abs(plane.y) * bounds.extentY[i] + std::abs(plane.z) * bounds.extentZ[i];
+				visible &= (distance >= -radius);
+			}
+			out[count] = i;
+			count += visible ? 1 : 0;
+		}
+		return count;
+	}
+
+#if defined(FRUSTUM_CULLING_X86)
+	// 4 objects per iteration
+	uint32_t cullSSE(const BoundsView& bounds, uint32_t begin, uint32_t end, const Frustum& frustum, uint32_t* out)
+	{
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+		for (uint32_t p = 0; p < 6; p++)
+		{
+			planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+			planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+			planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+			planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+			absX[p] = _mm_set1_ps(std::abs(frustum.planes[p].x));
+			absY[p] = _mm_set1_ps(std::abs(frustum.planes[p].y));
+			absZ[p] = _mm_set1_ps(std::abs(frustum.planes[p].z));
+		}
+		const __m128 zero = _mm_setzero_ps();
+
+		uint32_t count = 0;
+		uint32_t i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			const __m128 cx = _mm_loadu_ps(bounds.centerX + i);
+			const __m128 cy = _mm_loadu_ps(bounds.centerY + i);
+			const __m128 cz = _mm_loadu_ps(bounds.centerZ + i);
+			__m128 ex = zero, ey = zero, ez = zero, radius = zero;
+			if (bounds.radius)
+			{
+				radius = _mm_loadu_ps(bounds.radius + i);
+			}
+			else
+			{
+				ex = _mm_loadu_ps(bounds.extentX + i);
+				ey = _mm_loadu_ps(bounds.extentY + i);
+				ez = _mm_loadu_ps(bounds.extentZ + i);
+			}
+
+			__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (uint32_t p = 0; p < 6; p++)
+			{
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)), _mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeW[p]));
+				if (!bounds.radius)
+				{
+					radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)), _mm_mul_ps(absZ[p], ez));
+				}
+				// distance + radius >= 0
+				visible = _mm_and_ps(visible, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+			}
+
+			uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(visible));
+			while (mask)
+			{
+				out[count++] = i + std::countr_zero(mask);
+				mask &= mask - 1;
+			}
+		}
+		// Remainder
+		return count + cullScalar(bounds, i, end, frustum, out + count);
+	}
+
+	// 8 objects per iteration
+	TARGET_AVX2 uint32_t cullAVX2(const BoundsView& bounds, uint32_t begin, uint32_t end, const Frustum& frustum, uint32_t* out)
+	{
+		__m256 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+		for (uint32_t p = 0; p < 6; p++)
+		{
+			planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+			planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+			planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+			planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+			absX[p] = _mm256_set1_ps(std::abs(frustum.planes[p].x));
+			absY[p] = _mm256_set1_ps(std::abs(frustum.planes[p].y));
+			absZ[p] = _mm256_set1_ps(std::abs(frustum.planes[p].z));
+		}
+		const __m256 zero = _mm256_setzero_ps();
+
+		uint32_t count = 0;
+		uint32_t i = begin;
+		for (; i + 8 <= end; i += 8)
+		{
+			const __m256 cx = _mm256_loadu_ps(bounds.centerX + i);
+			const __m256 cy = _mm256_loadu_ps(bounds.centerY + i);
+			const __m256 cz = _mm256_loadu_ps(bounds.centerZ + i);
+			__m256 ex = zero, ey = zero, ez = zero, radius = zero;
+			if (bounds.radius)
+			{
+				radius = _mm256_loadu_ps(bounds.radius + i);
+			}
+			else
+			{
+				ex = _mm256_loadu_ps(bounds.extentX + i);
+				ey = _mm256_loadu_ps(bounds.extentY + i);
+				ez = _mm256_loadu_ps(bounds.extentZ + i);
+			}
+
+			__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (uint32_t p = 0; p < 6; p++)
+			{
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], cx), _mm256_mul_ps(planeY[p], cy)), _mm256_add_ps(_mm256_mul_ps(planeZ[p], cz), planeW[p]));
+				if (!bounds.radius)
+				{
+					radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absX[p], ex), _mm256_mul_ps(absY[p], ey)), _mm256_mul_ps(absZ[p], ez));
+				}
+				visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_GE_OQ));
+			}
+
+			uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(visible));
+			while (mask)
+			{
+				out[count++] = i + std::countr_zero(mask);
+				mask &= mask - 1;
+			}
+		}
+		return count + cullScalar(bounds, i, end, frustum, out + count);
+	}
+#endif
+}
+
+
+FrustumCuller::FrustumCuller()
+	: m_instructionSet(getSupportedInstructionSet())
+{
+}
+
+void FrustumCuller::clear()
+{
+	m_centerX.clear();
+	m_centerY.clear();
+	m_centerZ.clear();
+	m_extentX.clear();
+	m_extentY.clear();
+	m_extentZ.clear();
+	m_radius.clear();
+}
+
+void FrustumCuller::reserve(uint32_t count)
+{
+	m_centerX.reserve(count);
+	m_centerY.reserve(count);
+	m_centerZ.reserve(count);
+	m_extentX.reserve(count);
+	m_extentY.reserve(count);
+	m_extentZ.reserve(count);
+	m_radius.reserve(count);
+}
+
+uint32_t FrustumCuller::add(const glm::vec3& aabbMin, const glm::vec3& aabbMax)
+{
+	const uint32_t index = size();
+	m_centerX.push_back(0.0f);
+	m_centerY.push_back(0.0f);
+	m_centerZ.push_back(0.0f);
+	m_extentX.push_back(0.0f);
+	m_extentY.push_back(0.0f);
+	m_extentZ.push_back(0.0f);
+	m_radius.push_back(0.0f);
+	setBounds(index, aabbMin, aabbMax);
+	return index;
+}
+
+void FrustumCuller::setBounds(uint32_t index, const glm::vec3& aabbMin, const glm::vec3& aabbMax)
+{
+	const glm::vec3 center = 0.5f * (aabbMin + aabbMax);
+	const glm::vec3 extent = 0.5f * (aabbMax - aabbMin);
+	m_centerX[index] = center.x;
+	m_centerY[index] = center.y;
+	m_centerZ[index] = center.z;
+	m_extentX[index] = extent.x;
+	m_extentY[index] = extent.y;
+	m_extentZ[index] = extent.z;
+	m_radius[index] = glm::length(extent);
+}
+
+uint32_t FrustumCuller::cull(const Frustum& frustum, std::vector<uint32_t>& visible, BoundingVolume volume, JobSystem* jobSystem) const
+{
+	const uint32_t objectCount = size();
+	if (visible.size() < objectCount)
+	{
+		visible.resize(objectCount);
+	}
+	if (jobSystem == nullptr || objectCount <= CULL_BATCH_SIZE)
+	{
+		return cullRange(frustum, 0, objectCount, visible.data(), volume);
+	}
+
+	// Every batch writes its visible objects to the start of its own range of visible, the ranges are then moved together
+	const uint32_t batchCount = (objectCount + CULL_BATCH_SIZE - 1) / CULL_BATCH_SIZE;
+	std::vector<uint32_t> batchVisibleCounts(batchCount);
+	jobSystem->parallelFor(batchCount, 1, [&](uint32_t firstBatch, uint32_t lastBatch) {
+		for (uint32_t batch = firstBatch; batch < lastBatch; batch++)
+		{
+			const uint32_t first = batch * CULL_BATCH_SIZE;
+			batchVisibleCounts[batch] = cullRange(frustum, first, std::min(objectCount, first + CULL_BATCH_SIZE), visible.data() + first, volume);
+		}
+	});
+	uint32_t visibleCount = batchVisibleCounts[0];
+	for (uint32_t batch = 1; batch < batchCount; batch++)
+	{
+		const uint32_t* batchVisible = visible.data() + batch * CULL_BATCH_SIZE;
+		std::copy(batchVisible, batchVisible + batchVisibleCounts[batch], visible.data() + visibleCount);
+		visibleCount += batchVisibleCounts[batch];
+	}
+	return visibleCount;
+}
+
+uint32_t FrustumCuller::cullRange(const Frustum& frustum, uint32_t first, uint32_t last, uint32_t* out, BoundingVolume volume) const
+{
+	const BoundsView bounds{
+		.centerX = m_centerX.data(),
+		.centerY = m_centerY.data(),
+		.centerZ = m_centerZ.data(),
+		.extentX = m_extentX.data(),
+		.extentY = m_extentY.data(),
+		.extentZ = m_extentZ.data(),
+		.radius = (volume == BoundingVolume::Sphere) ? m_radius.data() : nullptr
+	};
+
+	switch (m_instructionSet)
+	{
+#if defined(FRUSTUM_CULLING_X86)
+	case InstructionSet::AVX2:
+		return cullAVX2(bounds, first, last, frustum, out);
+	case InstructionSet::SSE:
+		return cullSSE(bounds, first, last, frustum, out);
+#endif
+	default:
+		return cullScalar(bounds, first, last, frustum, out);
+	}
+}
+
+void FrustumCuller::setInstructionSet(InstructionSet instructionSet)
+{
+	m_instructionSet = std::min(instructionSet, getSupportedInstructionSet());
+}
+
+FrustumCuller::InstructionSet FrustumCuller::getSupportedInstructionSet()
+{
+#if defined(FRUSTUM_CULLING_X86)
+#if defined(_MSC_VER)
+	// AVX2 needs the CPU flag (leaf 7) and the OS saving the YMM registers (OSXSAVE + XCR0)
+	int cpuInfo[4];
+	__cpuid(cpuInfo, 1);
+	const bool osxsave = (cpuInfo[2] & (1 << 27)) != 0;
+	const bool avx = (cpuInfo[2] & (1 << 28)) != 0;
+	const bool sse2 = (cpuInfo[3] & (1 << 26)) != 0;
+	__cpuidex(cpuInfo, 7, 0);
+	const bool avx2 = (cpuInfo[1] & (1 << 5)) != 0;
+	if (osxsave && avx && avx2 && ((_xgetbv(0) & 0x6) == 0x6))
+	{
+		return InstructionSet::AVX2;
+	}
+	return sse2 ? InstructionSet::SSE : InstructionSet::Scalar;
+#else
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return InstructionSet::AVX2;
+	}
+	return __builtin_cpu_supports("sse2") ? InstructionSet::SSE : InstructionSet::Scalar;
+#endif
+#else
+	return InstructionSet::Scalar;
+#endif
+}
+
+const char* FrustumCuller::instructionSetName(InstructionSet instructionSet)
+{
+	switch (instructionSet)
+	{
+	case InstructionSet::AVX2:
+		return "AVX2";
+	case InstructionSet::SSE:
+		return "SSE";
+	default:
+		return "Scalar";
+	}
+}
+
+void FrustumCuller::runBenchmark(uint32_t objectCount)
+{
+	// Random boxes scattered around the camera, roughly a sixth of them end up inside the frustum
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> size(0.5f, 2.0f);
+
+	FrustumCuller culler;
+	culler.reserve(objectCount);
+	for (uint32_t i = 0; i < objectCount; i++)
+	{
+		const glm::vec3 center(position(random), position(random), position(random));
+		const glm::vec3 extent(size(random), size(random), size(random));
+		culler.add(center - extent, center + extent);
+	}
+
+	const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+	const glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	const Frustum frustum = Frustum::fromMatrix(projection * view);
+
+	constexpr uint32_t iterations = 20;
+	std::vector<uint32_t> visible;
+
+	std::cout << "Frustum culling benchmark, " << objectCount << " objects\n";
+	for (BoundingVolume volume : { BoundingVolume::Sphere, BoundingVolume::AABB })
+	{
+		uint32_t referenceCount = 0;
+		for (InstructionSet instructionSet : { InstructionSet::Scalar, InstructionSet::SSE, InstructionSet::AVX2 })
+		{
+			if (instructionSet > getSupportedInstructionSet())
+			{
+				continue;
+			}
+			culler.setInstructionSet(instructionSet);
+
+			// Report the best run, the first one also warms up the caches
+			double bestMs = 1e30;
+			uint32_t visibleCount = 0;
+			for (uint32_t i = 0; i < iterations; i++)
+			{
+				auto tStart = std::chrono::high_resolution_clock::now();
+				visibleCount = culler.cull(frustum, visible, volume);
+				auto tEnd = std::chrono::high_resolution_clock::now();
+				bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+			}
+			if (instructionSet == InstructionSet::Scalar)
+			{
+				referenceCount = visibleCount;
+			}
+
+			std::cout << " " << ((volume == BoundingVolume::Sphere) ? "Sphere" : "AABB  ") << " " << instructionSetName(instructionSet) << ": "
+				<< bestMs << " ms, " << (objectCount / bestMs) / 1000.0 << " Mobjects/s, " << visibleCount << " visible"
+				<< ((visibleCount != referenceCount) ? " (MISMATCH with scalar result!)" : "") << "\n";
+		}
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+class JobSystem;
+
+
+// View frustum as six planes, xyz is the plane normal pointing into the frustum and w the distance
+// A point p is inside if dot(plane.xyz, p) + plane.w >= 0 holds for every plane
+struct Frustum {
+    glm::vec4 planes[6];    // left, right, bottom, top, near, far
+
+    // Extracts the planes from a combined (projection * view) matrix
+    static Frustum fromMatrix(const glm::mat4& viewProjection);
+};
+
+
+// CPU frustum culling for large numbers of objects
+// The bounding volumes are stored as structure of arrays (one array per component) so that the SIMD paths can load
+// the same component of 4 (SSE) or 8 (AVX2) consecutive objects with a single instruction and test all of them against a plane at once
+// The visible objects are written as a compact, ascending list of object indices
+class FrustumCuller
+{
+public:
+    enum class InstructionSet { Scalar, SSE, AVX2 };
+    enum class BoundingVolume { Sphere, AABB };
+
+    FrustumCuller();
+
+    void clear();
+    void reserve(uint32_t count);
+    uint32_t size() const { return static_cast<uint32_t>(m_centerX.size()); }
+
+    // Adds an object with a world space AABB and returns its index, the bounding sphere is derived from the AABB
+    uint32_t add(const glm::vec3& aabbMin, const glm::vec3& aabbMax);
+    void setBounds(uint32_t index, const glm::vec3& aabbMin, const glm::vec3& aabbMax);
+
+    // Tests all objects against the frustum, visible is resized as needed and holds the visible object indices in its first (returned) count entries
+    // With a job system the objects are culled in batches on all workers, the result is the same ascending list
+    uint32_t cull(const Frustum& frustum, std::vector<uint32_t>& visible, BoundingVolume volume = BoundingVolume::AABB, JobSystem* jobSystem = nullptr) const;
+
+    // Defaults to the widest instruction set supported by the CPU, requests for unsupported sets are clamped
+    void setInstructionSet(InstructionSet instructionSet);
+    InstructionSet getInstructionSet() const { return m_instructionSet; }
+    static InstructionSet getSupportedInstructionSet();
+    static const char* instructionSetName(InstructionSet instructionSet);
+
+    // Culls objectCount random objects with every supported instruction set and bounding volume and logs the timings
+    static void runBenchmark(uint32_t objectCount = 1000000);
+
+private:
+    // Culls the objects [first, last) and writes the visible ones to out, returns their number
+    uint32_t cullRange(const Frustum& frustum, uint32_t first, uint32_t last, uint32_t* out, BoundingVolume volume) const;
+
+    // Center is shared by the AABB and the sphere
+    std::vector<float> m_centerX;
+    std::vector<float> m_centerY;
+    std::vector<float> m_centerZ;
+    // AABB half extents
+    std::vector<float> m_extentX;
+    std::vector<float> m_extentY;
+    std::vector<float> m_extentZ;
+    std::vector<float> m_radius;
+
+    InstructionSet m_instructionSet;
+};
@@ -0,0 +1,111 @@
+#include "HiZReference.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+
+HiZReference::HiZReference(const std::vector<float>& depth, uint32_t width, uint32_t height)
+	: m_width(width), m_height(height)
+{
+	// Same level count as VulkanRender::createHiZ
+	const uint32_t mipCount = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+	m_levels.resize(mipCount);
+	m_levels[0] = { width, height, depth };
+	for (uint32_t level = 1; level < mipCount; level++)
+	{
+		const Level& source = m_levels[level - 1];
+		Level& destination = m_levels[level];
+		destination.width = std::max(width >> level, 1u);
+		destination.height = std::max(height >> level, 1u);
+		destination.maxDepth.resize(static_cast<size_t>(destination.width) * destination.height);
+		for (uint32_t y = 0; y < destination.height; y++)
+		{
+			for (uint32_t x = 0; x < destination.width; x++)
+			{
+				const uint32_t footprintX = ((source.width & 1) != 0 && x == destination.width - 1) ? 3 : 2;
+				const uint32_t footprintY = ((source.height & 1) != 0 && y == destination.height - 1) ? 3 : 2;
+				float maxDepth = 0.0f;
+				for (uint32_t sy = 0; sy < footprintY; sy++)
+				{
+					for (uint32_t sx = 0; sx < footprintX; sx++)
+					{
+						const uint32_t sourceX = std::min(x * 2 + sx, source.width - 1);
+						const uint32_t sourceY = std::min(y * 2 + sy, source.height - 1);
+						maxDepth = std::max(maxDepth, source.maxDepth[static_cast<size_t>(sourceY) * source.width + sourceX]);
+					}
+				}
+				destination.maxDepth[static_cast<size_t>(y) * destination.width + x] = maxDepth;
+			}
+		}
+	}
+}
+
+float HiZReference::lookupMaxDepth(float uvMinX, float uvMinY, float uvMaxX, float uvMaxY) const
+{
+	const float sizeX = (uvMaxX - uvMinX) * m_width;
+	const float sizeY = (uvMaxY - uvMinY) * m_height;
+	const uint32_t level = std::min(static_cast<uint32_t>(std::ceil(std::log2(std::max(std::max(sizeX, sizeY), 1.0f)))), getMipCount() - 1);
+	const Level& hiZLevel = m_levels[level];
+	auto texel = [&](float uv, uint32_t size, uint32_t levelSize) {
+		const uint32_t pixel = std::min(static_cast<uint32_t>(uv * size), size - 1);
+		return std::min(pixel >> level, levelSize - 1);
+	};
+	const uint32_t texelMinX = texel(uvMinX, m_width, hiZLevel.width);
+	const uint32_t texelMinY = texel(uvMinY, m_height, hiZLevel.height);
+	const uint32_t texelMaxX = texel(uvMaxX, m_width, hiZLevel.width);
+	const uint32_t texelMaxY = texel(uvMaxY, m_height, hiZLevel.height);
+	auto load = [&](uint32_t x, uint32_t y) { return hiZLevel.maxDepth[static_cast<size_t>(y) * hiZLevel.width + x]; };
+	return std::max(std::max(load(texelMinX, texelMinY), load(texelMaxX, texelMinY)), std::max(load(texelMinX, texelMaxY), load(texelMaxX, texelMaxY)));
+}
+
+void HiZReference::runCheck(uint32_t rectangleCount)
+{
+	const uint32_t sizes[][2] = { { 1280, 720 }, { 1283, 719 }, { 1920, 1080 }, { 1024, 1024 }, { 333, 77 }, { 7, 5 }, { 1, 9 } };
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	uint32_t failures = 0;
+	for (const auto& size : sizes)
+	{
+		const uint32_t width = size[0];
+		const uint32_t height = size[1];
+		std::vector<float> depth(static_cast<size_t>(width) * height);
+		for (float& value : depth)
+		{
+			value = unit(random);
+		}
+		const HiZReference hiZ(depth, width, height);
+
+		// Rectangles of all sizes, the smaller ones more often, like the bounds of distant objects
+		for (uint32_t i = 0; i < rectangleCount; i++)
+		{
+			const float extentX = std::pow(unit(random), 4.0f);
+			const float extentY = std::pow(unit(random), 4.0f);
+			const float uvMinX = unit(random) * (1.0f - extentX);
+			const float uvMinY = unit(random) * (1.0f - extentY);
+			const float uvMaxX = uvMinX + extentX;
+			const float uvMaxY = uvMinY + extentY;
+
+			const uint32_t pixelMinX = std::min(static_cast<uint32_t>(uvMinX * width), width - 1);
+			const uint32_t pixelMinY = std::min(static_cast<uint32_t>(uvMinY * height), height - 1);
+			const uint32_t pixelMaxX = std::min(static_cast<uint32_t>(uvMaxX * width), width - 1);
+			const uint32_t pixelMaxY = std::min(static_cast<uint32_t>(uvMaxY * height), height - 1);
+			float maxDepth = 0.0f;
+			for (uint32_t y = pixelMinY; y <= pixelMaxY; y++)
+			{
+				for (uint32_t x = pixelMinX; x <= pixelMaxX; x++)
+				{
+					maxDepth = std::max(maxDepth, depth[static_cast<size_t>(y) * width + x]);
+				}
+			}
+			if (hiZ.lookupMaxDepth(uvMinX, uvMinY, uvMaxX, uvMaxY) < maxDepth)
+			{
+				failures++;
+			}
+		}
+	}
+
+	std::cout << "Hi-Z check, " << rectangleCount << " rectangles on each of " << std::size(sizes) << " depth buffer sizes: " << failures << " rectangles not covered"
+		<< ((failures == 0) ? "" : " (MISMATCH!)") << "\n";
+}
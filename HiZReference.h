@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+
+// CPU version of the Hi-Z pyramid build (hiz.slang) and of the texel lookup of the occlusion test (isOccluded in cull.slang)
+// Used to check that the texels the test reads cover every pixel of the tested rectangle, also for sizes that are not a power of two
+class HiZReference
+{
+public:
+    // Builds the max depth of every level from a width * height depth buffer, levels get max(size >> level, 1) texels
+    // like the GPU pyramid, with an odd size the last column / row of the next level also covers the texel that would be dropped
+    HiZReference(const std::vector<float>& depth, uint32_t width, uint32_t height);
+
+    uint32_t getMipCount() const { return static_cast<uint32_t>(m_levels.size()); }
+
+    // Max depth of the texels isOccluded reads for the rectangle [uvMin, uvMax] of the screen
+    float lookupMaxDepth(float uvMinX, float uvMinY, float uvMaxX, float uvMaxY) const;
+
+    // Builds pyramids of random depth buffers in several sizes (most of them not a power of two), looks up random rectangles and logs whether
+    // the lookup always returns at least the max depth of the pixels inside the rectangle
+    static void runCheck(uint32_t rectangleCount = 10000);
+
+private:
+    struct Level {
+        uint32_t width;
+        uint32_t height;
+        std::vector<float> maxDepth;
+    };
+
+    uint32_t m_width;
+    uint32_t m_height;
+    std::vector<Level> m_levels;
+};
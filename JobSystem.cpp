@@ -0,0 +1,359 @@
+#include "JobSystem.h"
+#include "MatrixKernels.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+
+namespace
+{
+	// Worker index of the calling thread, only valid for the job system that started the thread
+	thread_local const JobSystem* t_jobSystem = nullptr;
+	thread_local uint32_t t_workerIndex = 0;
+	// Victim selection for stealing
+	thread_local uint32_t t_random = 0x9E3779B9u;
+
+	uint32_t nextRandom()
+	{
+		// xorshift32
+		t_random ^= t_random << 13;
+		t_random ^= t_random >> 17;
+		t_random ^= t_random << 5;
+		return t_random;
+	}
+}
+
+
+JobSystem::JobSystem(uint32_t workerCount)
+{
+	if (workerCount == 0)
+	{
+		workerCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	m_queues.reserve(workerCount);
+	for (uint32_t i = 0; i < workerCount; i++)
+	{
+		m_queues.push_back(std::make_unique<WorkerQueue>());
+	}
+	// Worker 0 is the creating thread (and any other thread that isn't a worker)
+	m_threads.reserve(workerCount - 1);
+	for (uint32_t i = 1; i < workerCount; i++)
+	{
+		m_threads.emplace_back(&JobSystem::workerLoop, this, i);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	m_stop.store(true);
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+	}
+	m_sleepCondition.notify_all();
+	for (std::thread& thread : m_threads)
+	{
+		thread.join();
+	}
+}
+
+uint32_t JobSystem::currentWorker() const
+{
+	// Threads that aren't workers of this job system share the deque of worker 0
+	return (t_jobSystem == this) ? t_workerIndex : 0;
+}
+
+void JobSystem::workerLoop(uint32_t workerIndex)
+{
+	t_jobSystem = this;
+	t_workerIndex = workerIndex;
+	t_random ^= workerIndex * 0x85EBCA6Bu;
+
+	while (!m_stop.load())
+	{
+		if (runOneJob(workerIndex))
+		{
+			continue;
+		}
+
+		// Spin for a moment before going to sleep, the next jobs of a frame usually follow shortly
+		bool jobQueued = false;
+		for (uint32_t spin = 0; spin < 64 && !jobQueued; spin++)
+		{
+			std::this_thread::yield();
+			jobQueued = m_queuedJobCount.load() > 0;
+		}
+		if (jobQueued)
+		{
+			continue;
+		}
+
+		// push() checks m_sleepingWorkers after incrementing m_queuedJobCount, so either it wakes this worker or the predicate sees the job
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_sleepingWorkers++;
+		m_sleepCondition.wait(lock, [this] { return m_queuedJobCount.load() > 0 || m_stop.load(); });
+		m_sleepingWorkers--;
+	}
+}
+
+void JobSystem::push(uint32_t workerIndex, QueuedJob job)
+{
+	WorkerQueue& queue = *m_queues[workerIndex];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(std::move(job));
+	}
+	m_queuedJobCount++;
+	if (m_sleepingWorkers.load() > 0)
+	{
+		// Taking the mutex ensures a worker that is about to sleep is either already waiting or hasn't checked its predicate yet
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+		}
+		m_sleepCondition.notify_one();
+	}
+}
+
+bool JobSystem::pop(uint32_t workerIndex, QueuedJob& job)
+{
+	WorkerQueue& queue = *m_queues[workerIndex];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.jobs.empty())
+	{
+		return false;
+	}
+	job = std::move(queue.jobs.back());
+	queue.jobs.pop_back();
+	m_queuedJobCount--;
+	return true;
+}
+
+bool JobSystem::steal(uint32_t workerIndex, QueuedJob& job)
+{
+	const uint32_t workerCount = getWorkerCount();
+	const uint32_t start = nextRandom() % workerCount;
+	for (uint32_t i = 0; i < workerCount; i++)
+	{
+		const uint32_t victim = (start + i) % workerCount;
+		if (victim == workerIndex)
+		{
+			continue;
+		}
+		WorkerQueue& queue = *m_queues[victim];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty())
+		{
+			job = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			m_queuedJobCount--;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool JobSystem::runOneJob(uint32_t workerIndex)
+{
+	QueuedJob job;
+	if (pop(workerIndex, job))
+	{
+		execute(workerIndex, job);
+		return true;
+	}
+	if (steal(workerIndex, job))
+	{
+		m_queues[workerIndex]->stealCount.fetch_add(1, std::memory_order_relaxed);
+		execute(workerIndex, job);
+		return true;
+	}
+	return false;
+}
+
+void JobSystem::execute(uint32_t workerIndex, QueuedJob& job)
+{
+	auto tStart = std::chrono::steady_clock::now();
+	job.function();
+	auto tEnd = std::chrono::steady_clock::now();
+
+	WorkerQueue& queue = *m_queues[workerIndex];
+	queue.jobCount.fetch_add(1, std::memory_order_relaxed);
+	queue.busyNanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(tEnd - tStart).count(), std::memory_order_relaxed);
+
+	if (job.counter != nullptr)
+	{
+		finish(job.counter);
+	}
+}
+
+void JobSystem::finish(JobCounter* counter)
+{
+	// The counter is only touched under its mutex, wait() takes the mutex as well before it returns, so the counter can't go out of scope while this still uses it
+	std::vector<JobCounter::WaitingJob> readyJobs;
+	{
+		std::lock_guard<std::mutex> lock(counter->m_mutex);
+		if (counter->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			readyJobs.swap(counter->m_waitingJobs);
+		}
+	}
+	const uint32_t workerIndex = currentWorker();
+	for (JobCounter::WaitingJob& waitingJob : readyJobs)
+	{
+		push(workerIndex, QueuedJob{ std::move(waitingJob.function), waitingJob.counter });
+	}
+}
+
+void JobSystem::run(Job job, JobCounter* counter, JobCounter* dependency)
+{
+	if (counter != nullptr)
+	{
+		counter->m_pending.fetch_add(1, std::memory_order_acq_rel);
+	}
+	if (dependency != nullptr)
+	{
+		std::lock_guard<std::mutex> lock(dependency->m_mutex);
+		if (dependency->m_pending.load(std::memory_order_acquire) != 0)
+		{
+			dependency->m_waitingJobs.push_back(JobCounter::WaitingJob{ std::move(job), counter });
+			return;
+		}
+	}
+	push(currentWorker(), QueuedJob{ std::move(job), counter });
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+	const uint32_t workerIndex = currentWorker();
+	while (!counter.isDone())
+	{
+		if (!runOneJob(workerIndex))
+		{
+			std::this_thread::yield();
+		}
+	}
+	// The job that dropped the counter to zero may still be queuing the jobs depending on it
+	std::lock_guard<std::mutex> lock(counter.m_mutex);
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t first, uint32_t last)>& function)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	batchSize = std::max(1u, batchSize);
+	if (count <= batchSize)
+	{
+		// A single batch runs right here, but still counts as a job of the calling worker
+		QueuedJob job{ [&function, count]() { function(0, count); }, nullptr };
+		execute(currentWorker(), job);
+		return;
+	}
+
+	// function is only referenced by the jobs, this returns after all of them have run
+	JobCounter counter;
+	for (uint32_t first = 0; first < count; first += batchSize)
+	{
+		const uint32_t last = std::min(count, first + batchSize);
+		run([&function, first, last]() { function(first, last); }, &counter);
+	}
+	wait(counter);
+}
+
+std::vector<JobSystem::WorkerStats> JobSystem::getStats() const
+{
+	std::vector<WorkerStats> stats(m_queues.size());
+	for (size_t i = 0; i < m_queues.size(); i++)
+	{
+		stats[i].jobCount = m_queues[i]->jobCount.load(std::memory_order_relaxed);
+		stats[i].stealCount = m_queues[i]->stealCount.load(std::memory_order_relaxed);
+		stats[i].busySeconds = m_queues[i]->busyNanoseconds.load(std::memory_order_relaxed) * 1e-9;
+	}
+	return stats;
+}
+
+void JobSystem::resetStats()
+{
+	for (const std::unique_ptr<WorkerQueue>& queue : m_queues)
+	{
+		queue->jobCount.store(0, std::memory_order_relaxed);
+		queue->stealCount.store(0, std::memory_order_relaxed);
+		queue->busyNanoseconds.store(0, std::memory_order_relaxed);
+	}
+}
+
+void JobSystem::runBenchmark(uint32_t count)
+{
+	// Local transforms composed from random TRS, multiplied with a parent and their normal matrices computed, in batches of 4096
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+	std::vector<glm::vec3> positions(count);
+	std::vector<glm::quat> rotations(count);
+	std::vector<glm::vec3> scales(count, glm::vec3(1.0f));
+	std::vector<glm::mat4> parents(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		positions[i] = glm::vec3(value(random), value(random), value(random)) * 100.0f;
+		rotations[i] = glm::normalize(glm::quat(value(random), value(random), value(random), value(random) + 2.0f));
+		parents[i] = glm::translate(glm::mat4(1.0f), positions[(i * 7919u) % count]);
+	}
+	std::vector<glm::mat4> world(count);
+	std::vector<glm::mat4> normal(count);
+
+	constexpr uint32_t batchSize = 4096;
+	constexpr uint32_t iterations = 10;
+	auto workload = [&](uint32_t first, uint32_t last) {
+		MatrixKernels::composeTRS(&positions[first], &rotations[first], &scales[first], &world[first], last - first);
+		MatrixKernels::multiply(&parents[first], &world[first], &world[first], last - first);
+		MatrixKernels::inverseTranspose(&world[first], &normal[first], last - first);
+	};
+
+	const uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<uint32_t> workerCounts;
+	for (uint32_t workers = 1; workers < hardwareThreads; workers *= 2)
+	{
+		workerCounts.push_back(workers);
+	}
+	workerCounts.push_back(hardwareThreads);
+
+	std::cout << "Job system benchmark, " << count << " transforms (compose, parent multiply, inverse transpose) in batches of " << batchSize << "\n";
+	double singleWorkerMs = 0.0;
+	for (uint32_t workers : workerCounts)
+	{
+		JobSystem jobSystem(workers);
+		// Warm up (wakes all workers and touches the data)
+		jobSystem.parallelFor(count, batchSize, workload);
+		jobSystem.resetStats();
+
+		double bestMs = 1e30;
+		double totalMs = 0.0;
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			auto tStart = std::chrono::high_resolution_clock::now();
+			jobSystem.parallelFor(count, batchSize, workload);
+			auto tEnd = std::chrono::high_resolution_clock::now();
+			const double ms = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+			bestMs = std::min(bestMs, ms);
+			totalMs += ms;
+		}
+		if (workers == 1)
+		{
+			singleWorkerMs = bestMs;
+		}
+
+		std::cout << " " << workers << " workers: " << bestMs << " ms, " << singleWorkerMs / bestMs << "x, utilization";
+		for (const WorkerStats& stats : jobSystem.getStats())
+		{
+			std::cout << " " << static_cast<uint32_t>(100.0 * stats.busySeconds * 1000.0 / totalMs + 0.5) << "%";
+		}
+		uint64_t steals = 0;
+		for (const WorkerStats& stats : jobSystem.getStats())
+		{
+			steals += stats.stealCount;
+		}
+		std::cout << ", " << steals / iterations << " steals per run\n";
+	}
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+
+// Counts the unfinished jobs of a group, a job started with a counter increments it and decrements it once it has run
+// Jobs can also depend on a counter, they are only queued once it has dropped to zero
+// A counter has to stay alive and must not be reused until it has dropped to zero
+class JobCounter
+{
+public:
+    bool isDone() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+    std::atomic<uint32_t> m_pending{ 0 };
+    // Jobs depending on this counter, queued by the job that decrements it to zero
+    struct WaitingJob {
+        std::function<void()> function;
+        JobCounter* counter;
+    };
+    std::mutex m_mutex;
+    std::vector<WaitingJob> m_waitingJobs;
+};
+
+
+// Work stealing job scheduler
+// Every worker owns a deque: it pushes and pops its own jobs at the back (most recent first, the data is likely still in its cache),
+// idle workers steal the oldest jobs from the front of a random other deque. The deques are short critical sections guarded by a mutex each
+// Worker 0 is the thread that created the job system (and every other thread that isn't a worker), it only runs jobs while it waits for a counter,
+// so waiting never blocks a core: the waiting thread helps to finish the work it waits for
+class JobSystem
+{
+public:
+    using Job = std::function<void()>;
+
+    // Busy time of a worker since the last resetStats, the utilization is busySeconds over the elapsed time
+    struct WorkerStats {
+        uint64_t jobCount{ 0 };
+        uint64_t stealCount{ 0 };   // Jobs taken from another worker's deque
+        double busySeconds{ 0.0 };
+    };
+
+    // workerCount includes the calling thread, 0 uses one worker per hardware thread
+    explicit JobSystem(uint32_t workerCount = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    uint32_t getWorkerCount() const { return static_cast<uint32_t>(m_queues.size()); }
+
+    // Queues job on the calling worker's deque, counter (optional) is incremented now and decremented once the job has run
+    // With a dependency the job is held back until that counter has dropped to zero
+    void run(Job job, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+
+    // Runs queued jobs on the calling thread until counter has dropped to zero
+    void wait(JobCounter& counter);
+
+    // Calls function(first, last) for consecutive ranges of at most batchSize of [0, count) on all workers and returns once all have run
+    void parallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t first, uint32_t last)>& function);
+
+    std::vector<WorkerStats> getStats() const;
+    void resetStats();
+
+    // Runs the same batched transform workload with 1, 2, 4 ... hardware threads workers and logs the speedup and utilization
+    static void runBenchmark(uint32_t count = 1000000);
+
+private:
+    struct QueuedJob {
+        Job function;
+        JobCounter* counter{ nullptr };
+    };
+
+    // Padded to a cache line each, so workers don't invalidate each other's deques and statistics
+    struct alignas(64) WorkerQueue {
+        std::mutex mutex;
+        std::deque<QueuedJob> jobs;
+        std::atomic<uint64_t> jobCount{ 0 };
+        std::atomic<uint64_t> stealCount{ 0 };
+        std::atomic<uint64_t> busyNanoseconds{ 0 };
+    };
+
+    void workerLoop(uint32_t workerIndex);
+    uint32_t currentWorker() const;
+    void push(uint32_t workerIndex, QueuedJob job);
+    bool pop(uint32_t workerIndex, QueuedJob& job);
+    bool steal(uint32_t workerIndex, QueuedJob& job);
+    // Runs one job of the worker's own deque or stolen from another one, false if there was none
+    bool runOneJob(uint32_t workerIndex);
+    void execute(uint32_t workerIndex, QueuedJob& job);
+    void finish(JobCounter* counter);
+
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    // Idle workers sleep until a job is queued
+    std::atomic<uint32_t> m_queuedJobCount{ 0 };
+    std::atomic<uint32_t> m_sleepingWorkers{ 0 };
+    std::mutex m_sleepMutex;
+    std::condition_variable m_sleepCondition;
+    std::atomic<bool> m_stop{ false };
+};
@@ -0,0 +1,756 @@
+#include "MatrixKernels.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MATRIX_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC allows the intrinsics of any instruction set in any function, GCC and Clang need the target enabled per function
+#if defined(MATRIX_KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_SSE4 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#else
+#define TARGET_SSE4
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+
+MatrixKernels::InstructionSet MatrixKernels::s_instructionSet = MatrixKernels::getSupportedInstructionSet();
+
+namespace
+{
+	// Reference implementations, also used for the remainders of the SIMD kernels
+	void multiplyScalar(const glm::mat4* a, const glm::mat4* b, glm::mat4* out, size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			out[i] = a[i] * b[i];
+		}
+	}
+
+	void composeTRSScalar(const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, glm::mat4* out, size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			glm::mat4 transform = glm::mat4_cast(rotations[i]);
+			transform[0] = transform[0] * scales[i].x;
+			transform[1] = transform[1] * scales[i].y;
+			transform[2] = transform[2] * scales[i].z;
+			transform[3] = glm::vec4(positions[i], 1.0f);
+			out[i] = transform;
+		}
+	}
+
+	void inverseTransposeScalar(const glm::mat4* matrices, glm::mat4* out, size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			out[i] = glm::mat4(glm::transpose(glm::inverse(glm::mat3(matrices[i]))));
+		}
+	}
+
+	void transformAabbsScalar(const glm::mat4* matrices, const glm::vec3* localMin, const glm::vec3* localMax, glm::vec3* worldMin, glm::vec3* worldMax, size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			// Transform the center, the extent projected onto each world axis is the sum of the absolute matrix entries times the local extents
+			const glm::mat4& m = matrices[i];
+			const glm::vec3 center = 0.5f * (localMin[i] + localMax[i]);
+			const glm::vec3 extent = 0.5f * (localMax[i] - localMin[i]);
+			const glm::vec3 worldCenter(m * glm::vec4(center, 1.0f));
+			const glm::vec3 worldExtent(
+				std::abs(m[0][0]) * extent.x + std::abs(m[1][0]) * extent.y + std::abs(m[2][0]) * extent.z,
+				std::abs(m[0][1]) * extent.x + std::abs(m[1][1]) * extent.y + std::abs(m[2][1]) * extent.z,
+				std::abs(m[0][2]) * extent.x + std::abs(m[1][2]) * extent.y + std::abs(m[2][2]) * extent.z);
+			worldMin[i] = worldCenter - worldExtent;
+			worldMax[i] = worldCenter + worldExtent;
+		}
+	}
+
+#if defined(MATRIX_KERNELS_X86)
+	// Lane orders used by the shuffles below, see _MM_SHUFFLE
+	constexpr int SHUFFLE_XXXX = _MM_SHUFFLE(0, 0, 0, 0);
+	constexpr int SHUFFLE_YYYY = _MM_SHUFFLE(1, 1, 1, 1);
+	constexpr int SHUFFLE_ZZZZ = _MM_SHUFFLE(2, 2, 2, 2);
+	constexpr int SHUFFLE_WWWW = _MM_SHUFFLE(3, 3, 3, 3);
+	constexpr int SHUFFLE_YZXW = _MM_SHUFFLE(3, 0, 2, 1);
+	constexpr int SHUFFLE_ZXYW = _MM_SHUFFLE(3, 1, 0, 2);
+	constexpr int SHUFFLE_YXXW = _MM_SHUFFLE(3, 0, 0, 1);
+	constexpr int SHUFFLE_ZZYW = _MM_SHUFFLE(3, 1, 2, 2);
+	constexpr int SHUFFLE_XXYW = _MM_SHUFFLE(3, 1, 0, 0);
+	constexpr int SHUFFLE_ZYZW = _MM_SHUFFLE(3, 2, 1, 2);
+
+	// The quaternion and vector members are read by name, so the kernels don't depend on glm's quaternion storage order
+	TARGET_SSE4 inline __m128 loadQuat(const glm::quat& q)
+	{
+		return _mm_set_ps(q.w, q.z, q.y, q.x);
+	}
+
+	TARGET_SSE4 inline __m128 loadVec3(const glm::vec3& v, float w)
+	{
+		return _mm_set_ps(w, v.z, v.y, v.x);
+	}
+
+	// SSE4.1
+
+	TARGET_SSE4 void multiplySSE4(const glm::mat4* a, const glm::mat4* b, glm::mat4* out, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			const float* ma = &a[i][0][0];
+			const float* mb = &b[i][0][0];
+			const __m128 a0 = _mm_loadu_ps(ma + 0);
+			const __m128 a1 = _mm_loadu_ps(ma + 4);
+			const __m128 a2 = _mm_loadu_ps(ma + 8);
+			const __m128 a3 = _mm_loadu_ps(ma + 12);
+			__m128 columns[4];
+			for (uint32_t column = 0; column < 4; column++)
+			{
+				columns[column] = _mm_loadu_ps(mb + column * 4);
+			}
+			// Column j of the result is a combination of the columns of a weighted by column j of b
+			float* result = &out[i][0][0];
+			for (uint32_t column = 0; column < 4; column++)
+			{
+				const __m128 bc = columns[column];
+				__m128 r = _mm_mul_ps(a0, _mm_shuffle_ps(bc, bc, SHUFFLE_XXXX));
+				r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_shuffle_ps(bc, bc, SHUFFLE_YYYY)));
+				r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_shuffle_ps(bc, bc, SHUFFLE_ZZZZ)));
+				r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_shuffle_ps(bc, bc, SHUFFLE_WWWW)));
+				_mm_storeu_ps(result + column * 4, r);
+			}
+		}
+	}
+
+	// Rotation matrix columns of a unit quaternion (x, y, z, w), the same terms as glm::mat4_cast
+	TARGET_SSE4 inline void quatToColumnsSSE4(__m128 q, __m128& c0, __m128& c1, __m128& c2)
+	{
+		const __m128 q2 = _mm_add_ps(q, q);
+		const __m128 squares = _mm_mul_ps(q, q2);   // 2xx, 2yy, 2zz
+		// 1 - 2yy - 2zz, 1 - 2xx - 2zz, 1 - 2xx - 2yy
+		const __m128 diagonal = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_shuffle_ps(squares, squares, SHUFFLE_YXXW)), _mm_shuffle_ps(squares, squares, SHUFFLE_ZZYW));
+		// 2xz, 2xy, 2yz and 2wy, 2wz, 2wx
+		const __m128 products = _mm_mul_ps(_mm_shuffle_ps(q, q, SHUFFLE_XXYW), _mm_shuffle_ps(q2, q2, SHUFFLE_ZYZW));
+		const __m128 wProducts = _mm_mul_ps(_mm_shuffle_ps(q, q, SHUFFLE_WWWW), _mm_shuffle_ps(q2, q2, SHUFFLE_YZXW));
+		const __m128 sum = _mm_add_ps(products, wProducts);
+		const __m128 difference = _mm_sub_ps(products, wProducts);
+		const __m128 zero = _mm_setzero_ps();
+		// (diagonal.x, sum.y, difference.x, 0), (difference.y, diagonal.y, sum.z, 0), (sum.x, difference.z, diagonal.z, 0)
+		c0 = _mm_blend_ps(_mm_blend_ps(_mm_blend_ps(diagonal, sum, 0x2), _mm_shuffle_ps(difference, difference, SHUFFLE_XXXX), 0x4), zero, 0x8);
+		c1 = _mm_blend_ps(_mm_blend_ps(_mm_blend_ps(diagonal, _mm_shuffle_ps(difference, difference, SHUFFLE_YYYY), 0x1), sum, 0x4), zero, 0x8);
+		c2 = _mm_blend_ps(_mm_blend_ps(_mm_blend_ps(diagonal, sum, 0x1), _mm_shuffle_ps(difference, difference, SHUFFLE_ZZZZ), 0x2), zero, 0x8);
+	}
+
+	TARGET_SSE4 void composeTRSSSE4(const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, glm::mat4* out, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			__m128 c0, c1, c2;
+			quatToColumnsSSE4(loadQuat(rotations[i]), c0, c1, c2);
+			const __m128 scale = loadVec3(scales[i], 0.0f);
+			float* result = &out[i][0][0];
+			_mm_storeu_ps(result + 0, _mm_mul_ps(c0, _mm_shuffle_ps(scale, scale, SHUFFLE_XXXX)));
+			_mm_storeu_ps(result + 4, _mm_mul_ps(c1, _mm_shuffle_ps(scale, scale, SHUFFLE_YYYY)));
+			_mm_storeu_ps(result + 8, _mm_mul_ps(c2, _mm_shuffle_ps(scale, scale, SHUFFLE_ZZZZ)));
+			_mm_storeu_ps(result + 12, loadVec3(positions[i], 1.0f));
+		}
+	}
+
+	TARGET_SSE4 inline __m128 crossSSE4(__m128 a, __m128 b)
+	{
+		return _mm_sub_ps(
+			_mm_mul_ps(_mm_shuffle_ps(a, a, SHUFFLE_YZXW), _mm_shuffle_ps(b, b, SHUFFLE_ZXYW)),
+			_mm_mul_ps(_mm_shuffle_ps(a, a, SHUFFLE_ZXYW), _mm_shuffle_ps(b, b, SHUFFLE_YZXW)));
+	}
+
+	// The inverse transpose of the upper 3x3 matrix (columns c0, c1, c2) has the columns cross(c1, c2), cross(c2, c0) and cross(c0, c1) divided by the determinant
+	TARGET_SSE4 void inverseTransposeSSE4(const glm::mat4* matrices, glm::mat4* out, size_t count)
+	{
+		const __m128 unitW = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+		const __m128 xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+		for (size_t i = 0; i < count; i++)
+		{
+			const float* m = &matrices[i][0][0];
+			const __m128 c0 = _mm_and_ps(_mm_loadu_ps(m + 0), xyzMask);
+			const __m128 c1 = _mm_and_ps(_mm_loadu_ps(m + 4), xyzMask);
+			const __m128 c2 = _mm_and_ps(_mm_loadu_ps(m + 8), xyzMask);
+			const __m128 r0 = crossSSE4(c1, c2);
+			const __m128 r1 = crossSSE4(c2, c0);
+			const __m128 r2 = crossSSE4(c0, c1);
+			const __m128 inverseDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), _mm_dp_ps(c0, r0, 0x7F));
+			float* result = &out[i][0][0];
+			_mm_storeu_ps(result + 0, _mm_mul_ps(r0, inverseDeterminant));
+			_mm_storeu_ps(result + 4, _mm_mul_ps(r1, inverseDeterminant));
+			_mm_storeu_ps(result + 8, _mm_mul_ps(r2, inverseDeterminant));
+			_mm_storeu_ps(result + 12, unitW);
+		}
+	}
+
+	TARGET_SSE4 void transformAabbsSSE4(const glm::mat4* matrices, const glm::vec3* localMin, const glm::vec3* localMax, glm::vec3* worldMin, glm::vec3* worldMax, size_t count)
+	{
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		alignas(16) float minResult[4];
+		alignas(16) float maxResult[4];
+		for (size_t i = 0; i < count; i++)
+		{
+			const float* m = &matrices[i][0][0];
+			const __m128 c0 = _mm_loadu_ps(m + 0);
+			const __m128 c1 = _mm_loadu_ps(m + 4);
+			const __m128 c2 = _mm_loadu_ps(m + 8);
+			const __m128 c3 = _mm_loadu_ps(m + 12);
+			const __m128 boxMin = loadVec3(localMin[i], 0.0f);
+			const __m128 boxMax = loadVec3(localMax[i], 0.0f);
+			const __m128 center = _mm_mul_ps(_mm_add_ps(boxMin, boxMax), half);
+			const __m128 extent = _mm_mul_ps(_mm_sub_ps(boxMax, boxMin), half);
+
+			__m128 worldCenter = _mm_add_ps(c3, _mm_mul_ps(c0, _mm_shuffle_ps(center, center, SHUFFLE_XXXX)));
+			worldCenter = _mm_add_ps(worldCenter, _mm_mul_ps(c1, _mm_shuffle_ps(center, center, SHUFFLE_YYYY)));
+			worldCenter = _mm_add_ps(worldCenter, _mm_mul_ps(c2, _mm_shuffle_ps(center, center, SHUFFLE_ZZZZ)));
+			__m128 worldExtent = _mm_mul_ps(_mm_and_ps(c0, absMask), _mm_shuffle_ps(extent, extent, SHUFFLE_XXXX));
+			worldExtent = _mm_add_ps(worldExtent, _mm_mul_ps(_mm_and_ps(c1, absMask), _mm_shuffle_ps(extent, extent, SHUFFLE_YYYY)));
+			worldExtent = _mm_add_ps(worldExtent, _mm_mul_ps(_mm_and_ps(c2, absMask), _mm_shuffle_ps(extent, extent, SHUFFLE_ZZZZ)));
+
+			_mm_store_ps(minResult, _mm_sub_ps(worldCenter, worldExtent));
+			_mm_store_ps(maxResult, _mm_add_ps(worldCenter, worldExtent));
+			worldMin[i] = glm::vec3(minResult[0], minResult[1], minResult[2]);
+			worldMax[i] = glm::vec3(maxResult[0], maxResult[1], maxResult[2]);
+		}
+	}
+
+	// AVX2, the 256 bit permutes and blends work on both 128 bit halves alike, so the SSE4.1 lane logic carries over with one matrix per half
+
+	TARGET_AVX2 inline __m256 loadColumns2(const glm::mat4* matrices, size_t i, uint32_t column)
+	{
+		return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&matrices[i][column][0])), _mm_loadu_ps(&matrices[i + 1][column][0]), 1);
+	}
+
+	TARGET_AVX2 inline __m256 combine2(__m128 low, __m128 high)
+	{
+		return _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1);
+	}
+
+	// Stores the columns c0..c3 (each holding the same column of matrices i and i + 1)
+	TARGET_AVX2 inline void storeColumns2(glm::mat4* out, size_t i, __m256 c0, __m256 c1, __m256 c2, __m256 c3)
+	{
+		_mm256_storeu_ps(&out[i][0][0], _mm256_permute2f128_ps(c0, c1, 0x20));
+		_mm256_storeu_ps(&out[i][2][0], _mm256_permute2f128_ps(c2, c3, 0x20));
+		_mm256_storeu_ps(&out[i + 1][0][0], _mm256_permute2f128_ps(c0, c1, 0x31));
+		_mm256_storeu_ps(&out[i + 1][2][0], _mm256_permute2f128_ps(c2, c3, 0x31));
+	}
+
+	TARGET_AVX2 void multiplyAVX2(const glm::mat4* a, const glm::mat4* b, glm::mat4* out, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			const float* ma = &a[i][0][0];
+			const float* mb = &b[i][0][0];
+			// Every column of a in both halves, columns 0 and 1 (2 and 3) of b
+			const __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(ma + 0));
+			const __m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(ma + 4));
+			const __m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(ma + 8));
+			const __m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(ma + 12));
+			const __m256 b01 = _mm256_loadu_ps(mb + 0);
+			const __m256 b23 = _mm256_loadu_ps(mb + 8);
+
+			__m256 r01 = _mm256_mul_ps(a0, _mm256_permute_ps(b01, SHUFFLE_XXXX));
+			r01 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b01, SHUFFLE_YYYY), r01);
+			r01 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b01, SHUFFLE_ZZZZ), r01);
+			r01 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b01, SHUFFLE_WWWW), r01);
+			__m256 r23 = _mm256_mul_ps(a0, _mm256_permute_ps(b23, SHUFFLE_XXXX));
+			r23 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b23, SHUFFLE_YYYY), r23);
+			r23 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b23, SHUFFLE_ZZZZ), r23);
+			r23 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b23, SHUFFLE_WWWW), r23);
+
+			float* result = &out[i][0][0];
+			_mm256_storeu_ps(result + 0, r01);
+			_mm256_storeu_ps(result + 8, r23);
+		}
+	}
+
+	TARGET_AVX2 inline void quatToColumnsAVX2(__m256 q, __m256& c0, __m256& c1, __m256& c2)
+	{
+		const __m256 q2 = _mm256_add_ps(q, q);
+		const __m256 squares = _mm256_mul_ps(q, q2);
+		const __m256 diagonal = _mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_permute_ps(squares, SHUFFLE_YXXW)), _mm256_permute_ps(squares, SHUFFLE_ZZYW));
+		const __m256 products = _mm256_mul_ps(_mm256_permute_ps(q, SHUFFLE_XXYW), _mm256_permute_ps(q2, SHUFFLE_ZYZW));
+		const __m256 wProducts = _mm256_mul_ps(_mm256_permute_ps(q, SHUFFLE_WWWW), _mm256_permute_ps(q2, SHUFFLE_YZXW));
+		const __m256 sum = _mm256_add_ps(products, wProducts);
+		const __m256 difference = _mm256_sub_ps(products, wProducts);
+		const __m256 zero = _mm256_setzero_ps();
+		c0 = _mm256_blend_ps(_mm256_blend_ps(_mm256_blend_ps(diagonal, sum, 0x22), _mm256_permute_ps(difference, SHUFFLE_XXXX), 0x44), zero, 0x88);
+		c1 = _mm256_blend_ps(_mm256_blend_ps(_mm256_blend_ps(diagonal, _mm256_permute_ps(difference, SHUFFLE_YYYY), 0x11), sum, 0x44), zero, 0x88);
+		c2 = _mm256_blend_ps(_mm256_blend_ps(_mm256_blend_ps(diagonal, sum, 0x11), _mm256_permute_ps(difference, SHUFFLE_ZZZZ), 0x22), zero, 0x88);
+	}
+
+	TARGET_AVX2 void composeTRSAVX2(const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, glm::mat4* out, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 2 <= count; i += 2)
+		{
+			__m256 c0, c1, c2;
+			quatToColumnsAVX2(combine2(loadQuat(rotations[i]), loadQuat(rotations[i + 1])), c0, c1, c2);
+			const __m256 scale = combine2(loadVec3(scales[i], 0.0f), loadVec3(scales[i + 1], 0.0f));
+			c0 = _mm256_mul_ps(c0, _mm256_permute_ps(scale, SHUFFLE_XXXX));
+			c1 = _mm256_mul_ps(c1, _mm256_permute_ps(scale, SHUFFLE_YYYY));
+			c2 = _mm256_mul_ps(c2, _mm256_permute_ps(scale, SHUFFLE_ZZZZ));
+			const __m256 c3 = combine2(loadVec3(positions[i], 1.0f), loadVec3(positions[i + 1], 1.0f));
+			storeColumns2(out, i, c0, c1, c2, c3);
+		}
+		composeTRSScalar(positions, rotations, scales, out, i, count);
+	}
+
+	TARGET_AVX2 inline __m256 crossAVX2(__m256 a, __m256 b)
+	{
+		return _mm256_fmsub_ps(_mm256_permute_ps(a, SHUFFLE_YZXW), _mm256_permute_ps(b, SHUFFLE_ZXYW), _mm256_mul_ps(_mm256_permute_ps(a, SHUFFLE_ZXYW), _mm256_permute_ps(b, SHUFFLE_YZXW)));
+	}
+
+	TARGET_AVX2 void inverseTransposeAVX2(const glm::mat4* matrices, glm::mat4* out, size_t count)
+	{
+		const __m256 unitW = _mm256_set_ps(1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+		const __m256 xyzMask = _mm256_castsi256_ps(_mm256_set_epi32(0, -1, -1, -1, 0, -1, -1, -1));
+		size_t i = 0;
+		for (; i + 2 <= count; i += 2)
+		{
+			const __m256 c0 = _mm256_and_ps(loadColumns2(matrices, i, 0), xyzMask);
+			const __m256 c1 = _mm256_and_ps(loadColumns2(matrices, i, 1), xyzMask);
+			const __m256 c2 = _mm256_and_ps(loadColumns2(matrices, i, 2), xyzMask);
+			const __m256 r0 = crossAVX2(c1, c2);
+			const __m256 r1 = crossAVX2(c2, c0);
+			const __m256 r2 = crossAVX2(c0, c1);
+			const __m256 inverseDeterminant = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_dp_ps(c0, r0, 0x7F));
+			storeColumns2(out, i, _mm256_mul_ps(r0, inverseDeterminant), _mm256_mul_ps(r1, inverseDeterminant), _mm256_mul_ps(r2, inverseDeterminant), unitW);
+		}
+		inverseTransposeScalar(matrices, out, i, count);
+	}
+
+	TARGET_AVX2 void transformAabbsAVX2(const glm::mat4* matrices, const glm::vec3* localMin, const glm::vec3* localMax, glm::vec3* worldMin, glm::vec3* worldMax, size_t count)
+	{
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+		alignas(32) float minResult[8];
+		alignas(32) float maxResult[8];
+		size_t i = 0;
+		for (; i + 2 <= count; i += 2)
+		{
+			const __m256 c0 = loadColumns2(matrices, i, 0);
+			const __m256 c1 = loadColumns2(matrices, i, 1);
+			const __m256 c2 = loadColumns2(matrices, i, 2);
+			const __m256 c3 = loadColumns2(matrices, i, 3);
+			const __m256 boxMin = combine2(loadVec3(localMin[i], 0.0f), loadVec3(localMin[i + 1], 0.0f));
+			const __m256 boxMax = combine2(loadVec3(localMax[i], 0.0f), loadVec3(localMax[i + 1], 0.0f));
+			const __m256 center = _mm256_mul_ps(_mm256_add_ps(boxMin, boxMax), half);
+			const __m256 extent = _mm256_mul_ps(_mm256_sub_ps(boxMax, boxMin), half);
+
+			__m256 worldCenter = _mm256_fmadd_ps(c0, _mm256_permute_ps(center, SHUFFLE_XXXX), c3);
+			worldCenter = _mm256_fmadd_ps(c1, _mm256_permute_ps(center, SHUFFLE_YYYY), worldCenter);
+			worldCenter = _mm256_fmadd_ps(c2, _mm256_permute_ps(center, SHUFFLE_ZZZZ), worldCenter);
+			__m256 worldExtent = _mm256_mul_ps(_mm256_and_ps(c0, absMask), _mm256_permute_ps(extent, SHUFFLE_XXXX));
+			worldExtent = _mm256_fmadd_ps(_mm256_and_ps(c1, absMask), _mm256_permute_ps(extent, SHUFFLE_YYYY), worldExtent);
+			worldExtent = _mm256_fmadd_ps(_mm256_and_ps(c2, absMask), _mm256_permute_ps(extent, SHUFFLE_ZZZZ), worldExtent);
+
+			_mm256_store_ps(minResult, _mm256_sub_ps(worldCenter, worldExtent));
+			_mm256_store_ps(maxResult, _mm256_add_ps(worldCenter, worldExtent));
+			for (uint32_t j = 0; j < 2; j++)
+			{
+				worldMin[i + j] = glm::vec3(minResult[j * 4 + 0], minResult[j * 4 + 1], minResult[j * 4 + 2]);
+				worldMax[i + j] = glm::vec3(maxResult[j * 4 + 0], maxResult[j * 4 + 1], maxResult[j * 4 + 2]);
+			}
+		}
+		transformAabbsScalar(matrices, localMin, localMax, worldMin, worldMax, i, count);
+	}
+
+	// AVX-512, one matrix per register for the multiply, otherwise the same column of four matrices (one per 128 bit block)
+
+	TARGET_AVX512 inline __m512 combine4(__m128 v0, __m128 v1, __m128 v2, __m128 v3)
+	{
+		return _mm512_insertf32x4(_mm512_insertf32x4(_mm512_insertf32x4(_mm512_castps128_ps512(v0), v1, 1), v2, 2), v3, 3);
+	}
+
+	TARGET_AVX512 inline __m512 loadColumns4(const glm::mat4* matrices, size_t i, uint32_t column)
+	{
+		return combine4(_mm_loadu_ps(&matrices[i][column][0]), _mm_loadu_ps(&matrices[i + 1][column][0]), _mm_loadu_ps(&matrices[i + 2][column][0]), _mm_loadu_ps(&matrices[i + 3][column][0]));
+	}
+
+	// Transposes the 4x4 grid of 128 bit blocks (column c of matrix i -> matrix i of column c) and stores the four matrices
+	TARGET_AVX512 inline void storeColumns4(glm::mat4* out, size_t i, __m512 c0, __m512 c1, __m512 c2, __m512 c3)
+	{
+		const __m512 t0 = _mm512_shuffle_f32x4(c0, c1, _MM_SHUFFLE(1, 0, 1, 0));
+		const __m512 t1 = _mm512_shuffle_f32x4(c0, c1, _MM_SHUFFLE(3, 2, 3, 2));
+		const __m512 t2 = _mm512_shuffle_f32x4(c2, c3, _MM_SHUFFLE(1, 0, 1, 0));
+		const __m512 t3 = _mm512_shuffle_f32x4(c2, c3, _MM_SHUFFLE(3, 2, 3, 2));
+		_mm512_storeu_ps(&out[i + 0][0][0], _mm512_shuffle_f32x4(t0, t2, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm512_storeu_ps(&out[i + 1][0][0], _mm512_shuffle_f32x4(t0, t2, _MM_SHUFFLE(3, 1, 3, 1)));
+		_mm512_storeu_ps(&out[i + 2][0][0], _mm512_shuffle_f32x4(t1, t3, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm512_storeu_ps(&out[i + 3][0][0], _mm512_shuffle_f32x4(t1, t3, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+
+	TARGET_AVX512 inline __m512 abs512(__m512 v)
+	{
+		return _mm512_castsi512_ps(_mm512_and_epi32(_mm512_castps_si512(v), _mm512_set1_epi32(0x7fffffff)));
+	}
+
+	TARGET_AVX512 void multiplyAVX512(const glm::mat4* a, const glm::mat4* b, glm::mat4* out, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			const float* ma = &a[i][0][0];
+			const __m512 mb = _mm512_loadu_ps(&b[i][0][0]);
+			__m512 r = _mm512_mul_ps(_mm512_broadcast_f32x4(_mm_loadu_ps(ma + 0)), _mm512_permute_ps(mb, SHUFFLE_XXXX));
+			r = _mm512_fmadd_ps(_mm512_broadcast_f32x4(_mm_loadu_ps(ma + 4)), _mm512_permute_ps(mb, SHUFFLE_YYYY), r);
+			r = _mm512_fmadd_ps(_mm512_broadcast_f32x4(_mm_loadu_ps(ma + 8)), _mm512_permute_ps(mb, SHUFFLE_ZZZZ), r);
+			r = _mm512_fmadd_ps(_mm512_broadcast_f32x4(_mm_loadu_ps(ma + 12)), _mm512_permute_ps(mb, SHUFFLE_WWWW), r);
+			_mm512_storeu_ps(&out[i][0][0], r);
+		}
+	}
+
+	TARGET_AVX512 void composeTRSAVX512(const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, glm::mat4* out, size_t count)
+	{
+		const __m512 one = _mm512_set1_ps(1.0f);
+		const __m512 zero = _mm512_setzero_ps();
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m512 q = combine4(loadQuat(rotations[i]), loadQuat(rotations[i + 1]), loadQuat(rotations[i + 2]), loadQuat(rotations[i + 3]));
+			const __m512 q2 = _mm512_add_ps(q, q);
+			const __m512 squares = _mm512_mul_ps(q, q2);
+			const __m512 diagonal = _mm512_sub_ps(_mm512_sub_ps(one, _mm512_permute_ps(squares, SHUFFLE_YXXW)), _mm512_permute_ps(squares, SHUFFLE_ZZYW));
+			const __m512 products = _mm512_mul_ps(_mm512_permute_ps(q, SHUFFLE_XXYW), _mm512_permute_ps(q2, SHUFFLE_ZYZW));
+			const __m512 wProducts = _mm512_mul_ps(_mm512_permute_ps(q, SHUFFLE_WWWW), _mm512_permute_ps(q2, SHUFFLE_YZXW));
+			const __m512 sum = _mm512_add_ps(products, wProducts);
+			const __m512 difference = _mm512_sub_ps(products, wProducts);
+			__m512 c0 = _mm512_mask_blend_ps(0x8888, _mm512_mask_blend_ps(0x4444, _mm512_mask_blend_ps(0x2222, diagonal, sum), _mm512_permute_ps(difference, SHUFFLE_XXXX)), zero);
+			__m512 c1 = _mm512_mask_blend_ps(0x8888, _mm512_mask_blend_ps(0x4444, _mm512_mask_blend_ps(0x1111, diagonal, _mm512_permute_ps(difference, SHUFFLE_YYYY)), sum), zero);
+			__m512 c2 = _mm512_mask_blend_ps(0x8888, _mm512_mask_blend_ps(0x2222, _mm512_mask_blend_ps(0x1111, diagonal, sum), _mm512_permute_ps(difference, SHUFFLE_ZZZZ)), zero);
+
+			const __m512 scale = combine4(loadVec3(scales[i], 0.0f), loadVec3(scales[i + 1], 0.0f), loadVec3(scales[i + 2], 0.0f), loadVec3(scales[i + 3], 0.0f));
+			c0 = _mm512_mul_ps(c0, _mm512_permute_ps(scale, SHUFFLE_XXXX));
+			c1 = _mm512_mul_ps(c1, _mm512_permute_ps(scale, SHUFFLE_YYYY));
+			c2 = _mm512_mul_ps(c2, _mm512_permute_ps(scale, SHUFFLE_ZZZZ));
+			const __m512 c3 = combine4(loadVec3(positions[i], 1.0f), loadVec3(positions[i + 1], 1.0f), loadVec3(positions[i + 2], 1.0f), loadVec3(positions[i + 3], 1.0f));
+			storeColumns4(out, i, c0, c1, c2, c3);
+		}
+		composeTRSScalar(positions, rotations, scales, out, i, count);
+	}
+
+	TARGET_AVX512 inline __m512 cross512(__m512 a, __m512 b)
+	{
+		return _mm512_fmsub_ps(_mm512_permute_ps(a, SHUFFLE_YZXW), _mm512_permute_ps(b, SHUFFLE_ZXYW), _mm512_mul_ps(_mm512_permute_ps(a, SHUFFLE_ZXYW), _mm512_permute_ps(b, SHUFFLE_YZXW)));
+	}
+
+	TARGET_AVX512 void inverseTransposeAVX512(const glm::mat4* matrices, glm::mat4* out, size_t count)
+	{
+		const __m512 unitW = _mm512_mask_blend_ps(0x8888, _mm512_setzero_ps(), _mm512_set1_ps(1.0f));
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m512 c0 = _mm512_maskz_mov_ps(0x7777, loadColumns4(matrices, i, 0));
+			const __m512 c1 = _mm512_maskz_mov_ps(0x7777, loadColumns4(matrices, i, 1));
+			const __m512 c2 = _mm512_maskz_mov_ps(0x7777, loadColumns4(matrices, i, 2));
+			const __m512 r0 = cross512(c1, c2);
+			const __m512 r1 = cross512(c2, c0);
+			const __m512 r2 = cross512(c0, c1);
+			// Sum of the x, y and z products, taken from lane x of each block (lane w of the products is 0)
+			const __m512 products = _mm512_mul_ps(c0, r0);
+			const __m512 determinant = _mm512_add_ps(_mm512_add_ps(products, _mm512_permute_ps(products, SHUFFLE_YZXW)), _mm512_permute_ps(products, SHUFFLE_ZXYW));
+			const __m512 inverseDeterminant = _mm512_div_ps(_mm512_set1_ps(1.0f), _mm512_permute_ps(determinant, SHUFFLE_XXXX));
+			storeColumns4(out, i, _mm512_mul_ps(r0, inverseDeterminant), _mm512_mul_ps(r1, inverseDeterminant), _mm512_mul_ps(r2, inverseDeterminant), unitW);
+		}
+		inverseTransposeScalar(matrices, out, i, count);
+	}
+
+	TARGET_AVX512 void transformAabbsAVX512(const glm::mat4* matrices, const glm::vec3* localMin, const glm::vec3* localMax, glm::vec3* worldMin, glm::vec3* worldMax, size_t count)
+	{
+		const __m512 half = _mm512_set1_ps(0.5f);
+		alignas(64) float minResult[16];
+		alignas(64) float maxResult[16];
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m512 c0 = loadColumns4(matrices, i, 0);
+			const __m512 c1 = loadColumns4(matrices, i, 1);
+			const __m512 c2 = loadColumns4(matrices, i, 2);
+			const __m512 c3 = loadColumns4(matrices, i, 3);
+			const __m512 boxMin = combine4(loadVec3(localMin[i], 0.0f), loadVec3(localMin[i + 1], 0.0f), loadVec3(localMin[i + 2], 0.0f), loadVec3(localMin[i + 3], 0.0f));
+			const __m512 boxMax = combine4(loadVec3(localMax[i], 0.0f), loadVec3(localMax[i + 1], 0.0f), loadVec3(localMax[i + 2], 0.0f), loadVec3(localMax[i + 3], 0.0f));
+			const __m512 center = _mm512_mul_ps(_mm512_add_ps(boxMin, boxMax), half);
+			const __m512 extent = _mm512_mul_ps(_mm512_sub_ps(boxMax, boxMin), half);
+
+			__m512 worldCenter = _mm512_fmadd_ps(c0, _mm512_permute_ps(center, SHUFFLE_XXXX), c3);
+			worldCenter = _mm512_fmadd_ps(c1, _mm512_permute_ps(center, SHUFFLE_YYYY), worldCenter);
+			worldCenter = _mm512_fmadd_ps(c2, _mm512_permute_ps(center, SHUFFLE_ZZZZ), worldCenter);
+			__m512 worldExtent = _mm512_mul_ps(abs512(c0), _mm512_permute_ps(extent, SHUFFLE_XXXX));
+			worldExtent = _mm512_fmadd_ps(abs512(c1), _mm512_permute_ps(extent, SHUFFLE_YYYY), worldExtent);
+			worldExtent = _mm512_fmadd_ps(abs512(c2), _mm512_permute_ps(extent, SHUFFLE_ZZZZ), worldExtent);
+
+			_mm512_store_ps(minResult, _mm512_sub_ps(worldCenter, worldExtent));
+			_mm512_store_ps(maxResult, _mm512_add_ps(worldCenter, worldExtent));
+			for (uint32_t j = 0; j < 4; j++)
+			{
+				worldMin[i + j] = glm::vec3(minResult[j * 4 + 0], minResult[j * 4 + 1], minResult[j * 4 + 2]);
+				worldMax[i + j] = glm::vec3(maxResult[j * 4 + 0], maxResult[j * 4 + 1], maxResult[j * 4 + 2]);
+			}
+		}
+		transformAabbsScalar(matrices, localMin, localMax, worldMin, worldMax, i, count);
+	}
+#endif
+}
+
+
+void MatrixKernels::multiply(const glm::mat4* a, const glm::mat4* b, glm::mat4* out, size_t count)
+{
+	switch (s_instructionSet)
+	{
+#if defined(MATRIX_KERNELS_X86)
+	case InstructionSet::AVX512:
+		return multiplyAVX512(a, b, out, count);
+	case InstructionSet::AVX2:
+		return multiplyAVX2(a, b, out, count);
+	case InstructionSet::SSE4:
+		return multiplySSE4(a, b, out, count);
+#endif
+	default:
+		return multiplyScalar(a, b, out, 0, count);
+	}
+}
+
+void MatrixKernels::composeTRS(const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, glm::mat4* out, size_t count)
+{
+	switch (s_instructionSet)
+	{
+#if defined(MATRIX_KERNELS_X86)
+	case InstructionSet::AVX512:
+		return composeTRSAVX512(positions, rotations, scales, out, count);
+	case InstructionSet::AVX2:
+		return composeTRSAVX2(positions, rotations, scales, out, count);
+	case InstructionSet::SSE4:
+		return composeTRSSSE4(positions, rotations, scales, out, count);
+#endif
+	default:
+		return composeTRSScalar(positions, rotations, scales, out, 0, count);
+	}
+}
+
+void MatrixKernels::inverseTranspose(const glm::mat4* matrices, glm::mat4* out, size_t count)
+{
+	switch (s_instructionSet)
+	{
+#if defined(MATRIX_KERNELS_X86)
+	case InstructionSet::AVX512:
+		return inverseTransposeAVX512(matrices, out, count);
+	case InstructionSet::AVX2:
+		return inverseTransposeAVX2(matrices, out, count);
+	case InstructionSet::SSE4:
+		return inverseTransposeSSE4(matrices, out, count);
+#endif
+	default:
+		return inverseTransposeScalar(matrices, out, 0, count);
+	}
+}
+
+void MatrixKernels::transformAabbs(const glm::mat4* matrices, const glm::vec3* localMin, const glm::vec3* localMax, glm::vec3* worldMin, glm::vec3* worldMax, size_t count)
+{
+	switch (s_instructionSet)
+	{
+#if defined(MATRIX_KERNELS_X86)
+	case InstructionSet::AVX512:
+		return transformAabbsAVX512(matrices, localMin, localMax, worldMin, worldMax, count);
+	case InstructionSet::AVX2:
+		return transformAabbsAVX2(matrices, localMin, localMax, worldMin, worldMax, count);
+	case InstructionSet::SSE4:
+		return transformAabbsSSE4(matrices, localMin, localMax, worldMin, worldMax, count);
+#endif
+	default:
+		return transformAabbsScalar(matrices, localMin, localMax, worldMin, worldMax, 0, count);
+	}
+}
+
+void MatrixKernels::setInstructionSet(InstructionSet instructionSet)
+{
+	s_instructionSet = std::min(instructionSet, getSupportedInstructionSet());
+}
+
+MatrixKernels::InstructionSet MatrixKernels::getSupportedInstructionSet()
+{
+#if defined(MATRIX_KERNELS_X86)
+#if defined(_MSC_VER)
+	// AVX2 and AVX-512 need the CPU flags (leaf 7) and the OS saving the YMM (XCR0 bits 1 and 2) and ZMM registers (XCR0 bits 5 to 7)
+	int cpuInfo[4];
+	__cpuid(cpuInfo, 1);
+	const bool sse41 = (cpuInfo[2] & (1 << 19)) != 0;
+	const bool fma = (cpuInfo[2] & (1 << 12)) != 0;
+	const bool osxsave = (cpuInfo[2] & (1 << 27)) != 0;
+	const bool avx = (cpuInfo[2] & (1 << 28)) != 0;
+	__cpuidex(cpuInfo, 7, 0);
+	const bool avx2 = (cpuInfo[1] & (1 << 5)) != 0;
+	const bool avx512f = (cpuInfo[1] & (1 << 16)) != 0;
+	const unsigned long long xcr0 = (osxsave && avx) ? _xgetbv(0) : 0;
+	if (avx512f && avx2 && fma && ((xcr0 & 0xE6) == 0xE6))
+	{
+		return InstructionSet::AVX512;
+	}
+	if (avx2 && fma && ((xcr0 & 0x6) == 0x6))
+	{
+		return InstructionSet::AVX2;
+	}
+	return sse41 ? InstructionSet::SSE4 : InstructionSet::Scalar;
+#else
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+	{
+		return InstructionSet::AVX512;
+	}
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+	{
+		return InstructionSet::AVX2;
+	}
+	return __builtin_cpu_supports("sse4.1") ? InstructionSet::SSE4 : InstructionSet::Scalar;
+#endif
+#else
+	return InstructionSet::Scalar;
+#endif
+}
+
+const char* MatrixKernels::instructionSetName(InstructionSet instructionSet)
+{
+	switch (instructionSet)
+	{
+	case InstructionSet::AVX512:
+		return "AVX-512";
+	case InstructionSet::AVX2:
+		return "AVX2";
+	case InstructionSet::SSE4:
+		return "SSE4.1";
+	default:
+		return "Scalar";
+	}
+}
+
+void MatrixKernels::runBenchmark(uint32_t count)
+{
+	// Random rigid transforms with non uniform scale, the object space boxes are unit cubes of random size
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> axis(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+	std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+
+	std::vector<glm::vec3> positions(count);
+	std::vector<glm::quat> rotations(count);
+	std::vector<glm::vec3> scales(count);
+	std::vector<glm::vec3> boxMin(count);
+	std::vector<glm::vec3> boxMax(count);
+	std::vector<glm::mat4> parents(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		positions[i] = glm::vec3(position(random), position(random), position(random));
+		glm::vec3 rotationAxis(axis(random), axis(random), axis(random));
+		rotationAxis = glm::length(rotationAxis) > 0.01f ? glm::normalize(rotationAxis) : glm::vec3(0.0f, 1.0f, 0.0f);
+		rotations[i] = glm::angleAxis(angle(random), rotationAxis);
+		scales[i] = glm::vec3(scale(random), scale(random), scale(random));
+		boxMax[i] = glm::vec3(scale(random), scale(random), scale(random));
+		boxMin[i] = -boxMax[i];
+	}
+
+	// glm reference results
+	std::vector<glm::mat4> referenceTRS(count);
+	std::vector<glm::mat4> referenceProduct(count);
+	std::vector<glm::mat4> referenceNormal(count);
+	std::vector<glm::vec3> referenceMin(count);
+	std::vector<glm::vec3> referenceMax(count);
+	auto tStart = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		referenceTRS[i] = glm::translate(glm::mat4(1.0f), positions[i]) * glm::mat4_cast(rotations[i]) * glm::scale(glm::mat4(1.0f), scales[i]);
+	}
+	auto tEnd = std::chrono::high_resolution_clock::now();
+	const double glmTRSMs = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		parents[i] = referenceTRS[(i * 7919u) % count];
+		referenceProduct[i] = parents[i] * referenceTRS[i];
+		referenceNormal[i] = glm::mat4(glm::transpose(glm::inverse(glm::mat3(referenceTRS[i]))));
+		referenceMin[i] = glm::vec3(std::numeric_limits<float>::max());
+		referenceMax[i] = glm::vec3(-std::numeric_limits<float>::max());
+		for (uint32_t corner = 0; corner < 8; corner++)
+		{
+			const glm::vec3 local((corner & 1) ? boxMax[i].x : boxMin[i].x, (corner & 2) ? boxMax[i].y : boxMin[i].y, (corner & 4) ? boxMax[i].z : boxMin[i].z);
+			const glm::vec3 world(referenceTRS[i] * glm::vec4(local, 1.0f));
+			referenceMin[i] = glm::min(referenceMin[i], world);
+			referenceMax[i] = glm::max(referenceMax[i], world);
+		}
+	}
+
+	// Largest deviation relative to the magnitude of the reference value
+	auto deviation = [](const float* result, const float* reference, size_t floatCount) {
+		float largest = 0.0f;
+		for (size_t i = 0; i < floatCount; i++)
+		{
+			largest = std::max(largest, std::abs(result[i] - reference[i]) / (1.0f + std::abs(reference[i])));
+		}
+		return largest;
+	};
+
+	std::vector<glm::mat4> matrices(count);
+	std::vector<glm::mat4> results(count);
+	std::vector<glm::vec3> worldMin(count);
+	std::vector<glm::vec3> worldMax(count);
+	constexpr uint32_t iterations = 10;
+	constexpr float tolerance = 1e-4f;
+
+	// Report the best run, the first one also warms up the caches
+	auto measure = [&](auto&& kernel) {
+		double bestMs = 1e30;
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			auto tStart = std::chrono::high_resolution_clock::now();
+			kernel();
+			auto tEnd = std::chrono::high_resolution_clock::now();
+			bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+		}
+		return bestMs;
+	};
+	auto report = [&](const char* kernel, double ms, float largestDeviation) {
+		std::cout << "  " << kernel << ": " << ms << " ms, " << (count / ms) / 1000.0 << " Mmatrices/s, max deviation from glm " << largestDeviation
+			<< ((largestDeviation > tolerance) ? " (MISMATCH!)" : "") << "\n";
+	};
+
+	const InstructionSet previousInstructionSet = s_instructionSet;
+	std::cout << "Matrix kernel benchmark, " << count << " matrices, glm translate * rotate * scale " << glmTRSMs << " ms\n";
+	for (InstructionSet instructionSet : { InstructionSet::Scalar, InstructionSet::SSE4, InstructionSet::AVX2, InstructionSet::AVX512 })
+	{
+		if (instructionSet > getSupportedInstructionSet())
+		{
+			continue;
+		}
+		setInstructionSet(instructionSet);
+		std::cout << " " << instructionSetName(instructionSet) << "\n";
+
+		double ms = measure([&] { composeTRS(positions.data(), rotations.data(), scales.data(), matrices.data(), count); });
+		report("TRS compose      ", ms, deviation(&matrices[0][0][0], &referenceTRS[0][0][0], count * 16));
+
+		ms = measure([&] { multiply(parents.data(), matrices.data(), results.data(), count); });
+		report("4x4 multiply     ", ms, deviation(&results[0][0][0], &referenceProduct[0][0][0], count * 16));
+
+		ms = measure([&] { inverseTranspose(matrices.data(), results.data(), count); });
+		report("inverse transpose", ms, deviation(&results[0][0][0], &referenceNormal[0][0][0], count * 16));
+
+		ms = measure([&] { transformAabbs(matrices.data(), boxMin.data(), boxMax.data(), worldMin.data(), worldMax.data(), count); });
+		report("AABB transform   ", ms, std::max(deviation(&worldMin[0].x, &referenceMin[0].x, count * 3), deviation(&worldMax[0].x, &referenceMax[0].x, count * 3)));
+	}
+	s_instructionSet = previousInstructionSet;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+
+// Batched matrix math for transform updates, every kernel processes whole arrays of glm matrices (column major)
+// The instruction set is selected at runtime, by default the widest one supported by the CPU:
+//  SSE4.1  one matrix per iteration, one column per register
+//  AVX2    two columns of a matrix (multiply) or the same column of two matrices (all other kernels) per register, with fused multiply adds
+//  AVX-512 a whole matrix (multiply) or the same column of four matrices per register
+// The SIMD results match glm up to floating point rounding, runBenchmark checks them against glm
+class MatrixKernels
+{
+public:
+    enum class InstructionSet { Scalar, SSE4, AVX2, AVX512 };
+
+    // out[i] = a[i] * b[i], out may be a or b
+    static void multiply(const glm::mat4* a, const glm::mat4* b, glm::mat4* out, size_t count);
+    // out[i] = translate(positions[i]) * mat4_cast(rotations[i]) * scale(scales[i]), the rotations have to be unit quaternions
+    static void composeTRS(const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, glm::mat4* out, size_t count);
+    // out[i] = mat4(transpose(inverse(mat3(matrices[i])))), the matrix transforming the normals, out may be matrices
+    static void inverseTranspose(const glm::mat4* matrices, glm::mat4* out, size_t count);
+    // World space AABBs of object space AABBs, the world AABB encloses the transformed object space box
+    static void transformAabbs(const glm::mat4* matrices, const glm::vec3* localMin, const glm::vec3* localMax, glm::vec3* worldMin, glm::vec3* worldMax, size_t count);
+
+    // Requests for unsupported sets are clamped, applies to all kernels
+    static void setInstructionSet(InstructionSet instructionSet);
+    static InstructionSet getInstructionSet() { return s_instructionSet; }
+    static InstructionSet getSupportedInstructionSet();
+    static const char* instructionSetName(InstructionSet instructionSet);
+
+    // Runs every kernel over count random matrices with every supported instruction set, logs the throughput and the largest deviation from glm
+    static void runBenchmark(uint32_t count = 1000000);
+
+private:
+    static InstructionSet s_instructionSet;
+};
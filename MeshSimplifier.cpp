@@ -0,0 +1,384 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <queue>
+#include <unordered_map>
+
+
+namespace
+{
+	// Symmetric 4x4 matrix summing the squared distances to a set of planes, stored as its upper triangle
+	struct Quadric {
+		double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+
+		void addPlane(double a, double b, double c, double d)
+		{
+			xx += a * a; xy += a * b; xz += a * c; xw += a * d;
+			yy += b * b; yz += b * c; yw += b * d;
+			zz += c * c; zw += c * d;
+			ww += d * d;
+		}
+
+		void add(const Quadric& q)
+		{
+			xx += q.xx; xy += q.xy; xz += q.xz; xw += q.xw;
+			yy += q.yy; yz += q.yz; yw += q.yw;
+			zz += q.zz; zw += q.zw;
+			ww += q.ww;
+		}
+
+		// Sum of the squared distances of p to all planes
+		double evaluate(const glm::vec3& p) const
+		{
+			const double x = p.x, y = p.y, z = p.z;
+			return x * x * xx + 2.0 * x * y * xy + 2.0 * x * z * xz + 2.0 * x * xw
+				+ y * y * yy + 2.0 * y * z * yz + 2.0 * y * yw
+				+ z * z * zz + 2.0 * z * zw
+				+ ww;
+		}
+	};
+
+	struct Collapse {
+		double cost;
+		uint32_t from;
+		uint32_t to;
+		uint32_t fromVersion;
+		uint32_t toVersion;
+
+		bool operator>(const Collapse& other) const { return cost > other.cost; }
+	};
+
+	glm::vec3 readVec3(const float* base, size_t vertexStride, uint32_t vertex)
+	{
+		const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(base) + vertex * vertexStride);
+		return glm::vec3(p[0], p[1], p[2]);
+	}
+
+	uint64_t edgeKey(uint32_t a, uint32_t b)
+	{
+		return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+	}
+
+	struct PositionKey {
+		int32_t x, y, z;
+		bool operator==(const PositionKey& other) const { return x == other.x && y == other.y && z == other.z; }
+	};
+
+	struct PositionKeyHash {
+		size_t operator()(const PositionKey& key) const { return (static_cast<uint32_t>(key.x) * 73856093u) ^ (static_cast<uint32_t>(key.y) * 19349663u) ^ (static_cast<uint32_t>(key.z) * 83492791u); }
+	};
+}
+
+
+std::vector<uint32_t> MeshSimplifier::simplify(const float* positions, const float* normals, size_t vertexStride, size_t vertexCount, const std::vector<uint32_t>& indices, size_t targetIndexCount, float* error)
+{
+	double maxCost = 0.0;
+
+	// Weld the vertices by position, every weld group is represented by its first vertex
+	// Positions are snapped to a grid far below the mesh detail, generated meshes (the sphere's seam and poles) are off by a few ulps
+	// Groups whose normals disagree form a hard edge, moving them would tear the surface apart
+	glm::vec3 minPosition(FLT_MAX);
+	glm::vec3 maxPosition(-FLT_MAX);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		minPosition = glm::min(minPosition, readVec3(positions, vertexStride, v));
+		maxPosition = glm::max(maxPosition, readVec3(positions, vertexStride, v));
+	}
+	const glm::vec3 extent = maxPosition - minPosition;
+	const float weldScale = 1.0f / (std::max(std::max(extent.x, extent.y), std::max(extent.z, FLT_MIN)) * 1e-5f);
+	std::vector<uint32_t> group(vertexCount);
+	std::vector<bool> seam(vertexCount, false);
+	std::unordered_map<PositionKey, uint32_t, PositionKeyHash> groupByPosition;
+	groupByPosition.reserve(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		const glm::vec3 p = readVec3(positions, vertexStride, v);
+		const PositionKey key{
+			static_cast<int32_t>(std::lround(p.x * weldScale)),
+			static_cast<int32_t>(std::lround(p.y * weldScale)),
+			static_cast<int32_t>(std::lround(p.z * weldScale))
+		};
+		const auto inserted = groupByPosition.emplace(key, v);
+		group[v] = inserted.first->second;
+		if (!inserted.second && normals != nullptr && glm::dot(readVec3(normals, vertexStride, v), readVec3(normals, vertexStride, group[v])) < 0.99f)
+		{
+			seam[group[v]] = true;
+		}
+	}
+
+	// Triangles on weld groups, corners keeps the vertex written to the output
+	const uint32_t inputTriangleCount = static_cast<uint32_t>(indices.size() / 3);
+	std::vector<uint32_t> triangles;
+	std::vector<uint32_t> corners;
+	triangles.reserve(indices.size());
+	corners.reserve(indices.size());
+	for (uint32_t t = 0; t < inputTriangleCount; t++)
+	{
+		const uint32_t a = group[indices[t * 3 + 0]];
+		const uint32_t b = group[indices[t * 3 + 1]];
+		const uint32_t c = group[indices[t * 3 + 2]];
+		if (a == b || b == c || c == a)
+		{
+			continue;
+		}
+		triangles.insert(triangles.end(), { a, b, c });
+		corners.insert(corners.end(), { indices[t * 3 + 0], indices[t * 3 + 1], indices[t * 3 + 2] });
+	}
+	const uint32_t triangleCount = static_cast<uint32_t>(triangles.size() / 3);
+
+	// Edges used by a single triangle are open borders, edges used by more than two are non-manifold, both stay in place
+	std::vector<bool> border(vertexCount, false);
+	{
+		std::unordered_map<uint64_t, uint32_t> edgeUses;
+		edgeUses.reserve(triangles.size());
+		for (uint32_t t = 0; t < triangleCount; t++)
+		{
+			for (uint32_t e = 0; e < 3; e++)
+			{
+				edgeUses[edgeKey(triangles[t * 3 + e], triangles[t * 3 + (e + 1) % 3])]++;
+			}
+		}
+		for (const auto& [key, uses] : edgeUses)
+		{
+			if (uses != 2)
+			{
+				border[static_cast<uint32_t>(key >> 32)] = true;
+				border[static_cast<uint32_t>(key & 0xffffffffu)] = true;
+			}
+		}
+	}
+
+	// Quadric of every group: the planes of all triangles around it
+	std::vector<Quadric> quadrics(vertexCount, Quadric{});
+	std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+	for (uint32_t t = 0; t < triangleCount; t++)
+	{
+		const glm::vec3 p0 = readVec3(positions, vertexStride, triangles[t * 3 + 0]);
+		const glm::vec3 p1 = readVec3(positions, vertexStride, triangles[t * 3 + 1]);
+		const glm::vec3 p2 = readVec3(positions, vertexStride, triangles[t * 3 + 2]);
+		const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		const float length = glm::length(normal);
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			vertexTriangles[triangles[t * 3 + corner]].push_back(t);
+		}
+		if (length > 0.0f)
+		{
+			const glm::vec3 n = normal / length;
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				quadrics[triangles[t * 3 + corner]].addPlane(n.x, n.y, n.z, -glm::dot(n, p0));
+			}
+		}
+	}
+
+	std::vector<bool> removedVertex(vertexCount, false);
+	std::vector<bool> removedTriangle(triangleCount, false);
+	std::vector<uint32_t> version(vertexCount, 0);
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> collapses;
+
+	auto pushCollapse = [&](uint32_t from, uint32_t to) {
+		// A vertex that leaves must be free to move, the one it lands on must not be part of a hard edge (its normal would be wrong for the moved triangles)
+		if (seam[from] || border[from] || seam[to])
+		{
+			return;
+		}
+		Quadric q = quadrics[from];
+		q.add(quadrics[to]);
+		collapses.push({ std::max(q.evaluate(readVec3(positions, vertexStride, to)), 0.0), from, to, version[from], version[to] });
+	};
+
+	for (uint32_t t = 0; t < triangleCount; t++)
+	{
+		for (uint32_t e = 0; e < 3; e++)
+		{
+			pushCollapse(triangles[t * 3 + e], triangles[t * 3 + (e + 1) % 3]);
+			pushCollapse(triangles[t * 3 + (e + 1) % 3], triangles[t * 3 + e]);
+		}
+	}
+
+	auto triangleContains = [&](uint32_t t, uint32_t v) {
+		return triangles[t * 3 + 0] == v || triangles[t * 3 + 1] == v || triangles[t * 3 + 2] == v;
+	};
+
+	std::vector<uint32_t> neighbours;
+	std::vector<uint32_t> fromNeighbours;
+	uint32_t liveTriangles = triangleCount;
+	while (liveTriangles * 3 > targetIndexCount && !collapses.empty())
+	{
+		const Collapse collapse = collapses.top();
+		collapses.pop();
+		const uint32_t from = collapse.from;
+		const uint32_t to = collapse.to;
+		if (removedVertex[from] || removedVertex[to] || version[from] != collapse.fromVersion || version[to] != collapse.toVersion)
+		{
+			continue;
+		}
+
+		// Link condition: the two vertices may only share the neighbours opposite to their shared triangles, otherwise the collapse pinches the surface
+		uint32_t sharedTriangles = 0;
+		fromNeighbours.clear();
+		for (uint32_t t : vertexTriangles[from])
+		{
+			if (removedTriangle[t])
+			{
+				continue;
+			}
+			if (triangleContains(t, to))
+			{
+				sharedTriangles++;
+			}
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				const uint32_t v = triangles[t * 3 + corner];
+				if (v != from && v != to)
+				{
+					fromNeighbours.push_back(v);
+				}
+			}
+		}
+		std::sort(fromNeighbours.begin(), fromNeighbours.end());
+		fromNeighbours.erase(std::unique(fromNeighbours.begin(), fromNeighbours.end()), fromNeighbours.end());
+		neighbours.clear();
+		for (uint32_t t : vertexTriangles[to])
+		{
+			if (removedTriangle[t])
+			{
+				continue;
+			}
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				const uint32_t v = triangles[t * 3 + corner];
+				if (v != from && v != to && std::binary_search(fromNeighbours.begin(), fromNeighbours.end(), v))
+				{
+					neighbours.push_back(v);
+				}
+			}
+		}
+		std::sort(neighbours.begin(), neighbours.end());
+		neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+		if (sharedTriangles == 0 || neighbours.size() > sharedTriangles)
+		{
+			continue;
+		}
+
+		// Reject collapses that flip (or nearly flip) one of the triangles that stay
+		const glm::vec3 target = readVec3(positions, vertexStride, to);
+		bool flips = false;
+		for (uint32_t t : vertexTriangles[from])
+		{
+			if (removedTriangle[t] || triangleContains(t, to))
+			{
+				continue;
+			}
+			glm::vec3 before[3];
+			glm::vec3 after[3];
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				const uint32_t v = triangles[t * 3 + corner];
+				before[corner] = readVec3(positions, vertexStride, v);
+				after[corner] = (v == from) ? target : before[corner];
+			}
+			const glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+			const glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+			if (glm::dot(normalBefore, normalAfter) < 0.2f * glm::length(normalBefore) * glm::length(normalAfter) || glm::length(normalAfter) == 0.0f)
+			{
+				flips = true;
+				break;
+			}
+		}
+		if (flips)
+		{
+			continue;
+		}
+
+		// Collapse: the shared triangles disappear, all others move over to the target vertex
+		for (uint32_t t : vertexTriangles[from])
+		{
+			if (removedTriangle[t])
+			{
+				continue;
+			}
+			if (triangleContains(t, to))
+			{
+				removedTriangle[t] = true;
+				liveTriangles--;
+				continue;
+			}
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				if (triangles[t * 3 + corner] == from)
+				{
+					triangles[t * 3 + corner] = to;
+					corners[t * 3 + corner] = to;
+				}
+			}
+			vertexTriangles[to].push_back(t);
+		}
+		vertexTriangles[from].clear();
+		quadrics[to].add(quadrics[from]);
+		removedVertex[from] = true;
+		version[to]++;
+		maxCost = std::max(maxCost, collapse.cost);
+
+		// The target's quadric changed, so do the costs of all collapses involving it
+		for (uint32_t t : vertexTriangles[to])
+		{
+			if (removedTriangle[t])
+			{
+				continue;
+			}
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				const uint32_t v = triangles[t * 3 + corner];
+				if (v != to)
+				{
+					pushCollapse(to, v);
+					pushCollapse(v, to);
+				}
+			}
+		}
+	}
+
+	std::vector<uint32_t> result;
+	result.reserve(liveTriangles * 3);
+	for (uint32_t t = 0; t < triangleCount; t++)
+	{
+		if (!removedTriangle[t])
+		{
+			result.insert(result.end(), { corners[t * 3 + 0], corners[t * 3 + 1], corners[t * 3 + 2] });
+		}
+	}
+
+	if (error != nullptr)
+	{
+		*error = static_cast<float>(std::sqrt(maxCost));
+	}
+	return result;
+}
+
+std::vector<MeshLodLevel> MeshSimplifier::buildLodChain(const float* positions, const float* normals, size_t vertexStride, size_t vertexCount, const std::vector<uint32_t>& indices, uint32_t maxLevels)
+{
+	std::vector<MeshLodLevel> levels;
+	levels.push_back({ indices, 0.0f });
+
+	while (levels.size() < maxLevels)
+	{
+		const MeshLodLevel& previous = levels.back();
+		const size_t targetIndexCount = (previous.indices.size() / 3 / 4) * 3;
+		float error = 0.0f;
+		std::vector<uint32_t> simplified = simplify(positions, normals, vertexStride, vertexCount, previous.indices, targetIndexCount, &error);
+
+		// Stop once a level saves less than a tenth of the triangles, the remaining collapses are all blocked
+		if (simplified.empty() || simplified.size() * 10 > previous.indices.size() * 9)
+		{
+			break;
+		}
+		// Every level is simplified from the one before, so the estimated deviations add up
+		const float levelError = previous.error + error;
+		levels.push_back({ std::move(simplified), levelError });
+	}
+	return levels;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+
+// Maximum number of levels of detail per mesh, including the full detail mesh (LOD 0)
+constexpr uint32_t MAX_LOD_COUNT = 6;
+
+// One level of detail of a mesh, it references the mesh's original vertices and only has its own indices
+struct MeshLodLevel {
+    std::vector<uint32_t> indices;
+    float error;    // Estimated object space deviation from the full detail mesh (see buildLodChain), 0 for LOD 0
+};
+
+
+// Mesh simplification by edge collapses ordered by the quadric error metric (Garland and Heckbert)
+// A collapse moves a vertex onto one of its neighbours, so vertices are only ever removed and every level can share the vertex data of the full mesh
+// Vertices at the same position are welded, where their normals differ (hard edges like the corners of the cube) or on open borders they are locked
+class MeshSimplifier
+{
+public:
+    // positions / normals point at the first vertex position / normal (3 floats each), consecutive vertices are vertexStride bytes apart
+    // Without normals all vertices at the same position are welded
+    // Collapses edges until at most targetIndexCount indices are left or no valid collapse remains
+    // error receives the square root of the largest collapse cost: the moved vertex is at most that far from each plane of the input triangles
+    // merged into it, an estimate of the surface deviation but not a bound of it (the triangles can deviate more than their vertices)
+    static std::vector<uint32_t> simplify(const float* positions, const float* normals, size_t vertexStride, size_t vertexCount, const std::vector<uint32_t>& indices, size_t targetIndexCount, float* error);
+
+    // LOD 0 is the input, every further level has about a quarter of the triangles of the level before
+    // The chain ends early once the mesh can't be reduced any further
+    // The error of a level is the sum of the simplify errors of all levels up to it, an estimate used to select the levels by their projected size
+    static std::vector<MeshLodLevel> buildLodChain(const float* positions, const float* normals, size_t vertexStride, size_t vertexCount, const std::vector<uint32_t>& indices, uint32_t maxLevels = MAX_LOD_COUNT);
+};
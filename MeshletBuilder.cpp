@@ -0,0 +1,365 @@
+#include "MeshletBuilder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+
+namespace
+{
+	constexpr uint32_t MESHLET_CACHE_MAGIC = 0x4c48534d;   // "MSHL"
+	constexpr uint32_t MESHLET_CACHE_VERSION = 1;
+
+	struct MeshletCacheHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t sourceHash;
+		uint32_t meshletCount;
+		uint32_t vertexCount;
+		uint32_t triangleByteCount;
+		uint32_t padding;
+	};
+
+	glm::vec3 readPosition(const float* positions, size_t vertexStride, uint32_t vertex)
+	{
+		const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + vertex * vertexStride);
+		return glm::vec3(p[0], p[1], p[2]);
+	}
+
+	MeshletBounds computeBounds(const MeshletMesh& mesh, const Meshlet& meshlet, const float* positions, size_t vertexStride)
+	{
+		MeshletBounds bounds{};
+
+		// Bounding sphere around the center of the meshlet's AABB
+		glm::vec3 aabbMin(std::numeric_limits<float>::max());
+		glm::vec3 aabbMax(-std::numeric_limits<float>::max());
+		for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+		{
+			const glm::vec3 p = readPosition(positions, vertexStride, mesh.vertices[meshlet.vertexOffset + i]);
+			aabbMin = glm::min(aabbMin, p);
+			aabbMax = glm::max(aabbMax, p);
+		}
+		bounds.center = 0.5f * (aabbMin + aabbMax);
+		for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+		{
+			const glm::vec3 p = readPosition(positions, vertexStride, mesh.vertices[meshlet.vertexOffset + i]);
+			bounds.radius = std::max(bounds.radius, glm::length(p - bounds.center));
+		}
+
+		// Normal cone: the axis is the average triangle normal, the spread is given by the normal furthest away from it
+		std::vector<glm::vec3> normals;
+		normals.reserve(meshlet.triangleCount);
+		glm::vec3 normalSum(0.0f);
+		for (uint32_t i = 0; i < meshlet.triangleCount; i++)
+		{
+			const uint8_t* triangle = &mesh.triangles[(meshlet.triangleOffset + i) * 3];
+			const glm::vec3 p0 = readPosition(positions, vertexStride, mesh.vertices[meshlet.vertexOffset + triangle[0]]);
+			const glm::vec3 p1 = readPosition(positions, vertexStride, mesh.vertices[meshlet.vertexOffset + triangle[1]]);
+			const glm::vec3 p2 = readPosition(positions, vertexStride, mesh.vertices[meshlet.vertexOffset + triangle[2]]);
+			const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			const float area = glm::length(normal);
+			// Degenerate triangles have no orientation and can't be backfacing
+			if (area > 0.0f)
+			{
+				normals.push_back(normal / area);
+				normalSum += normal / area;
+			}
+		}
+
+		bounds.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+		bounds.coneCutoff = 1.0f;
+		const float axisLength = glm::length(normalSum);
+		if (axisLength > 0.0f)
+		{
+			const glm::vec3 axis = normalSum / axisLength;
+			float minDot = 1.0f;
+			for (const glm::vec3& normal : normals)
+			{
+				minDot = std::min(minDot, glm::dot(normal, axis));
+			}
+			// Cones wider than ~84 degrees would (almost) never be culled, leave those at a cutoff of 1
+			if (minDot > 0.1f)
+			{
+				bounds.coneAxis = axis;
+				bounds.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+			}
+		}
+		return bounds;
+	}
+}
+
+
+bool MeshletMesh::save(const std::string& filename, uint64_t sourceHash) const
+{
+	std::ofstream file(filename, std::ios::binary | std::ios::out | std::ios::trunc);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	const MeshletCacheHeader header{ MESHLET_CACHE_MAGIC, MESHLET_CACHE_VERSION, sourceHash, static_cast<uint32_t>(meshlets.size()), static_cast<uint32_t>(vertices.size()), static_cast<uint32_t>(triangles.size()), 0 };
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(meshlets.data()), meshlets.size() * sizeof(Meshlet));
+	file.write(reinterpret_cast<const char*>(bounds.data()), bounds.size() * sizeof(MeshletBounds));
+	file.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(uint32_t));
+	file.write(reinterpret_cast<const char*>(triangles.data()), triangles.size());
+	return file.good();
+}
+
+bool MeshletMesh::load(const std::string& filename, uint64_t sourceHash, size_t meshVertexCount)
+{
+	std::ifstream file(filename, std::ios::binary | std::ios::in);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	MeshletCacheHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file.good() || header.magic != MESHLET_CACHE_MAGIC || header.version != MESHLET_CACHE_VERSION || header.sourceHash != sourceHash)
+	{
+		return false;
+	}
+
+	// The arrays are only allocated once the file is known to hold them
+	const std::streamoff dataStart = file.tellg();
+	file.seekg(0, std::ios::end);
+	const std::streamoff remaining = file.tellg() - dataStart;
+	file.seekg(dataStart);
+	const uint64_t dataSize = static_cast<uint64_t>(header.meshletCount) * (sizeof(Meshlet) + sizeof(MeshletBounds)) + static_cast<uint64_t>(header.vertexCount) * sizeof(uint32_t) + header.triangleByteCount;
+	if (!file.good() || dataSize > static_cast<uint64_t>(remaining))
+	{
+		return false;
+	}
+
+	meshlets.resize(header.meshletCount);
+	bounds.resize(header.meshletCount);
+	vertices.resize(header.vertexCount);
+	triangles.resize(header.triangleByteCount);
+	file.read(reinterpret_cast<char*>(meshlets.data()), meshlets.size() * sizeof(Meshlet));
+	file.read(reinterpret_cast<char*>(bounds.data()), bounds.size() * sizeof(MeshletBounds));
+	file.read(reinterpret_cast<char*>(vertices.data()), vertices.size() * sizeof(uint32_t));
+	file.read(reinterpret_cast<char*>(triangles.data()), triangles.size());
+	if (!file.good())
+	{
+		*this = {};
+		return false;
+	}
+
+	// The meshlets are copied into the geometry arena without further checks
+	bool valid = std::all_of(vertices.begin(), vertices.end(), [meshVertexCount](uint32_t vertex) { return vertex < meshVertexCount; });
+	for (const Meshlet& meshlet : meshlets)
+	{
+		if (!valid)
+		{
+			break;
+		}
+		valid = meshlet.vertexCount <= MESHLET_MAX_VERTICES && meshlet.triangleCount <= MESHLET_MAX_TRIANGLES
+			&& static_cast<uint64_t>(meshlet.vertexOffset) + meshlet.vertexCount <= vertices.size()
+			&& (static_cast<uint64_t>(meshlet.triangleOffset) + meshlet.triangleCount) * 3 <= triangles.size();
+		for (uint32_t i = 0; valid && i < meshlet.triangleCount * 3; i++)
+		{
+			valid = triangles[static_cast<size_t>(meshlet.triangleOffset) * 3 + i] < meshlet.vertexCount;
+		}
+	}
+	if (!valid)
+	{
+		*this = {};
+		return false;
+	}
+	return true;
+}
+
+
+MeshletMesh MeshletBuilder::build(const float* positions, size_t vertexStride, size_t vertexCount, const std::vector<uint32_t>& indices)
+{
+	MeshletMesh mesh;
+	const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	if (triangleCount == 0)
+	{
+		return mesh;
+	}
+
+	// Vertex -> triangle adjacency, the triangles using vertex v are adjacency[adjacencyOffsets[v]..adjacencyOffsets[v + 1]]
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (uint32_t index : indices)
+	{
+		adjacencyOffsets[index + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	}
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (uint32_t i = 0; i < indices.size(); i++)
+	{
+		adjacency[adjacencyFill[indices[i]]++] = i / 3;
+	}
+
+	std::vector<glm::vec3> triangleCenters(triangleCount);
+	for (uint32_t t = 0; t < triangleCount; t++)
+	{
+		triangleCenters[t] = (readPosition(positions, vertexStride, indices[t * 3 + 0]) + readPosition(positions, vertexStride, indices[t * 3 + 1]) + readPosition(positions, vertexStride, indices[t * 3 + 2])) / 3.0f;
+	}
+
+	std::vector<bool> emitted(triangleCount, false);
+	// Local index of a mesh vertex in the meshlet being built, only valid if localMeshlet[v] is the current meshlet's index
+	std::vector<uint32_t> localIndex(vertexCount, 0);
+	std::vector<uint32_t> localMeshlet(vertexCount, std::numeric_limits<uint32_t>::max());
+
+	Meshlet meshlet{};
+	glm::vec3 positionSum(0.0f);
+	uint32_t emittedCount = 0;
+	uint32_t nextSeed = 0;
+
+	auto newVertexCount = [&](uint32_t triangle) {
+		const uint32_t meshletIndex = static_cast<uint32_t>(mesh.meshlets.size());
+		uint32_t count = 0;
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			count += (localMeshlet[indices[triangle * 3 + corner]] != meshletIndex) ? 1 : 0;
+		}
+		return count;
+	};
+
+	auto addTriangle = [&](uint32_t triangle) {
+		const uint32_t meshletIndex = static_cast<uint32_t>(mesh.meshlets.size());
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			const uint32_t vertex = indices[triangle * 3 + corner];
+			if (localMeshlet[vertex] != meshletIndex)
+			{
+				localMeshlet[vertex] = meshletIndex;
+				localIndex[vertex] = meshlet.vertexCount++;
+				mesh.vertices.push_back(vertex);
+				positionSum += readPosition(positions, vertexStride, vertex);
+			}
+			mesh.triangles.push_back(static_cast<uint8_t>(localIndex[vertex]));
+		}
+		meshlet.triangleCount++;
+		emitted[triangle] = true;
+		emittedCount++;
+	};
+
+	auto finishMeshlet = [&]() {
+		mesh.meshlets.push_back(meshlet);
+		mesh.bounds.push_back(computeBounds(mesh, meshlet, positions, vertexStride));
+		meshlet = Meshlet{ static_cast<uint32_t>(mesh.vertices.size()), static_cast<uint32_t>(mesh.triangles.size() / 3), 0, 0 };
+		positionSum = glm::vec3(0.0f);
+	};
+
+	while (emittedCount < triangleCount)
+	{
+		// Best connected triangle: fewest new vertices, ties go to the one closest to the meshlet's center
+		uint32_t best = std::numeric_limits<uint32_t>::max();
+		uint32_t bestNewVertices = 4;
+		float bestDistance = std::numeric_limits<float>::max();
+		const glm::vec3 meshletCenter = positionSum / float(std::max(meshlet.vertexCount, 1u));
+		for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+		{
+			const uint32_t vertex = mesh.vertices[meshlet.vertexOffset + i];
+			for (uint32_t a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; a++)
+			{
+				const uint32_t triangle = adjacency[a];
+				if (emitted[triangle])
+				{
+					continue;
+				}
+				const uint32_t newVertices = newVertexCount(triangle);
+				if (meshlet.vertexCount + newVertices > MESHLET_MAX_VERTICES || newVertices > bestNewVertices)
+				{
+					continue;
+				}
+				const glm::vec3 offset = triangleCenters[triangle] - meshletCenter;
+				const float distance = glm::dot(offset, offset);
+				if (newVertices < bestNewVertices || distance < bestDistance)
+				{
+					best = triangle;
+					bestNewVertices = newVertices;
+					bestDistance = distance;
+				}
+			}
+		}
+
+		// Nothing connected fits, continue with the next unused triangle (this also starts every new meshlet)
+		if (best == std::numeric_limits<uint32_t>::max())
+		{
+			while (emitted[nextSeed])
+			{
+				nextSeed++;
+			}
+			if (meshlet.vertexCount + newVertexCount(nextSeed) <= MESHLET_MAX_VERTICES)
+			{
+				best = nextSeed;
+			}
+		}
+
+		if (best == std::numeric_limits<uint32_t>::max())
+		{
+			finishMeshlet();
+			continue;
+		}
+
+		addTriangle(best);
+		if (meshlet.triangleCount == MESHLET_MAX_TRIANGLES)
+		{
+			finishMeshlet();
+		}
+	}
+	if (meshlet.triangleCount > 0)
+	{
+		finishMeshlet();
+	}
+
+	return mesh;
+}
+
+MeshletMesh MeshletBuilder::loadOrBuild(const std::string& cacheFile, const float* positions, size_t vertexStride, size_t vertexCount, const std::vector<uint32_t>& indices)
+{
+	const uint64_t sourceHash = hashMesh(positions, vertexStride, vertexCount, indices);
+
+	MeshletMesh mesh;
+	if (mesh.load(cacheFile, sourceHash, vertexCount))
+	{
+		std::cout << "Meshlets: loaded " << mesh.meshlets.size() << " meshlets from \"" << cacheFile << "\"\n";
+		return mesh;
+	}
+
+	auto tStart = std::chrono::high_resolution_clock::now();
+	mesh = build(positions, vertexStride, vertexCount, indices);
+	auto tEnd = std::chrono::high_resolution_clock::now();
+	const double buildMs = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+
+	std::cout << "Meshlets: built " << mesh.meshlets.size() << " meshlets for " << indices.size() / 3 << " triangles in " << buildMs << " ms";
+	if (mesh.save(cacheFile, sourceHash))
+	{
+		std::cout << ", written to \"" << cacheFile << "\"";
+	}
+	std::cout << "\n";
+	return mesh;
+}
+
+// FNV-1a over the vertex positions and the indices
+uint64_t MeshletBuilder::hashMesh(const float* positions, size_t vertexStride, size_t vertexCount, const std::vector<uint32_t>& indices)
+{
+	uint64_t hash = 14695981039346656037ull;
+	auto hashBytes = [&hash](const void* data, size_t size) {
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		}
+	};
+
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		const glm::vec3 p = readPosition(positions, vertexStride, static_cast<uint32_t>(v));
+		hashBytes(&p, sizeof(p));
+	}
+	hashBytes(indices.data(), indices.size() * sizeof(uint32_t));
+	return hash;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+
+// Limits of a single meshlet, chosen to fit the common mesh shader output limits (and the NVIDIA recommendation of 64 / 124)
+constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// A meshlet (cluster) is a small group of connected triangles with its own local vertex list
+struct Meshlet {
+    uint32_t vertexOffset;      // First entry of the meshlet in MeshletMesh::vertices
+    uint32_t triangleOffset;    // First triangle of the meshlet in MeshletMesh::triangles (3 local indices per triangle)
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+};
+
+// Culling bounds of a meshlet in object space
+// The normal cone tests the whole meshlet for backfacing, it is invisible from a camera position p if
+//   dot(center - p, coneAxis) >= coneCutoff * length(center - p) + radius
+// coneCutoff is 1 for meshlets whose normals spread too far to ever be culled that way
+struct MeshletBounds {
+    glm::vec3 center;
+    float radius;
+    glm::vec3 coneAxis;
+    float coneCutoff;
+};
+
+// Meshlets of a single mesh
+struct MeshletMesh {
+    std::vector<Meshlet> meshlets;
+    std::vector<MeshletBounds> bounds;      // One entry per meshlet
+    std::vector<uint32_t> vertices;         // Meshlet local vertex -> mesh vertex index
+    std::vector<uint8_t> triangles;         // Meshlet local vertex indices, 3 per triangle
+
+    // Binary cache, sourceHash identifies the mesh the meshlets were built from (see MeshletBuilder::hashMesh)
+    bool save(const std::string& filename, uint64_t sourceHash) const;
+    // Fails for a file that is not a complete cache of the mesh, or whose meshlets reference vertices or triangles outside of the
+    // arrays, outside of the meshlet or beyond the meshVertexCount vertices of the mesh
+    bool load(const std::string& filename, uint64_t sourceHash, size_t meshVertexCount);
+};
+
+
+// Splits indexed triangle meshes into meshlets of at most MESHLET_MAX_VERTICES vertices and MESHLET_MAX_TRIANGLES triangles
+// Meshlets are grown greedily over the triangle adjacency, preferring triangles that add the fewest new vertices, so they stay compact
+// which keeps the vertex reuse high and the bounding spheres and normal cones tight
+class MeshletBuilder
+{
+public:
+    // positions points at the first vertex position (3 floats), consecutive positions are vertexStride bytes apart
+    static MeshletMesh build(const float* positions, size_t vertexStride, size_t vertexCount, const std::vector<uint32_t>& indices);
+
+    // Offline build: returns the meshlets stored in cacheFile if they were built from the same mesh,
+    // otherwise builds them at load and writes cacheFile so the next run can skip the build
+    static MeshletMesh loadOrBuild(const std::string& cacheFile, const float* positions, size_t vertexStride, size_t vertexCount, const std::vector<uint32_t>& indices);
+
+    static uint64_t hashMesh(const float* positions, size_t vertexStride, size_t vertexCount, const std::vector<uint32_t>& indices);
+};
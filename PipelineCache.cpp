@@ -0,0 +1,115 @@
+#include "PipelineCache.h"
+
+#include "VulkanBase/VulkanTools.h"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+
+void PipelineCache::create(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& filename)
+{
+	m_device = device;
+	m_properties = properties;
+	m_filename = filename;
+
+	std::string data;
+	std::ifstream file(filename, std::ios::binary | std::ios::in);
+	if (file.is_open())
+	{
+		data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+	m_warm = isCompatible(data);
+	if (!m_warm && !data.empty())
+	{
+		std::cout << "Pipeline cache \"" << filename << "\" was written by a different device or driver, it is rebuilt\n";
+	}
+
+	VkPipelineCacheCreateInfo pipelineCacheCI{};
+	pipelineCacheCI.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	pipelineCacheCI.initialDataSize = m_warm ? data.size() : 0;
+	pipelineCacheCI.pInitialData = m_warm ? data.data() : nullptr;
+	VK_CHECK_RESULT(vkCreatePipelineCache(m_device, &pipelineCacheCI, nullptr, &m_cache));
+	m_savedSize = pipelineCacheCI.initialDataSize;
+}
+
+void PipelineCache::destroy()
+{
+	if (m_cache != VK_NULL_HANDLE)
+	{
+		vkDestroyPipelineCache(m_device, m_cache, nullptr);
+		m_cache = VK_NULL_HANDLE;
+	}
+}
+
+bool PipelineCache::isCompatible(const std::string& data) const
+{
+	VkPipelineCacheHeaderVersionOne header{};
+	if (data.size() < sizeof(header))
+	{
+		return false;
+	}
+	memcpy(&header, data.data(), sizeof(header));
+	return header.headerSize >= sizeof(header) && header.headerSize <= data.size()
+		&& header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		&& header.vendorID == m_properties.vendorID
+		&& header.deviceID == m_properties.deviceID
+		&& memcmp(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+bool PipelineCache::save()
+{
+	size_t size = 0;
+	VK_CHECK_RESULT(vkGetPipelineCacheData(m_device, m_cache, &size, nullptr));
+	if (size == m_savedSize)
+	{
+		return true;
+	}
+	std::string data(size, '\0');
+	VK_CHECK_RESULT(vkGetPipelineCacheData(m_device, m_cache, &size, data.data()));
+	data.resize(size);
+
+	const std::string tempFilename = m_filename + ".tmp";
+	{
+		std::ofstream file(tempFilename, std::ios::binary | std::ios::out | std::ios::trunc);
+		file.write(data.data(), data.size());
+		if (!file.good())
+		{
+			std::cerr << "Error: Could not write the pipeline cache \"" << tempFilename << "\"" << std::endl;
+			return false;
+		}
+	}
+	// Replaces an existing cache file in one step
+	std::error_code error;
+	std::filesystem::rename(tempFilename, m_filename, error);
+	if (error)
+	{
+		std::cerr << "Error: Could not replace the pipeline cache \"" << m_filename << "\": " << error.message() << std::endl;
+		return false;
+	}
+	m_savedSize = size;
+	return true;
+}
+
+VkResult PipelineCache::createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline* pipeline)
+{
+	auto tStart = std::chrono::high_resolution_clock::now();
+	VkResult result = vkCreateGraphicsPipelines(m_device, m_cache, 1, &createInfo, nullptr, pipeline);
+	auto tEnd = std::chrono::high_resolution_clock::now();
+	m_creationNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(tEnd - tStart).count();
+	m_creationCount++;
+	return result;
+}
+
+VkResult PipelineCache::createComputePipeline(const VkComputePipelineCreateInfo& createInfo, VkPipeline* pipeline)
+{
+	auto tStart = std::chrono::high_resolution_clock::now();
+	VkResult result = vkCreateComputePipelines(m_device, m_cache, 1, &createInfo, nullptr, pipeline);
+	auto tEnd = std::chrono::high_resolution_clock::now();
+	m_creationNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(tEnd - tStart).count();
+	m_creationCount++;
+	return result;
+}
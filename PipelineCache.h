@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+#include "vulkan/vulkan.h"
+
+
+// VkPipelineCache that persists across runs
+// The cache data is loaded from a file at startup, so pipelines that were created in a previous run don't have to be compiled from SPIR-V again
+// The data is only used if its header matches the device (vendor and device ID) and the driver (pipeline cache UUID), a driver update invalidates it
+// The pipelines are created through this class, which measures the time spent on pipeline creation. Pipelines can be created on any thread
+class PipelineCache
+{
+public:
+    // Creates the cache, seeded with the data in filename if it is valid for the device described by properties
+    void create(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& filename);
+    void destroy();
+
+    // Writes the cache data to the file if it has changed since the last save, false on failure
+    // The data is written to a temporary file that then replaces the cache file, so an interrupted save never leaves a torn cache behind
+    bool save();
+
+    VkPipelineCache getHandle() const { return m_cache; }
+    // True if the cache was seeded with valid data from a previous run
+    bool isWarm() const { return m_warm; }
+
+    VkResult createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline* pipeline);
+    VkResult createComputePipeline(const VkComputePipelineCreateInfo& createInfo, VkPipeline* pipeline);
+
+    // Time spent in pipeline creation (summed over all threads) and the number of pipelines created so far
+    double getCreationMilliseconds() const { return m_creationNanoseconds.load() * 1e-6; }
+    uint32_t getCreationCount() const { return m_creationCount.load(); }
+
+private:
+    // True if data starts with a pipeline cache header written by the same device and driver
+    bool isCompatible(const std::string& data) const;
+
+    VkDevice m_device{ VK_NULL_HANDLE };
+    VkPhysicalDeviceProperties m_properties{};
+    VkPipelineCache m_cache{ VK_NULL_HANDLE };
+    std::string m_filename;
+    bool m_warm{ false };
+    size_t m_savedSize{ 0 };   // Size of the data at the last load or save, pipeline creation only ever adds data
+
+    std::atomic<uint64_t> m_creationNanoseconds{ 0 };
+    std::atomic<uint32_t> m_creationCount{ 0 };
+};
@@ -0,0 +1,219 @@
+#include "PipelineCompiler.h"
+#include "PipelineCache.h"
+#include "PipelineLibrary.h"
+
+#include "VulkanBase/VulkanTools.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+
+GraphicsPipelineDescription GraphicsPipelineDescription::fromCreateInfo(const VkGraphicsPipelineCreateInfo& createInfo)
+{
+	GraphicsPipelineDescription description;
+	description.shaderStages.assign(createInfo.pStages, createInfo.pStages + createInfo.stageCount);
+	for (VkPipelineShaderStageCreateInfo& shaderStage : description.shaderStages)
+	{
+		if (shaderStage.pSpecializationInfo != nullptr && description.specializationEntries.empty())
+		{
+			const VkSpecializationInfo& specializationInfo = *shaderStage.pSpecializationInfo;
+			description.specializationEntries.assign(specializationInfo.pMapEntries, specializationInfo.pMapEntries + specializationInfo.mapEntryCount);
+			description.specializationData.resize((specializationInfo.dataSize + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+			memcpy(description.specializationData.data(), specializationInfo.pData, specializationInfo.dataSize);
+		}
+		// Points into createInfo, the compiler points the stages at the copy
+		shaderStage.pSpecializationInfo = nullptr;
+	}
+	description.vertexInput = createInfo.pVertexInputState != nullptr;
+	if (description.vertexInput)
+	{
+		const VkPipelineVertexInputStateCreateInfo& vertexInputState = *createInfo.pVertexInputState;
+		description.vertexBindings.assign(vertexInputState.pVertexBindingDescriptions, vertexInputState.pVertexBindingDescriptions + vertexInputState.vertexBindingDescriptionCount);
+		description.vertexAttributes.assign(vertexInputState.pVertexAttributeDescriptions, vertexInputState.pVertexAttributeDescriptions + vertexInputState.vertexAttributeDescriptionCount);
+		description.inputAssembly = *createInfo.pInputAssemblyState;
+	}
+	description.rasterization = *createInfo.pRasterizationState;
+	description.multisample = *createInfo.pMultisampleState;
+	description.depthStencil = *createInfo.pDepthStencilState;
+	description.blendAttachments.assign(createInfo.pColorBlendState->pAttachments, createInfo.pColorBlendState->pAttachments + createInfo.pColorBlendState->attachmentCount);
+	description.viewportCount = createInfo.pViewportState->viewportCount;
+	description.scissorCount = createInfo.pViewportState->scissorCount;
+	if (createInfo.pDynamicState != nullptr)
+	{
+		description.dynamicStates.assign(createInfo.pDynamicState->pDynamicStates, createInfo.pDynamicState->pDynamicStates + createInfo.pDynamicState->dynamicStateCount);
+	}
+	description.layout = createInfo.layout;
+	description.renderPass = createInfo.renderPass;
+	description.subpass = createInfo.subpass;
+	return description;
+}
+
+
+GraphicsPipelineCreateInfo::GraphicsPipelineCreateInfo(const GraphicsPipelineDescription& description)
+{
+	vertexInputState.vertexBindingDescriptionCount = static_cast<uint32_t>(description.vertexBindings.size());
+	vertexInputState.pVertexBindingDescriptions = description.vertexBindings.data();
+	vertexInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(description.vertexAttributes.size());
+	vertexInputState.pVertexAttributeDescriptions = description.vertexAttributes.data();
+	colorBlendState.attachmentCount = static_cast<uint32_t>(description.blendAttachments.size());
+	colorBlendState.pAttachments = description.blendAttachments.data();
+	viewportState.viewportCount = description.viewportCount;
+	viewportState.scissorCount = description.scissorCount;
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(description.dynamicStates.size());
+	dynamicState.pDynamicStates = description.dynamicStates.data();
+	specializationInfo.mapEntryCount = static_cast<uint32_t>(description.specializationEntries.size());
+	specializationInfo.pMapEntries = description.specializationEntries.data();
+	specializationInfo.dataSize = description.specializationData.size() * sizeof(uint32_t);
+	specializationInfo.pData = description.specializationData.data();
+	shaderStages = description.shaderStages;
+	for (VkPipelineShaderStageCreateInfo& shaderStage : shaderStages)
+	{
+		shaderStage.pSpecializationInfo = description.specializationEntries.empty() ? nullptr : &specializationInfo;
+	}
+
+	createInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+	createInfo.pStages = shaderStages.data();
+	createInfo.pVertexInputState = description.vertexInput ? &vertexInputState : nullptr;
+	createInfo.pInputAssemblyState = description.vertexInput ? &description.inputAssembly : nullptr;
+	createInfo.pViewportState = &viewportState;
+	createInfo.pRasterizationState = &description.rasterization;
+	createInfo.pMultisampleState = &description.multisample;
+	createInfo.pDepthStencilState = &description.depthStencil;
+	createInfo.pColorBlendState = &colorBlendState;
+	createInfo.pDynamicState = &dynamicState;
+	createInfo.layout = description.layout;
+	createInfo.renderPass = description.renderPass;
+	createInfo.subpass = description.subpass;
+}
+
+void PipelineCompiler::start(VkDevice device, PipelineCache* pipelineCache, uint32_t threadCount)
+{
+	m_device = device;
+	m_pipelineCache = pipelineCache;
+	if (threadCount == 0)
+	{
+		threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+	}
+	m_stop = false;
+	m_threads.reserve(threadCount);
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		m_threads.emplace_back(&PipelineCompiler::workerLoop, this);
+	}
+}
+
+void PipelineCompiler::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_condition.notify_all();
+	for (std::thread& thread : m_threads)
+	{
+		thread.join();
+	}
+	m_threads.clear();
+}
+
+void PipelineCompiler::workerLoop()
+{
+	while (true)
+	{
+		std::packaged_task<VkPipeline()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			// The queue is drained before the threads stop, so no future is left without a value
+			m_condition.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+			if (m_queue.empty())
+			{
+				return;
+			}
+			task = std::move(m_queue.front());
+			m_queue.pop_front();
+		}
+		task();
+		m_pendingCount--;
+	}
+}
+
+std::shared_future<VkPipeline> PipelineCompiler::enqueue(std::packaged_task<VkPipeline()> task)
+{
+	std::shared_future<VkPipeline> future = task.get_future().share();
+	m_pendingCount++;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(std::move(task));
+	}
+	m_condition.notify_one();
+	return future;
+}
+
+std::shared_future<VkPipeline> PipelineCompiler::compile(GraphicsPipelineDescription description, std::shared_future<VkPipeline>* optimized)
+{
+	if (m_library != nullptr && optimized != nullptr)
+	{
+		// The parts don't depend on the shader modules anymore once they have been created, the optimized link only needs the parts
+		GraphicsPipelineDescription partsDescription = description;
+		for (VkPipelineShaderStageCreateInfo& shaderStage : partsDescription.shaderStages)
+		{
+			shaderStage.module = VK_NULL_HANDLE;
+		}
+
+		std::shared_future<VkPipeline> linked = enqueue(std::packaged_task<VkPipeline()>([this, description = std::move(description)]() {
+			VkPipeline pipeline{ VK_NULL_HANDLE };
+			const VkResult result = m_library->link(description, false, &pipeline);
+			for (const VkPipelineShaderStageCreateInfo& shaderStage : description.shaderStages)
+			{
+				vkDestroyShaderModule(m_device, shaderStage.module, nullptr);
+			}
+			if (result != VK_SUCCESS)
+			{
+				throw std::runtime_error("Could not link a graphics pipeline: " + vks::tools::errorString(result));
+			}
+			return pipeline;
+		}));
+		// Queued behind the fast link, which is running or done once a thread takes this task, so waiting for it can't block the queue
+		*optimized = enqueue(std::packaged_task<VkPipeline()>([this, linked, description = std::move(partsDescription)]() {
+			linked.get();
+			VkPipeline pipeline{ VK_NULL_HANDLE };
+			const VkResult result = m_library->link(description, true, &pipeline);
+			if (result != VK_SUCCESS)
+			{
+				throw std::runtime_error("Could not link an optimized graphics pipeline: " + vks::tools::errorString(result));
+			}
+			return pipeline;
+		}));
+		return linked;
+	}
+
+	return enqueue(std::packaged_task<VkPipeline()>([this, description = std::move(description)]() {
+		GraphicsPipelineCreateInfo pipelineCI(description);
+		VkPipeline pipeline{ VK_NULL_HANDLE };
+		const VkResult result = m_pipelineCache->createGraphicsPipeline(pipelineCI.createInfo, &pipeline);
+		for (const VkPipelineShaderStageCreateInfo& shaderStage : description.shaderStages)
+		{
+			vkDestroyShaderModule(m_device, shaderStage.module, nullptr);
+		}
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Could not create a graphics pipeline: " + vks::tools::errorString(result));
+		}
+		return pipeline;
+	}));
+}
+
+std::shared_future<VkPipeline> PipelineCompiler::compile(const VkComputePipelineCreateInfo& createInfo)
+{
+	return enqueue(std::packaged_task<VkPipeline()>([this, createInfo]() {
+		VkPipeline pipeline{ VK_NULL_HANDLE };
+		const VkResult result = m_pipelineCache->createComputePipeline(createInfo, &pipeline);
+		vkDestroyShaderModule(m_device, createInfo.stage.module, nullptr);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Could not create a compute pipeline: " + vks::tools::errorString(result));
+		}
+		return pipeline;
+	}));
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <atomic>
+#include <cstdint>
+
+#include "vulkan/vulkan.h"
+
+class PipelineCache;
+class PipelineLibrary;
+
+
+// Everything a graphics pipeline is created from, held by value so that it can be compiled later on another thread
+// The shader modules are owned by the description, the compiler destroys them once the pipeline has been created
+// Entry point names have to be string literals, pNext chains are not supported. All stages are specialized with the same constants
+struct GraphicsPipelineDescription {
+    std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+    bool vertexInput{ true };   // False for mesh shader pipelines, which have no vertex input and input assembly state
+    std::vector<VkVertexInputBindingDescription> vertexBindings;
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    VkPipelineRasterizationStateCreateInfo rasterization{};
+    VkPipelineMultisampleStateCreateInfo multisample{};
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    std::vector<VkPipelineColorBlendAttachmentState> blendAttachments;
+    uint32_t viewportCount{ 1 };
+    uint32_t scissorCount{ 1 };
+    std::vector<VkDynamicState> dynamicStates;
+    VkPipelineLayout layout{ VK_NULL_HANDLE };
+    VkRenderPass renderPass{ VK_NULL_HANDLE };
+    uint32_t subpass{ 0 };
+    // Specialization constants, the offsets of the entries are byte offsets into specializationData
+    std::vector<VkSpecializationMapEntry> specializationEntries;
+    std::vector<uint32_t> specializationData;
+    // Keys of the four parts of a graphics pipeline library (see PipelineLibrary::Part), pipelines with the same key for a part share it
+    std::array<uint64_t, 4> libraryKeys{};
+
+    // Copies the states createInfo points to, the specialization info of the first stage that has one is used for all stages
+    static GraphicsPipelineDescription fromCreateInfo(const VkGraphicsPipelineCreateInfo& createInfo);
+};
+
+// A create info pointing at the states of a description (and this struct, so it can't be copied), the opposite of fromCreateInfo
+struct GraphicsPipelineCreateInfo {
+    explicit GraphicsPipelineCreateInfo(const GraphicsPipelineDescription& description);
+    GraphicsPipelineCreateInfo(const GraphicsPipelineCreateInfo&) = delete;
+    GraphicsPipelineCreateInfo& operator=(const GraphicsPipelineCreateInfo&) = delete;
+
+    VkPipelineVertexInputStateCreateInfo vertexInputState{ VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+    VkPipelineColorBlendStateCreateInfo colorBlendState{ VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+    VkPipelineViewportStateCreateInfo viewportState{ VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+    VkPipelineDynamicStateCreateInfo dynamicState{ VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+    VkSpecializationInfo specializationInfo{};
+    std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+    VkGraphicsPipelineCreateInfo createInfo{ VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+};
+
+
+// Compiles pipelines on its own threads, so that pipeline creation doesn't block the thread that needs them
+// All threads create their pipelines through the same pipeline cache, VkPipelineCache is internally synchronized
+// Each request returns a future of the pipeline, the caller polls it and keeps drawing without the pipeline (or with a fallback) until it is ready
+// The compiled pipelines belong to the caller. Failed compilations throw std::runtime_error from the future's get
+class PipelineCompiler
+{
+public:
+    // threadCount 0 uses one thread per hardware thread but one (at least one)
+    void start(VkDevice device, PipelineCache* pipelineCache, uint32_t threadCount = 0);
+    // Finishes the queued compilations and stops the threads
+    void stop();
+
+    // With a pipeline library and optimized given, the returned pipeline is fast linked from the library parts of description and optimized
+    // receives the future of the same pipeline linked with link time optimization (compiled after it). Otherwise it is compiled as one pipeline
+    std::shared_future<VkPipeline> compile(GraphicsPipelineDescription description, std::shared_future<VkPipeline>* optimized = nullptr);
+    // The shader module of createInfo is destroyed once the pipeline has been created
+    std::shared_future<VkPipeline> compile(const VkComputePipelineCreateInfo& createInfo);
+
+    // Links the graphics pipelines from parts (see compile), must be set before the first compilation
+    void setPipelineLibrary(PipelineLibrary* library) { m_library = library; }
+    bool hasPipelineLibrary() const { return m_library != nullptr; }
+
+    uint32_t getThreadCount() const { return static_cast<uint32_t>(m_threads.size()); }
+    // Compilations that are queued or running
+    uint32_t getPendingCount() const { return m_pendingCount.load(); }
+
+private:
+    std::shared_future<VkPipeline> enqueue(std::packaged_task<VkPipeline()> task);
+    void workerLoop();
+
+    VkDevice m_device{ VK_NULL_HANDLE };
+    PipelineCache* m_pipelineCache{ nullptr };
+    PipelineLibrary* m_library{ nullptr };
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<std::packaged_task<VkPipeline()>> m_queue;
+    bool m_stop{ false };
+    std::atomic<uint32_t> m_pendingCount{ 0 };
+};
@@ -0,0 +1,170 @@
+#include "PipelineDynamicState.h"
+
+#include "VulkanBase/VulkanDevice.h"
+
+#include <type_traits>
+
+
+void PipelineDynamicState::VertexInput::set(const std::vector<VkVertexInputBindingDescription>& vertexBindings, const std::vector<VkVertexInputAttributeDescription>& vertexAttributes)
+{
+	bindings.clear();
+	attributes.clear();
+	for (const VkVertexInputBindingDescription& binding : vertexBindings)
+	{
+		bindings.push_back({ VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT, nullptr, binding.binding, binding.stride, binding.inputRate, 1 });
+	}
+	for (const VkVertexInputAttributeDescription& attribute : vertexAttributes)
+	{
+		attributes.push_back({ VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT, nullptr, attribute.location, attribute.binding, attribute.format, attribute.offset });
+	}
+}
+
+void PipelineDynamicState::enableFeatures(vks::VulkanDevice* device, std::vector<const char*>& extensions, void*& pNextChain)
+{
+	// Query the features of all supported extensions at once
+	VkPhysicalDeviceExtendedDynamicStateFeaturesEXT supportedExtendedDynamicStateFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT };
+	VkPhysicalDeviceExtendedDynamicState2FeaturesEXT supportedExtendedDynamicState2Features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT };
+	VkPhysicalDeviceExtendedDynamicState3FeaturesEXT supportedExtendedDynamicState3Features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT };
+	VkPhysicalDeviceVertexInputDynamicStateFeaturesEXT supportedVertexInputDynamicStateFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VERTEX_INPUT_DYNAMIC_STATE_FEATURES_EXT };
+	VkPhysicalDeviceFeatures2 deviceFeatures2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+	auto query = [&deviceFeatures2, device](const char* extension, void* features) {
+		if (device->extensionSupported(extension))
+		{
+			static_cast<VkBaseOutStructure*>(features)->pNext = static_cast<VkBaseOutStructure*>(deviceFeatures2.pNext);
+			deviceFeatures2.pNext = features;
+		}
+	};
+	query(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME, &supportedExtendedDynamicStateFeatures);
+	query(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME, &supportedExtendedDynamicState2Features);
+	query(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME, &supportedExtendedDynamicState3Features);
+	query(VK_EXT_VERTEX_INPUT_DYNAMIC_STATE_EXTENSION_NAME, &supportedVertexInputDynamicStateFeatures);
+	vkGetPhysicalDeviceFeatures2(device->physicalDevice, &deviceFeatures2);
+
+	auto enable = [&extensions, &pNextChain](const char* extension, void* features) {
+		extensions.push_back(extension);
+		static_cast<VkBaseOutStructure*>(features)->pNext = static_cast<VkBaseOutStructure*>(pNextChain);
+		pNextChain = features;
+	};
+	if (supportedExtendedDynamicStateFeatures.extendedDynamicState)
+	{
+		m_enabledExtendedDynamicStateFeatures.extendedDynamicState = VK_TRUE;
+		enable(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME, &m_enabledExtendedDynamicStateFeatures);
+		m_flags |= PIPELINE_DYNAMIC_STATE_CULL_MODE | PIPELINE_DYNAMIC_STATE_TOPOLOGY | PIPELINE_DYNAMIC_STATE_DEPTH;
+	}
+	if (supportedExtendedDynamicState2Features.extendedDynamicState2)
+	{
+		m_enabledExtendedDynamicState2Features.extendedDynamicState2 = VK_TRUE;
+		enable(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME, &m_enabledExtendedDynamicState2Features);
+		m_flags |= PIPELINE_DYNAMIC_STATE_RASTERIZER | PIPELINE_DYNAMIC_STATE_PRIMITIVE_RESTART;
+	}
+	// Extended dynamic state 3 has a feature per state
+	const bool polygonMode = supportedExtendedDynamicState3Features.extendedDynamicState3PolygonMode;
+	const bool colorBlend = supportedExtendedDynamicState3Features.extendedDynamicState3ColorBlendEnable && supportedExtendedDynamicState3Features.extendedDynamicState3ColorBlendEquation;
+	if (polygonMode || colorBlend)
+	{
+		m_enabledExtendedDynamicState3Features.extendedDynamicState3PolygonMode = polygonMode;
+		m_enabledExtendedDynamicState3Features.extendedDynamicState3ColorBlendEnable = colorBlend;
+		m_enabledExtendedDynamicState3Features.extendedDynamicState3ColorBlendEquation = colorBlend;
+		enable(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME, &m_enabledExtendedDynamicState3Features);
+		m_flags |= polygonMode ? PIPELINE_DYNAMIC_STATE_POLYGON_MODE : 0u;
+		m_flags |= colorBlend ? PIPELINE_DYNAMIC_STATE_COLOR_BLEND : 0u;
+	}
+	if (supportedVertexInputDynamicStateFeatures.vertexInputDynamicState)
+	{
+		m_enabledVertexInputDynamicStateFeatures.vertexInputDynamicState = VK_TRUE;
+		enable(VK_EXT_VERTEX_INPUT_DYNAMIC_STATE_EXTENSION_NAME, &m_enabledVertexInputDynamicStateFeatures);
+		m_flags |= PIPELINE_DYNAMIC_STATE_VERTEX_INPUT;
+	}
+}
+
+void PipelineDynamicState::init(VkDevice device)
+{
+	auto load = [device](auto& command, const char* name) {
+		command = reinterpret_cast<std::remove_reference_t<decltype(command)>>(vkGetDeviceProcAddr(device, name));
+	};
+	if (m_flags & (PIPELINE_DYNAMIC_STATE_CULL_MODE | PIPELINE_DYNAMIC_STATE_TOPOLOGY | PIPELINE_DYNAMIC_STATE_DEPTH))
+	{
+		load(m_vkCmdSetCullModeEXT, "vkCmdSetCullModeEXT");
+		load(m_vkCmdSetFrontFaceEXT, "vkCmdSetFrontFaceEXT");
+		load(m_vkCmdSetPrimitiveTopologyEXT, "vkCmdSetPrimitiveTopologyEXT");
+		load(m_vkCmdSetDepthTestEnableEXT, "vkCmdSetDepthTestEnableEXT");
+		load(m_vkCmdSetDepthWriteEnableEXT, "vkCmdSetDepthWriteEnableEXT");
+		load(m_vkCmdSetDepthCompareOpEXT, "vkCmdSetDepthCompareOpEXT");
+	}
+	if (m_flags & (PIPELINE_DYNAMIC_STATE_RASTERIZER | PIPELINE_DYNAMIC_STATE_PRIMITIVE_RESTART))
+	{
+		load(m_vkCmdSetDepthBiasEnableEXT, "vkCmdSetDepthBiasEnableEXT");
+		load(m_vkCmdSetRasterizerDiscardEnableEXT, "vkCmdSetRasterizerDiscardEnableEXT");
+		load(m_vkCmdSetPrimitiveRestartEnableEXT, "vkCmdSetPrimitiveRestartEnableEXT");
+	}
+	if (m_flags & PIPELINE_DYNAMIC_STATE_POLYGON_MODE)
+	{
+		load(m_vkCmdSetPolygonModeEXT, "vkCmdSetPolygonModeEXT");
+	}
+	if (m_flags & PIPELINE_DYNAMIC_STATE_COLOR_BLEND)
+	{
+		load(m_vkCmdSetColorBlendEnableEXT, "vkCmdSetColorBlendEnableEXT");
+		load(m_vkCmdSetColorBlendEquationEXT, "vkCmdSetColorBlendEquationEXT");
+	}
+	if (m_flags & PIPELINE_DYNAMIC_STATE_VERTEX_INPUT)
+	{
+		load(m_vkCmdSetVertexInputEXT, "vkCmdSetVertexInputEXT");
+	}
+}
+
+uint32_t PipelineDynamicState::record(VkCommandBuffer commandBuffer, const PipelineStateKey& key, PipelineDynamicStateFlags dynamicStates, const VertexInput& vertexInput) const
+{
+	uint32_t commandCount = 0;
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_CULL_MODE)
+	{
+		m_vkCmdSetCullModeEXT(commandBuffer, key.cullMode);
+		m_vkCmdSetFrontFaceEXT(commandBuffer, static_cast<VkFrontFace>(key.frontFace));
+		commandCount += 2;
+	}
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_TOPOLOGY)
+	{
+		m_vkCmdSetPrimitiveTopologyEXT(commandBuffer, static_cast<VkPrimitiveTopology>(key.topology));
+		commandCount++;
+	}
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_DEPTH)
+	{
+		m_vkCmdSetDepthTestEnableEXT(commandBuffer, key.depthTest);
+		m_vkCmdSetDepthWriteEnableEXT(commandBuffer, key.depthWrite);
+		m_vkCmdSetDepthCompareOpEXT(commandBuffer, static_cast<VkCompareOp>(key.depthCompareOp));
+		commandCount += 3;
+	}
+	// The key has no depth bias, rasterizer discard or primitive restart, they are always off as in the pipelines without the extension
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_RASTERIZER)
+	{
+		m_vkCmdSetDepthBiasEnableEXT(commandBuffer, VK_FALSE);
+		m_vkCmdSetRasterizerDiscardEnableEXT(commandBuffer, VK_FALSE);
+		commandCount += 2;
+	}
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_PRIMITIVE_RESTART)
+	{
+		m_vkCmdSetPrimitiveRestartEnableEXT(commandBuffer, VK_FALSE);
+		commandCount++;
+	}
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_POLYGON_MODE)
+	{
+		m_vkCmdSetPolygonModeEXT(commandBuffer, static_cast<VkPolygonMode>(key.polygonMode));
+		commandCount++;
+	}
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_COLOR_BLEND)
+	{
+		const VkPipelineColorBlendAttachmentState blendAttachmentState = PipelineRegistry::getBlendAttachmentState(key.blendMode);
+		const VkColorBlendEquationEXT blendEquation{
+			blendAttachmentState.srcColorBlendFactor, blendAttachmentState.dstColorBlendFactor, blendAttachmentState.colorBlendOp,
+			blendAttachmentState.srcAlphaBlendFactor, blendAttachmentState.dstAlphaBlendFactor, blendAttachmentState.alphaBlendOp,
+		};
+		m_vkCmdSetColorBlendEnableEXT(commandBuffer, 0, 1, &blendAttachmentState.blendEnable);
+		m_vkCmdSetColorBlendEquationEXT(commandBuffer, 0, 1, &blendEquation);
+		commandCount += 2;
+	}
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_VERTEX_INPUT)
+	{
+		m_vkCmdSetVertexInputEXT(commandBuffer, static_cast<uint32_t>(vertexInput.bindings.size()), vertexInput.bindings.data(), static_cast<uint32_t>(vertexInput.attributes.size()), vertexInput.attributes.data());
+		commandCount++;
+	}
+	return commandCount;
+}
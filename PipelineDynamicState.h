@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "vulkan/vulkan.h"
+
+#include "PipelineRegistry.h"
+
+namespace vks
+{
+    struct VulkanDevice;
+}
+
+
+// Pipeline states set in the command buffer instead of being baked into the pipelines
+// VK_EXT_extended_dynamic_state (cull mode, front face, topology, depth test), VK_EXT_extended_dynamic_state2 (depth bias, rasterizer discard and
+// primitive restart enables), VK_EXT_extended_dynamic_state3 (polygon mode, color blend) and VK_EXT_vertex_input_dynamic_state are enabled where
+// supported. The registry leaves these states out of the keys it registers the pipelines under (see PipelineRegistry::setDynamicStates), so keys
+// that only differ in them share one pipeline, and the renderer sets them from the full key whenever it binds a pipeline
+// The extensions are used through their EXT commands, they are only core from Vulkan 1.3 on (extended dynamic state 1 and 2)
+class PipelineDynamicState
+{
+public:
+    // Vertex input of a pipeline in the form of vkCmdSetVertexInputEXT
+    struct VertexInput {
+        std::vector<VkVertexInputBindingDescription2EXT> bindings;
+        std::vector<VkVertexInputAttributeDescription2EXT> attributes;
+
+        void set(const std::vector<VkVertexInputBindingDescription>& vertexBindings, const std::vector<VkVertexInputAttributeDescription>& vertexAttributes);
+    };
+
+    // Adds the supported extensions and chains their features into pNextChain, called before the device is created
+    void enableFeatures(vks::VulkanDevice* device, std::vector<const char*>& extensions, void*& pNextChain);
+    // Loads the commands of the enabled extensions, called after the device has been created
+    void init(VkDevice device);
+    PipelineDynamicStateFlags getFlags() const { return m_flags; }
+
+    // Records the states of key that are dynamic in its pipeline (see PipelineRegistry::getDynamicStates), returns the number of commands recorded
+    uint32_t record(VkCommandBuffer commandBuffer, const PipelineStateKey& key, PipelineDynamicStateFlags dynamicStates, const VertexInput& vertexInput) const;
+
+private:
+    PipelineDynamicStateFlags m_flags{ 0 };
+    VkPhysicalDeviceExtendedDynamicStateFeaturesEXT m_enabledExtendedDynamicStateFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT };
+    VkPhysicalDeviceExtendedDynamicState2FeaturesEXT m_enabledExtendedDynamicState2Features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT };
+    VkPhysicalDeviceExtendedDynamicState3FeaturesEXT m_enabledExtendedDynamicState3Features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT };
+    VkPhysicalDeviceVertexInputDynamicStateFeaturesEXT m_enabledVertexInputDynamicStateFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VERTEX_INPUT_DYNAMIC_STATE_FEATURES_EXT };
+
+    PFN_vkCmdSetCullModeEXT m_vkCmdSetCullModeEXT{ nullptr };
+    PFN_vkCmdSetFrontFaceEXT m_vkCmdSetFrontFaceEXT{ nullptr };
+    PFN_vkCmdSetPrimitiveTopologyEXT m_vkCmdSetPrimitiveTopologyEXT{ nullptr };
+    PFN_vkCmdSetDepthTestEnableEXT m_vkCmdSetDepthTestEnableEXT{ nullptr };
+    PFN_vkCmdSetDepthWriteEnableEXT m_vkCmdSetDepthWriteEnableEXT{ nullptr };
+    PFN_vkCmdSetDepthCompareOpEXT m_vkCmdSetDepthCompareOpEXT{ nullptr };
+    PFN_vkCmdSetDepthBiasEnableEXT m_vkCmdSetDepthBiasEnableEXT{ nullptr };
+    PFN_vkCmdSetRasterizerDiscardEnableEXT m_vkCmdSetRasterizerDiscardEnableEXT{ nullptr };
+    PFN_vkCmdSetPrimitiveRestartEnableEXT m_vkCmdSetPrimitiveRestartEnableEXT{ nullptr };
+    PFN_vkCmdSetPolygonModeEXT m_vkCmdSetPolygonModeEXT{ nullptr };
+    PFN_vkCmdSetColorBlendEnableEXT m_vkCmdSetColorBlendEnableEXT{ nullptr };
+    PFN_vkCmdSetColorBlendEquationEXT m_vkCmdSetColorBlendEquationEXT{ nullptr };
+    PFN_vkCmdSetVertexInputEXT m_vkCmdSetVertexInputEXT{ nullptr };
+};
@@ -0,0 +1,122 @@
+#include "PipelineLayoutCache.h"
+#include "ShaderReflection.h"
+
+#include "VulkanBase/VulkanTools.h"
+
+#include <algorithm>
+
+
+void PipelineLayoutCache::init(VkDevice device)
+{
+	m_device = device;
+}
+
+void PipelineLayoutCache::destroy()
+{
+	for (auto& [key, pipelineLayout] : m_pipelineLayouts)
+	{
+		vkDestroyPipelineLayout(m_device, pipelineLayout, nullptr);
+	}
+	for (auto& [key, setLayout] : m_setLayouts)
+	{
+		vkDestroyDescriptorSetLayout(m_device, setLayout, nullptr);
+	}
+	m_pipelineLayouts.clear();
+	m_setLayouts.clear();
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::getSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+	return getSetLayout(bindings, 0, {});
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::getSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings, VkDescriptorSetLayoutCreateFlags flags, const std::vector<VkDescriptorBindingFlags>& bindingFlags)
+{
+	assert(bindingFlags.empty() || bindingFlags.size() == bindings.size());
+	std::vector<uint64_t> key;
+	key.reserve(1 + bindings.size() * 4);
+	key.push_back(flags);
+	for (size_t i = 0; i < bindings.size(); i++)
+	{
+		const VkDescriptorSetLayoutBinding& binding = bindings[i];
+		key.push_back((static_cast<uint64_t>(binding.binding) << 32) | binding.descriptorType);
+		key.push_back((static_cast<uint64_t>(binding.descriptorCount) << 32) | binding.stageFlags);
+		key.push_back((uint64_t)binding.pImmutableSamplers);
+		key.push_back(bindingFlags.empty() ? 0 : bindingFlags[i]);
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_setLayouts.find(key);
+	if (it != m_setLayouts.end())
+	{
+		m_hitCount++;
+		return it->second;
+	}
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsCI{};
+	bindingFlagsCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	bindingFlagsCI.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+	bindingFlagsCI.pBindingFlags = bindingFlags.data();
+
+	VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
+	descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptorLayoutCI.pNext = bindingFlags.empty() ? nullptr : &bindingFlagsCI;
+	descriptorLayoutCI.flags = flags;
+	descriptorLayoutCI.bindingCount = static_cast<uint32_t>(bindings.size());
+	descriptorLayoutCI.pBindings = bindings.data();
+	VkDescriptorSetLayout setLayout;
+	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_device, &descriptorLayoutCI, nullptr, &setLayout));
+	m_setLayouts.emplace(std::move(key), setLayout);
+	return setLayout;
+}
+
+VkPipelineLayout PipelineLayoutCache::getPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges)
+{
+	std::vector<uint64_t> key;
+	key.reserve(1 + setLayouts.size() + pushConstantRanges.size() * 2);
+	key.push_back(setLayouts.size());
+	for (VkDescriptorSetLayout setLayout : setLayouts)
+	{
+		key.push_back((uint64_t)setLayout);
+	}
+	for (const VkPushConstantRange& range : pushConstantRanges)
+	{
+		key.push_back(range.stageFlags);
+		key.push_back((static_cast<uint64_t>(range.offset) << 32) | range.size);
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_pipelineLayouts.find(key);
+	if (it != m_pipelineLayouts.end())
+	{
+		m_hitCount++;
+		return it->second;
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCI{};
+	pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCI.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	pipelineLayoutCI.pSetLayouts = setLayouts.data();
+	pipelineLayoutCI.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+	pipelineLayoutCI.pPushConstantRanges = pushConstantRanges.data();
+	VkPipelineLayout pipelineLayout;
+	VK_CHECK_RESULT(vkCreatePipelineLayout(m_device, &pipelineLayoutCI, nullptr, &pipelineLayout));
+	m_pipelineLayouts.emplace(std::move(key), pipelineLayout);
+	return pipelineLayout;
+}
+
+VkPipelineLayout PipelineLayoutCache::getPipelineLayout(const std::vector<const ShaderReflection*>& stages, std::vector<VkDescriptorSetLayout>& setLayouts, uint32_t pushDescriptorSet)
+{
+	const uint32_t setCount = std::max(ShaderReflection::getSetCount(stages), static_cast<uint32_t>(setLayouts.size()));
+	setLayouts.resize(setCount, VK_NULL_HANDLE);
+	for (uint32_t set = 0; set < setCount; set++)
+	{
+		// Sets the stages don't use still need a (then empty) layout, the sets of a pipeline layout are numbered consecutively
+		if (setLayouts[set] == VK_NULL_HANDLE)
+		{
+			const VkDescriptorSetLayoutCreateFlags flags = (set == pushDescriptorSet) ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0;
+			setLayouts[set] = getSetLayout(ShaderReflection::mergeBindings(stages, set), flags, {});
+		}
+	}
+	return getPipelineLayout(setLayouts, ShaderReflection::mergePushConstants(stages));
+}
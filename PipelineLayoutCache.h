@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <cstdint>
+
+#include "vulkan/vulkan.h"
+
+struct ShaderReflection;
+
+
+// Creates every distinct descriptor set layout and pipeline layout once
+// Layouts are looked up by their definition, so pipelines whose shaders declare the same interface get the same handles. A descriptor set is only
+// compatible with the pipeline layouts it was allocated for (and those with an identically defined set layout at its set number), sharing the
+// handles keeps the descriptor sets bindable across all of them
+// The layouts are owned by the cache and destroyed with it. Layouts can be requested on any thread
+class PipelineLayoutCache
+{
+public:
+    void init(VkDevice device);
+    void destroy();
+
+    VkDescriptorSetLayout getSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+    // With layout create flags and per binding flags (VkDescriptorSetLayoutBindingFlagsCreateInfo), bindingFlags is empty or has one entry per binding
+    VkDescriptorSetLayout getSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings, VkDescriptorSetLayoutCreateFlags flags, const std::vector<VkDescriptorBindingFlags>& bindingFlags);
+    VkPipelineLayout getPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges);
+
+    // Pipeline layout of the reflected shader stages
+    // The non-null entries of setLayouts are used as they are (for sets shared with pipelines of other shaders), the other sets are created from the
+    // bindings of the stages. On return setLayouts holds the set layouts of the pipeline layout
+    // If pushDescriptorSet is given that set is created as push descriptor set (VK_KHR_push_descriptor, which has to be enabled): it is never
+    // allocated, its descriptors are recorded into the command buffer with vkCmdPushDescriptorSetKHR. A pipeline layout has at most one
+    VkPipelineLayout getPipelineLayout(const std::vector<const ShaderReflection*>& stages, std::vector<VkDescriptorSetLayout>& setLayouts, uint32_t pushDescriptorSet = NO_PUSH_DESCRIPTOR_SET);
+
+    static constexpr uint32_t NO_PUSH_DESCRIPTOR_SET = ~0u;
+
+    uint32_t getSetLayoutCount() const { return static_cast<uint32_t>(m_setLayouts.size()); }
+    uint32_t getPipelineLayoutCount() const { return static_cast<uint32_t>(m_pipelineLayouts.size()); }
+    // Requests that were served with an existing layout
+    uint32_t getHitCount() const { return m_hitCount; }
+
+private:
+    VkDevice m_device{ VK_NULL_HANDLE };
+    std::mutex m_mutex;
+    // Keyed by the create info contents flattened into 64 bit words
+    std::map<std::vector<uint64_t>, VkDescriptorSetLayout> m_setLayouts;
+    std::map<std::vector<uint64_t>, VkPipelineLayout> m_pipelineLayouts;
+    uint32_t m_hitCount{ 0 };
+};
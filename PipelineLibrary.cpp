@@ -0,0 +1,177 @@
+#include "PipelineLibrary.h"
+#include "PipelineCompiler.h"
+
+#include "VulkanBase/VulkanTools.h"
+
+#include <chrono>
+#include <stdexcept>
+
+
+void PipelineLibrary::init(VkDevice device, VkPipelineCache cache)
+{
+	m_device = device;
+	m_cache = cache;
+}
+
+void PipelineLibrary::destroy()
+{
+	for (auto& parts : m_parts)
+	{
+		for (auto& [key, part] : parts)
+		{
+			try
+			{
+				vkDestroyPipeline(m_device, part.get(), nullptr);
+			}
+			catch (const std::runtime_error&)
+			{
+			}
+		}
+		parts.clear();
+	}
+}
+
+VkResult PipelineLibrary::link(const GraphicsPipelineDescription& description, bool optimize, VkPipeline* pipeline)
+{
+	std::array<VkPipeline, PartCount> parts{};
+	uint32_t partCount = 0;
+	for (uint32_t part = 0; part < PartCount; part++)
+	{
+		// Mesh shader pipelines have no vertex input
+		if (part == VertexInput && !description.vertexInput)
+		{
+			continue;
+		}
+		try
+		{
+			parts[partCount++] = getPart(static_cast<Part>(part), description);
+		}
+		catch (const std::runtime_error&)
+		{
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+	}
+
+	VkPipelineLibraryCreateInfoKHR libraryCI{ VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR };
+	libraryCI.libraryCount = partCount;
+	libraryCI.pLibraries = parts.data();
+	VkGraphicsPipelineCreateInfo pipelineCI{ VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+	pipelineCI.pNext = &libraryCI;
+	pipelineCI.flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+	pipelineCI.layout = description.layout;
+
+	auto tStart = std::chrono::high_resolution_clock::now();
+	const VkResult result = vkCreateGraphicsPipelines(m_device, m_cache, 1, &pipelineCI, nullptr, pipeline);
+	auto tEnd = std::chrono::high_resolution_clock::now();
+	m_linkNanoseconds[optimize ? 1 : 0] += std::chrono::duration_cast<std::chrono::nanoseconds>(tEnd - tStart).count();
+	m_linkCounts[optimize ? 1 : 0]++;
+	return result;
+}
+
+VkPipeline PipelineLibrary::getPart(Part part, const GraphicsPipelineDescription& description)
+{
+	const uint64_t key = description.libraryKeys[part];
+	std::shared_future<VkPipeline> existing;
+	std::promise<VkPipeline> created;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_parts[part].find(key);
+		if (it != m_parts[part].end())
+		{
+			existing = it->second;
+		}
+		else
+		{
+			m_parts[part].emplace(key, created.get_future().share());
+		}
+	}
+	// The thread creating the part is already running, so this never waits for a queued compilation
+	if (existing.valid())
+	{
+		return existing.get();
+	}
+
+	VkPipeline pipeline{ VK_NULL_HANDLE };
+	const VkResult result = createPart(part, description, &pipeline);
+	if (result != VK_SUCCESS)
+	{
+		// Every pipeline using the part fails from now on, like a monolithic pipeline that fails to compile
+		const std::runtime_error error("Could not create a graphics pipeline library: " + vks::tools::errorString(result));
+		created.set_exception(std::make_exception_ptr(error));
+		throw error;
+	}
+	created.set_value(pipeline);
+	return pipeline;
+}
+
+VkResult PipelineLibrary::createPart(Part part, const GraphicsPipelineDescription& description, VkPipeline* pipeline)
+{
+	static constexpr VkGraphicsPipelineLibraryFlagsEXT partFlags[PartCount] = {
+		VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+		VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+		VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+		VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT,
+	};
+	VkGraphicsPipelineLibraryCreateInfoEXT libraryCI{ VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT };
+	libraryCI.flags = partFlags[part];
+
+	// Start from the complete create info and leave out the states of the other parts
+	GraphicsPipelineCreateInfo completeCI(description);
+	VkGraphicsPipelineCreateInfo pipelineCI{ VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+	pipelineCI.pNext = &libraryCI;
+	pipelineCI.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+	pipelineCI.pDynamicState = completeCI.createInfo.pDynamicState;
+	std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+	switch (part)
+	{
+	case VertexInput:
+		pipelineCI.pVertexInputState = completeCI.createInfo.pVertexInputState;
+		pipelineCI.pInputAssemblyState = completeCI.createInfo.pInputAssemblyState;
+		break;
+	case PreRasterization:
+		for (uint32_t i = 0; i < completeCI.createInfo.stageCount; i++)
+		{
+			if (completeCI.createInfo.pStages[i].stage != VK_SHADER_STAGE_FRAGMENT_BIT)
+			{
+				shaderStages.push_back(completeCI.createInfo.pStages[i]);
+			}
+		}
+		pipelineCI.pViewportState = completeCI.createInfo.pViewportState;
+		pipelineCI.pRasterizationState = completeCI.createInfo.pRasterizationState;
+		pipelineCI.layout = description.layout;
+		pipelineCI.renderPass = description.renderPass;
+		pipelineCI.subpass = description.subpass;
+		break;
+	case FragmentShader:
+		for (uint32_t i = 0; i < completeCI.createInfo.stageCount; i++)
+		{
+			if (completeCI.createInfo.pStages[i].stage == VK_SHADER_STAGE_FRAGMENT_BIT)
+			{
+				shaderStages.push_back(completeCI.createInfo.pStages[i]);
+			}
+		}
+		pipelineCI.pMultisampleState = completeCI.createInfo.pMultisampleState;
+		pipelineCI.pDepthStencilState = completeCI.createInfo.pDepthStencilState;
+		pipelineCI.layout = description.layout;
+		pipelineCI.renderPass = description.renderPass;
+		pipelineCI.subpass = description.subpass;
+		break;
+	case FragmentOutput:
+		pipelineCI.pMultisampleState = completeCI.createInfo.pMultisampleState;
+		pipelineCI.pColorBlendState = completeCI.createInfo.pColorBlendState;
+		pipelineCI.renderPass = description.renderPass;
+		pipelineCI.subpass = description.subpass;
+		break;
+	default:
+		break;
+	}
+	pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
+	pipelineCI.pStages = shaderStages.data();
+
+	auto tStart = std::chrono::high_resolution_clock::now();
+	const VkResult result = vkCreateGraphicsPipelines(m_device, m_cache, 1, &pipelineCI, nullptr, pipeline);
+	auto tEnd = std::chrono::high_resolution_clock::now();
+	m_partNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(tEnd - tStart).count();
+	m_partCount++;
+	return result;
+}
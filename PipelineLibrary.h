@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <unordered_map>
+#include <future>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#include "vulkan/vulkan.h"
+
+struct GraphicsPipelineDescription;
+
+
+// Graphics pipelines linked from precompiled parts (VK_EXT_graphics_pipeline_library)
+// A pipeline is split into its vertex input interface, pre-rasterization shaders, fragment shader and fragment output interface. Each part is
+// compiled once and shared by all pipelines with the same states for it (see GraphicsPipelineDescription::libraryKeys), so a new combination of
+// existing parts only has to be linked. A fast link skips the optimizations across the parts, which retain what is needed to link the same
+// pipeline again with link time optimization in the background, then it is as fast as a monolithic pipeline
+// Pipelines are linked on the pipeline compiler threads, a part needed by two threads at once is created by the first one
+class PipelineLibrary
+{
+public:
+    enum Part : uint32_t { VertexInput, PreRasterization, FragmentShader, FragmentOutput, PartCount };
+
+    void init(VkDevice device, VkPipelineCache cache);
+    // Destroys the parts, the pipelines linked from them stay valid
+    void destroy();
+
+    // Links the pipeline of description from its parts, the missing parts are created from its states and shader modules
+    // optimize links with link time optimization, which takes about as long as compiling a monolithic pipeline
+    VkResult link(const GraphicsPipelineDescription& description, bool optimize, VkPipeline* pipeline);
+
+    // Time spent creating parts and linking pipelines (summed over all threads)
+    uint32_t getPartCount() const { return m_partCount.load(); }
+    double getPartMilliseconds() const { return m_partNanoseconds.load() * 1e-6; }
+    uint32_t getLinkCount(bool optimized) const { return m_linkCounts[optimized ? 1 : 0].load(); }
+    double getLinkMilliseconds(bool optimized) const { return m_linkNanoseconds[optimized ? 1 : 0].load() * 1e-6; }
+
+private:
+    // Throws std::runtime_error if the part can't be created
+    VkPipeline getPart(Part part, const GraphicsPipelineDescription& description);
+    VkResult createPart(Part part, const GraphicsPipelineDescription& description, VkPipeline* pipeline);
+
+    VkDevice m_device{ VK_NULL_HANDLE };
+    VkPipelineCache m_cache{ VK_NULL_HANDLE };
+    std::mutex m_mutex;
+    std::array<std::unordered_map<uint64_t, std::shared_future<VkPipeline>>, PartCount> m_parts;
+
+    std::atomic<uint32_t> m_partCount{ 0 };
+    std::atomic<uint64_t> m_partNanoseconds{ 0 };
+    std::array<std::atomic<uint32_t>, 2> m_linkCounts{};            // Fast and optimized
+    std::array<std::atomic<uint64_t>, 2> m_linkNanoseconds{};
+};
@@ -0,0 +1,547 @@
+#include "PipelineRegistry.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+
+namespace
+{
+	constexpr uint32_t PIPELINE_KEYS_MAGIC = 0x59454b50;   // "PKEY"
+	constexpr uint32_t PIPELINE_KEYS_VERSION = 2;
+
+	struct PipelineKeysHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t shaderCount;
+		uint32_t keyCount;
+	};
+
+	constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+
+	// FNV-1a over the bytes of the key
+	uint64_t hashKey(const PipelineStateKey& key)
+	{
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&key);
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (size_t i = 0; i < sizeof(PipelineStateKey); i++)
+		{
+			hash = (hash ^ bytes[i]) * FNV_PRIME;
+		}
+		return hash;
+	}
+
+	// Switching the topology within its class (point, line, triangle or patch) is always possible with dynamic topology
+	VkPrimitiveTopology getTopologyClass(VkPrimitiveTopology topology)
+	{
+		switch (topology)
+		{
+		case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+			return VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+		case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+		case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+		case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+		case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+			return VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+		case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
+			return VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
+		default:
+			return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		}
+	}
+}
+
+
+size_t PipelineStateKeyHash::operator()(const PipelineStateKey& key) const
+{
+	return static_cast<size_t>(hashKey(key));
+}
+
+
+void PipelineRegistry::init(PipelineCompiler* compiler, Builder builder)
+{
+	m_compiler = compiler;
+	m_builder = std::move(builder);
+}
+
+void PipelineRegistry::destroy(VkDevice device)
+{
+	for (const OptimizingPipeline& optimizing : m_optimizing)
+	{
+		try
+		{
+			vkDestroyPipeline(device, optimizing.optimized.get(), nullptr);
+		}
+		catch (const std::runtime_error&)
+		{
+		}
+	}
+	m_optimizing.clear();
+	for (auto& [key, pipeline] : m_pipelines)
+	{
+		try
+		{
+			vkDestroyPipeline(device, pipeline.get(), nullptr);
+		}
+		catch (const std::runtime_error&)
+		{
+		}
+	}
+	m_pipelines.clear();
+}
+
+uint16_t PipelineRegistry::registerShader(const std::string& filename, VkShaderStageFlagBits stage)
+{
+	for (size_t i = 0; i < m_shaders.size(); i++)
+	{
+		if (m_shaders[i].filename == filename && m_shaders[i].stage == stage)
+		{
+			return static_cast<uint16_t>(i + 1);
+		}
+	}
+	m_shaders.push_back({ filename, stage });
+	return static_cast<uint16_t>(m_shaders.size());
+}
+
+PipelineDynamicStateFlags PipelineRegistry::getDynamicStates(const PipelineStateKey& key) const
+{
+	if (key.shaders[1] != 0 && getShaderStage(key.shaders[1]) == VK_SHADER_STAGE_MESH_BIT_EXT)
+	{
+		return m_dynamicStates & ~(PIPELINE_DYNAMIC_STATE_TOPOLOGY | PIPELINE_DYNAMIC_STATE_PRIMITIVE_RESTART | PIPELINE_DYNAMIC_STATE_VERTEX_INPUT);
+	}
+	return m_dynamicStates;
+}
+
+std::shared_future<VkPipeline> PipelineRegistry::request(const PipelineStateKey& key)
+{
+	const PipelineStateKey registeredKey = getRegisteredKey(key);
+	auto pipeline = m_pipelines.find(registeredKey);
+	if (pipeline != m_pipelines.end())
+	{
+		m_hitCount++;
+		return pipeline->second;
+	}
+
+	GraphicsPipelineDescription description = describe(registeredKey);
+	if (!m_builder(registeredKey, description))
+	{
+		return {};
+	}
+	m_missCount++;
+	std::shared_future<VkPipeline> optimized;
+	std::shared_future<VkPipeline> future = m_compiler->compile(std::move(description), &optimized);
+	if (optimized.valid())
+	{
+		m_optimizing.push_back({ registeredKey, optimized, false });
+	}
+	m_pipelines.emplace(registeredKey, future);
+	return future;
+}
+
+std::shared_future<VkPipeline> PipelineRegistry::rebuild(const PipelineStateKey& key)
+{
+	const PipelineStateKey registeredKey = getRegisteredKey(key);
+	GraphicsPipelineDescription description = describe(registeredKey);
+	if (!m_builder(registeredKey, description))
+	{
+		return {};
+	}
+	return m_compiler->compile(std::move(description));
+}
+
+VkPipeline PipelineRegistry::replace(const PipelineStateKey& key, VkPipeline pipeline)
+{
+	// The optimized version of the replaced pipeline would undo the replacement
+	const PipelineStateKey registeredKey = getRegisteredKey(key);
+	for (OptimizingPipeline& optimizing : m_optimizing)
+	{
+		optimizing.superseded |= optimizing.key == registeredKey;
+	}
+	return replacePipeline(registeredKey, pipeline);
+}
+
+VkPipeline PipelineRegistry::replacePipeline(const PipelineStateKey& key, VkPipeline pipeline)
+{
+	std::promise<VkPipeline> compiled;
+	compiled.set_value(pipeline);
+	std::shared_future<VkPipeline>& registered = m_pipelines[key];
+	const VkPipeline replaced = registered.valid() ? registered.get() : VK_NULL_HANDLE;
+	registered = compiled.get_future().share();
+	return replaced;
+}
+
+bool PipelineRegistry::usesShader(const PipelineStateKey& key, const std::string& filename) const
+{
+	for (uint16_t shader : key.shaders)
+	{
+		if (shader != 0 && getShaderName(shader) == filename)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void PipelineRegistry::invalidateShader(const std::string& filename)
+{
+	for (Shader& shader : m_shaders)
+	{
+		if (shader.filename == filename)
+		{
+			shader.version++;
+		}
+	}
+}
+
+std::vector<PipelineRegistry::OptimizedPipeline> PipelineRegistry::takeOptimizedPipelines()
+{
+	std::vector<OptimizedPipeline> optimizedPipelines;
+	auto done = std::remove_if(m_optimizing.begin(), m_optimizing.end(), [this, &optimizedPipelines](const OptimizingPipeline& optimizing) {
+		if (optimizing.optimized.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			return false;
+		}
+		VkPipeline pipeline;
+		try
+		{
+			pipeline = optimizing.optimized.get();
+		}
+		catch (const std::runtime_error& error)
+		{
+			// The fast linked pipeline stays in place
+			std::cerr << "Error: " << error.what() << std::endl;
+			return true;
+		}
+		if (optimizing.superseded)
+		{
+			optimizedPipelines.push_back({ optimizing.key, VK_NULL_HANDLE, pipeline });
+		}
+		else
+		{
+			optimizedPipelines.push_back({ optimizing.key, pipeline, replacePipeline(optimizing.key, pipeline) });
+		}
+		return true;
+	});
+	m_optimizing.erase(done, m_optimizing.end());
+	return optimizedPipelines;
+}
+
+PipelineStateKey PipelineRegistry::getRegisteredKey(const PipelineStateKey& key) const
+{
+	const PipelineDynamicStateFlags dynamicStates = getDynamicStates(key);
+	const PipelineStateKey defaults{};
+	PipelineStateKey registeredKey = key;
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_CULL_MODE)
+	{
+		registeredKey.cullMode = defaults.cullMode;
+		registeredKey.frontFace = defaults.frontFace;
+	}
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_TOPOLOGY)
+	{
+		registeredKey.topology = static_cast<uint8_t>(getTopologyClass(static_cast<VkPrimitiveTopology>(key.topology)));
+	}
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_DEPTH)
+	{
+		registeredKey.depthTest = defaults.depthTest;
+		registeredKey.depthWrite = defaults.depthWrite;
+		registeredKey.depthCompareOp = defaults.depthCompareOp;
+	}
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_POLYGON_MODE)
+	{
+		registeredKey.polygonMode = defaults.polygonMode;
+	}
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_COLOR_BLEND)
+	{
+		registeredKey.blendMode = defaults.blendMode;
+	}
+	return registeredKey;
+}
+
+GraphicsPipelineDescription PipelineRegistry::describe(const PipelineStateKey& key) const
+{
+	GraphicsPipelineDescription description;
+
+	// Input assembly state describes how primitives are assembled
+	description.inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	description.inputAssembly.topology = static_cast<VkPrimitiveTopology>(key.topology);
+
+	// Rasterization state
+	description.rasterization.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	description.rasterization.polygonMode = static_cast<VkPolygonMode>(key.polygonMode);
+	description.rasterization.cullMode = key.cullMode;
+	description.rasterization.frontFace = static_cast<VkFrontFace>(key.frontFace);
+	description.rasterization.depthClampEnable = VK_FALSE;
+	description.rasterization.rasterizerDiscardEnable = VK_FALSE;
+	description.rasterization.depthBiasEnable = VK_FALSE;
+	description.rasterization.lineWidth = 1.0f;
+
+	// Multi sampling state, the state must be set even without multi sampling
+	description.multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	description.multisample.rasterizationSamples = static_cast<VkSampleCountFlagBits>(key.sampleCount);
+
+	// Depth and stencil state containing depth and stencil compare and test operations, stencil isn't used
+	description.depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	description.depthStencil.depthTestEnable = key.depthTest;
+	description.depthStencil.depthWriteEnable = key.depthWrite;
+	description.depthStencil.depthCompareOp = static_cast<VkCompareOp>(key.depthCompareOp);
+	description.depthStencil.depthBoundsTestEnable = VK_FALSE;
+	description.depthStencil.back.failOp = VK_STENCIL_OP_KEEP;
+	description.depthStencil.back.passOp = VK_STENCIL_OP_KEEP;
+	description.depthStencil.back.compareOp = VK_COMPARE_OP_ALWAYS;
+	description.depthStencil.stencilTestEnable = VK_FALSE;
+	description.depthStencil.front = description.depthStencil.back;
+
+	// One blend attachment state for the single color attachment
+	description.blendAttachments.push_back(getBlendAttachmentState(key.blendMode));
+
+	// Viewport and scissor are dynamic states, set in the command buffer, as are the states of the extended dynamic state extensions in use
+	// (the values of the key for these are ignored, see getRegisteredKey)
+	description.viewportCount = 1;
+	description.scissorCount = 1;
+	description.dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	const PipelineDynamicStateFlags dynamicStates = getDynamicStates(key);
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_CULL_MODE)
+	{
+		description.dynamicStates.insert(description.dynamicStates.end(), { VK_DYNAMIC_STATE_CULL_MODE_EXT, VK_DYNAMIC_STATE_FRONT_FACE_EXT });
+	}
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_TOPOLOGY)
+	{
+		description.dynamicStates.push_back(VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT);
+	}
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_DEPTH)
+	{
+		description.dynamicStates.insert(description.dynamicStates.end(), { VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT, VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT, VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT });
+	}
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_RASTERIZER)
+	{
+		description.dynamicStates.insert(description.dynamicStates.end(), { VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE_EXT, VK_DYNAMIC_STATE_RASTERIZER_DISCARD_ENABLE_EXT });
+	}
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_PRIMITIVE_RESTART)
+	{
+		description.dynamicStates.push_back(VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE_EXT);
+	}
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_POLYGON_MODE)
+	{
+		description.dynamicStates.push_back(VK_DYNAMIC_STATE_POLYGON_MODE_EXT);
+	}
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_COLOR_BLEND)
+	{
+		description.dynamicStates.insert(description.dynamicStates.end(), { VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT, VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT });
+	}
+	if (dynamicStates & PIPELINE_DYNAMIC_STATE_VERTEX_INPUT)
+	{
+		// The vertex input state of the description is ignored
+		description.dynamicStates.push_back(VK_DYNAMIC_STATE_VERTEX_INPUT_EXT);
+	}
+
+	// Every specialization constant is 32 bits wide in SPIR-V (bool, int and uint)
+	for (uint32_t i = 0; i < key.specialization.size(); i++)
+	{
+		description.specializationEntries.push_back({ i, i * static_cast<uint32_t>(sizeof(uint32_t)), sizeof(uint32_t) });
+		description.specializationData.push_back(key.specialization[i]);
+	}
+
+	// The shader modules are loaded by the builder, it knows where the files are
+	for (uint16_t shader : key.shaders)
+	{
+		if (shader != 0)
+		{
+			VkPipelineShaderStageCreateInfo shaderStage{};
+			shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			shaderStage.stage = getShaderStage(shader);
+			shaderStage.pName = "main";
+			description.shaderStages.push_back(shaderStage);
+		}
+	}
+
+	for (uint32_t part = 0; part < PipelineLibrary::PartCount; part++)
+	{
+		description.libraryKeys[part] = getLibraryKey(key, static_cast<PipelineLibrary::Part>(part));
+	}
+	return description;
+}
+
+VkPipelineColorBlendAttachmentState PipelineRegistry::getBlendAttachmentState(PipelineBlendMode blendMode)
+{
+	VkPipelineColorBlendAttachmentState blendAttachmentState{};
+	blendAttachmentState.colorWriteMask = 0xf;
+	switch (blendMode)
+	{
+	case PipelineBlendMode::Opaque:
+		blendAttachmentState.blendEnable = VK_FALSE;
+		break;
+	case PipelineBlendMode::AlphaBlend:
+		blendAttachmentState.blendEnable = VK_TRUE;
+		blendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+		blendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		blendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
+		blendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
+		break;
+	case PipelineBlendMode::Additive:
+		blendAttachmentState.blendEnable = VK_TRUE;
+		blendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
+		blendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
+		break;
+	}
+	return blendAttachmentState;
+}
+
+uint64_t PipelineRegistry::getLibraryKey(const PipelineStateKey& key, PipelineLibrary::Part part) const
+{
+	// A key with only the states of the part, the render pass and the attachment formats go into all parts that depend on the render pass
+	// The vertex input depends on the vertex shader, which selects the attributes it reads (see the builder), unless it is dynamic
+	PipelineStateKey partKey{};
+	switch (part)
+	{
+	case PipelineLibrary::VertexInput:
+		partKey.shaders[0] = (getDynamicStates(key) & PIPELINE_DYNAMIC_STATE_VERTEX_INPUT) ? 0 : key.shaders[0];
+		partKey.vertexLayout = key.vertexLayout;
+		partKey.topology = key.topology;
+		break;
+	case PipelineLibrary::PreRasterization:
+		partKey.shaders = { key.shaders[0], key.shaders[1], 0 };
+		partKey.pipelineLayout = key.pipelineLayout;
+		partKey.polygonMode = key.polygonMode;
+		partKey.cullMode = key.cullMode;
+		partKey.frontFace = key.frontFace;
+		partKey.specialization = key.specialization;
+		break;
+	case PipelineLibrary::FragmentShader:
+		partKey.shaders[2] = key.shaders[2];
+		partKey.pipelineLayout = key.pipelineLayout;
+		partKey.depthTest = key.depthTest;
+		partKey.depthWrite = key.depthWrite;
+		partKey.depthCompareOp = key.depthCompareOp;
+		partKey.sampleCount = key.sampleCount;
+		partKey.specialization = key.specialization;
+		break;
+	case PipelineLibrary::FragmentOutput:
+		partKey.blendMode = key.blendMode;
+		partKey.sampleCount = key.sampleCount;
+		break;
+	default:
+		break;
+	}
+	if (part != PipelineLibrary::VertexInput)
+	{
+		partKey.renderPass = key.renderPass;
+		partKey.colorFormat = key.colorFormat;
+		partKey.depthFormat = key.depthFormat;
+	}
+
+	// The versions of the shaders keep parts built from replaced shader code apart
+	uint64_t hash = hashKey(partKey);
+	hash = (hash ^ part) * FNV_PRIME;
+	for (uint16_t shader : partKey.shaders)
+	{
+		hash = (hash ^ (shader != 0 ? m_shaders[shader - 1].version : 0)) * FNV_PRIME;
+	}
+	return hash;
+}
+
+bool PipelineRegistry::save(const std::string& filename) const
+{
+	std::ofstream file(filename, std::ios::binary | std::ios::out | std::ios::trunc);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	const PipelineKeysHeader header{ PIPELINE_KEYS_MAGIC, PIPELINE_KEYS_VERSION, static_cast<uint32_t>(m_shaders.size()), static_cast<uint32_t>(m_pipelines.size()) };
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	// Shader table: stage, name length, name
+	for (const Shader& shader : m_shaders)
+	{
+		const uint32_t stage = shader.stage;
+		const uint32_t length = static_cast<uint32_t>(shader.filename.size());
+		file.write(reinterpret_cast<const char*>(&stage), sizeof(stage));
+		file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+		file.write(shader.filename.data(), length);
+	}
+	for (const auto& [key, pipeline] : m_pipelines)
+	{
+		file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+	}
+	return file.good();
+}
+
+std::vector<PipelineStateKey> PipelineRegistry::load(const std::string& filename)
+{
+	std::ifstream file(filename, std::ios::binary | std::ios::in);
+	if (!file.is_open())
+	{
+		return {};
+	}
+
+	PipelineKeysHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file.good() || header.magic != PIPELINE_KEYS_MAGIC || header.version != PIPELINE_KEYS_VERSION)
+	{
+		return {};
+	}
+
+	// Shader ids are 16 bit
+	if (header.shaderCount > std::numeric_limits<uint16_t>::max())
+	{
+		return {};
+	}
+	// The shaders are only registered once the whole file has been read, a damaged file leaves the registry as it is
+	std::vector<Shader> shaders;
+	for (uint32_t i = 0; i < header.shaderCount; i++)
+	{
+		uint32_t stage = 0;
+		uint32_t length = 0;
+		file.read(reinterpret_cast<char*>(&stage), sizeof(stage));
+		file.read(reinterpret_cast<char*>(&length), sizeof(length));
+		if (!file.good() || length > 4096)
+		{
+			return {};
+		}
+		std::string name(length, '\0');
+		file.read(name.data(), length);
+		if (!file.good())
+		{
+			return {};
+		}
+		shaders.push_back({ std::move(name), static_cast<VkShaderStageFlagBits>(stage) });
+	}
+
+	// The key count has to fit into the rest of the file before anything is allocated for it
+	const std::streamoff keysStart = file.tellg();
+	file.seekg(0, std::ios::end);
+	const std::streamoff remaining = file.tellg() - keysStart;
+	file.seekg(keysStart);
+	if (!file.good() || static_cast<uint64_t>(header.keyCount) * sizeof(PipelineStateKey) > static_cast<uint64_t>(remaining))
+	{
+		return {};
+	}
+	std::vector<PipelineStateKey> keys(header.keyCount);
+	file.read(reinterpret_cast<char*>(keys.data()), keys.size() * sizeof(PipelineStateKey));
+	if (!file.good())
+	{
+		return {};
+	}
+
+	// The shader ids of the file are mapped to the ids of this registry
+	std::vector<uint16_t> shaderIds(shaders.size() + 1, 0);
+	for (size_t i = 0; i < shaders.size(); i++)
+	{
+		shaderIds[i + 1] = registerShader(shaders[i].filename, shaders[i].stage);
+	}
+	for (PipelineStateKey& key : keys)
+	{
+		for (uint16_t& shader : key.shaders)
+		{
+			shader = (shader <= header.shaderCount) ? shaderIds[shader] : 0;
+		}
+	}
+	return keys;
+}
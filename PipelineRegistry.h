@@ -0,0 +1,153 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <functional>
+#include <future>
+#include <type_traits>
+#include <cstdint>
+
+#include "vulkan/vulkan.h"
+
+#include "PipelineCompiler.h"
+#include "PipelineLibrary.h"
+
+
+enum class PipelineBlendMode : uint8_t { Opaque, AlphaBlend, Additive };
+
+// Compact description of a graphics pipeline: shaders, vertex layout, rasterization, depth, blend and attachment formats
+// Two requests with the same key get the same pipeline. The vertex layout, the pipeline layout and the render pass are ids defined by the renderer
+// (see PipelineRegistry::Builder). The key has no padding, so it can be hashed and compared bytewise and written to a file as is
+struct PipelineStateKey {
+    std::array<uint16_t, 3> shaders{};  // Shader ids of the registry (see PipelineRegistry::registerShader), 0 for unused stages
+    uint8_t vertexLayout{ 0 };
+    uint8_t pipelineLayout{ 0 };
+    uint8_t renderPass{ 0 };
+    uint8_t topology{ VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST };
+    uint8_t polygonMode{ VK_POLYGON_MODE_FILL };
+    uint8_t cullMode{ VK_CULL_MODE_NONE };
+    uint8_t frontFace{ VK_FRONT_FACE_COUNTER_CLOCKWISE };
+    uint8_t depthTest{ VK_TRUE };
+    uint8_t depthWrite{ VK_TRUE };
+    uint8_t depthCompareOp{ VK_COMPARE_OP_LESS_OR_EQUAL };
+    PipelineBlendMode blendMode{ PipelineBlendMode::Opaque };
+    uint8_t sampleCount{ VK_SAMPLE_COUNT_1_BIT };
+    // Values of the specialization constants 0 to 3 ([[vk::constant_id]]) of all stages, a shader ignores the constants it doesn't declare
+    std::array<uint8_t, 4> specialization{};
+    uint8_t reserved[2]{};
+    VkFormat colorFormat{ VK_FORMAT_UNDEFINED };
+    VkFormat depthFormat{ VK_FORMAT_UNDEFINED };
+
+    bool operator==(const PipelineStateKey& other) const = default;
+};
+static_assert(std::has_unique_object_representations_v<PipelineStateKey>, "PipelineStateKey must not contain padding");
+
+struct PipelineStateKeyHash {
+    size_t operator()(const PipelineStateKey& key) const;
+};
+
+// States of PipelineStateKey that are set in the command buffer instead of being baked into the pipelines (see PipelineDynamicState)
+enum PipelineDynamicStateBits : uint32_t {
+    PIPELINE_DYNAMIC_STATE_CULL_MODE = 0x1,         // Cull mode and front face (VK_EXT_extended_dynamic_state)
+    PIPELINE_DYNAMIC_STATE_TOPOLOGY = 0x2,          // Within the topology class of the pipeline (VK_EXT_extended_dynamic_state)
+    PIPELINE_DYNAMIC_STATE_DEPTH = 0x4,             // Depth test, write and compare op (VK_EXT_extended_dynamic_state)
+    PIPELINE_DYNAMIC_STATE_RASTERIZER = 0x8,        // Depth bias and rasterizer discard enables (VK_EXT_extended_dynamic_state2)
+    PIPELINE_DYNAMIC_STATE_PRIMITIVE_RESTART = 0x10,    // VK_EXT_extended_dynamic_state2
+    PIPELINE_DYNAMIC_STATE_POLYGON_MODE = 0x20,     // VK_EXT_extended_dynamic_state3
+    PIPELINE_DYNAMIC_STATE_COLOR_BLEND = 0x40,      // Blend enable and equation (VK_EXT_extended_dynamic_state3)
+    PIPELINE_DYNAMIC_STATE_VERTEX_INPUT = 0x80,     // VK_EXT_vertex_input_dynamic_state
+};
+using PipelineDynamicStateFlags = uint32_t;
+
+
+// Deduplicating registry of the graphics pipelines, keyed by PipelineStateKey
+// The first request of a key builds the pipeline's description from the key and queues it on the pipeline compiler (a miss),
+// every further request returns the same pipeline (a hit). The registry owns the pipelines
+// The keys can be written to a file and read at the next start to compile all pipelines before they are requested (pre-warming)
+// The dynamic states are left out of the keys the pipelines are registered under, so requests that only differ in them share one pipeline
+// With a pipeline library the compiler fast links the requested pipelines, their link time optimized versions replace them once compiled
+// (see takeOptimizedPipelines)
+// Not thread safe, used by the thread that renders
+class PipelineRegistry
+{
+public:
+    // Fills in the renderer defined parts of a description: shader modules, vertex input, pipeline layout and render pass
+    // Returns false if the key can't be built in the current configuration (e.g. a pre-warmed key of a disabled feature)
+    using Builder = std::function<bool(const PipelineStateKey& key, GraphicsPipelineDescription& description)>;
+
+    void init(PipelineCompiler* compiler, Builder builder);
+    // The states the renderer sets in the command buffer, must be set before the first request
+    void setDynamicStates(PipelineDynamicStateFlags dynamicStates) { m_dynamicStates = dynamicStates; }
+    // The dynamic states of the pipeline of key, mesh shader pipelines have no vertex input and input assembly state
+    PipelineDynamicStateFlags getDynamicStates(const PipelineStateKey& key) const;
+    // Blend state of the color attachment
+    static VkPipelineColorBlendAttachmentState getBlendAttachmentState(PipelineBlendMode blendMode);
+    // Destroys all pipelines, the compiler has to be stopped before
+    void destroy(VkDevice device);
+
+    // Id of a SPIR-V shader file for PipelineStateKey::shaders, registering the same file again returns the same id
+    uint16_t registerShader(const std::string& filename, VkShaderStageFlagBits stage);
+    const std::string& getShaderName(uint16_t shader) const { return m_shaders[shader - 1].filename; }
+    VkShaderStageFlagBits getShaderStage(uint16_t shader) const { return m_shaders[shader - 1].stage; }
+
+    // The pipeline of key, compiled on the first request. Not valid if the builder rejects the key
+    std::shared_future<VkPipeline> request(const PipelineStateKey& key);
+    // Compiles key again from the current shader files (shader hot reload), the registered pipeline stays in place until replace is called
+    // Not valid if the builder rejects the key
+    std::shared_future<VkPipeline> rebuild(const PipelineStateKey& key);
+    // Registers pipeline for key and returns the pipeline it replaces, which the caller has to destroy once no frame uses it anymore
+    VkPipeline replace(const PipelineStateKey& key, VkPipeline pipeline);
+    // True if one of the stages of key uses the shader file
+    bool usesShader(const PipelineStateKey& key, const std::string& filename) const;
+    // The shader file has changed, pipelines requested from now on don't share library parts with the ones built from the old code
+    void invalidateShader(const std::string& filename);
+
+    struct OptimizedPipeline {
+        PipelineStateKey key;
+        VkPipeline pipeline;        // VK_NULL_HANDLE if the fast linked pipeline has been replaced in the meantime
+        VkPipeline replaced;        // The caller has to destroy it once no frame uses it anymore
+    };
+    // The link time optimized pipelines compiled since the last call, they are registered in place of the fast linked ones
+    std::vector<OptimizedPipeline> takeOptimizedPipelines();
+    uint32_t getOptimizingCount() const { return static_cast<uint32_t>(m_optimizing.size()); }
+
+    uint32_t getPipelineCount() const { return static_cast<uint32_t>(m_pipelines.size()); }
+    uint64_t getHitCount() const { return m_hitCount; }
+    uint64_t getMissCount() const { return m_missCount; }
+
+    // Writes the keys of all pipelines (with the names of their shaders), false on failure
+    bool save(const std::string& filename) const;
+    // Reads the keys written by save, their shaders are registered with this registry
+    std::vector<PipelineStateKey> load(const std::string& filename);
+
+private:
+    // The key the pipeline of key is registered under, with the dynamic states set to their defaults
+    PipelineStateKey getRegisteredKey(const PipelineStateKey& key) const;
+    // The fixed function states of key
+    GraphicsPipelineDescription describe(const PipelineStateKey& key) const;
+    // Hash of the states of key that go into a part of the pipeline library
+    uint64_t getLibraryKey(const PipelineStateKey& key, PipelineLibrary::Part part) const;
+    VkPipeline replacePipeline(const PipelineStateKey& key, VkPipeline pipeline);
+
+    struct Shader {
+        std::string filename;
+        VkShaderStageFlagBits stage;
+        uint32_t version{ 0 };      // Incremented by invalidateShader
+    };
+    struct OptimizingPipeline {
+        PipelineStateKey key;
+        std::shared_future<VkPipeline> optimized;
+        bool superseded;            // The fast linked pipeline has been replaced
+    };
+
+    PipelineCompiler* m_compiler{ nullptr };
+    Builder m_builder;
+    PipelineDynamicStateFlags m_dynamicStates{ 0 };
+    std::vector<Shader> m_shaders;
+    std::unordered_map<PipelineStateKey, std::shared_future<VkPipeline>, PipelineStateKeyHash> m_pipelines;
+    std::vector<OptimizingPipeline> m_optimizing;
+    uint64_t m_hitCount{ 0 };
+    uint64_t m_missCount{ 0 };
+};
@@ -0,0 +1,209 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+
+uint64_t RenderQueue::makeKey(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth)
+{
+	// Negative depths (and NaN) sort first, like a depth of 0
+	uint32_t depthBits = 0;
+	if (depth > 0.0f)
+	{
+		memcpy(&depthBits, &depth, sizeof(depthBits));
+		depthBits >>= 31 - DEPTH_BITS;
+	}
+	auto field = [](uint32_t value, uint32_t bits) { return static_cast<uint64_t>(value) & ((1ull << bits) - 1); };
+	return (field(pipeline, PIPELINE_BITS) << (MATERIAL_BITS + MESH_BITS + DEPTH_BITS))
+		| (field(material, MATERIAL_BITS) << (MESH_BITS + DEPTH_BITS))
+		| (field(mesh, MESH_BITS) << DEPTH_BITS)
+		| field(depthBits, DEPTH_BITS);
+}
+
+void RenderQueue::clear()
+{
+	m_draws.clear();
+	m_entries.clear();
+	m_stats = {};
+}
+
+void RenderQueue::push(uint64_t key, const Draw& draw)
+{
+	// execute tracks the bound sets and vertex buffers in arrays of these sizes
+	if (draw.firstSet + draw.descriptorSetCount > MAX_DESCRIPTOR_SETS || draw.vertexBufferCount > MAX_VERTEX_BUFFERS)
+	{
+		throw std::runtime_error("A render queue draw binds " + std::to_string(draw.firstSet + draw.descriptorSetCount) + " descriptor sets and " + std::to_string(draw.vertexBufferCount)
+			+ " vertex buffers, the queue tracks up to " + std::to_string(MAX_DESCRIPTOR_SETS) + " and " + std::to_string(MAX_VERTEX_BUFFERS));
+	}
+	m_entries.push_back({ key, static_cast<uint32_t>(m_draws.size()) });
+	m_draws.push_back(draw);
+}
+
+void RenderQueue::sort()
+{
+	radixSort(m_entries, m_scratch);
+}
+
+void RenderQueue::radixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch)
+{
+	if (entries.size() < 2)
+	{
+		return;
+	}
+
+	// The histograms of all eight bytes are counted in a single pass over the keys
+	constexpr uint32_t byteCount = sizeof(uint64_t);
+	std::array<std::array<uint32_t, 256>, byteCount> histograms{};
+	for (const SortEntry& entry : entries)
+	{
+		for (uint32_t byte = 0; byte < byteCount; byte++)
+		{
+			histograms[byte][(entry.key >> (byte * 8)) & 0xff]++;
+		}
+	}
+
+	scratch.resize(entries.size());
+	const uint32_t count = static_cast<uint32_t>(entries.size());
+	for (uint32_t byte = 0; byte < byteCount; byte++)
+	{
+		// A byte all keys share (e.g. the pipeline of a pass that only has one) leaves the order as it is
+		std::array<uint32_t, 256>& histogram = histograms[byte];
+		if (histogram[(entries[0].key >> (byte * 8)) & 0xff] == count)
+		{
+			continue;
+		}
+		uint32_t offset = 0;
+		for (uint32_t& digitCount : histogram)
+		{
+			const uint32_t digitOffset = offset;
+			offset += digitCount;
+			digitCount = digitOffset;
+		}
+		for (const SortEntry& entry : entries)
+		{
+			scratch[histogram[(entry.key >> (byte * 8)) & 0xff]++] = entry;
+		}
+		entries.swap(scratch);
+	}
+}
+
+void RenderQueue::execute(VkCommandBuffer commandBuffer, const std::function<void(VkCommandBuffer, const VkPipeline*)>& bindPipeline)
+{
+	// Pipelines are compared by their handle members: members holding the same pipeline can still differ in the dynamic states set with it
+	const VkPipeline* boundPipeline{ nullptr };
+	VkPipelineLayout boundLayout{ VK_NULL_HANDLE };
+	std::array<VkDescriptorSet, MAX_DESCRIPTOR_SETS> boundDescriptorSets{};
+	uint32_t boundVertexBufferCount{ 0 };
+	std::array<VkBuffer, MAX_VERTEX_BUFFERS> boundVertexBuffers{};
+	VkBuffer boundIndexBuffer{ VK_NULL_HANDLE };
+	VkIndexType boundIndexType{ VK_INDEX_TYPE_UINT16 };
+
+	for (const SortEntry& entry : m_entries)
+	{
+		const Draw& draw = m_draws[entry.draw];
+
+		if (draw.pipeline != boundPipeline)
+		{
+			bindPipeline(commandBuffer, draw.pipeline);
+			boundPipeline = draw.pipeline;
+			m_stats.pipelineBinds++;
+		}
+		else
+		{
+			m_stats.pipelineBindsSkipped++;
+		}
+
+		// Sets bound with another pipeline layout are all treated as unbound, the layouts may not be compatible
+		if (draw.descriptorSetCount > 0)
+		{
+			if (draw.pipelineLayout != boundLayout)
+			{
+				boundDescriptorSets.fill(VK_NULL_HANDLE);
+				boundLayout = draw.pipelineLayout;
+			}
+			if (!std::equal(draw.descriptorSets.begin(), draw.descriptorSets.begin() + draw.descriptorSetCount, boundDescriptorSets.begin() + draw.firstSet))
+			{
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, draw.pipelineLayout, draw.firstSet, draw.descriptorSetCount, draw.descriptorSets.data(), 0, nullptr);
+				std::copy(draw.descriptorSets.begin(), draw.descriptorSets.begin() + draw.descriptorSetCount, boundDescriptorSets.begin() + draw.firstSet);
+				m_stats.descriptorSetBinds++;
+			}
+			else
+			{
+				m_stats.descriptorSetBindsSkipped++;
+			}
+		}
+
+		if (draw.vertexBufferCount != boundVertexBufferCount || !std::equal(draw.vertexBuffers.begin(), draw.vertexBuffers.begin() + draw.vertexBufferCount, boundVertexBuffers.begin()))
+		{
+			const std::array<VkDeviceSize, MAX_VERTEX_BUFFERS> offsets{};
+			vkCmdBindVertexBuffers(commandBuffer, 0, draw.vertexBufferCount, draw.vertexBuffers.data(), offsets.data());
+			boundVertexBuffers = draw.vertexBuffers;
+			boundVertexBufferCount = draw.vertexBufferCount;
+			m_stats.vertexBufferBinds++;
+		}
+		else
+		{
+			m_stats.vertexBufferBindsSkipped++;
+		}
+		if (draw.indexBuffer != boundIndexBuffer || draw.indexType != boundIndexType)
+		{
+			vkCmdBindIndexBuffer(commandBuffer, draw.indexBuffer, 0, draw.indexType);
+			boundIndexBuffer = draw.indexBuffer;
+			boundIndexType = draw.indexType;
+			m_stats.vertexBufferBinds++;
+		}
+		else
+		{
+			m_stats.vertexBufferBindsSkipped++;
+		}
+
+		vkCmdDrawIndexed(commandBuffer, draw.indexCount, draw.instanceCount, draw.firstIndex, draw.vertexOffset, draw.firstInstance);
+		m_stats.draws++;
+	}
+}
+
+void RenderQueue::runBenchmark(uint32_t count)
+{
+	// Keys of a typical scene: a few pipelines, a few hundred materials, a thousand meshes, depths up to 1000 units
+	std::mt19937 random(1234);
+	std::uniform_int_distribution<uint32_t> pipeline(0, 3);
+	std::uniform_int_distribution<uint32_t> material(0, 255);
+	std::uniform_int_distribution<uint32_t> mesh(0, 1023);
+	std::uniform_real_distribution<float> depth(0.0f, 1000.0f);
+	std::vector<SortEntry> keys(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		keys[i] = { makeKey(pipeline(random), material(random), mesh(random), depth(random)), i };
+	}
+
+	constexpr uint32_t iterations = 10;
+	std::vector<SortEntry> entries;
+	std::vector<SortEntry> scratch;
+	auto measure = [&](auto sortEntries) {
+		double bestNs = 1e30;
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			entries = keys;
+			auto tStart = std::chrono::high_resolution_clock::now();
+			sortEntries();
+			auto tEnd = std::chrono::high_resolution_clock::now();
+			bestNs = std::min(bestNs, std::chrono::duration<double, std::nano>(tEnd - tStart).count() / count);
+		}
+		return bestNs;
+	};
+
+	const double radixNs = measure([&]() { radixSort(entries, scratch); });
+	const std::vector<SortEntry> radixSorted = entries;
+	const double stdSortNs = measure([&]() {
+		std::stable_sort(entries.begin(), entries.end(), [](const SortEntry& a, const SortEntry& b) { return a.key < b.key; });
+	});
+	const bool match = std::equal(radixSorted.begin(), radixSorted.end(), entries.begin(), [](const SortEntry& a, const SortEntry& b) { return a.key == b.key && a.draw == b.draw; });
+
+	std::cout << "Render queue benchmark, " << count << " draw keys: radix sort " << radixNs << " ns/key, std::stable_sort " << stdSortNs << " ns/key ("
+		<< stdSortNs / radixNs << "x)" << (match ? "" : " (MISMATCH!)") << "\n";
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <functional>
+
+#include "vulkan/vulkan.h"
+
+
+// Draws of a pass collected with a 64-bit sort key, radix sorted and recorded in key order
+// The key packs (most significant first) the pipeline, the material, the mesh and the depth of a draw, so sorting groups the draws that share a
+// pipeline, then those that share descriptor sets and geometry, and orders draws of the same mesh front to back
+// The executor keeps track of what it has bound and only records a bind when it changes, the binds recorded and skipped are counted (see Stats)
+class RenderQueue
+{
+public:
+    static constexpr uint32_t MAX_DESCRIPTOR_SETS = 4;
+    static constexpr uint32_t MAX_VERTEX_BUFFERS = 2;
+
+    // Bits of the key fields, the pipeline and material are small ids the caller assigns, the mesh is its index in the geometry arena
+    static constexpr uint32_t PIPELINE_BITS = 8;
+    static constexpr uint32_t MATERIAL_BITS = 16;
+    static constexpr uint32_t MESH_BITS = 20;
+    static constexpr uint32_t DEPTH_BITS = 20;
+
+    // A draw and the state it is recorded with
+    struct Draw {
+        const VkPipeline* pipeline{ nullptr };  // Through the handle member, read when the queue is executed
+        VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
+        uint32_t firstSet{ 0 };
+        uint32_t descriptorSetCount{ 0 };
+        std::array<VkDescriptorSet, MAX_DESCRIPTOR_SETS> descriptorSets{};
+        uint32_t vertexBufferCount{ 0 };
+        std::array<VkBuffer, MAX_VERTEX_BUFFERS> vertexBuffers{};
+        VkBuffer indexBuffer{ VK_NULL_HANDLE };
+        VkIndexType indexType{ VK_INDEX_TYPE_UINT16 };
+        uint32_t indexCount{ 0 };
+        uint32_t instanceCount{ 0 };
+        uint32_t firstIndex{ 0 };
+        int32_t vertexOffset{ 0 };
+        uint32_t firstInstance{ 0 };
+    };
+
+    // Binds recorded and skipped (the state was already bound) by execute, since the last clear
+    struct Stats {
+        uint32_t draws{ 0 };
+        uint32_t pipelineBinds{ 0 };
+        uint32_t pipelineBindsSkipped{ 0 };
+        uint32_t descriptorSetBinds{ 0 };
+        uint32_t descriptorSetBindsSkipped{ 0 };
+        uint32_t vertexBufferBinds{ 0 };        // Index buffer binds included
+        uint32_t vertexBufferBindsSkipped{ 0 };
+    };
+
+    // Sort key of a draw, the fields are truncated to their bits
+    // depth is any non-negative view distance (or squared distance), its float bits are monotonic so the top DEPTH_BITS of them are used as they are
+    static uint64_t makeKey(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+
+    // Drops the draws and the stats, keeps the memory for the next frame
+    void clear();
+    // Throws if firstSet + descriptorSetCount of draw exceeds MAX_DESCRIPTOR_SETS or vertexBufferCount exceeds MAX_VERTEX_BUFFERS
+    void push(uint64_t key, const Draw& draw);
+    // LSD radix sort of the keys, 8 bits per pass, passes over bytes all keys share are skipped. Draws with equal keys keep their order
+    void sort();
+    // Records the draws in sorted order, nothing is assumed to be bound before. bindPipeline records the bind of a pipeline (so the caller can
+    // set the pipeline's dynamic states along with it), it is only called when the pipeline changes
+    void execute(VkCommandBuffer commandBuffer, const std::function<void(VkCommandBuffer, const VkPipeline*)>& bindPipeline);
+
+    uint32_t getDrawCount() const { return static_cast<uint32_t>(m_draws.size()); }
+    const Stats& getStats() const { return m_stats; }
+
+    // Sorts count random draw keys with the radix sort and with std::stable_sort and logs the time per key of both
+    static void runBenchmark(uint32_t count = 1000000);
+
+private:
+    struct SortEntry {
+        uint64_t key;
+        uint32_t draw;
+    };
+
+    static void radixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch);
+
+    std::vector<Draw> m_draws;
+    std::vector<SortEntry> m_entries;
+    std::vector<SortEntry> m_scratch;   // Ping-pong buffer of the radix sort
+    Stats m_stats;
+};
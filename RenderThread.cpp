@@ -0,0 +1,222 @@
+#include "RenderThread.h"
+#include "VulkanRender.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+
+void RenderThread::start(VulkanRender* renderer)
+{
+	m_renderer = renderer;
+	m_thread = std::thread(&RenderThread::run, this);
+}
+
+void RenderThread::stop()
+{
+	if (!m_thread.joinable())
+	{
+		return;
+	}
+	// The quit event must not get lost, the render thread empties the queue every frame
+	while (!m_events.push(RenderEvent{ .type = RenderEvent::Type::Quit }))
+	{
+		std::this_thread::yield();
+	}
+	m_thread.join();
+}
+
+void RenderThread::recordTimesteps(const std::string& filename)
+{
+	m_timestepMode = TimestepMode::Record;
+	m_recordingFile = filename;
+	m_recording.timesteps.clear();
+}
+
+bool RenderThread::replayTimesteps(const std::string& filename, std::function<void()> finished)
+{
+	if (!m_recording.load(filename) || m_recording.timesteps.empty())
+	{
+		std::cerr << "Error: Could not load the timestep recording \"" << filename << "\"" << std::endl;
+		return false;
+	}
+	m_timestepMode = TimestepMode::Replay;
+	m_replaySimulation = Simulation();
+	m_replayPosition = 0;
+	m_replayFrameTimes.clear();
+	m_replayFrameTimes.reserve(m_recording.timesteps.size());
+	m_replayFinished = std::move(finished);
+	return true;
+}
+
+void RenderThread::handleKey(uint32_t key)
+{
+	switch (key)
+	{
+	case 'L':
+		m_renderer->SetLevelOfDetail(!m_renderer->GetLevelOfDetail());
+		std::cout << "Level of detail " << (m_renderer->GetLevelOfDetail() ? "on" : "off") << std::endl;
+		break;
+	// Shader variants: "S" toggles specular lighting, "1" to "4" set the light count, "N" toggles flat normals and "V" cycles the debug views
+	case 'S':
+	case 'N':
+	case 'V':
+	case '1':
+	case '2':
+	case '3':
+	case '4':
+	{
+		ShaderVariant variant = m_renderer->GetShaderVariant();
+		if (key == 'S')
+		{
+			variant.specular = !variant.specular;
+		}
+		else if (key == 'N')
+		{
+			variant.normalMode = (variant.normalMode == ShaderNormalMode::Vertex) ? ShaderNormalMode::Flat : ShaderNormalMode::Vertex;
+		}
+		else if (key == 'V')
+		{
+			variant.debugView = static_cast<ShaderDebugView>((static_cast<uint32_t>(variant.debugView) + 1) % 3);
+		}
+		else
+		{
+			variant.lightCount = static_cast<uint8_t>(key - '0');
+		}
+		m_renderer->SetShaderVariant(variant);
+		std::cout << "Shader variant: specular " << (variant.specular ? "on" : "off") << ", " << static_cast<uint32_t>(variant.lightCount) << " lights, "
+			<< (variant.normalMode == ShaderNormalMode::Flat ? "flat" : "vertex") << " normals, debug view " << static_cast<uint32_t>(variant.debugView) << std::endl;
+		break;
+	}
+	// Render states: "W" toggles wireframe, "C" toggles back face culling
+	case 'W':
+	case 'C':
+	{
+		SceneRenderState renderState = m_renderer->GetSceneRenderState();
+		if (key == 'W')
+		{
+			renderState.wireframe = !renderState.wireframe;
+		}
+		else
+		{
+			renderState.backfaceCulling = !renderState.backfaceCulling;
+		}
+		m_renderer->SetSceneRenderState(renderState);
+		std::cout << "Render state: wireframe " << (renderState.wireframe ? "on" : "off") << ", back face culling " << (renderState.backfaceCulling ? "on" : "off") << std::endl;
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+void RenderThread::run()
+{
+	auto lastTimestamp = std::chrono::high_resolution_clock::now();
+	bool minimized = false;
+
+	while (true)
+	{
+		// Drain all events posted since the last frame, of several resizes (e.g. while dragging the window border) only the last one matters
+		bool resize = false;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		RenderEvent event;
+		while (m_events.pop(event))
+		{
+			switch (event.type)
+			{
+			case RenderEvent::Type::Resize:
+				resize = true;
+				width = event.width;
+				height = event.height;
+				break;
+			case RenderEvent::Type::KeyDown:
+				handleKey(event.key);
+				break;
+			case RenderEvent::Type::Quit:
+				// Finalize (on the message thread) waits for the device to become idle
+				if (m_timestepMode == TimestepMode::Record)
+				{
+					if (m_recording.save(m_recordingFile))
+					{
+						std::cout << "Recorded " << m_recording.timesteps.size() << " timesteps to \"" << m_recordingFile << "\"" << std::endl;
+					}
+					else
+					{
+						std::cerr << "Error: Could not write the timestep recording \"" << m_recordingFile << "\"" << std::endl;
+					}
+				}
+				return;
+			}
+		}
+
+		if (resize)
+		{
+			minimized = (width == 0) || (height == 0);
+			if (!minimized)
+			{
+				m_renderer->HandleWindowResize(width, height);
+			}
+		}
+
+		auto tNow = std::chrono::high_resolution_clock::now();
+		const bool replayDone = (m_timestepMode == TimestepMode::Replay) && (m_replayPosition == m_recording.timesteps.size());
+		if (minimized || replayDone || !m_renderer->IsPrepared())
+		{
+			// Nothing to present to, check for events again in a moment
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			lastTimestamp = tNow;
+			continue;
+		}
+
+		float deltaTime = std::chrono::duration<float>(tNow - lastTimestamp).count();
+		lastTimestamp = tNow;
+
+		if (m_timestepMode == TimestepMode::Replay)
+		{
+			if (!replayFrame(deltaTime))
+			{
+				m_replayFinished();
+			}
+			continue;
+		}
+		if (m_timestepMode == TimestepMode::Record)
+		{
+			m_recording.timesteps.push_back(deltaTime);
+		}
+
+		// The most recently published simulation state, or the previous one again if the simulation hasn't stepped since the last frame,
+		// interpolated to the time of this frame
+		m_snapshots.update();
+		m_renderer->RenderFrame(deltaTime, m_snapshots.readBuffer().advancedTo(std::chrono::high_resolution_clock::now()));
+	}
+}
+
+bool RenderThread::replayFrame(float deltaTime)
+{
+	// The simulated time comes from the recording, the frame time itself is measured
+	m_replaySimulation.advance(m_recording.timesteps[m_replayPosition++]);
+
+	auto tStart = std::chrono::high_resolution_clock::now();
+	m_renderer->RenderFrame(deltaTime, m_replaySimulation.getSnapshot());
+	auto tEnd = std::chrono::high_resolution_clock::now();
+	m_replayFrameTimes.push_back(std::chrono::duration<float, std::milli>(tEnd - tStart).count());
+
+	if (m_replayPosition < m_recording.timesteps.size())
+	{
+		return true;
+	}
+
+	std::vector<float> sorted = m_replayFrameTimes;
+	std::sort(sorted.begin(), sorted.end());
+	double totalMs = 0.0;
+	for (float ms : sorted)
+	{
+		totalMs += ms;
+	}
+	auto percentile = [&sorted](double p) { return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))]; };
+	std::cout << "Replayed " << sorted.size() << " frames (" << m_replaySimulation.getSnapshot().current.step << " simulation steps):"
+		<< " average " << totalMs / sorted.size() << " ms, median " << percentile(0.5) << " ms, 99th percentile " << percentile(0.99) << " ms, max " << sorted.back() << " ms" << std::endl;
+	return false;
+}
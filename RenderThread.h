@@ -0,0 +1,153 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <functional>
+#include <cstdint>
+
+#include "Simulation.h"
+
+class VulkanRender;
+
+
+// Window events forwarded from the message thread to the render thread
+struct RenderEvent {
+    enum class Type : uint32_t { Resize, KeyDown, Quit };
+
+    Type type{ Type::Quit };
+    uint32_t width{ 0 };    // Resize: new client area size, 0 while minimized
+    uint32_t height{ 0 };
+    uint32_t key{ 0 };      // KeyDown: virtual key code
+};
+
+
+// Lock free ring buffer for exactly one producer and one consumer thread
+// Each side only writes its own index, the release store publishes the slot it just filled or emptied to the other side
+template <typename T, uint32_t Capacity>
+class EventQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+
+public:
+    // Producer side, false if the queue is full
+    bool push(const T& value)
+    {
+        const uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == Capacity)
+        {
+            return false;
+        }
+        m_items[head & (Capacity - 1)] = value;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, false if the queue is empty
+    bool pop(T& value)
+    {
+        const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (m_head.load(std::memory_order_acquire) == tail)
+        {
+            return false;
+        }
+        value = m_items[tail & (Capacity - 1)];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::array<T, Capacity> m_items{};
+    // On separate cache lines, as they are written by different threads
+    alignas(64) std::atomic<uint32_t> m_head{ 0 };  // Next slot to write, only written by the producer
+    alignas(64) std::atomic<uint32_t> m_tail{ 0 };  // Next slot to read, only written by the consumer
+};
+
+
+// Hands the latest state from one producer to one consumer thread without either of them ever waiting
+// The producer fills its write buffer and swaps it with the shared one, the consumer swaps its read buffer with the shared one if that holds newer data
+// States published in between two updates of the consumer are skipped, the consumer keeps the last one if nothing new was published
+template <typename T>
+class TripleBuffer
+{
+public:
+    // Producer side
+    T& writeBuffer() { return m_buffers[m_writeIndex]; }
+    void publish()
+    {
+        m_writeIndex = m_shared.exchange(m_writeIndex | NEW_DATA, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Consumer side, true if a newer state was published since the last update
+    bool update()
+    {
+        if ((m_shared.load(std::memory_order_relaxed) & NEW_DATA) == 0)
+        {
+            return false;
+        }
+        m_readIndex = m_shared.exchange(m_readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+    const T& readBuffer() const { return m_buffers[m_readIndex]; }
+
+private:
+    static constexpr uint32_t INDEX_MASK = 0x3;
+    static constexpr uint32_t NEW_DATA = 0x4;
+
+    std::array<T, 3> m_buffers{};
+    uint32_t m_writeIndex{ 0 };
+    uint32_t m_readIndex{ 1 };
+    // Index of the buffer owned by neither side, NEW_DATA is set if the producer published it after the consumer's last swap
+    alignas(64) std::atomic<uint32_t> m_shared{ 2 };
+};
+
+
+// Renders on its own thread, decoupled from the Win32 message pump
+// The message thread posts resize, input and quit events and publishes simulation snapshots, the render thread drains the events
+// before each frame and renders the latest snapshot. Neither side blocks the other: a modal resize or move loop on the message thread
+// doesn't stall rendering and a long frame doesn't stall message processing
+// For benchmarks the time between frames can be recorded, and a recording replayed instead of rendering the published snapshots
+class RenderThread
+{
+public:
+    // Starts rendering with an initialized renderer, which is only used by the render thread until stop
+    void start(VulkanRender* renderer);
+    // Posts a quit event and waits until the render thread has finished its last frame
+    void stop();
+    bool isRunning() const { return m_thread.joinable(); }
+
+    // Records the time between rendered frames and writes it to filename once rendering stops, must be called before start
+    void recordTimesteps(const std::string& filename);
+    // Renders an own simulation advanced by one recorded timestep per frame instead of the published snapshots, must be called before start
+    // Once all timesteps have been replayed the frame times are logged and finished is called (on the render thread), false if filename can't be loaded
+    bool replayTimesteps(const std::string& filename, std::function<void()> finished);
+
+    // Message thread side, false if the queue is full and the event was dropped
+    bool postEvent(const RenderEvent& event) { return m_events.push(event); }
+
+    // Simulation side: fill the snapshot, then publish it for the next frame
+    SimulationSnapshot& getSnapshot() { return m_snapshots.writeBuffer(); }
+    void publishSnapshot() { m_snapshots.publish(); }
+
+private:
+    void run();
+    void handleKey(uint32_t key);
+    // Renders the next frame of the replay, false once all timesteps have been replayed
+    bool replayFrame(float deltaTime);
+
+    VulkanRender* m_renderer{ nullptr };
+    std::thread m_thread;
+    EventQueue<RenderEvent, 256> m_events;
+    TripleBuffer<SimulationSnapshot> m_snapshots;
+
+    enum class TimestepMode { Live, Record, Replay };
+    TimestepMode m_timestepMode{ TimestepMode::Live };
+    std::string m_recordingFile;
+    TimestepRecording m_recording;
+    // Replay
+    Simulation m_replaySimulation;
+    size_t m_replayPosition{ 0 };
+    std::vector<float> m_replayFrameTimes;
+    std::function<void()> m_replayFinished;
+};
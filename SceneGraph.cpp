@@ -0,0 +1,328 @@
+#include "SceneGraph.h"
+#include "MatrixKernels.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+
+namespace
+{
+	glm::mat4 composeTransform(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+	{
+		glm::mat4 transform = glm::mat4_cast(rotation);
+		transform[0] = transform[0] * scale.x;
+		transform[1] = transform[1] * scale.y;
+		transform[2] = transform[2] * scale.z;
+		transform[3] = glm::vec4(position, 1.0f);
+		return transform;
+	}
+}
+
+
+void SceneGraph::clear()
+{
+	m_parent.clear();
+	m_localPosition.clear();
+	m_localRotation.clear();
+	m_localScale.clear();
+	m_world.clear();
+	m_dirty.clear();
+	m_handle.clear();
+	m_depth.clear();
+	m_nodeIndex.clear();
+	m_depthOffsets.assign(1, 0);
+	m_sorted = true;
+	m_anyDirty = false;
+}
+
+void SceneGraph::reserve(uint32_t count)
+{
+	m_parent.reserve(count);
+	m_localPosition.reserve(count);
+	m_localRotation.reserve(count);
+	m_localScale.reserve(count);
+	m_world.reserve(count);
+	m_dirty.reserve(count);
+	m_handle.reserve(count);
+	m_depth.reserve(count);
+	m_nodeIndex.reserve(count);
+}
+
+uint32_t SceneGraph::addNode(uint32_t parent, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+{
+	const uint32_t handle = static_cast<uint32_t>(m_nodeIndex.size());
+	const uint32_t index = static_cast<uint32_t>(m_parent.size());
+	const uint32_t parentIndex = (parent == INVALID_NODE) ? INVALID_NODE : m_nodeIndex[parent];
+	const uint32_t depth = (parent == INVALID_NODE) ? 0 : m_depth[parentIndex] + 1;
+
+	m_parent.push_back(parentIndex);
+	m_localPosition.push_back(position);
+	m_localRotation.push_back(rotation);
+	m_localScale.push_back(scale);
+	m_world.push_back(glm::mat4(1.0f));
+	m_dirty.push_back(1);
+	m_handle.push_back(handle);
+	m_depth.push_back(depth);
+	m_nodeIndex.push_back(index);
+	m_anyDirty = true;
+
+	// Appending keeps the depth order as long as the node is at the deepest depth so far (or starts the next one)
+	if (m_sorted)
+	{
+		if (getDepthCount() > 0 && depth == getDepthCount() - 1)
+		{
+			m_depthOffsets.back()++;
+		}
+		else if (depth == getDepthCount())
+		{
+			m_depthOffsets.push_back(index + 1);
+		}
+		else
+		{
+			m_sorted = false;
+		}
+	}
+	return handle;
+}
+
+void SceneGraph::markDirty(uint32_t index)
+{
+	m_dirty[index] = 1;
+	m_anyDirty = true;
+}
+
+void SceneGraph::setLocalTransform(uint32_t node, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+{
+	const uint32_t index = m_nodeIndex[node];
+	m_localPosition[index] = position;
+	m_localRotation[index] = rotation;
+	m_localScale[index] = scale;
+	markDirty(index);
+}
+
+void SceneGraph::setLocalPosition(uint32_t node, const glm::vec3& position)
+{
+	const uint32_t index = m_nodeIndex[node];
+	m_localPosition[index] = position;
+	markDirty(index);
+}
+
+void SceneGraph::setLocalRotation(uint32_t node, const glm::quat& rotation)
+{
+	const uint32_t index = m_nodeIndex[node];
+	m_localRotation[index] = rotation;
+	markDirty(index);
+}
+
+// Stable counting sort of all node arrays by depth, nodes of the same depth keep their relative order
+void SceneGraph::sortByDepth()
+{
+	const uint32_t count = size();
+	const uint32_t depthCount = count > 0 ? *std::max_element(m_depth.begin(), m_depth.end()) + 1 : 0;
+
+	m_depthOffsets.assign(depthCount + 1, 0);
+	for (uint32_t index = 0; index < count; index++)
+	{
+		m_depthOffsets[m_depth[index] + 1]++;
+	}
+	for (uint32_t depth = 0; depth < depthCount; depth++)
+	{
+		m_depthOffsets[depth + 1] += m_depthOffsets[depth];
+	}
+
+	std::vector<uint32_t> newIndex(count);
+	std::vector<uint32_t> next(m_depthOffsets.begin(), m_depthOffsets.end() - 1);
+	for (uint32_t index = 0; index < count; index++)
+	{
+		newIndex[index] = next[m_depth[index]]++;
+	}
+
+	auto permute = [&](auto& values) {
+		std::remove_reference_t<decltype(values)> sorted(values.size());
+		for (uint32_t index = 0; index < count; index++)
+		{
+			sorted[newIndex[index]] = values[index];
+		}
+		values.swap(sorted);
+	};
+	for (uint32_t& parent : m_parent)
+	{
+		if (parent != INVALID_NODE)
+		{
+			parent = newIndex[parent];
+		}
+	}
+	permute(m_parent);
+	permute(m_localPosition);
+	permute(m_localRotation);
+	permute(m_localScale);
+	permute(m_world);
+	permute(m_dirty);
+	permute(m_handle);
+	permute(m_depth);
+	for (uint32_t index = 0; index < count; index++)
+	{
+		m_nodeIndex[m_handle[index]] = index;
+	}
+	m_sorted = true;
+}
+
+void SceneGraph::updateRange(uint32_t first, uint32_t last)
+{
+	// Runs of consecutive nodes to recompute are handled with the batched matrix kernels: the local transforms are composed
+	// in place in m_world, then multiplied with the gathered parent world transforms
+	constexpr uint32_t BATCH_SIZE = 64;
+	constexpr uint32_t MIN_BATCH_SIZE = 4;
+	glm::mat4 parentWorld[BATCH_SIZE];
+	uint32_t index = first;
+	while (index < last)
+	{
+		const uint32_t firstParent = m_parent[index];
+		if (m_dirty[index] == 0 && (firstParent == INVALID_NODE || m_dirty[firstParent] == 0))
+		{
+			index++;
+			continue;
+		}
+		uint32_t runEnd = index;
+		while (runEnd < last && runEnd - index < BATCH_SIZE)
+		{
+			const uint32_t parent = m_parent[runEnd];
+			if (m_dirty[runEnd] == 0 && (parent == INVALID_NODE || m_dirty[parent] == 0))
+			{
+				break;
+			}
+			// Flag the node as recomputed, so its children follow
+			m_dirty[runEnd] = 1;
+			runEnd++;
+		}
+		const uint32_t count = runEnd - index;
+		if (count < MIN_BATCH_SIZE)
+		{
+			// Too short for the kernels to pay off, typical for sparse changes
+			for (; index < runEnd; index++)
+			{
+				const uint32_t parent = m_parent[index];
+				const glm::mat4 local = composeTransform(m_localPosition[index], m_localRotation[index], m_localScale[index]);
+				m_world[index] = (parent == INVALID_NODE) ? local : m_world[parent] * local;
+			}
+			continue;
+		}
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const uint32_t parent = m_parent[index + i];
+			parentWorld[i] = (parent == INVALID_NODE) ? glm::mat4(1.0f) : m_world[parent];
+		}
+		MatrixKernels::composeTRS(&m_localPosition[index], &m_localRotation[index], &m_localScale[index], &m_world[index], count);
+		MatrixKernels::multiply(parentWorld, &m_world[index], &m_world[index], count);
+		index = runEnd;
+	}
+}
+
+uint32_t SceneGraph::update(std::vector<uint32_t>* changedNodes, JobSystem* jobSystem)
+{
+	if (!m_sorted)
+	{
+		sortByDepth();
+	}
+	if (!m_anyDirty)
+	{
+		return 0;
+	}
+
+	// Nodes per job, the depths have to be done one after another
+	constexpr uint32_t UPDATE_BATCH_SIZE = 4096;
+	for (uint32_t depth = 0; depth < getDepthCount(); depth++)
+	{
+		const uint32_t first = getDepthBegin(depth);
+		const uint32_t last = getDepthEnd(depth);
+		if (jobSystem != nullptr)
+		{
+			jobSystem->parallelFor(last - first, UPDATE_BATCH_SIZE, [&](uint32_t batchFirst, uint32_t batchLast) { updateRange(first + batchFirst, first + batchLast); });
+		}
+		else
+		{
+			updateRange(first, last);
+		}
+	}
+
+	uint32_t changedCount = 0;
+	if (changedNodes != nullptr)
+	{
+		for (uint32_t index = 0; index < size(); index++)
+		{
+			if (m_dirty[index] != 0)
+			{
+				changedNodes->push_back(m_handle[index]);
+				changedCount++;
+			}
+		}
+	}
+	else
+	{
+		changedCount = static_cast<uint32_t>(std::count(m_dirty.begin(), m_dirty.end(), uint8_t(1)));
+	}
+	memset(m_dirty.data(), 0, m_dirty.size());
+	m_anyDirty = false;
+	return changedCount;
+}
+
+void SceneGraph::runBenchmark(uint32_t nodeCount, float changedFraction)
+{
+	// A random forest: 1000 roots, every other node is attached to a random earlier node, nodes are added in that (not depth sorted) order
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+	std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+	constexpr uint32_t rootCount = 1000;
+
+	SceneGraph sceneGraph;
+	sceneGraph.reserve(nodeCount);
+	auto tStart = std::chrono::high_resolution_clock::now();
+	for (uint32_t node = 0; node < nodeCount; node++)
+	{
+		const uint32_t parent = (node < rootCount) ? INVALID_NODE : std::uniform_int_distribution<uint32_t>(0, node - 1)(random);
+		sceneGraph.addNode(parent, glm::vec3(position(random), position(random), position(random)), glm::angleAxis(angle(random), glm::vec3(0.0f, 1.0f, 0.0f)));
+	}
+	auto tEnd = std::chrono::high_resolution_clock::now();
+	const double buildMs = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+
+	// The first update sorts the nodes by depth and computes all world transforms
+	tStart = std::chrono::high_resolution_clock::now();
+	sceneGraph.update();
+	tEnd = std::chrono::high_resolution_clock::now();
+	const double firstUpdateMs = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+
+	std::cout << "Scene graph benchmark, " << nodeCount << " nodes, " << sceneGraph.getDepthCount() << " depths, build " << buildMs << " ms, sort and first update " << firstUpdateMs << " ms\n";
+
+	constexpr uint32_t iterations = 20;
+	const uint32_t changedCount = std::max(1u, static_cast<uint32_t>(nodeCount * changedFraction));
+	std::uniform_int_distribution<uint32_t> anyNode(0, nodeCount - 1);
+
+	// Report the best run, the first one also warms up the caches
+	auto measure = [&](uint32_t changes, uint32_t& recomputed) {
+		double bestMs = 1e30;
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			for (uint32_t change = 0; change < changes; change++)
+			{
+				const uint32_t node = (changes == nodeCount) ? change : anyNode(random);
+				sceneGraph.setLocalRotation(node, glm::angleAxis(angle(random), glm::vec3(0.0f, 1.0f, 0.0f)));
+			}
+			tStart = std::chrono::high_resolution_clock::now();
+			recomputed = sceneGraph.update();
+			tEnd = std::chrono::high_resolution_clock::now();
+			bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+		}
+		return bestMs;
+	};
+
+	uint32_t recomputed = 0;
+	const double fullMs = measure(nodeCount, recomputed);
+	std::cout << " All nodes changed: " << fullMs << " ms, " << (recomputed / fullMs) / 1000.0 << " Mnodes/s\n";
+	const double partialMs = measure(changedCount, recomputed);
+	std::cout << " " << changedCount << " nodes changed: " << partialMs << " ms, " << recomputed << " nodes recomputed (changed subtrees), "
+		<< (fullMs / partialMs) << "x faster than a full update\n";
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+class JobSystem;
+
+
+// Transform hierarchy for large numbers of nodes
+// Nodes are addressed by stable handles, internally all node data is stored as structure of arrays sorted by depth,
+// so every parent precedes its children and the nodes of one depth form a contiguous range
+// Changing a local transform only flags the node, update() then recomputes the world transforms of all flagged subtrees
+// in a single linear pass: a node is recomputed if it or its parent was flagged, the parent has always been handled before
+// The nodes of one depth only read the world transforms of the depth before, so each depth range can be split across threads
+class SceneGraph
+{
+public:
+    static constexpr uint32_t INVALID_NODE = ~0u;
+
+    void clear();
+    void reserve(uint32_t count);
+    uint32_t size() const { return static_cast<uint32_t>(m_parent.size()); }
+
+    // Adds a node below parent (INVALID_NODE for a root) and returns its handle, the parent has to exist already
+    uint32_t addNode(uint32_t parent, const glm::vec3& position, const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), const glm::vec3& scale = glm::vec3(1.0f));
+
+    void setLocalTransform(uint32_t node, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+    void setLocalPosition(uint32_t node, const glm::vec3& position);
+    void setLocalRotation(uint32_t node, const glm::quat& rotation);
+
+    // Valid after update()
+    const glm::mat4& getWorldTransform(uint32_t node) const { return m_world[m_nodeIndex[node]]; }
+
+    // Recomputes the world transforms of all nodes changed since the last update and of their descendants
+    // changedNodes (optional) receives the handles of all recomputed nodes, returns their number
+    // With a job system every large depth range is split into batches that are updated on all workers
+    uint32_t update(std::vector<uint32_t>* changedNodes = nullptr, JobSystem* jobSystem = nullptr);
+
+    // Number of depths and the index range [first, last) of one depth in the sorted arrays, valid after update()
+    uint32_t getDepthCount() const { return static_cast<uint32_t>(m_depthOffsets.size()) - 1; }
+    uint32_t getDepthBegin(uint32_t depth) const { return m_depthOffsets[depth]; }
+    uint32_t getDepthEnd(uint32_t depth) const { return m_depthOffsets[depth + 1]; }
+
+    // Recomputes the flagged nodes of the sorted index range [first, last), all depths before the range have to be up to date
+    // update() calls this once per depth, a caller can instead split each depth into several ranges and process them in parallel
+    void updateRange(uint32_t first, uint32_t last);
+
+    // Builds a random hierarchy of nodeCount nodes, changes changedFraction of the nodes per frame and logs the update timings
+    static void runBenchmark(uint32_t nodeCount = 1000000, float changedFraction = 0.01f);
+
+private:
+    // Restores the depth order after nodes were added
+    void sortByDepth();
+    void markDirty(uint32_t index);
+
+    // Node data in depth order
+    std::vector<uint32_t> m_parent;         // Sorted index of the parent, INVALID_NODE for roots
+    std::vector<glm::vec3> m_localPosition;
+    std::vector<glm::quat> m_localRotation;
+    std::vector<glm::vec3> m_localScale;
+    std::vector<glm::mat4> m_world;
+    std::vector<uint8_t> m_dirty;           // Local transform changed (1), or recomputed during the current update (propagates to the children)
+    std::vector<uint32_t> m_handle;         // Sorted index -> handle
+    std::vector<uint32_t> m_depth;
+
+    std::vector<uint32_t> m_nodeIndex;      // Handle -> sorted index
+    std::vector<uint32_t> m_depthOffsets{ 0 };
+    bool m_sorted{ true };
+    bool m_anyDirty{ false };
+};
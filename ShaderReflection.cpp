@@ -0,0 +1,499 @@
+#include "ShaderReflection.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <iostream>
+
+
+namespace
+{
+	constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+	// From SPIR-V 1.4 on the entry point lists every global variable it uses, before only its inputs and outputs
+	constexpr uint32_t SPIRV_VERSION_1_4 = 0x00010400;
+
+	// The subset of the SPIR-V specification needed for the resource interface
+	enum SpirvOp : uint32_t {
+		OpEntryPoint = 15,
+		OpTypeInt = 21,
+		OpTypeFloat = 22,
+		OpTypeVector = 23,
+		OpTypeMatrix = 24,
+		OpTypeImage = 25,
+		OpTypeSampler = 26,
+		OpTypeSampledImage = 27,
+		OpTypeArray = 28,
+		OpTypeRuntimeArray = 29,
+		OpTypeStruct = 30,
+		OpTypePointer = 32,
+		OpConstant = 43,
+		OpVariable = 59,
+		OpDecorate = 71,
+		OpMemberDecorate = 72,
+		OpTypeAccelerationStructureKHR = 5341,
+	};
+	enum SpirvDecoration : uint32_t {
+		DecorationBufferBlock = 3,
+		DecorationArrayStride = 6,
+		DecorationMatrixStride = 7,
+		DecorationBuiltIn = 11,
+		DecorationLocation = 30,
+		DecorationBinding = 33,
+		DecorationDescriptorSet = 34,
+		DecorationOffset = 35,
+	};
+	enum SpirvStorageClass : uint32_t {
+		StorageClassUniformConstant = 0,
+		StorageClassInput = 1,
+		StorageClassUniform = 2,
+		StorageClassOutput = 3,
+		StorageClassPushConstant = 9,
+		StorageClassStorageBuffer = 12,
+	};
+	enum SpirvDim : uint32_t {
+		DimBuffer = 5,
+		DimSubpassData = 6,
+	};
+
+	constexpr uint32_t NONE = ~0u;
+
+	// Everything recorded about one result id, which fields are used depends on the instruction that declared it
+	struct SpirvId {
+		uint32_t opcode{ 0 };
+		uint32_t typeId{ 0 };           // Pointers: pointee, vectors, matrices and arrays: element, variables and constants: their type
+		uint32_t storageClass{ 0 };     // Pointers and variables
+		uint32_t count{ 0 };            // Vectors: components, matrices: columns, arrays: id of the length constant, int and float: width
+		uint32_t value{ 0 };            // Constants: low word, int: signedness, image: dim
+		uint32_t sampled{ 0 };          // Images: 1 sampled, 2 storage
+		uint32_t set{ NONE };
+		uint32_t binding{ NONE };
+		uint32_t location{ NONE };
+		uint32_t arrayStride{ 0 };
+		bool bufferBlock{ false };
+		bool builtIn{ false };
+		std::vector<uint32_t> members;
+		std::vector<uint32_t> memberOffsets;
+		std::vector<uint32_t> memberMatrixStrides;
+	};
+
+	void setMemberDecoration(std::vector<uint32_t>& values, uint32_t member, uint32_t value)
+	{
+		if (values.size() <= member)
+		{
+			values.resize(member + 1, 0);
+		}
+		values[member] = value;
+	}
+
+	// Size in bytes of a type in a push constant block, laid out with the explicit offsets and strides of the block
+	uint32_t typeSize(const std::vector<SpirvId>& ids, uint32_t typeId, uint32_t matrixStride = 0)
+	{
+		const SpirvId& type = ids[typeId];
+		switch (type.opcode)
+		{
+		case OpTypeInt:
+		case OpTypeFloat:
+			return type.count / 8;
+		case OpTypeVector:
+			return type.count * typeSize(ids, type.typeId);
+		case OpTypeMatrix:
+			return type.count * (matrixStride != 0 ? matrixStride : typeSize(ids, type.typeId));
+		case OpTypeArray:
+			return ids[type.count].value * (type.arrayStride != 0 ? type.arrayStride : typeSize(ids, type.typeId));
+		case OpTypeStruct:
+		{
+			uint32_t size = 0;
+			for (size_t i = 0; i < type.members.size(); i++)
+			{
+				const uint32_t offset = (i < type.memberOffsets.size()) ? type.memberOffsets[i] : 0;
+				const uint32_t stride = (i < type.memberMatrixStrides.size()) ? type.memberMatrixStrides[i] : 0;
+				size = std::max(size, offset + typeSize(ids, type.members[i], stride));
+			}
+			return size;
+		}
+		default:
+			return 0;
+		}
+	}
+
+	// Vertex attribute format of a scalar or vector input
+	VkFormat vertexInputFormat(const std::vector<SpirvId>& ids, uint32_t typeId)
+	{
+		const SpirvId& type = ids[typeId];
+		const uint32_t components = (type.opcode == OpTypeVector) ? type.count : 1;
+		const SpirvId& scalar = (type.opcode == OpTypeVector) ? ids[type.typeId] : type;
+		if (components < 1 || components > 4 || scalar.count != 32)
+		{
+			return VK_FORMAT_UNDEFINED;
+		}
+		static constexpr VkFormat floatFormats[4] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+		static constexpr VkFormat intFormats[4] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+		static constexpr VkFormat uintFormats[4] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+		switch (scalar.opcode)
+		{
+		case OpTypeFloat:
+			return floatFormats[components - 1];
+		case OpTypeInt:
+			return (scalar.value != 0) ? intFormats[components - 1] : uintFormats[components - 1];
+		default:
+			return VK_FORMAT_UNDEFINED;
+		}
+	}
+
+	VkShaderStageFlagBits executionModelStage(uint32_t executionModel)
+	{
+		switch (executionModel)
+		{
+		case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+		case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+		case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+		case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+		case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+		case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+		case 5364: return VK_SHADER_STAGE_TASK_BIT_EXT;
+		case 5365: return VK_SHADER_STAGE_MESH_BIT_EXT;
+		default: return VK_SHADER_STAGE_ALL;
+		}
+	}
+}
+
+
+bool ShaderReflection::reflect(const uint32_t* code, size_t wordCount)
+{
+	*this = ShaderReflection{};
+	if (wordCount < 5 || code[0] != SPIRV_MAGIC)
+	{
+		std::cerr << "Error: Not a SPIR-V binary\n";
+		return false;
+	}
+	const uint32_t version = code[1];
+	// Every result id is below the bound of the header
+	std::vector<SpirvId> ids(code[3]);
+	std::vector<uint32_t> variables;
+	std::vector<uint32_t> interfaceIds;
+	uint32_t entryPointCount = 0;
+
+	for (size_t offset = 5; offset < wordCount;)
+	{
+		const uint32_t* instruction = code + offset;
+		const uint32_t opcode = instruction[0] & 0xffff;
+		const uint32_t length = instruction[0] >> 16;
+		if (length == 0 || offset + length > wordCount)
+		{
+			std::cerr << "Error: Truncated SPIR-V instruction at word " << offset << "\n";
+			return false;
+		}
+		offset += length;
+		// Operands past the end of a malformed instruction read as 0, and so do ids beyond the bound (0 is never a valid id)
+		auto operand = [instruction, length](uint32_t index) { return (index < length) ? instruction[index] : 0u; };
+		auto idOperand = [&operand, &ids](uint32_t index) { const uint32_t id = operand(index); return (id < ids.size()) ? id : 0u; };
+
+		// The result id of type declarations is the first operand, the one of constants and variables the second
+		const uint32_t resultId = (opcode == OpConstant || opcode == OpVariable) ? operand(2) : operand(1);
+		const bool declaresType = (opcode >= OpTypeInt && opcode <= OpTypePointer) || opcode == OpTypeAccelerationStructureKHR;
+		if ((declaresType || opcode == OpConstant || opcode == OpVariable) && (length < 2 || resultId >= ids.size()))
+		{
+			std::cerr << "Error: Invalid SPIR-V result id\n";
+			return false;
+		}
+
+		switch (opcode)
+		{
+		case OpEntryPoint:
+		{
+			if (length < 4)
+			{
+				break;
+			}
+			entryPointCount++;
+			stage = executionModelStage(operand(1));
+			// The name is a nul terminated string packed into words, the interface ids follow it
+			const char* name = reinterpret_cast<const char*>(instruction + 3);
+			const size_t maxNameLength = (length - 3) * sizeof(uint32_t);
+			entryPoint.assign(name, strnlen(name, maxNameLength));
+			for (uint32_t word = 3 + static_cast<uint32_t>(entryPoint.size() / sizeof(uint32_t)) + 1; word < length; word++)
+			{
+				interfaceIds.push_back(instruction[word]);
+			}
+			break;
+		}
+		case OpDecorate:
+		{
+			if (length < 3 || operand(1) >= ids.size())
+			{
+				break;
+			}
+			SpirvId& target = ids[operand(1)];
+			const uint32_t value = (length > 3) ? operand(3) : 0;
+			switch (operand(2))
+			{
+			case DecorationBufferBlock: target.bufferBlock = true; break;
+			case DecorationArrayStride: target.arrayStride = value; break;
+			case DecorationBuiltIn: target.builtIn = true; break;
+			case DecorationLocation: target.location = value; break;
+			case DecorationBinding: target.binding = value; break;
+			case DecorationDescriptorSet: target.set = value; break;
+			}
+			break;
+		}
+		case OpMemberDecorate:
+			if (length < 5 || operand(1) >= ids.size())
+			{
+				break;
+			}
+			if (operand(3) == DecorationOffset)
+			{
+				setMemberDecoration(ids[operand(1)].memberOffsets, operand(2), operand(4));
+			}
+			else if (operand(3) == DecorationMatrixStride)
+			{
+				setMemberDecoration(ids[operand(1)].memberMatrixStrides, operand(2), operand(4));
+			}
+			break;
+		case OpTypeInt:
+			ids[resultId].opcode = opcode;
+			ids[resultId].count = operand(2);
+			ids[resultId].value = operand(3);
+			break;
+		case OpTypeFloat:
+			ids[resultId].opcode = opcode;
+			ids[resultId].count = operand(2);
+			break;
+		case OpTypeVector:
+		case OpTypeMatrix:
+			ids[resultId].opcode = opcode;
+			ids[resultId].typeId = idOperand(2);
+			ids[resultId].count = operand(3);
+			break;
+		case OpTypeArray:
+			ids[resultId].opcode = opcode;
+			ids[resultId].typeId = idOperand(2);
+			ids[resultId].count = idOperand(3);
+			break;
+		case OpTypeRuntimeArray:
+		case OpTypeSampledImage:
+			ids[resultId].opcode = opcode;
+			ids[resultId].typeId = idOperand(2);
+			break;
+		case OpTypeImage:
+			ids[resultId].opcode = opcode;
+			ids[resultId].typeId = idOperand(2);
+			ids[resultId].value = operand(3);
+			ids[resultId].sampled = operand(7);
+			break;
+		case OpTypeSampler:
+		case OpTypeAccelerationStructureKHR:
+			ids[resultId].opcode = opcode;
+			break;
+		case OpTypeStruct:
+			ids[resultId].opcode = opcode;
+			for (uint32_t member = 2; member < length; member++)
+			{
+				ids[resultId].members.push_back(idOperand(member));
+			}
+			break;
+		case OpTypePointer:
+			ids[resultId].opcode = opcode;
+			ids[resultId].storageClass = operand(2);
+			ids[resultId].typeId = idOperand(3);
+			break;
+		case OpConstant:
+			ids[resultId].opcode = opcode;
+			ids[resultId].typeId = idOperand(1);
+			ids[resultId].value = operand(3);
+			break;
+		case OpVariable:
+			ids[resultId].opcode = opcode;
+			ids[resultId].typeId = idOperand(1);
+			ids[resultId].storageClass = operand(3);
+			variables.push_back(resultId);
+			break;
+		}
+	}
+
+	if (entryPointCount != 1)
+	{
+		std::cerr << "Error: Expected a single entry point in the SPIR-V binary, found " << entryPointCount << "\n";
+		return false;
+	}
+
+	for (uint32_t variableId : variables)
+	{
+		const SpirvId& variable = ids[variableId];
+		const bool listed = std::find(interfaceIds.begin(), interfaceIds.end(), variableId) != interfaceIds.end();
+		const bool inputOrOutput = (variable.storageClass == StorageClassInput || variable.storageClass == StorageClassOutput);
+		// Variables that aren't part of the entry point's interface are declared but never used by it
+		if (!listed && (version >= SPIRV_VERSION_1_4 || inputOrOutput))
+		{
+			continue;
+		}
+		uint32_t typeId = ids[variable.typeId].typeId;
+
+		if (variable.storageClass == StorageClassPushConstant)
+		{
+			const SpirvId& block = ids[typeId];
+			if (block.opcode == OpTypeStruct && !block.memberOffsets.empty())
+			{
+				// Push constant ranges are in multiples of 4 bytes
+				pushConstantOffset = *std::min_element(block.memberOffsets.begin(), block.memberOffsets.end()) & ~3u;
+				pushConstantSize = (typeSize(ids, typeId) - pushConstantOffset + 3) & ~3u;
+			}
+			continue;
+		}
+
+		if (variable.storageClass == StorageClassInput)
+		{
+			if (stage != VK_SHADER_STAGE_VERTEX_BIT || variable.builtIn || variable.location == NONE)
+			{
+				continue;
+			}
+			// Arrays and matrices of inputs take consecutive locations, one per element or column
+			uint32_t location = variable.location;
+			uint32_t elementCount = 1;
+			while (ids[typeId].opcode == OpTypeArray)
+			{
+				elementCount *= ids[ids[typeId].count].value;
+				typeId = ids[typeId].typeId;
+			}
+			const uint32_t columnCount = (ids[typeId].opcode == OpTypeMatrix) ? ids[typeId].count : 1;
+			const VkFormat format = vertexInputFormat(ids, (columnCount > 1) ? ids[typeId].typeId : typeId);
+			for (uint32_t i = 0; i < elementCount * columnCount; i++)
+			{
+				vertexInputs.push_back({ location++, format });
+			}
+			continue;
+		}
+
+		if (variable.binding == NONE)
+		{
+			continue;
+		}
+
+		// Arrays of descriptors, a runtime sized array has its count set when the descriptor set is allocated
+		uint32_t descriptorCount = 1;
+		while (ids[typeId].opcode == OpTypeArray || ids[typeId].opcode == OpTypeRuntimeArray)
+		{
+			descriptorCount *= (ids[typeId].opcode == OpTypeArray) ? ids[ids[typeId].count].value : 0;
+			typeId = ids[typeId].typeId;
+		}
+
+		const SpirvId& type = ids[typeId];
+		VkDescriptorType descriptorType;
+		switch (variable.storageClass)
+		{
+		case StorageClassUniform:
+			// Before storage buffers had their own storage class they were uniform blocks decorated as buffer blocks
+			descriptorType = type.bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			break;
+		case StorageClassStorageBuffer:
+			descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			break;
+		case StorageClassUniformConstant:
+			switch (type.opcode)
+			{
+			case OpTypeImage:
+				if (type.value == DimBuffer)
+				{
+					descriptorType = (type.sampled == 2) ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+				}
+				else if (type.value == DimSubpassData)
+				{
+					descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+				}
+				else
+				{
+					descriptorType = (type.sampled == 2) ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+				}
+				break;
+			case OpTypeSampler:
+				descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+				break;
+			case OpTypeSampledImage:
+				descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+				break;
+			case OpTypeAccelerationStructureKHR:
+				descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+				break;
+			default:
+				std::cerr << "Error: Unsupported descriptor type at set " << variable.set << " binding " << variable.binding << "\n";
+				return false;
+			}
+			break;
+		default:
+			continue;
+		}
+		bindings.push_back({ (variable.set != NONE) ? variable.set : 0, variable.binding, descriptorType, descriptorCount });
+	}
+
+	std::sort(bindings.begin(), bindings.end(), [](const DescriptorBinding& a, const DescriptorBinding& b) { return (a.set != b.set) ? a.set < b.set : a.binding < b.binding; });
+	std::sort(vertexInputs.begin(), vertexInputs.end(), [](const VertexInput& a, const VertexInput& b) { return a.location < b.location; });
+	return true;
+}
+
+bool ShaderReflection::hasSameLayout(const ShaderReflection& other) const
+{
+	return stage == other.stage && bindings == other.bindings && pushConstantOffset == other.pushConstantOffset && pushConstantSize == other.pushConstantSize;
+}
+
+std::vector<VkDescriptorSetLayoutBinding> ShaderReflection::mergeBindings(const std::vector<const ShaderReflection*>& stages, uint32_t set)
+{
+	std::vector<VkDescriptorSetLayoutBinding> merged;
+	for (const ShaderReflection* reflection : stages)
+	{
+		for (const DescriptorBinding& binding : reflection->bindings)
+		{
+			if (binding.set != set)
+			{
+				continue;
+			}
+			auto existing = std::find_if(merged.begin(), merged.end(), [&binding](const VkDescriptorSetLayoutBinding& b) { return b.binding == binding.binding; });
+			if (existing == merged.end())
+			{
+				merged.push_back({ binding.binding, binding.descriptorType, binding.descriptorCount, static_cast<VkShaderStageFlags>(reflection->stage), nullptr });
+				continue;
+			}
+			if (existing->descriptorType != binding.descriptorType || existing->descriptorCount != binding.descriptorCount)
+			{
+				throw std::runtime_error("Shader stages declare set " + std::to_string(set) + " binding " + std::to_string(binding.binding) + " differently");
+			}
+			existing->stageFlags |= reflection->stage;
+		}
+	}
+	std::sort(merged.begin(), merged.end(), [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+	return merged;
+}
+
+std::vector<VkPushConstantRange> ShaderReflection::mergePushConstants(const std::vector<const ShaderReflection*>& stages)
+{
+	VkPushConstantRange range{ 0, UINT32_MAX, 0 };
+	uint32_t end = 0;
+	for (const ShaderReflection* reflection : stages)
+	{
+		if (reflection->pushConstantSize == 0)
+		{
+			continue;
+		}
+		range.stageFlags |= reflection->stage;
+		range.offset = std::min(range.offset, reflection->pushConstantOffset);
+		end = std::max(end, reflection->pushConstantOffset + reflection->pushConstantSize);
+	}
+	if (range.stageFlags == 0)
+	{
+		return {};
+	}
+	range.size = end - range.offset;
+	return { range };
+}
+
+uint32_t ShaderReflection::getSetCount(const std::vector<const ShaderReflection*>& stages)
+{
+	uint32_t setCount = 0;
+	for (const ShaderReflection* reflection : stages)
+	{
+		for (const DescriptorBinding& binding : reflection->bindings)
+		{
+			setCount = std::max(setCount, binding.set + 1);
+		}
+	}
+	return setCount;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "vulkan/vulkan.h"
+
+
+// Resource interface of a SPIR-V shader, read from the binary when the shader is loaded
+// Covers what the pipeline layouts and the vertex input state are built from: the descriptor bindings, the push constant block and the
+// vertex shader inputs, so the renderer doesn't have to repeat the [[vk::binding]] and [[vk::location]] declarations of the slang files
+struct ShaderReflection {
+    struct DescriptorBinding {
+        uint32_t set;
+        uint32_t binding;
+        VkDescriptorType descriptorType;
+        uint32_t descriptorCount;       // 0 for runtime sized arrays
+
+        bool operator==(const DescriptorBinding& other) const = default;
+    };
+    struct VertexInput {
+        uint32_t location;
+        VkFormat format;
+    };
+
+    VkShaderStageFlagBits stage{};
+    std::string entryPoint;
+    std::vector<DescriptorBinding> bindings;        // Sorted by set and binding
+    // Byte range of the push constant block, pushConstantSize is 0 if the shader has no push constants
+    uint32_t pushConstantOffset{ 0 };
+    uint32_t pushConstantSize{ 0 };
+    std::vector<VertexInput> vertexInputs;          // Vertex shaders only, sorted by location. Matrices and arrays take one location per column or element
+
+    // Parses a SPIR-V binary with a single entry point, false (with the error logged) if it can't be reflected
+    bool reflect(const uint32_t* code, size_t wordCount);
+    // True if the descriptor bindings and push constants are the same, then pipelines of both shaders can use the same pipeline layout
+    bool hasSameLayout(const ShaderReflection& other) const;
+
+    // Bindings of set in any of the stages, with the stage flags of all stages using a binding combined
+    // Throws if two stages declare the same binding with different descriptor types or counts
+    static std::vector<VkDescriptorSetLayoutBinding> mergeBindings(const std::vector<const ShaderReflection*>& stages, uint32_t set);
+    // A single range covering the push constants of all stages (readable by every stage that has push constants), empty if none has
+    static std::vector<VkPushConstantRange> mergePushConstants(const std::vector<const ShaderReflection*>& stages);
+    // Number of descriptor sets of the pipeline layout, the highest set used plus one
+    static uint32_t getSetCount(const std::vector<const ShaderReflection*>& stages);
+};
@@ -0,0 +1,154 @@
+#include "ShaderWatcher.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+
+void ShaderWatcher::start(std::vector<Shader> shaders, std::chrono::milliseconds interval)
+{
+	m_shaders = std::move(shaders);
+	m_interval = interval;
+	m_stop = false;
+	// Only changes after the start count
+	for (const Shader& shader : m_shaders)
+	{
+		hasChanged(shader.source);
+		hasChanged(shader.output);
+	}
+	m_thread = std::thread(&ShaderWatcher::run, this);
+}
+
+void ShaderWatcher::stop()
+{
+	if (!m_thread.joinable())
+	{
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_stopCondition.notify_all();
+	m_thread.join();
+}
+
+std::vector<std::string> ShaderWatcher::takeChangedShaders()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::vector<std::string> changedShaders;
+	changedShaders.swap(m_changedShaders);
+	return changedShaders;
+}
+
+void ShaderWatcher::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_stopCondition.wait_for(lock, m_interval, [this] { return m_stop; }))
+	{
+		// Compiling takes a while, the renderer can take the changes reported so far in the meantime
+		lock.unlock();
+		poll();
+		lock.lock();
+	}
+}
+
+void ShaderWatcher::poll()
+{
+	// A source is compiled once even if several SPIR-V files are built from it, their changed times are noticed below
+	std::vector<std::string> changedSources;
+	for (const Shader& shader : m_shaders)
+	{
+		if (std::find(changedSources.begin(), changedSources.end(), shader.source) == changedSources.end() && hasChanged(shader.source))
+		{
+			changedSources.push_back(shader.source);
+		}
+	}
+	for (const Shader& shader : m_shaders)
+	{
+		if (std::find(changedSources.begin(), changedSources.end(), shader.source) != changedSources.end())
+		{
+			std::cout << "Shader hot reload: compiling \"" << shader.source << "\" to \"" << shader.output << "\"\n";
+			compile(shader);
+		}
+	}
+
+	std::vector<std::string> changedOutputs;
+	for (const Shader& shader : m_shaders)
+	{
+		if (hasChanged(shader.output))
+		{
+			changedOutputs.push_back(shader.output);
+		}
+	}
+	if (changedOutputs.empty())
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (const std::string& output : changedOutputs)
+	{
+		if (std::find(m_changedShaders.begin(), m_changedShaders.end(), output) == m_changedShaders.end())
+		{
+			m_changedShaders.push_back(output);
+		}
+	}
+}
+
+bool ShaderWatcher::compile(const Shader& shader) const
+{
+	const char* sdk = std::getenv("VULKAN_SDK");
+	if (sdk == nullptr)
+	{
+		std::cerr << "Error: VULKAN_SDK is not set, can't compile \"" << shader.source << "\"" << std::endl;
+		return false;
+	}
+
+	// The same options as shadercompile.bat
+	const std::string temporaryOutput = shader.output + ".tmp";
+	std::string command = "\"" + (std::filesystem::path(sdk) / "Bin" / "slangc").string() + "\" \"" + shader.source + "\" -profile spirv_1_4 -matrix-layout-column-major -target spirv"
+		+ " -o \"" + temporaryOutput + "\" -entry " + shader.entryPoint + " -stage " + shader.stage + " -warnings-disable 39001";
+#ifdef _WIN32
+	// cmd /c strips the outer quotes of a command line that starts with a quote
+	command = "\"" + command + "\"";
+#endif
+	if (std::system(command.c_str()) != 0)
+	{
+		std::cerr << "Error: Could not compile \"" << shader.source << "\", keeping \"" << shader.output << "\"" << std::endl;
+		std::error_code error;
+		std::filesystem::remove(temporaryOutput, error);
+		return false;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporaryOutput, shader.output, error);
+	if (error)
+	{
+		std::cerr << "Error: Could not replace \"" << shader.output << "\": " << error.message() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool ShaderWatcher::hasChanged(const std::string& filename)
+{
+	// A missing file (e.g. while an editor replaces it) counts as unchanged, it is compared again at the next poll
+	std::error_code error;
+	const std::filesystem::file_time_type time = std::filesystem::last_write_time(filename, error);
+	if (error)
+	{
+		return false;
+	}
+	auto it = m_timestamps.find(filename);
+	if (it == m_timestamps.end())
+	{
+		m_timestamps.emplace(filename, time);
+		return false;
+	}
+	if (it->second == time)
+	{
+		return false;
+	}
+	it->second = time;
+	return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+#include <chrono>
+
+
+// Watches the shader sources and SPIR-V files for changes while the renderer runs (shader hot reload)
+// A background thread polls the modification times. A changed .slang file is compiled with slangc (from the Vulkan SDK) into every SPIR-V file
+// built from it, a changed .spv file, recompiled or replaced on disk by shadercompile.bat, is reported to the renderer, which rebuilds the
+// pipelines using it. Compile errors are logged by slangc and leave the SPIR-V file as it is
+class ShaderWatcher
+{
+public:
+    // One SPIR-V file and how it is built, the same as the entries of shadercompile.bat
+    struct Shader {
+        std::string source;         // .slang file
+        std::string output;         // .spv file
+        std::string entryPoint;     // slangc -entry
+        std::string stage;          // slangc -stage
+    };
+
+    void start(std::vector<Shader> shaders, std::chrono::milliseconds interval = std::chrono::milliseconds(250));
+    void stop();
+    bool isRunning() const { return m_thread.joinable(); }
+
+    // The SPIR-V files that changed since the last call
+    std::vector<std::string> takeChangedShaders();
+
+private:
+    void run();
+    void poll();
+    // Compiles shader to a temporary file which then replaces the output, so a reader never sees a partially written file
+    bool compile(const Shader& shader) const;
+    // True if the modification time of filename differs from the last time it was checked
+    bool hasChanged(const std::string& filename);
+
+    std::vector<Shader> m_shaders;
+    std::chrono::milliseconds m_interval{ 0 };
+    std::map<std::string, std::filesystem::file_time_type> m_timestamps;    // Only used by the watcher thread after start
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_stopCondition;
+    bool m_stop{ false };
+    std::vector<std::string> m_changedShaders;
+};
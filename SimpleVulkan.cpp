@@ -4,6 +4,9 @@
 #include "framework.h"
 #include "SimpleVulkan.h"
 #include "VulkanRender.h"
+#include "RenderThread.h"
+#include "Simulation.h"
+#include "HiZReference.h"
 
 #include <chrono>
 
@@ -13,6 +16,9 @@
 static std::unique_ptr<VulkanRender> gVulkanRender = nullptr;
 HINSTANCE hInst;                                // current instance
 static HWND gHwnd = nullptr;
+// Rendering runs on its own thread, the simulation is stepped by the message thread and handed over as snapshots
+static RenderThread gRenderThread;
+static Simulation gSimulation;
 
 WCHAR szTitle[MAX_LOADSTRING];                  // The title bar text
 WCHAR szWindowClass[MAX_LOADSTRING];            // the main window class name
@@ -22,16 +28,31 @@ ATOM                MyRegisterClass(HINSTANCE hInstance);
 BOOL                InitInstance(HINSTANCE, int, uint32_t, uint32_t, bool);
 LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
 
-// Frame counter to display fps
-uint32_t gFrameCounter = 0;
-uint32_t lastFPS = 0;
+// Time of the last simulation step
 std::chrono::time_point<std::chrono::high_resolution_clock> gLastTimestamp;
 
 bool resizing = false;
+// Keeps the simulation stepping while the modal size/move loop blocks the main message loop
+constexpr UINT_PTR SIMULATION_TIMER_ID = 1;
+constexpr UINT SIMULATION_TIMER_INTERVAL = 10;    // ms
 
 int screenWidth;
 int screenHeight;
 
+// File written by "-recordtimesteps" and read by "-replaytimesteps"
+static const char* TIMESTEP_RECORDING_FILE = "timesteps.rec";
+
+// Advances the simulation by the time since the last call (in fixed steps) and publishes the new state to the render thread
+static void stepSimulation()
+{
+    auto tNow = std::chrono::high_resolution_clock::now();
+    double elapsed = std::chrono::duration<double>(tNow - gLastTimestamp).count();
+    gLastTimestamp = tNow;
+
+    gSimulation.advance(elapsed);
+    gRenderThread.getSnapshot() = gSimulation.getSnapshot(tNow);
+    gRenderThread.publishSnapshot();
+}
 
 int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
                      _In_opt_ HINSTANCE hPrevInstance,
@@ -39,7 +60,6 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
                      _In_ int       nCmdShow)
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
 
     // TODO: Place code here.
 
@@ -90,14 +110,91 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
 
 //    HACCEL hAccelTable = LoadAccelerators(hInstance, MAKEINTRESOURCE(IDC_SIMPLEVULKAN));
 
+    // "-cullbenchmark" runs the CPU frustum culling microbenchmark (1M objects) before starting the renderer
+    if (wcsstr(lpCmdLine, L"-cullbenchmark") != nullptr)
+    {
+        FrustumCuller::runBenchmark();
+    }
+    // "-scenebenchmark" runs the scene graph update microbenchmark (1M nodes, 1% changed per frame) before starting the renderer
+    if (wcsstr(lpCmdLine, L"-scenebenchmark") != nullptr)
+    {
+        SceneGraph::runBenchmark();
+    }
+    // "-matrixbenchmark" runs the batched matrix kernel microbenchmark (1M matrices per kernel and instruction set) before starting the renderer
+    if (wcsstr(lpCmdLine, L"-matrixbenchmark") != nullptr)
+    {
+        MatrixKernels::runBenchmark();
+    }
+    // "-jobbenchmark" runs the job system scaling microbenchmark (1M transforms on 1, 2, 4 ... workers) before starting the renderer
+    if (wcsstr(lpCmdLine, L"-jobbenchmark") != nullptr)
+    {
+        JobSystem::runBenchmark();
+    }
+    // "-queuebenchmark" runs the render queue sort microbenchmark (1M draw keys, radix sort against std::stable_sort) before starting the renderer
+    if (wcsstr(lpCmdLine, L"-queuebenchmark") != nullptr)
+    {
+        RenderQueue::runBenchmark();
+    }
+    // "-hizcheck" checks the texel lookup of the occlusion test against Hi-Z pyramids of several (non power of two) sizes before starting the renderer
+    if (wcsstr(lpCmdLine, L"-hizcheck") != nullptr)
+    {
+        HiZReference::runCheck();
+    }
+
     gVulkanRender = std::make_unique<VulkanRender>();
+    // "-stress" draws the 100k object instancing stress scene (cubes and every 16th object a dense sphere)
+    gVulkanRender->SetStressScene(wcsstr(lpCmdLine, L"-stress") != nullptr);
+    // "-gpudriven" culls on the GPU and draws with vkCmdDrawIndexedIndirectCount
+    // "-occlusion" adds two phase Hi-Z occlusion culling to that (and turns it on)
+    // "-meshlets" adds meshlet (cluster) culling to that (and turns it on)
+    const bool occlusionCulling = wcsstr(lpCmdLine, L"-occlusion") != nullptr;
+    const bool clusterCulling = wcsstr(lpCmdLine, L"-meshlets") != nullptr;
+    gVulkanRender->SetGpuDrivenRendering(occlusionCulling || clusterCulling || wcsstr(lpCmdLine, L"-gpudriven") != nullptr);
+    gVulkanRender->SetOcclusionCulling(occlusionCulling);
+    gVulkanRender->SetClusterCulling(clusterCulling);
+    // "-nolod" draws every object at full detail, to compare against the level of detail selection
+    gVulkanRender->SetLevelOfDetail(wcsstr(lpCmdLine, L"-nolod") == nullptr);
+    // "-singlethreaded" runs all jobs on the render thread, to compare against the job system scaling
+    if (wcsstr(lpCmdLine, L"-singlethreaded") != nullptr)
+    {
+        gVulkanRender->SetWorkerCount(1);
+    }
+    // "-hotreload" recompiles changed shaders (slangc of the Vulkan SDK) and replaces their pipelines while running
+    gVulkanRender->SetShaderHotReload(wcsstr(lpCmdLine, L"-hotreload") != nullptr);
+    // "-shadersfromdisk" reads the SPIR-V files from the working directory instead of the shaders embedded in the executable
+    gVulkanRender->SetShadersFromDisk(wcsstr(lpCmdLine, L"-shadersfromdisk") != nullptr);
+    // "-nopipelinelibrary" compiles every graphics pipeline as a whole instead of linking it from VK_EXT_graphics_pipeline_library parts
+    gVulkanRender->SetPipelineLibrary(wcsstr(lpCmdLine, L"-nopipelinelibrary") == nullptr);
+    // "-nodynamicstate" bakes the rasterization, depth, blend and vertex input states into the pipelines instead of setting them with extended dynamic state
+    gVulkanRender->SetExtendedDynamicState(wcsstr(lpCmdLine, L"-nodynamicstate") == nullptr);
+    // "-nodescriptorbuffer" allocates the transient descriptor sets of a frame from descriptor pools instead of writing them into a VK_EXT_descriptor_buffer buffer
+    gVulkanRender->SetDescriptorBuffer(wcsstr(lpCmdLine, L"-nodescriptorbuffer") == nullptr);
+    // "-nopushdescriptors" uses transient descriptor sets for the per dispatch descriptors of the Hi-Z build instead of pushing them with VK_KHR_push_descriptor
+    gVulkanRender->SetPushDescriptors(wcsstr(lpCmdLine, L"-nopushdescriptors") == nullptr);
+    // "-descriptorbenchmark" runs the descriptor microbenchmark (100k transient sets: descriptor pools, descriptor buffer and push descriptors) once the renderer is initialized
+    gVulkanRender->SetDescriptorBenchmark(wcsstr(lpCmdLine, L"-descriptorbenchmark") != nullptr);
     gVulkanRender->Init(hInstance, gHwnd, screenWidth, screenHeight);
 
     MSG msg;
 
     gLastTimestamp = std::chrono::high_resolution_clock::now();
 
-    // Main message loop:
+    // From here on the renderer is only used by the render thread, until it is stopped when the window is destroyed
+    gRenderThread.getSnapshot() = gSimulation.getSnapshot(gLastTimestamp);
+    gRenderThread.publishSnapshot();
+    // "-recordtimesteps" records the time between frames, "-replaytimesteps" replays such a recording (deterministic simulation, same frames every run),
+    // logs the frame times and exits, to compare the frame times of different builds or settings
+    if (wcsstr(lpCmdLine, L"-replaytimesteps") != nullptr)
+    {
+        gRenderThread.replayTimesteps(TIMESTEP_RECORDING_FILE, []() { PostMessage(gHwnd, WM_CLOSE, 0, 0); });
+    }
+    else if (wcsstr(lpCmdLine, L"-recordtimesteps") != nullptr)
+    {
+        gRenderThread.recordTimesteps(TIMESTEP_RECORDING_FILE);
+    }
+    gRenderThread.start(gVulkanRender.get());
+
+    // Main message loop, steps the simulation in between messages:
     bool quitMessageReceived = false;
     while (!quitMessageReceived) {
         while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
@@ -109,19 +206,17 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
             }
         }
 
-        // MAIN: render Vulkan3D
-        if (!IsIconic(gHwnd) && gVulkanRender->IsPrepared())
-        {
-            gFrameCounter++;
+        if (quitMessageReceived) {
+            break;
+        }
 
-            auto tNow = std::chrono::high_resolution_clock::now();
+        stepSimulation();
 
-            float deltaTime = std::chrono::duration_cast<std::chrono::duration<float>>(tNow - gLastTimestamp).count();
-            gVulkanRender->RenderFrame(deltaTime);
-            gLastTimestamp = tNow;
-        }
+        // Rendering doesn't depend on this loop anymore, so sleep until the next message (or for at most a millisecond) instead of spinning
+        MsgWaitForMultipleObjects(0, nullptr, FALSE, 1, QS_ALLINPUT);
     }
 
+    gRenderThread.stop();
     gVulkanRender->Finalize();
 
     return (int) msg.wParam;
@@ -214,19 +309,39 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
     {
     case WM_ENTERSIZEMOVE:
         resizing = true;
+        SetTimer(hWnd, SIMULATION_TIMER_ID, SIMULATION_TIMER_INTERVAL, nullptr);
         break;
     case WM_EXITSIZEMOVE:
         resizing = false;
+        KillTimer(hWnd, SIMULATION_TIMER_ID);
+        break;
+    case WM_TIMER:
+        if (wParam == SIMULATION_TIMER_ID)
+        {
+            stepSimulation();
+        }
         break;
     case WM_SIZE:
-        if (gVulkanRender.get() && (gVulkanRender->IsPrepared()) && (wParam != SIZE_MINIMIZED))
+        // The render thread recreates the swap chain, a size of 0 pauses rendering while the window is minimized
+        if (gRenderThread.isRunning())
         {
-            if ((resizing) || ((wParam == SIZE_MAXIMIZED) || (wParam == SIZE_RESTORED)))
+            if (wParam == SIZE_MINIMIZED)
+            {
+                gRenderThread.postEvent(RenderEvent{ .type = RenderEvent::Type::Resize });
+            }
+            else if ((resizing) || ((wParam == SIZE_MAXIMIZED) || (wParam == SIZE_RESTORED)))
             {
-                gVulkanRender->HandleWindowResize(LOWORD(lParam), HIWORD(lParam));
+                gRenderThread.postEvent(RenderEvent{ .type = RenderEvent::Type::Resize, .width = LOWORD(lParam), .height = HIWORD(lParam) });
             }
         }
         break;
+    case WM_KEYDOWN:
+        // "L" toggles the level of detail selection, "S", "N", "V" and "1" to "4" switch the shader variant (see RenderThread::handleKey)
+        if (gRenderThread.isRunning())
+        {
+            gRenderThread.postEvent(RenderEvent{ .type = RenderEvent::Type::KeyDown, .key = static_cast<uint32_t>(wParam) });
+        }
+        break;
     case WM_COMMAND:
         {
             int wmId = LOWORD(wParam);
@@ -250,10 +365,11 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
         }
         break;
     case WM_DESTROY:
+        // Rendering has to stop while the window (and with it the swap chain's surface) still exists
+        gRenderThread.stop();
         PostQuitMessage(0);
         break;
     case WM_CLOSE:
-        gVulkanRender->ClearPrepared();
         DestroyWindow(hWnd);
         break;
     default:
@@ -0,0 +1,117 @@
+#include "Simulation.h"
+
+#include <algorithm>
+#include <fstream>
+
+
+namespace
+{
+	constexpr uint32_t TIMESTEP_RECORDING_MAGIC = 0x53505354;  // "TSPS"
+	constexpr uint32_t TIMESTEP_RECORDING_VERSION = 1;
+
+	struct TimestepRecordingHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t timestepCount;
+		uint32_t reserved;
+	};
+}
+
+
+uint32_t Simulation::advance(double elapsed)
+{
+	m_accumulator += elapsed;
+
+	uint32_t steps = 0;
+	while (m_accumulator >= FIXED_TIMESTEP)
+	{
+		if (steps == MAX_STEPS_PER_ADVANCE)
+		{
+			m_accumulator = 0.0;
+			break;
+		}
+		step();
+		m_accumulator -= FIXED_TIMESTEP;
+		steps++;
+	}
+	return steps;
+}
+
+SimulationSnapshot SimulationSnapshot::advancedTo(std::chrono::high_resolution_clock::time_point now) const
+{
+	SimulationSnapshot snapshot = *this;
+	if (time != std::chrono::high_resolution_clock::time_point{} && now > time)
+	{
+		const double elapsed = std::chrono::duration<double>(now - time).count();
+		snapshot.alpha = static_cast<float>(std::min(alpha + elapsed / Simulation::FIXED_TIMESTEP, 1.0));
+		snapshot.time = now;
+	}
+	return snapshot;
+}
+
+
+SimulationSnapshot Simulation::getSnapshot(std::chrono::high_resolution_clock::time_point time) const
+{
+	return SimulationSnapshot{ .previous = m_previous, .current = m_current, .alpha = static_cast<float>(m_accumulator / FIXED_TIMESTEP), .time = time };
+}
+
+void Simulation::step()
+{
+	m_previous = m_current;
+
+	const float deltaTime = static_cast<float>(FIXED_TIMESTEP);
+	// The camera keeps spinning around the scene
+	m_current.cameraRotation.x -= 160.0f * deltaTime;
+	m_current.cameraRotation.y += 25.0f * deltaTime;
+	m_current.step++;
+}
+
+
+bool TimestepRecording::save(const std::string& filename) const
+{
+	std::ofstream file(filename, std::ios::binary | std::ios::out | std::ios::trunc);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	const TimestepRecordingHeader header{ TIMESTEP_RECORDING_MAGIC, TIMESTEP_RECORDING_VERSION, static_cast<uint32_t>(timesteps.size()), 0 };
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(timesteps.data()), timesteps.size() * sizeof(float));
+	return file.good();
+}
+
+bool TimestepRecording::load(const std::string& filename)
+{
+	std::ifstream file(filename, std::ios::binary | std::ios::in);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	TimestepRecordingHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file.good() || header.magic != TIMESTEP_RECORDING_MAGIC || header.version != TIMESTEP_RECORDING_VERSION)
+	{
+		return false;
+	}
+
+	// The timesteps are only allocated once the file is known to hold them
+	const std::streamoff timestepsStart = file.tellg();
+	file.seekg(0, std::ios::end);
+	const std::streamoff remaining = file.tellg() - timestepsStart;
+	file.seekg(timestepsStart);
+	if (!file.good() || static_cast<uint64_t>(header.timestepCount) * sizeof(float) > static_cast<uint64_t>(remaining))
+	{
+		return false;
+	}
+
+	timesteps.resize(header.timestepCount);
+	file.read(reinterpret_cast<char*>(timesteps.data()), timesteps.size() * sizeof(float));
+	if (!file.good())
+	{
+		timesteps.clear();
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+
+// State of the simulated world after a fixed simulation step
+// Only plain values, so states can simply be copied and interpolated
+struct SimulationState {
+    glm::vec3 cameraRotation{ 0.0f };   // Camera orientation in degrees around x, y and z
+    uint64_t step{ 0 };                 // Number of fixed steps so far
+};
+
+
+// Handed from the simulation to the render thread (see RenderThread)
+// The simulation runs at a fixed rate that is independent of the frame rate, so a frame usually falls in between two steps:
+// it renders the state interpolated between the last two steps by alpha, the fraction of a step that has elapsed since the last one
+struct SimulationSnapshot {
+    SimulationState previous;
+    SimulationState current;
+    float alpha{ 1.0f };
+    // When alpha was taken, default for a snapshot whose alpha is final (replays)
+    std::chrono::high_resolution_clock::time_point time{};
+
+    glm::vec3 getCameraRotation() const { return glm::mix(previous.cameraRotation, current.cameraRotation, alpha); }
+
+    // The snapshot with alpha advanced by the time elapsed since it was taken, up to the current state (the next one isn't known yet)
+    // Snapshots are published whenever the simulation thread gets to it, a frame computes its own alpha so the motion doesn't follow that rate
+    SimulationSnapshot advancedTo(std::chrono::high_resolution_clock::time_point now) const;
+};
+
+
+// The simulated world, advanced in fixed steps of FIXED_TIMESTEP
+// The elapsed time is accumulated and consumed in whole steps, the remainder carries over to the next advance. So the result only depends on the
+// sequence of elapsed times, and the cost of the simulation depends on the simulated time instead of the frame rate
+class Simulation
+{
+public:
+    static constexpr double FIXED_TIMESTEP = 1.0 / 60.0;
+    // After a hitch (or a breakpoint) at most this many steps are run at once, the rest of the elapsed time is dropped instead of catching up on it
+    static constexpr uint32_t MAX_STEPS_PER_ADVANCE = 8;
+
+    // Adds elapsed seconds and runs the steps that are due, returns their number
+    uint32_t advance(double elapsed);
+
+    // time is the time the last advance ran up to, see SimulationSnapshot::advancedTo
+    SimulationSnapshot getSnapshot(std::chrono::high_resolution_clock::time_point time = {}) const;
+
+private:
+    void step();
+
+    SimulationState m_previous;
+    SimulationState m_current;
+    double m_accumulator{ 0.0 };
+};
+
+
+// Sequence of frame times, recorded from a real run and replayed to drive the simulation deterministically (see RenderThread)
+// Replaying the same recording renders the same simulation states in the same frames, so frame times of different builds can be compared
+struct TimestepRecording {
+    std::vector<float> timesteps;   // Seconds between consecutive frames
+
+    bool save(const std::string& filename) const;
+    bool load(const std::string& filename);
+};
@@ -1,35 +1,100 @@
 #include "VulkanRender.h"
+#include "EmbeddedShaders.h"
 
 #include "VulkanBase/VulkanDebug.h"
 
+#include <filesystem>
+
 
 bool VulkanRender::Init(HINSTANCE hInstance, HWND hwnd, uint32_t destWidth, uint32_t destHeight)
 {
 	width = destWidth;
 	height = destHeight;
 
+	wchar_t executablePath[MAX_PATH];
+	const DWORD executablePathLength = GetModuleFileNameW(nullptr, executablePath, MAX_PATH);
+	if (executablePathLength > 0 && executablePathLength < MAX_PATH)
+	{
+		m_cacheDirectory = std::filesystem::path(executablePath).parent_path().string();
+	}
+	else
+	{
+		std::cerr << "The directory of the executable is not known, the caches are kept in the working directory\n";
+	}
+
+	m_jobSystem = std::make_unique<JobSystem>(m_workerCount);
+	std::cout << "Job system: " << m_jobSystem->getWorkerCount() << " workers\n";
+
 	initVulkan();
     createSurface(hInstance, hwnd);
 
+	// Seeded with the pipelines of the previous run, if it was on the same device and driver
+	m_pipelineCache.create(vulkDevice, vulkDeviceProperties, getCachePath(PIPELINE_CACHE_FILE));
+	if (m_graphicsPipelineLibrary)
+	{
+		// The parts are cached in the pipeline cache like whole pipelines
+		m_pipelineLibrary.init(vulkDevice, m_pipelineCache.getHandle());
+		m_pipelineCompiler.setPipelineLibrary(&m_pipelineLibrary);
+	}
+	m_pipelineCompiler.start(vulkDevice, &m_pipelineCache);
+	m_pipelineRegistry.init(&m_pipelineCompiler, [this](const PipelineStateKey& key, GraphicsPipelineDescription& description) { return buildPipelineDescription(key, description); });
+	m_pipelineRegistry.setDynamicStates(m_dynamicState.getFlags());
+	m_layoutCache.init(vulkDevice);
+	m_pipelineCompileStart = std::chrono::high_resolution_clock::now();
+
 	createSwapChain();
 
 	createSynchronizationPrimitives();
 	createCommandBuffers();
 	setupDepthStencil();
 
+	createVertexBuffer();
+
 	createUniformBuffers();
+	createInstanceBuffers();
 
 	createDescriptorSetLayout();
 	createDescriptorPool();
 	createDescriptorSets();
+	createMaterials();
 
 
 	setupRenderPass();
+	if (m_occlusionCulling)
+	{
+		setupOcclusionRenderPasses();
+	}
 	setupFrameBuffer();
 
+	// The mesh shader pipeline created with the graphics pipelines uses the culling descriptor set layouts
+	if (m_gpuDriven)
+	{
+		createCullingResources();
+	}
+
 	createPipelines();
 
-	createVertexBuffer();
+	// Rendering starts right away, the frames are drawn with whatever pipelines are ready (see updatePendingPipelines)
+	std::cout << "Pipeline compilation: " << m_pendingPipelines.size() << " pipelines queued on " << m_pipelineCompiler.getThreadCount() << " threads\n";
+
+	// The shaders built by shadercompile.bat
+	if (m_shaderHotReload)
+	{
+		m_shaderWatcher.start({
+			{ "triangle.slang", "triangle.vert.spv", "vertexMain", "vertex" },
+			{ "triangle.slang", "triangle.frag.spv", "fragmentMain", "fragment" },
+			{ "cull.slang", "cull.comp.spv", "cullMain", "compute" },
+			{ "hiz.slang", "hiz.comp.spv", "hizMain", "compute" },
+			{ "meshlet.slang", "meshlet.task.spv", "taskMain", "amplification" },
+			{ "meshlet.slang", "meshlet.mesh.spv", "meshMain", "mesh" },
+		});
+		std::cout << "Shader hot reload: watching the shader sources\n";
+	}
+
+	if (m_descriptorBenchmark)
+	{
+		runDescriptorBenchmark(100000);
+	}
 
 	// TODO: remove it from here!
 	prepared = true;
@@ -45,6 +110,8 @@ bool VulkanRender::Init(HINSTANCE hInstance, HWND hwnd, uint32_t destWidth, uint
 //		mat4 projectionMatrix;
 //		mat4 modelMatrix;
 //		mat4 viewMatrix;
+//		vec4 frustumPlanes[6];
+//		vec4 cameraPosition;
 //	} ubo;
 //
 // This way we can just memcopy the ubo data to the ubo
@@ -53,23 +120,45 @@ struct ShaderData {
 	glm::mat4 projectionMatrix;
 	glm::mat4 modelMatrix;
 	glm::mat4 viewMatrix;
+	glm::vec4 frustumPlanes[6];	// See Frustum
+	glm::vec4 cameraPosition;	// Same space as the frustum planes, used by the meshlet normal cone test
 };
 
-
-void VulkanRender::RenderFrame(float deltaTime)
+void VulkanRender::RenderFrame(float deltaTime, const SimulationSnapshot& snapshot)
 {
 	if (!prepared)
 	{
 		return;
 	}
 
+	updatePendingPipelines(false);
+	updateShaderReload();
+	updateOptimizedPipelines();
+
 	// game logic update
-	updateViewMatrix(deltaTime);	// set m_viewMatrix
+	updateViewMatrix(snapshot.getCameraRotation());	// set m_viewMatrix
+	updateSceneTransforms();
 
 
 	// Use a fence to wait until the command buffer has finished execution before using it again
 	vkWaitForFences(vulkDevice, 1, &vulkWaitFences[m_currentFrame], VK_TRUE, UINT64_MAX);
 	VK_CHECK_RESULT(vkResetFences(vulkDevice, 1, &vulkWaitFences[m_currentFrame]));
+	destroyRetiredPipelines(false);
+	// The transient descriptor sets this frame slot was last recorded with are no longer in use
+	m_benchmark.transientDescriptorSets += m_frameDescriptorAllocators[m_currentFrame].getAllocationCount();
+	m_frameDescriptorAllocators[m_currentFrame].reset();
+	if (m_descriptorBufferEnabled)
+	{
+		m_benchmark.transientDescriptorSets += m_descriptorBuffer.getSetCount(m_currentFrame);
+		m_descriptorBuffer.reset(m_currentFrame);
+	}
+
+	// The fence guarantees that the culling counters of this frame slot have been written, so they can be read back now
+	if (m_gpuDriven)
+	{
+		m_cullStats = *static_cast<CullCounters*>(m_indirectDraws[m_currentFrame].counters.mapped);
+		readTimestamps();
+	}
 
 	// Get the next swap chain image from the implementation
 	// Note that the implementation is free to return the images in any order, so we must use the acquire function and can't just cycle through the images/imageIndex on our own
@@ -90,11 +179,19 @@ void VulkanRender::RenderFrame(float deltaTime)
 	shaderData.projectionMatrix = glm::perspective(glm::pi<float>()/2.0f, float(width)/float(height), 0.1f, 256.0f); //camera.matrices.perspective;
 	shaderData.viewMatrix = m_viewMatrix;
 	shaderData.modelMatrix = glm::mat4(1.0f);
+	const Frustum frustum = Frustum::fromMatrix(shaderData.projectionMatrix * shaderData.modelMatrix * shaderData.viewMatrix);
+	std::copy(std::begin(frustum.planes), std::end(frustum.planes), shaderData.frustumPlanes);
+	shaderData.cameraPosition = glm::inverse(shaderData.modelMatrix * shaderData.viewMatrix)[3];
+	// An object space error e at distance d covers e * m_lodPixelScale / d pixels
+	m_lodPixelScale = shaderData.projectionMatrix[1][1] * 0.5f * float(height);
 
 	// Copy the current matrices to the current frame's uniform buffer
 	// Note: Since we requested a host coherent memory type for the uniform buffer, the write is instantly visible to the GPU
 	memcpy(m_uniformBuffers[m_currentFrame].mapped, &shaderData, sizeof(ShaderData));
 
+	// Write this frame's instance transforms, the buffer is persistently mapped and host coherent so no flush is required
+	updateInstances(frustum, glm::vec3(shaderData.cameraPosition), m_instanceBuffers[m_currentFrame]);
+
 	// Build the command buffer
 	// Unlike in OpenGL all rendering commands are recorded into command buffers that are then submitted to the queue
 	// This allows to generate work upfront in a separate thread
@@ -126,39 +223,70 @@ void VulkanRender::RenderFrame(float deltaTime)
 	const VkCommandBuffer curCommandBuffer = vulkCommandBuffers[m_currentFrame];
 	VK_CHECK_RESULT(vkBeginCommandBuffer(curCommandBuffer, &cmdBufInfo));
 
-	// Start the first sub pass specified in our default render pass setup by the base class
-	// This will clear the color and depth attachment
-	vkCmdBeginRenderPass(curCommandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-	// Update dynamic viewport state
-	VkViewport viewport{};
-	viewport.height = (float)height;
-	viewport.width = (float)width;
-	viewport.minDepth = (float)0.0f;
-	viewport.maxDepth = (float)1.0f;
-	vkCmdSetViewport(curCommandBuffer, 0, 1, &viewport);
-	// Update dynamic scissor state
-	VkRect2D scissor{};
-	scissor.extent.width = width;
-	scissor.extent.height = height;
-	scissor.offset.x = 0;
-	scissor.offset.y = 0;
-	vkCmdSetScissor(curCommandBuffer, 0, 1, &scissor);
+	// Timestamps are written once all previously recorded work has completed
+	const uint32_t firstQuery = m_currentFrame * TIMESTAMPS_PER_FRAME;
+	auto writeTimestamp = [&](uint32_t query) {
+		if (m_timestampQueryPool != VK_NULL_HANDLE)
+		{
+			vkCmdWriteTimestamp(curCommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampQueryPool, firstQuery + query);
+		}
+	};
 
-	// Bind descriptor set for the current frame's uniform buffer, so the shader uses the data from that buffer for this draw
-	vkCmdBindDescriptorSets(curCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkPipelineLayout, 0, 1, &m_uniformBuffers[m_currentFrame].descriptorSet, 0, nullptr);
-	// Bind the rendering pipeline
-	// The pipeline (state object) contains all states of the rendering pipeline, binding it will set all the states specified at pipeline creation time
-	vkCmdBindPipeline(curCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkPipeline);
-	// Bind triangle vertex buffer (contains position and colors)
-	VkDeviceSize offsets[1]{ 0 };
-	vkCmdBindVertexBuffers(curCommandBuffer, 0, 1, &m_vertices.buffer, offsets);
-	// Bind triangle index buffer
-	vkCmdBindIndexBuffer(curCommandBuffer, m_indices.buffer, 0, VK_INDEX_TYPE_UINT16);
-	// Draw indexed triangle
-	vkCmdDrawIndexed(curCommandBuffer, m_indices.count, 1, 0, 0, 0);
+	// Culling has to happen outside of the render pass
+	const bool drawScene = scenePipelinesReady();
+	if (m_gpuDriven && drawScene)
+	{
+		if (m_timestampQueryPool != VK_NULL_HANDLE)
+		{
+			vkCmdResetQueryPool(curCommandBuffer, m_timestampQueryPool, firstQuery, TIMESTAMPS_PER_FRAME);
+			m_timestampsWritten[m_currentFrame] = true;
+		}
+		recordCulling(curCommandBuffer, 0);
+		writeTimestamp(0);
+	}
 
-	vkCmdEndRenderPass(curCommandBuffer);
-	// Ending the render pass will add an implicit barrier transitioning the frame buffer color attachment to
+	if (!drawScene)
+	{
+		// Nothing to draw with yet, only clear
+		vkCmdBeginRenderPass(curCommandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdEndRenderPass(curCommandBuffer);
+	}
+	else if (m_occlusionCulling)
+	{
+		// First pass: draw the objects that were visible last frame, this clears the attachments and keeps the depth
+		renderPassBeginInfo.renderPass = m_earlyRenderPass;
+		vkCmdBeginRenderPass(curCommandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		recordSceneDraws(curCommandBuffer, 0);
+		vkCmdEndRenderPass(curCommandBuffer);
+		writeTimestamp(1);
+
+		// Reduce that depth into the Hi-Z pyramid and test all objects inside the frustum against it
+		recordHiZ(curCommandBuffer);
+		recordCulling(curCommandBuffer, 1);
+		writeTimestamp(2);
+
+		// Second pass: draw the objects that became visible on top of the first pass
+		renderPassBeginInfo.renderPass = m_lateRenderPass;
+		renderPassBeginInfo.clearValueCount = 0;
+		renderPassBeginInfo.pClearValues = nullptr;
+		vkCmdBeginRenderPass(curCommandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		recordSceneDraws(curCommandBuffer, 1);
+		vkCmdEndRenderPass(curCommandBuffer);
+		writeTimestamp(3);
+	}
+	else
+	{
+		// Start the first sub pass specified in our default render pass setup by the base class
+		// This will clear the color and depth attachment
+		vkCmdBeginRenderPass(curCommandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		recordSceneDraws(curCommandBuffer, 0);
+		vkCmdEndRenderPass(curCommandBuffer);
+		// There is no occlusion culling work, so all remaining timestamps mark the end of the draws
+		writeTimestamp(1);
+		writeTimestamp(2);
+		writeTimestamp(3);
+	}
+	// Ending the (last) render pass will add an implicit barrier transitioning the frame buffer color attachment to
 	// VK_IMAGE_LAYOUT_PRESENT_SRC_KHR for presenting it to the windowing system
 	VK_CHECK_RESULT(vkEndCommandBuffer(curCommandBuffer));
 
@@ -205,8 +333,29 @@ void VulkanRender::RenderFrame(float deltaTime)
 		throw std::runtime_error("Could not present the image to the swap chain!");
 	}
 
+	if (m_gpuDriven)
+	{
+		// With cluster culling the draws are meshlets, the mesh shader path issues a single indirect draw of all task work groups
+		const uint32_t gpuDrawCount = m_cullStats.drawCount + m_cullStats.lateDrawCount;
+		updateBenchmark(deltaTime, meshShadersReady() ? 1 : gpuDrawCount, meshShadersReady() ? m_cullStats.taskGroupCount[0] : gpuDrawCount, m_cullStats.triangleCount, m_cullStats.fullDetailTriangleCount);
+	}
+	else
+	{
+		const uint32_t cpuDrawCount = static_cast<uint32_t>(std::count_if(m_meshDrawRanges.begin(), m_meshDrawRanges.end(), [](const MeshDrawRange& range) { return range.instanceCount > 0; }));
+		updateBenchmark(deltaTime, cpuDrawCount, m_drawInstanceCount, m_drawTriangleCount, m_fullDetailTriangleCount);
+	}
+
+	// Pipelines created since the last save (e.g. reloaded shaders) are written out periodically, so a crash doesn't lose them
+	m_pipelineCacheSaveTimer += deltaTime;
+	if (m_pipelineCacheSaveTimer >= PIPELINE_CACHE_SAVE_INTERVAL)
+	{
+		m_pipelineCache.save();
+		m_pipelineCacheSaveTimer = 0.0f;
+	}
+
 	// Select the next frame to render to, based on the max. no. of concurrent frames
 	m_currentFrame = (m_currentFrame + 1) % MAX_CONCURRENT_FRAMES;
+	m_frameNumber++;
 }
 
 void VulkanRender::Finalize()
@@ -216,6 +365,29 @@ void VulkanRender::Finalize()
 
 	if (vulkDevice)
 	{
+		m_shaderWatcher.stop();
+		// The render thread may have submitted frames right before it stopped
+		vkDeviceWaitIdle(vulkDevice);
+		// Pipelines still compiling are finished and destroyed with the others
+		m_pipelineCompiler.stop();
+		updatePendingPipelines(true);
+		// Reloaded pipelines that haven't been swapped in yet and the replaced ones
+		for (const ReloadedPipeline& reloaded : m_reloadedPipelines)
+		{
+			try
+			{
+				vkDestroyPipeline(vulkDevice, reloaded.future.get(), nullptr);
+			}
+			catch (const std::runtime_error&)
+			{
+			}
+		}
+		m_reloadedPipelines.clear();
+		destroyRetiredPipelines(true);
+		m_pipelineRegistry.save(getCachePath(PIPELINE_KEYS_FILE));
+		m_pipelineRegistry.destroy(vulkDevice);
+		m_pipelineLibrary.destroy();
+
 //		vkDestroyPipeline(vulkDevice, pipeline, nullptr);
 //		vkDestroyPipelineLayout(vulkDevice, pipelineLayout, nullptr);
 //		vkDestroyDescriptorSetLayout(vulkDevice, descriptorSetLayout, nullptr);
@@ -237,10 +409,46 @@ void VulkanRender::Finalize()
 			vkDestroyFence(vulkDevice, vulkWaitFences[i], nullptr);
 			//vkDestroyBuffer(vulkDevice, uniformBuffers[i].buffer, nullptr);
 			//vkFreeMemory(vulkDevice, uniformBuffers[i].memory, nullptr);
+			vkUnmapMemory(vulkDevice, m_instanceBuffers[i].memory);
+			vkDestroyBuffer(vulkDevice, m_instanceBuffers[i].buffer, nullptr);
+			vkFreeMemory(vulkDevice, m_instanceBuffers[i].memory, nullptr);
+			m_indirectDraws[i].commands.destroy();
+			m_indirectDraws[i].counters.destroy();
+		}
+		m_meshBuffer.destroy();
+		m_meshletBuffer.destroy();
+		m_meshletVertexBuffer.destroy();
+		m_meshletTriangleBuffer.destroy();
+		vkDestroyPipeline(vulkDevice, m_cullPipeline, nullptr);
+		vkDestroyQueryPool(vulkDevice, m_timestampQueryPool, nullptr);
+		m_visibilityBuffer.destroy();
+		m_lodBuffer.destroy();
+		destroyHiZ();
+		vkDestroyPipeline(vulkDevice, m_hiZPipeline, nullptr);
+		destroyMaterials();
+		// The update templates refer to the set layouts
+		vkDestroyDescriptorUpdateTemplate(vulkDevice, m_uniformUpdateTemplate, nullptr);
+		vkDestroyDescriptorUpdateTemplate(vulkDevice, m_cullUpdateTemplate, nullptr);
+		vkDestroyDescriptorUpdateTemplate(vulkDevice, m_meshletUpdateTemplate, nullptr);
+		vkDestroyDescriptorUpdateTemplate(vulkDevice, m_hiZUpdateTemplate, nullptr);
+		m_descriptorAllocator.destroy();
+		for (DescriptorAllocator& frameDescriptorAllocator : m_frameDescriptorAllocators)
+		{
+			frameDescriptorAllocator.destroy();
 		}
+		m_descriptorBuffer.destroy();
+		// All descriptor set and pipeline layouts
+		m_layoutCache.destroy();
+		vkDestroyImageView(vulkDevice, m_depthSampleView, nullptr);
+		vkDestroyRenderPass(vulkDevice, m_earlyRenderPass, nullptr);
+		vkDestroyRenderPass(vulkDevice, m_lateRenderPass, nullptr);
+
+		m_pipelineCache.save();
+		m_pipelineCache.destroy();
 
 		m_swapChain.cleanup();
 	}
+	m_jobSystem.reset();
 }
 
 
@@ -293,14 +501,15 @@ void VulkanRender::initVulkan()
 	vkGetPhysicalDeviceFeatures(vulkPhysicalDevice, &vulkDeviceFeatures);
 	vkGetPhysicalDeviceMemoryProperties(vulkPhysicalDevice, &vulkDeviceMemoryProperties);
 
-	// Derived examples can override this to set actual features (based on above readings) to enable for logical device creation
-//	getEnabledFeatures();
-
 	// Vulkan device creation
 	// This is handled by a separate class that gets a logical device representation
 	// and encapsulates functions related to a device
 	m_vulkanDevice = new vks::VulkanDevice(vulkPhysicalDevice);
 
+	// Set actual features (based on above readings) to enable for logical device creation
+	// This is done after creating the device wrapper, as it reads the extensions supported by the physical device
+	getEnabledFeatures();
+
 	// Derived examples can enable extensions based on the list of supported extensions read from the physical device
 //	getEnabledExtensions();
 
@@ -323,9 +532,177 @@ void VulkanRender::initVulkan()
 	}
 	assert(validFormat);
 
+	// Occlusion culling builds the Hi-Z pyramid from the depth buffer, so the depth format has to support sampling
+	if (m_occlusionCullingRequested && m_gpuDriven)
+	{
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(vulkPhysicalDevice, vulkDepthFormat, &formatProperties);
+		m_occlusionCulling = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+	}
+	if (m_occlusionCullingRequested && !m_occlusionCulling)
+	{
+		std::cerr << "Occlusion culling needs GPU driven rendering and a sampleable depth format, it is disabled\n";
+	}
+
+	if (m_meshShaders)
+	{
+		m_vkCmdDrawMeshTasksIndirectEXT = reinterpret_cast<PFN_vkCmdDrawMeshTasksIndirectEXT>(vkGetDeviceProcAddr(vulkDevice, "vkCmdDrawMeshTasksIndirectEXT"));
+	}
+	if (m_pushDescriptorsEnabled)
+	{
+		m_vkCmdPushDescriptorSetKHR = reinterpret_cast<PFN_vkCmdPushDescriptorSetKHR>(vkGetDeviceProcAddr(vulkDevice, "vkCmdPushDescriptorSetKHR"));
+	}
+	m_dynamicState.init(vulkDevice);
+
 	m_swapChain.setContext(vulkInstance, vulkPhysicalDevice, vulkDevice);
 }
 
+// Enable the optional device features used by the renderer, each feature path falls back if the device doesn't support it
+void VulkanRender::getEnabledFeatures()
+{
+	// GPU driven rendering issues one indirect draw per visible object with firstInstance selecting the object
+	// This needs multi draw indirect, non-zero firstInstance in indirect draws and the (Vulkan 1.2) indirect count draw
+	if (m_gpuDrivenRequested && vulkDeviceProperties.apiVersion >= VK_API_VERSION_1_2)
+	{
+		VkPhysicalDeviceVulkan12Features supportedVulkan12Features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+		VkPhysicalDeviceFeatures2 deviceFeatures2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+		deviceFeatures2.pNext = &supportedVulkan12Features;
+		vkGetPhysicalDeviceFeatures2(vulkPhysicalDevice, &deviceFeatures2);
+
+		m_gpuDriven = supportedVulkan12Features.drawIndirectCount && vulkDeviceFeatures.multiDrawIndirect && vulkDeviceFeatures.drawIndirectFirstInstance;
+	}
+	if (m_gpuDrivenRequested && !m_gpuDriven)
+	{
+		std::cerr << "GPU driven rendering is not supported by the selected device, falling back to CPU driven instanced draws\n";
+	}
+
+	if (m_gpuDriven)
+	{
+		vulkEnabledFeatures.multiDrawIndirect = VK_TRUE;
+		vulkEnabledFeatures.drawIndirectFirstInstance = VK_TRUE;
+		m_enabledVulkan12Features.drawIndirectCount = VK_TRUE;
+	}
+
+	// Bindless resources: the materials select their textures and samplers by index from a single descriptor set (see BindlessDescriptors)
+	// All scene shaders read their material through it, so unlike the other features there is no fallback
+	if (!m_bindless.enableFeatures(m_vulkanDevice, vulkDeviceProperties.apiVersion, m_enabledDeviceExtensions, m_enabledVulkan12Features, vulkDeviceCreatepNextChain))
+	{
+		throw std::runtime_error("The selected device doesn't support descriptor indexing, which the bindless materials need");
+	}
+	// Descriptor buffers: the transient descriptors of a frame are written straight into a host visible buffer instead of sets allocated from the
+	// per-frame descriptor pools (see DescriptorBuffer)
+	if (m_descriptorBufferRequested)
+	{
+		m_descriptorBufferEnabled = m_descriptorBuffer.enableFeatures(m_vulkanDevice, vulkDeviceProperties.apiVersion, m_enabledDeviceExtensions, m_enabledVulkan12Features, vulkDeviceCreatepNextChain);
+		if (!m_descriptorBufferEnabled)
+		{
+			std::cerr << "Descriptor buffers are not supported by the selected device, transient descriptor sets are allocated from descriptor pools\n";
+		}
+	}
+	// Push descriptors: passes that bind new resources for every dispatch record the descriptors into the command buffer (no feature to enable)
+	if (m_pushDescriptorsRequested)
+	{
+		m_pushDescriptorsEnabled = m_vulkanDevice->extensionSupported(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+		if (m_pushDescriptorsEnabled)
+		{
+			m_enabledDeviceExtensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+		}
+		else
+		{
+			std::cerr << "Push descriptors are not supported by the selected device, per dispatch descriptors use transient descriptor sets\n";
+		}
+	}
+	// Push descriptors take precedence over the descriptor buffer for the per dispatch descriptors of the Hi-Z build, with both enabled the
+	// descriptor buffer is only used by the descriptor benchmark (-nopushdescriptors selects it)
+	std::cout << "Hi-Z build descriptors: " << (m_pushDescriptorsEnabled ? "push descriptors" : (m_descriptorBufferEnabled ? "descriptor buffer" : "descriptor pools"))
+		<< ((m_pushDescriptorsEnabled && m_descriptorBufferEnabled) ? " (descriptor buffer only used by -descriptorbenchmark)" : "") << "\n";
+	// The Vulkan 1.2 features of GPU driven rendering, descriptor indexing and buffer device address (descriptor buffers), only chained on Vulkan 1.2
+	// devices (descriptor indexing is enabled through its extension on older ones)
+	if (vulkDeviceProperties.apiVersion >= VK_API_VERSION_1_2)
+	{
+		m_enabledVulkan12Features.pNext = vulkDeviceCreatepNextChain;
+		vulkDeviceCreatepNextChain = &m_enabledVulkan12Features;
+	}
+
+	// Cluster culling runs in the GPU culling pass, with task and mesh shaders it skips the per meshlet indirect draws
+	// The mesh shader path draws in a single pass, so it isn't combined with (two pass) occlusion culling
+	m_clusterCulling = m_clusterCullingRequested && m_gpuDriven;
+	if (m_clusterCullingRequested && !m_clusterCulling)
+	{
+		std::cerr << "Cluster culling needs GPU driven rendering, it is disabled\n";
+	}
+	if (m_clusterCulling && !m_occlusionCullingRequested && m_vulkanDevice->extensionSupported(VK_EXT_MESH_SHADER_EXTENSION_NAME))
+	{
+		VkPhysicalDeviceMeshShaderFeaturesEXT supportedMeshShaderFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT };
+		VkPhysicalDeviceFeatures2 deviceFeatures2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+		deviceFeatures2.pNext = &supportedMeshShaderFeatures;
+		vkGetPhysicalDeviceFeatures2(vulkPhysicalDevice, &deviceFeatures2);
+
+		m_meshShaders = supportedMeshShaderFeatures.taskShader && supportedMeshShaderFeatures.meshShader;
+	}
+	if (m_meshShaders)
+	{
+		m_enabledDeviceExtensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+		m_enabledMeshShaderFeatures.taskShader = VK_TRUE;
+		m_enabledMeshShaderFeatures.meshShader = VK_TRUE;
+		m_enabledMeshShaderFeatures.pNext = vulkDeviceCreatepNextChain;
+		vulkDeviceCreatepNextChain = &m_enabledMeshShaderFeatures;
+	}
+	if (m_clusterCulling)
+	{
+		std::cout << "Cluster culling: " << (m_meshShaders ? "task and mesh shaders" : "compute shader with indirect draws") << "\n";
+	}
+
+	// Graphics pipeline libraries split the pipelines into parts that are compiled once and linked into each pipeline
+	if (m_pipelineLibraryRequested && m_vulkanDevice->extensionSupported(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) && m_vulkanDevice->extensionSupported(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME))
+	{
+		VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT supportedGraphicsPipelineLibraryFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT };
+		VkPhysicalDeviceFeatures2 deviceFeatures2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+		deviceFeatures2.pNext = &supportedGraphicsPipelineLibraryFeatures;
+		vkGetPhysicalDeviceFeatures2(vulkPhysicalDevice, &deviceFeatures2);
+
+		m_graphicsPipelineLibrary = supportedGraphicsPipelineLibraryFeatures.graphicsPipelineLibrary;
+	}
+	if (m_graphicsPipelineLibrary)
+	{
+		m_enabledDeviceExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+		m_enabledDeviceExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+		m_enabledGraphicsPipelineLibraryFeatures.graphicsPipelineLibrary = VK_TRUE;
+		m_enabledGraphicsPipelineLibraryFeatures.pNext = vulkDeviceCreatepNextChain;
+		vulkDeviceCreatepNextChain = &m_enabledGraphicsPipelineLibraryFeatures;
+
+		// Without fast linking a link can take as long as compiling the whole pipeline, the parts are still shared
+		VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT graphicsPipelineLibraryProperties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT };
+		VkPhysicalDeviceProperties2 deviceProperties2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+		deviceProperties2.pNext = &graphicsPipelineLibraryProperties;
+		vkGetPhysicalDeviceProperties2(vulkPhysicalDevice, &deviceProperties2);
+		std::cout << "Graphics pipeline library: " << (graphicsPipelineLibraryProperties.graphicsPipelineLibraryFastLinking ? "fast linking" : "no fast linking") << "\n";
+	}
+	else if (m_pipelineLibraryRequested)
+	{
+		std::cerr << "Graphics pipeline libraries are not supported by the selected device, pipelines are compiled as a whole\n";
+	}
+
+	// Wireframe rendering of the scene (see SceneRenderState)
+	vulkEnabledFeatures.fillModeNonSolid = vulkDeviceFeatures.fillModeNonSolid;
+
+	// Extended dynamic state takes the rasterization, depth, blend and vertex input states out of the pipelines, so fewer pipelines are compiled
+	if (m_dynamicStateRequested)
+	{
+		m_dynamicState.enableFeatures(m_vulkanDevice, m_enabledDeviceExtensions, vulkDeviceCreatepNextChain);
+		const std::array<const char*, 8> stateNames{ "cull mode", "topology", "depth", "rasterizer", "primitive restart", "polygon mode", "color blend", "vertex input" };
+		std::cout << "Dynamic states:";
+		for (uint32_t i = 0; i < stateNames.size(); i++)
+		{
+			if (m_dynamicState.getFlags() & (1u << i))
+			{
+				std::cout << " " << stateNames[i];
+			}
+		}
+		std::cout << (m_dynamicState.getFlags() == 0 ? " none supported\n" : "\n");
+	}
+}
+
 
 
 
@@ -407,6 +784,13 @@ VkResult VulkanRender::createInstance()
 		m_enabledDeviceExtensions.push_back(VK_KHR_SHADER_DRAW_PARAMETERS_EXTENSION_NAME);
 	}
 
+	// Descriptor indexing used by the bindless materials and vkCmdDrawIndexedIndirectCount used by GPU driven rendering are core in Vulkan 1.2
+	// Devices that only support Vulkan 1.1 are still used, up to their own version
+	if (m_apiVersion < VK_API_VERSION_1_2)
+	{
+		m_apiVersion = VK_API_VERSION_1_2;
+	}
+
 	VkApplicationInfo appInfo{
 		.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
 		.pApplicationName = "VI App name",
@@ -683,6 +1067,104 @@ void VulkanRender::setupRenderPass()
 	VK_CHECK_RESULT(vkCreateRenderPass(vulkDevice, &renderPassCI, nullptr, &vulkRenderPass));
 }
 
+// Occlusion culling splits the frame into two render passes with the Hi-Z build and the second culling phase in between
+// Both are compatible with the default render pass (same attachments, only load/store ops and layouts differ), so they use the same frame buffers and pipelines
+void VulkanRender::setupOcclusionRenderPasses()
+{
+	std::array<VkAttachmentDescription, 2> attachments{};
+	attachments[0].format = m_swapChain.colorFormat;
+	attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+	attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[1].format = vulkDepthFormat;
+	attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+	attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+	VkAttachmentReference colorReference{ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+	VkAttachmentReference depthReference{ 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+	VkSubpassDescription subpassDescription{};
+	subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpassDescription.colorAttachmentCount = 1;
+	subpassDescription.pColorAttachments = &colorReference;
+	subpassDescription.pDepthStencilAttachment = &depthReference;
+
+	VkRenderPassCreateInfo renderPassCI{};
+	renderPassCI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassCI.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPassCI.pAttachments = attachments.data();
+	renderPassCI.subpassCount = 1;
+	renderPassCI.pSubpasses = &subpassDescription;
+
+	// Early pass: clears both attachments, keeps the color for the late pass and stores the depth for the Hi-Z build
+	attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	std::array<VkSubpassDependency, 3> earlyDependencies{};
+	// Depth attachment, the previous frame's Hi-Z build may still be reading it
+	earlyDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	earlyDependencies[0].dstSubpass = 0;
+	earlyDependencies[0].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	earlyDependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	earlyDependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	earlyDependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+	// Color attachment
+	earlyDependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+	earlyDependencies[1].dstSubpass = 0;
+	earlyDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	earlyDependencies[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	earlyDependencies[1].srcAccessMask = 0;
+	earlyDependencies[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+	// Depth writes have to be visible to the Hi-Z build
+	earlyDependencies[2].srcSubpass = 0;
+	earlyDependencies[2].dstSubpass = VK_SUBPASS_EXTERNAL;
+	earlyDependencies[2].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	earlyDependencies[2].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	earlyDependencies[2].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	earlyDependencies[2].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	renderPassCI.dependencyCount = static_cast<uint32_t>(earlyDependencies.size());
+	renderPassCI.pDependencies = earlyDependencies.data();
+	VK_CHECK_RESULT(vkCreateRenderPass(vulkDevice, &renderPassCI, nullptr, &m_earlyRenderPass));
+
+	// Late pass: continues on the attachments of the early pass and presents
+	attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	std::array<VkSubpassDependency, 2> lateDependencies{};
+	// Depth attachment, the transition back to attachment layout has to wait for the Hi-Z build to finish reading
+	lateDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	lateDependencies[0].dstSubpass = 0;
+	lateDependencies[0].srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	lateDependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	lateDependencies[0].srcAccessMask = 0;
+	lateDependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+	// Color attachment, written by the early pass
+	lateDependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+	lateDependencies[1].dstSubpass = 0;
+	lateDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	lateDependencies[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	lateDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	lateDependencies[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+
+	renderPassCI.dependencyCount = static_cast<uint32_t>(lateDependencies.size());
+	renderPassCI.pDependencies = lateDependencies.data();
+	VK_CHECK_RESULT(vkCreateRenderPass(vulkDevice, &renderPassCI, nullptr, &m_lateRenderPass));
+}
+
 void VulkanRender::setupDepthStencil()
 {
 	// Create an optimal image used as the depth stencil attachment
@@ -697,6 +1179,11 @@ void VulkanRender::setupDepthStencil()
 		.tiling = VK_IMAGE_TILING_OPTIMAL,
 		.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
 	};
+	// Occlusion culling reads the depth of the first pass to build the Hi-Z pyramid
+	if (m_occlusionCulling)
+	{
+		imageCI.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+	}
 	VK_CHECK_RESULT(vkCreateImage(vulkDevice, &imageCI, nullptr, &depthStencil.image));
 
 	// Allocate memory for the image (device local) and bind it to our image
@@ -733,6 +1220,13 @@ void VulkanRender::setupDepthStencil()
 		depthStencilViewCI.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
 	}
 	VK_CHECK_RESULT(vkCreateImageView(vulkDevice, &depthStencilViewCI, nullptr, &depthStencil.view));
+
+	// Sampling needs a view with the depth aspect only
+	if (m_occlusionCulling)
+	{
+		depthStencilViewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		VK_CHECK_RESULT(vkCreateImageView(vulkDevice, &depthStencilViewCI, nullptr, &m_depthSampleView));
+	}
 }
 
 uint32_t VulkanRender::getMemoryTypeIndex(uint32_t typeBits, VkMemoryPropertyFlags properties)
@@ -793,236 +1287,342 @@ void VulkanRender::createUniformBuffers()
 
 }
 
+// Per-instance transforms are streamed through a host visible buffer that is mapped once and written every frame
+// Host coherent memory is used, so the writes are visible to the GPU without explicit flushes
+void VulkanRender::createInstanceBuffers()
+{
+	createScene();
+
+	VkBufferCreateInfo bufferCI{};
+	bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCI.size = m_instanceCount * sizeof(InstanceData);
+	// The instance buffer is also the object buffer read by the GPU culling pass
+	bufferCI.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+	for (uint32_t i = 0; i < MAX_CONCURRENT_FRAMES; i++)
+	{
+		VK_CHECK_RESULT(vkCreateBuffer(vulkDevice, &bufferCI, nullptr, &m_instanceBuffers[i].buffer));
+		VkMemoryRequirements memReqs;
+		vkGetBufferMemoryRequirements(vulkDevice, m_instanceBuffers[i].buffer, &memReqs);
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = memReqs.size;
+		allocInfo.memoryTypeIndex = getMemoryTypeIndex(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(vulkDevice, &allocInfo, nullptr, &m_instanceBuffers[i].memory));
+		VK_CHECK_RESULT(vkBindBufferMemory(vulkDevice, m_instanceBuffers[i].buffer, m_instanceBuffers[i].memory, 0));
+		// Persistent mapping, the pointer stays valid until the memory is freed in Finalize
+		VK_CHECK_RESULT(vkMapMemory(vulkDevice, m_instanceBuffers[i].memory, 0, bufferCI.size, 0, (void**)&m_instanceBuffers[i].mapped));
+		memcpy(m_instanceBuffers[i].mapped, m_sceneInstances.data(), bufferCI.size);
+	}
+}
+
 void VulkanRender::createPipelines()
 {
 	// Create the pipeline layout that is used to generate the rendering pipelines that are based on this descriptor set layout
-	// In a more complex scenario you would have different pipeline layouts for different descriptor set layouts that could be reused
-	VkPipelineLayoutCreateInfo pipelineLayoutCI{};
-	pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutCI.pNext = nullptr;
-	pipelineLayoutCI.setLayoutCount = 1;
-	pipelineLayoutCI.pSetLayouts = &vulkDescriptorSetLayout;
-	VK_CHECK_RESULT(vkCreatePipelineLayout(vulkDevice, &pipelineLayoutCI, nullptr, &vulkPipelineLayout));
+	// The layout cache hands out the same pipeline layout to every pipeline whose shaders have the same interface
+	// Set 0 is the uniform buffer and set 1 the bindless descriptor set, both shared with the mesh shader pipeline layout
+	std::vector<VkDescriptorSetLayout> sceneSetLayouts{ vulkDescriptorSetLayout, m_bindless.getSetLayout() };
+	vulkPipelineLayout = m_layoutCache.getPipelineLayout({ &getShaderReflection("triangle.vert.spv"), &getShaderReflection("triangle.frag.spv") }, sceneSetLayouts);
+
+	// Compile the pipelines of the previous run first, the requests below then find theirs in the registry
+	uint32_t prewarmCount = 0;
+	for (const PipelineStateKey& key : m_pipelineRegistry.load(getCachePath(PIPELINE_KEYS_FILE)))
+	{
+		prewarmCount += m_pipelineRegistry.request(key).valid() ? 1 : 0;
+	}
+	if (prewarmCount > 0)
+	{
+		std::cout << "Pre-warming " << prewarmCount << " pipelines of the last run\n";
+	}
 
 	// Create the graphics pipeline used in this example
 	// Vulkan uses the concept of rendering pipelines to encapsulate fixed states, replacing OpenGL's complex state machine
 	// A pipeline is then stored and hashed on the GPU making pipeline changes very fast
-	// Note: There are still a few dynamic states that are not directly part of the pipeline (but the info that they are used is)
-
-	VkGraphicsPipelineCreateInfo pipelineCI{};
-	pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	// The layout used for this pipeline (can be shared among multiple pipelines using the same layout)
-	pipelineCI.layout = vulkPipelineLayout;
-	// Renderpass this pipeline is attached to
-	pipelineCI.renderPass = vulkRenderPass;
-
-	// Construct the different states making up the pipeline
-
-	// Input assembly state describes how primitives are assembled
-	// This pipeline will assemble vertex data as a triangle lists (though we only use one triangle)
-	VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCI{};
-	inputAssemblyStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssemblyStateCI.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-
-	// Rasterization state
-	VkPipelineRasterizationStateCreateInfo rasterizationStateCI{};
-	rasterizationStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizationStateCI.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
-	rasterizationStateCI.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-	rasterizationStateCI.depthClampEnable = VK_FALSE;
-	rasterizationStateCI.rasterizerDiscardEnable = VK_FALSE;
-	rasterizationStateCI.depthBiasEnable = VK_FALSE;
-	rasterizationStateCI.lineWidth = 1.0f;
-
-	// Color blend state describes how blend factors are calculated (if used)
-	// We need one blend attachment state per color attachment (even if blending is not used)
-	VkPipelineColorBlendAttachmentState blendAttachmentState{};
-	blendAttachmentState.colorWriteMask = 0xf;
-	blendAttachmentState.blendEnable = VK_FALSE;
-	VkPipelineColorBlendStateCreateInfo colorBlendStateCI{};
-	colorBlendStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlendStateCI.attachmentCount = 1;
-	colorBlendStateCI.pAttachments = &blendAttachmentState;
-
-	// Viewport state sets the number of viewports and scissor used in this pipeline
-	// Note: This is actually overridden by the dynamic states (see below)
-	VkPipelineViewportStateCreateInfo viewportStateCI{};
-	viewportStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportStateCI.viewportCount = 1;
-	viewportStateCI.scissorCount = 1;
-
-	// Enable dynamic states
-	// Most states are baked into the pipeline, but there are still a few dynamic states that can be changed within a command buffer
-	// To be able to change these we need do specify which dynamic states will be changed using this pipeline. Their actual states are set later on in the command buffer.
-	// For this example we will set the viewport and scissor using dynamic states
-	std::vector<VkDynamicState> dynamicStateEnables;
-	dynamicStateEnables.push_back(VK_DYNAMIC_STATE_VIEWPORT);
-	dynamicStateEnables.push_back(VK_DYNAMIC_STATE_SCISSOR);
-	VkPipelineDynamicStateCreateInfo dynamicStateCI{};
-	dynamicStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicStateCI.pDynamicStates = dynamicStateEnables.data();
-	dynamicStateCI.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
-
-	// Depth and stencil state containing depth and stencil compare and test operations
-	// We only use depth tests and want depth tests and writes to be enabled and compare with less or equal
-	VkPipelineDepthStencilStateCreateInfo depthStencilStateCI{};
-	depthStencilStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencilStateCI.depthTestEnable = VK_TRUE;
-	depthStencilStateCI.depthWriteEnable = VK_TRUE;
-	depthStencilStateCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-	depthStencilStateCI.depthBoundsTestEnable = VK_FALSE;
-	depthStencilStateCI.back.failOp = VK_STENCIL_OP_KEEP;
-	depthStencilStateCI.back.passOp = VK_STENCIL_OP_KEEP;
-	depthStencilStateCI.back.compareOp = VK_COMPARE_OP_ALWAYS;
-	depthStencilStateCI.stencilTestEnable = VK_FALSE;
-	depthStencilStateCI.front = depthStencilStateCI.back;
-
-	// Multi sampling state
-	// This example does not make use of multi sampling (for anti-aliasing), the state must still be set and passed to the pipeline
-	VkPipelineMultisampleStateCreateInfo multisampleStateCI{};
-	multisampleStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampleStateCI.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-	multisampleStateCI.pSampleMask = nullptr;
-
-	// Vertex input descriptions
-	// Specifies the vertex input parameters for a pipeline
-
-	// Vertex input binding
-	// This example uses a single vertex input binding at binding point 0 (see vkCmdBindVertexBuffers)
-	VkVertexInputBindingDescription vertexInputBinding{};
-	vertexInputBinding.binding = 0;
-	vertexInputBinding.stride = sizeof(Vertex);
-	vertexInputBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-	// Input attribute bindings describe shader attribute locations and memory layouts
-	std::array<VkVertexInputAttributeDescription, 2> vertexInputAttributs{};
-	// These match the following shader layout (see triangle.vert):
-	//	layout (location = 0) in vec3 inPos;
-	//	layout (location = 1) in vec3 inColor;
-	// Attribute location 0: Position
-	vertexInputAttributs[0].binding = 0;
-	vertexInputAttributs[0].location = 0;
-	// Position attribute is three 32 bit signed (SFLOAT) floats (R32 G32 B32)
-	vertexInputAttributs[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-	vertexInputAttributs[0].offset = offsetof(Vertex, position);
-	// Attribute location 1: Color
-	vertexInputAttributs[1].binding = 0;
-	vertexInputAttributs[1].location = 1;
-	// Color attribute is three 32 bit signed (SFLOAT) floats (R32 G32 B32)
-	vertexInputAttributs[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-	vertexInputAttributs[1].offset = offsetof(Vertex, normal);
-
-	// Vertex input state used for pipeline creation
-	VkPipelineVertexInputStateCreateInfo vertexInputStateCI{};
-	vertexInputStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputStateCI.vertexBindingDescriptionCount = 1;
-	vertexInputStateCI.pVertexBindingDescriptions = &vertexInputBinding;
-	vertexInputStateCI.vertexAttributeDescriptionCount = 2;
-	vertexInputStateCI.pVertexAttributeDescriptions = vertexInputAttributs.data();
-
-	// Shaders
-	std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
-
-	// Vertex shader
-	shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	// Set pipeline stage for this shader
-	shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-	// Load binary SPIR-V shader
-	shaderStages[0].module = loadSPIRVShader("triangle.vert.spv");
-	// Main entry point for the shader
-	shaderStages[0].pName = "main";
-	assert(shaderStages[0].module != VK_NULL_HANDLE);
-
-	// Fragment shader
-	shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	// Set pipeline stage for this shader
-	shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	// Load binary SPIR-V shader
-	shaderStages[1].module = loadSPIRVShader("triangle.frag.spv");
-	// Main entry point for the shader
-	shaderStages[1].pName = "main";
-	assert(shaderStages[1].module != VK_NULL_HANDLE);
-
-	// Set pipeline shader stage info
-	pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
-	pipelineCI.pStages = shaderStages.data();
-
-	// Assign the pipeline states to the pipeline creation info structure
-	pipelineCI.pVertexInputState = &vertexInputStateCI;
-	pipelineCI.pInputAssemblyState = &inputAssemblyStateCI;
-	pipelineCI.pRasterizationState = &rasterizationStateCI;
-	pipelineCI.pColorBlendState = &colorBlendStateCI;
-	pipelineCI.pMultisampleState = &multisampleStateCI;
-	pipelineCI.pViewportState = &viewportStateCI;
-	pipelineCI.pDepthStencilState = &depthStencilStateCI;
-	pipelineCI.pDynamicState = &dynamicStateCI;
-
-	// Create rendering pipeline using the specified states
-	VK_CHECK_RESULT(vkCreateGraphicsPipelines(vulkDevice, vulkPipelineCache, 1, &pipelineCI, nullptr, &vulkPipeline));
-
-	// Shader modules are no longer needed once the graphics pipeline has been created
-	vkDestroyShaderModule(vulkDevice, shaderStages[0].module, nullptr);
-	vkDestroyShaderModule(vulkDevice, shaderStages[1].module, nullptr);
+	// The pipelines are described by a compact state key, the registry turns it into the Vulkan states (see PipelineRegistry::describe and
+	// buildPipelineDescription) and compiles one pipeline per distinct key in the background
+	PipelineStateKey sceneKey{};
+	sceneKey.shaders = { m_pipelineRegistry.registerShader("triangle.vert.spv", VK_SHADER_STAGE_VERTEX_BIT), 0, m_pipelineRegistry.registerShader("triangle.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT) };
+	sceneKey.vertexLayout = static_cast<uint8_t>(PipelineVertexLayout::MeshInstances);
+	sceneKey.pipelineLayout = static_cast<uint8_t>(PipelineLayoutId::Scene);
+	sceneKey.colorFormat = m_swapChain.colorFormat;
+	sceneKey.depthFormat = vulkDepthFormat;
+	applyShaderVariant(sceneKey);
+	applySceneRenderState(sceneKey);
+	m_pendingPipelines.push_back({ m_pipelineRegistry.request(sceneKey), &vulkPipeline });
+	m_graphicsPipelineKeys.push_back({ sceneKey, &vulkPipeline });
+
+	// Graphics pipeline of the mesh shader path, it shares all fixed function states with the regular pipeline
+	// The mesh shader fetches its vertices on its own, so there is no vertex input
+	if (m_meshShaders)
+	{
+		PipelineStateKey meshletKey = sceneKey;
+		meshletKey.shaders = { m_pipelineRegistry.registerShader("meshlet.task.spv", VK_SHADER_STAGE_TASK_BIT_EXT), m_pipelineRegistry.registerShader("meshlet.mesh.spv", VK_SHADER_STAGE_MESH_BIT_EXT), sceneKey.shaders[2] };
+		meshletKey.vertexLayout = static_cast<uint8_t>(PipelineVertexLayout::None);
+		meshletKey.pipelineLayout = static_cast<uint8_t>(PipelineLayoutId::Meshlet);
+		m_pendingPipelines.push_back({ m_pipelineRegistry.request(meshletKey), &m_meshletPipeline });
+		m_graphicsPipelineKeys.push_back({ meshletKey, &m_meshletPipeline });
+	}
+	updateVertexInputs();
 }
 
-// Prepare vertex and index buffers for an indexed triangle
-// Also uploads them to device local memory using staging and initializes vertex input and attribute binding to match the vertex shader
-void VulkanRender::createVertexBuffer()
+void VulkanRender::SetShaderVariant(const ShaderVariant& variant)
 {
-	// A note on memory management in Vulkan in general:
-	//	This is a very complex topic and while it's fine for an example application to small individual memory allocations that is not
-	//	what should be done a real-world application, where you should allocate large chunks of memory at once instead.
-
-	// Setup vertices
-	//std::vector<Vertex> vertexBuffer{
-	//	{ { -1.0f,  1.0f, 0.0f }, { 1.0f, 1.0f, 0.0f } },
-	//	{ { -1.0f, -1.0f, 0.0f }, { 1.0f, 0.0f, 1.0f } },
-	//	{ {  1.0f,  1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f } },
-	//	{ {  1.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
-	//};
-	std::vector<Vertex> vertexBuffer = {
-		// Front face (+Z)
-		{{-0.5f, -0.5f,  0.5f}, { 0.0f,  0.0f,  1.0f}},
-		{{ 0.5f, -0.5f,  0.5f}, { 0.0f,  0.0f,  1.0f}},
-		{{ 0.5f,  0.5f,  0.5f}, { 0.0f,  0.0f,  1.0f}},
-		{{-0.5f,  0.5f,  0.5f}, { 0.0f,  0.0f,  1.0f}},
+	m_shaderVariant = variant;
+	m_shaderVariant.lightCount = std::clamp<uint8_t>(variant.lightCount, 1, MAX_SHADER_LIGHT_COUNT);
+	// Before Init createPipelines requests the variant
+	if (!prepared)
+	{
+		return;
+	}
 
-		// Back face (-Z)
-		{{ 0.5f, -0.5f, -0.5f}, { 0.0f,  0.0f, -1.0f}},
-		{{-0.5f, -0.5f, -0.5f}, { 0.0f,  0.0f, -1.0f}},
-		{{-0.5f,  0.5f, -0.5f}, { 0.0f,  0.0f, -1.0f}},
-		{{ 0.5f,  0.5f, -0.5f}, { 0.0f,  0.0f, -1.0f}},
+	for (GraphicsPipelineKey& graphicsPipeline : m_graphicsPipelineKeys)
+	{
+		applyShaderVariant(graphicsPipeline.key);
+	}
+	requestGraphicsPipelines();
+}
 
-		// Left face (-X)
-		{{-0.5f, -0.5f, -0.5f}, {-1.0f,  0.0f,  0.0f}},
-		{{-0.5f, -0.5f,  0.5f}, {-1.0f,  0.0f,  0.0f}},
-		{{-0.5f,  0.5f,  0.5f}, {-1.0f,  0.0f,  0.0f}},
-		{{-0.5f,  0.5f, -0.5f}, {-1.0f,  0.0f,  0.0f}},
+void VulkanRender::SetSceneRenderState(const SceneRenderState& renderState)
+{
+	m_sceneRenderState = renderState;
+	if (!prepared)
+	{
+		return;
+	}
 
-		// Right face (+X)
-		{{ 0.5f, -0.5f,  0.5f}, { 1.0f,  0.0f,  0.0f}},
-		{{ 0.5f, -0.5f, -0.5f}, { 1.0f,  0.0f,  0.0f}},
-		{{ 0.5f,  0.5f, -0.5f}, { 1.0f,  0.0f,  0.0f}},
-		{{ 0.5f,  0.5f,  0.5f}, { 1.0f,  0.0f,  0.0f}},
+	if (renderState.wireframe && !vulkEnabledFeatures.fillModeNonSolid)
+	{
+		std::cerr << "Wireframe rendering is not supported by the selected device\n";
+	}
+	for (GraphicsPipelineKey& graphicsPipeline : m_graphicsPipelineKeys)
+	{
+		applySceneRenderState(graphicsPipeline.key);
+	}
+	requestGraphicsPipelines();
+}
 
-		// Top face (+Y)
-		{{-0.5f,  0.5f,  0.5f}, { 0.0f,  1.0f,  0.0f}},
-		{{ 0.5f,  0.5f,  0.5f}, { 0.0f,  1.0f,  0.0f}},
-		{{ 0.5f,  0.5f, -0.5f}, { 0.0f,  1.0f,  0.0f}},
-		{{-0.5f,  0.5f, -0.5f}, { 0.0f,  1.0f,  0.0f}},
+void VulkanRender::requestGraphicsPipelines()
+{
+	// A key that has been used before is a hit in the registry and ready right away
+	// So is a key that only differs in dynamic states, the new states are set from the next recorded frame on
+	m_pipelineCompileStart = std::chrono::high_resolution_clock::now();
+	for (const GraphicsPipelineKey& graphicsPipeline : m_graphicsPipelineKeys)
+	{
+		std::shared_future<VkPipeline> future = m_pipelineRegistry.request(graphicsPipeline.key);
+		if (future.valid())
+		{
+			m_pendingPipelines.push_back({ future, graphicsPipeline.pipeline });
+		}
+	}
+}
 
-		// Bottom face (-Y)
-		{{-0.5f, -0.5f, -0.5f}, { 0.0f, -1.0f,  0.0f}},
-		{{ 0.5f, -0.5f, -0.5f}, { 0.0f, -1.0f,  0.0f}},
-		{{ 0.5f, -0.5f,  0.5f}, { 0.0f, -1.0f,  0.0f}},
-		{{-0.5f, -0.5f,  0.5f}, { 0.0f, -1.0f,  0.0f}},
+// In the order of the [[vk::constant_id]] declarations of triangle.slang
+void VulkanRender::applyShaderVariant(PipelineStateKey& key) const
+{
+	key.specialization = {
+		static_cast<uint8_t>(m_shaderVariant.specular ? VK_TRUE : VK_FALSE),
+		m_shaderVariant.lightCount,
+		static_cast<uint8_t>(m_shaderVariant.normalMode),
+		static_cast<uint8_t>(m_shaderVariant.debugView),
 	};
-	uint32_t vertexBufferSize = static_cast<uint32_t>(vertexBuffer.size()) * sizeof(Vertex);
+}
 
-	// Setup indices
-//		std::vector<uint16_t> indexBuffer{ 0, 1, 2, 3 };
-	std::vector<uint16_t> indexBuffer = {
+void VulkanRender::applySceneRenderState(PipelineStateKey& key) const
+{
+	key.polygonMode = static_cast<uint8_t>((m_sceneRenderState.wireframe && vulkEnabledFeatures.fillModeNonSolid) ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL);
+	key.cullMode = static_cast<uint8_t>(m_sceneRenderState.backfaceCulling ? VK_CULL_MODE_BACK_BIT : VK_CULL_MODE_NONE);
+}
+
+// The renderer defined parts of a pipeline state key: the pipeline layout, the vertex input, the render pass and the shader modules
+bool VulkanRender::buildPipelineDescription(const PipelineStateKey& key, GraphicsPipelineDescription& description)
+{
+	// Pre-warmed keys can be from a run with other attachments or features
+	if (key.colorFormat != m_swapChain.colorFormat || key.depthFormat != vulkDepthFormat || key.renderPass != 0)
+	{
+		return false;
+	}
+
+	switch (static_cast<PipelineLayoutId>(key.pipelineLayout))
+	{
+	case PipelineLayoutId::Scene:
+		description.layout = vulkPipelineLayout;
+		break;
+	case PipelineLayoutId::Meshlet:
+		if (!m_meshShaders)
+		{
+			return false;
+		}
+		description.layout = m_meshletPipelineLayout;
+		break;
+	default:
+		return false;
+	}
+
+	// Mesh shader pipelines have no vertex input, the other vertex layouts are checked when the attributes are matched below
+	description.vertexInput = static_cast<PipelineVertexLayout>(key.vertexLayout) != PipelineVertexLayout::None;
+
+	// The early and late render passes of occlusion culling are compatible with the default one
+	description.renderPass = vulkRenderPass;
+
+	// The stages of the description are in the order of the key's shaders
+	size_t stageCount = 0;
+	auto destroyModules = [this, &description, &stageCount]() {
+		for (size_t i = 0; i < stageCount; i++)
+		{
+			vkDestroyShaderModule(vulkDevice, description.shaderStages[i].module, nullptr);
+		}
+	};
+	for (uint16_t shader : key.shaders)
+	{
+		if (shader == 0)
+		{
+			continue;
+		}
+		description.shaderStages[stageCount].module = loadSPIRVShader(m_pipelineRegistry.getShaderName(shader));
+		if (description.shaderStages[stageCount].module == VK_NULL_HANDLE)
+		{
+			destroyModules();
+			return false;
+		}
+		stageCount++;
+	}
+
+	// The locations the vertex shader reads have been reflected by loadSPIRVShader above
+	if (description.vertexInput && !getVertexInput(key, description.vertexBindings, description.vertexAttributes))
+	{
+		destroyModules();
+		return false;
+	}
+	return true;
+}
+
+// The vertex input of the pipelines of key, built into them or set in the command buffer with dynamic vertex input
+bool VulkanRender::getVertexInput(const PipelineStateKey& key, std::vector<VkVertexInputBindingDescription>& bindings, std::vector<VkVertexInputAttributeDescription>& attributes)
+{
+	bindings.clear();
+	attributes.clear();
+
+	// Vertex input bindings and the attributes they provide, the pipeline only gets the attributes the vertex shader reads
+	std::vector<VkVertexInputAttributeDescription> providedAttributes;
+	switch (static_cast<PipelineVertexLayout>(key.vertexLayout))
+	{
+	case PipelineVertexLayout::None:
+		return true;
+	case PipelineVertexLayout::MeshInstances:
+		// Vertex input bindings
+		// Binding 0 is advanced per vertex and holds the mesh, binding 1 is advanced per instance and holds the instance transforms (see vkCmdBindVertexBuffers)
+		bindings = {
+			{ .binding = 0, .stride = sizeof(Vertex), .inputRate = VK_VERTEX_INPUT_RATE_VERTEX },
+			{ .binding = 1, .stride = sizeof(InstanceData), .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE },
+		};
+		// Input attribute bindings describe shader attribute locations and memory layouts
+		// Location 0: position, location 1: normal, three 32 bit floats each
+		providedAttributes = {
+			{ .location = 0, .binding = 0, .format = VK_FORMAT_R32G32B32_SFLOAT, .offset = offsetof(Vertex, position) },
+			{ .location = 1, .binding = 0, .format = VK_FORMAT_R32G32B32_SFLOAT, .offset = offsetof(Vertex, normal) },
+		};
+		// Locations 2..5: Instance model matrix, one four component float attribute per matrix column
+		for (uint32_t column = 0; column < 4; column++)
+		{
+			providedAttributes.push_back({ .location = 2 + column, .binding = 1, .format = VK_FORMAT_R32G32B32A32_SFLOAT, .offset = static_cast<uint32_t>(offsetof(InstanceData, modelMatrix) + column * sizeof(glm::vec4)) });
+		}
+		// Location 6: Instance material index
+		providedAttributes.push_back({ .location = 6, .binding = 1, .format = VK_FORMAT_R32_UINT, .offset = offsetof(InstanceData, materialIndex) });
+		break;
+	default:
+		return false;
+	}
+
+	// Match the locations the vertex shader reads with the attributes of the vertex layout
+	const std::string& vertexShader = m_pipelineRegistry.getShaderName(key.shaders[0]);
+	for (const ShaderReflection::VertexInput& input : getShaderReflection(vertexShader).vertexInputs)
+	{
+		auto attribute = std::find_if(providedAttributes.begin(), providedAttributes.end(), [&input](const VkVertexInputAttributeDescription& a) { return a.location == input.location; });
+		if (attribute == providedAttributes.end())
+		{
+			std::cerr << "Error: \"" << vertexShader << "\" reads vertex input location " << input.location << ", which the vertex layout doesn't provide" << std::endl;
+			return false;
+		}
+		attributes.push_back(*attribute);
+	}
+	return true;
+}
+
+// With dynamic vertex input the pipelines don't know their vertex input, it is set when they are bound
+// Called when the keys are created and when reloaded vertex shaders are swapped in, as they may read other attributes
+void VulkanRender::updateVertexInputs()
+{
+	if ((m_dynamicState.getFlags() & PIPELINE_DYNAMIC_STATE_VERTEX_INPUT) == 0)
+	{
+		return;
+	}
+	std::vector<VkVertexInputBindingDescription> bindings;
+	std::vector<VkVertexInputAttributeDescription> attributes;
+	for (GraphicsPipelineKey& graphicsPipeline : m_graphicsPipelineKeys)
+	{
+		if (getVertexInput(graphicsPipeline.key, bindings, attributes))
+		{
+			graphicsPipeline.vertexInput.set(bindings, attributes);
+		}
+	}
+}
+
+// Prepare vertex and index buffers for an indexed triangle
+// Also uploads them to device local memory using staging and initializes vertex input and attribute binding to match the vertex shader
+void VulkanRender::createVertexBuffer()
+{
+	// A note on memory management in Vulkan in general:
+	//	This is a very complex topic and while it's fine for an example application to small individual memory allocations that is not
+	//	what should be done a real-world application, where you should allocate large chunks of memory at once instead.
+
+	// Setup vertices
+	//std::vector<Vertex> vertexBuffer{
+	//	{ { -1.0f,  1.0f, 0.0f }, { 1.0f, 1.0f, 0.0f } },
+	//	{ { -1.0f, -1.0f, 0.0f }, { 1.0f, 0.0f, 1.0f } },
+	//	{ {  1.0f,  1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f } },
+	//	{ {  1.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+	//};
+	std::vector<Vertex> vertexBuffer = {
+		// Front face (+Z)
+		{{-0.5f, -0.5f,  0.5f}, { 0.0f,  0.0f,  1.0f}},
+		{{ 0.5f, -0.5f,  0.5f}, { 0.0f,  0.0f,  1.0f}},
+		{{ 0.5f,  0.5f,  0.5f}, { 0.0f,  0.0f,  1.0f}},
+		{{-0.5f,  0.5f,  0.5f}, { 0.0f,  0.0f,  1.0f}},
+
+		// Back face (-Z)
+		{{ 0.5f, -0.5f, -0.5f}, { 0.0f,  0.0f, -1.0f}},
+		{{-0.5f, -0.5f, -0.5f}, { 0.0f,  0.0f, -1.0f}},
+		{{-0.5f,  0.5f, -0.5f}, { 0.0f,  0.0f, -1.0f}},
+		{{ 0.5f,  0.5f, -0.5f}, { 0.0f,  0.0f, -1.0f}},
+
+		// Left face (-X)
+		{{-0.5f, -0.5f, -0.5f}, {-1.0f,  0.0f,  0.0f}},
+		{{-0.5f, -0.5f,  0.5f}, {-1.0f,  0.0f,  0.0f}},
+		{{-0.5f,  0.5f,  0.5f}, {-1.0f,  0.0f,  0.0f}},
+		{{-0.5f,  0.5f, -0.5f}, {-1.0f,  0.0f,  0.0f}},
+
+		// Right face (+X)
+		{{ 0.5f, -0.5f,  0.5f}, { 1.0f,  0.0f,  0.0f}},
+		{{ 0.5f, -0.5f, -0.5f}, { 1.0f,  0.0f,  0.0f}},
+		{{ 0.5f,  0.5f, -0.5f}, { 1.0f,  0.0f,  0.0f}},
+		{{ 0.5f,  0.5f,  0.5f}, { 1.0f,  0.0f,  0.0f}},
+
+		// Top face (+Y)
+		{{-0.5f,  0.5f,  0.5f}, { 0.0f,  1.0f,  0.0f}},
+		{{ 0.5f,  0.5f,  0.5f}, { 0.0f,  1.0f,  0.0f}},
+		{{ 0.5f,  0.5f, -0.5f}, { 0.0f,  1.0f,  0.0f}},
+		{{-0.5f,  0.5f, -0.5f}, { 0.0f,  1.0f,  0.0f}},
+
+		// Bottom face (-Y)
+		{{-0.5f, -0.5f, -0.5f}, { 0.0f, -1.0f,  0.0f}},
+		{{ 0.5f, -0.5f, -0.5f}, { 0.0f, -1.0f,  0.0f}},
+		{{ 0.5f, -0.5f,  0.5f}, { 0.0f, -1.0f,  0.0f}},
+		{{-0.5f, -0.5f,  0.5f}, { 0.0f, -1.0f,  0.0f}},
+	};
+
+	// Setup indices
+//		std::vector<uint16_t> indexBuffer{ 0, 1, 2, 3 };
+	std::vector<uint16_t> indexBuffer = {
 		// Front face (+Z)
 		0, 1, 2,  2, 3, 0,
 
@@ -1041,8 +1641,132 @@ void VulkanRender::createVertexBuffer()
 	  // Bottom face (-Y)
 	 20,21,22, 22,23,20
 	};
+	const uint32_t cubeVertexCount = static_cast<uint32_t>(vertexBuffer.size());
+	const uint32_t cubeIndexCount = static_cast<uint32_t>(indexBuffer.size());
+
+	// A dense UV sphere (radius 0.5) stored behind the cube, it is split into a few hundred meshlets
+	// Its indices are relative to its first vertex (see MeshInfo::vertexOffset), so they still fit into 16 bits
+	constexpr uint32_t sphereRings = 96;
+	constexpr uint32_t sphereSegments = 192;
+	for (uint32_t ring = 0; ring <= sphereRings; ring++)
+	{
+		const float theta = glm::pi<float>() * ring / sphereRings;
+		for (uint32_t segment = 0; segment <= sphereSegments; segment++)
+		{
+			const float phi = 2.0f * glm::pi<float>() * segment / sphereSegments;
+			const glm::vec3 normal(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+			vertexBuffer.push_back({ { 0.5f * normal.x, 0.5f * normal.y, 0.5f * normal.z }, { normal.x, normal.y, normal.z } });
+		}
+	}
+	const uint32_t sphereVertexCount = static_cast<uint32_t>(vertexBuffer.size()) - cubeVertexCount;
+	for (uint32_t ring = 0; ring < sphereRings; ring++)
+	{
+		for (uint32_t segment = 0; segment < sphereSegments; segment++)
+		{
+			const uint16_t a = static_cast<uint16_t>(ring * (sphereSegments + 1) + segment);
+			const uint16_t b = static_cast<uint16_t>(a + sphereSegments + 1);
+			// The triangles touching the poles would be degenerate
+			if (ring != 0)
+			{
+				indexBuffer.insert(indexBuffer.end(), { a, static_cast<uint16_t>(a + 1), b });
+			}
+			if (ring != sphereRings - 1)
+			{
+				indexBuffer.insert(indexBuffer.end(), { static_cast<uint16_t>(a + 1), static_cast<uint16_t>(b + 1), b });
+			}
+		}
+	}
+
+	// The vertex and index buffers form the geometry arena, every mesh is a range of indices inside it
+	// Both meshes are centered at the origin, so are their bounding spheres
+	m_meshes = {
+		MeshInfo{ .indexCount = cubeIndexCount, .firstIndex = 0, .vertexOffset = 0, .boundingRadius = glm::length(glm::vec3(0.5f)) },
+		MeshInfo{ .indexCount = static_cast<uint32_t>(indexBuffer.size()) - cubeIndexCount, .firstIndex = cubeIndexCount, .vertexOffset = static_cast<int32_t>(cubeVertexCount), .boundingRadius = 0.5f },
+	};
+	m_meshExtents = { glm::vec3(0.5f), glm::vec3(0.5f) };
+	const uint32_t meshVertexCounts[] = { cubeVertexCount, sphereVertexCount };
+
+	// The meshlets and the level of detail chain of every mesh are loaded or built as separate jobs, they only read the mesh's vertices and its original index range
+	// The cache files next to the executable hold the offline built meshlets
+	const char* meshletCacheFiles[] = { "cube.meshlets", "sphere.meshlets" };
+	std::vector<std::vector<uint32_t>> meshIndexLists(m_meshes.size());
+	std::vector<MeshletMesh> meshletMeshes(m_meshes.size());
+	std::vector<std::vector<MeshLodLevel>> lodChains(m_meshes.size());
+	JobCounter meshBuildCounter;
+	for (size_t meshIndex = 0; meshIndex < m_meshes.size(); meshIndex++)
+	{
+		const MeshInfo& mesh = m_meshes[meshIndex];
+		meshIndexLists[meshIndex].assign(indexBuffer.begin() + mesh.firstIndex, indexBuffer.begin() + mesh.firstIndex + mesh.indexCount);
+		const Vertex* meshVertices = &vertexBuffer[mesh.vertexOffset];
+		m_jobSystem->run([&, meshIndex, meshVertices]() {
+			meshletMeshes[meshIndex] = MeshletBuilder::loadOrBuild(getCachePath(meshletCacheFiles[meshIndex]), meshVertices->position, sizeof(Vertex), meshVertexCounts[meshIndex], meshIndexLists[meshIndex]);
+		}, &meshBuildCounter);
+		m_jobSystem->run([&, meshIndex, meshVertices]() {
+			lodChains[meshIndex] = MeshSimplifier::buildLodChain(meshVertices->position, meshVertices->normal, sizeof(Vertex), meshVertexCounts[meshIndex], meshIndexLists[meshIndex]);
+		}, &meshBuildCounter);
+	}
+	m_jobSystem->wait(meshBuildCounter);
+
+	// Split every mesh into meshlets for cluster culling
+	// The meshlet triangles are appended to the index buffer in meshlet order, so the compute culling path can draw a meshlet as a range of indices
+	m_meshlets.clear();
+	m_meshletVertices.clear();
+	m_meshletTriangles.clear();
+	for (size_t meshIndex = 0; meshIndex < m_meshes.size(); meshIndex++)
+	{
+		MeshInfo& mesh = m_meshes[meshIndex];
+		const MeshletMesh& meshletMesh = meshletMeshes[meshIndex];
+
+		mesh.firstMeshlet = static_cast<uint32_t>(m_meshlets.size());
+		mesh.meshletCount = static_cast<uint32_t>(meshletMesh.meshlets.size());
+		for (size_t i = 0; i < meshletMesh.meshlets.size(); i++)
+		{
+			const Meshlet& meshlet = meshletMesh.meshlets[i];
+			const MeshletBounds& bounds = meshletMesh.bounds[i];
+
+			MeshletInfo meshletInfo{};
+			meshletInfo.boundingSphere = glm::vec4(bounds.center, bounds.radius);
+			meshletInfo.cone = glm::vec4(bounds.coneAxis, bounds.coneCutoff);
+			meshletInfo.firstIndex = static_cast<uint32_t>(indexBuffer.size());
+			meshletInfo.triangleCount = meshlet.triangleCount;
+			meshletInfo.firstVertex = static_cast<uint32_t>(m_meshletVertices.size());
+			meshletInfo.vertexCount = meshlet.vertexCount;
+			meshletInfo.firstTriangle = static_cast<uint32_t>(m_meshletTriangles.size());
+			m_meshlets.push_back(meshletInfo);
+
+			m_meshletVertices.insert(m_meshletVertices.end(), meshletMesh.vertices.begin() + meshlet.vertexOffset, meshletMesh.vertices.begin() + meshlet.vertexOffset + meshlet.vertexCount);
+			for (uint32_t triangle = 0; triangle < meshlet.triangleCount; triangle++)
+			{
+				const uint8_t* corners = &meshletMesh.triangles[(meshlet.triangleOffset + triangle) * 3];
+				m_meshletTriangles.push_back(static_cast<uint32_t>(corners[0] | (corners[1] << 8) | (corners[2] << 16)));
+				for (uint32_t corner = 0; corner < 3; corner++)
+				{
+					indexBuffer.push_back(static_cast<uint16_t>(meshletMesh.vertices[meshlet.vertexOffset + corners[corner]]));
+				}
+			}
+		}
+	}
 
+	// Bake the level of detail chain of every mesh into the arena, the simplified index ranges are appended to the index buffer and reuse the mesh's vertices
+	// The cube's faces all meet at hard edges, so it has nothing to simplify and keeps its full detail level only
+	for (size_t meshIndex = 0; meshIndex < m_meshes.size(); meshIndex++)
+	{
+		MeshInfo& mesh = m_meshes[meshIndex];
+		const std::vector<MeshLodLevel>& lodLevels = lodChains[meshIndex];
+
+		mesh.lodCount = static_cast<uint32_t>(lodLevels.size());
+		mesh.lods[0] = MeshLod{ .firstIndex = mesh.firstIndex, .indexCount = mesh.indexCount, .error = 0.0f };
+		for (uint32_t lod = 1; lod < mesh.lodCount; lod++)
+		{
+			mesh.lods[lod] = MeshLod{ .firstIndex = static_cast<uint32_t>(indexBuffer.size()), .indexCount = static_cast<uint32_t>(lodLevels[lod].indices.size()), .error = lodLevels[lod].error };
+			for (uint32_t index : lodLevels[lod].indices)
+			{
+				indexBuffer.push_back(static_cast<uint16_t>(index));
+			}
+		}
+	}
 
+	uint32_t vertexBufferSize = static_cast<uint32_t>(vertexBuffer.size()) * sizeof(Vertex);
 	m_indices.count = static_cast<uint32_t>(indexBuffer.size());
 	uint32_t indexBufferSize = m_indices.count * sizeof(uint16_t);
 
@@ -1096,7 +1820,8 @@ void VulkanRender::createVertexBuffer()
 	VK_CHECK_RESULT(vkBindBufferMemory(vulkDevice, stagingBuffers.vertices.buffer, stagingBuffers.vertices.memory, 0));
 
 	// Create a device local buffer to which the (host local) vertex data will be copied and which will be used for rendering
-	vertexBufferInfoCI.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	// Mesh shaders fetch the vertices themselves, so it is a storage buffer as well
+	vertexBufferInfoCI.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 	VK_CHECK_RESULT(vkCreateBuffer(vulkDevice, &vertexBufferInfoCI, nullptr, &m_vertices.buffer));
 	vkGetBufferMemoryRequirements(vulkDevice, m_vertices.buffer, &memReqs);
 	memAlloc.allocationSize = memReqs.size;
@@ -1181,181 +1906,1676 @@ void VulkanRender::createVertexBuffer()
 	vkFreeMemory(vulkDevice, stagingBuffers.indices.memory, nullptr);
 }
 
-// Descriptors are allocated from a pool, that tells the implementation how many and what types of descriptors we are going to use (at maximum)
+// Descriptors are allocated from pools, that tell the implementation how many and what types of descriptors we are going to use (at maximum)
+// The renderer allocates its sets from chains of pools (see DescriptorAllocator) that add a pool whenever the current one runs out, so the sizes
+// below only have to fit the sets of one pool instead of every set that will ever be allocated
 void VulkanRender::createDescriptorPool()
 {
-	// We need to tell the API the number of max. requested descriptors per type
-	VkDescriptorPoolSize descriptorTypeCounts[1]{};
-	// This example only one descriptor type (uniform buffer)
-	descriptorTypeCounts[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	// We have one buffer (and as such descriptor) per frame
-	descriptorTypeCounts[0].descriptorCount = MAX_CONCURRENT_FRAMES;
-	// For additional types you need to add new entries in the type count list
-	// E.g. for two combined image samplers :
-	// typeCounts[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	// typeCounts[1].descriptorCount = 2;
-
-	// Create the global descriptor pool
-	// All descriptors used in this example are allocated from this pool
-	VkDescriptorPoolCreateInfo descriptorPoolCI{};
-	descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	descriptorPoolCI.pNext = nullptr;
-	descriptorPoolCI.poolSizeCount = 1;
-	descriptorPoolCI.pPoolSizes = descriptorTypeCounts;
-	// Set the max. number of descriptor sets that can be requested from this pool (requesting beyond this limit will result in an error)
-	// Our sample will create one set per uniform buffer per frame
-	descriptorPoolCI.maxSets = MAX_CONCURRENT_FRAMES;
-	VK_CHECK_RESULT(vkCreateDescriptorPool(vulkDevice, &descriptorPoolCI, nullptr, &vulkDescriptorPool));
+	// Descriptors per set of each type: a set holds at most one uniform buffer, the culling set (objects, meshes, draw commands, counters, visibility,
+	// meshlets, task items and levels of detail) and the mesh shader set (objects, meshlets, meshlet vertices and triangles, vertices, task items
+	// and counters) most of the storage buffers, the culling set and the Hi-Z build sets the images
+	const std::vector<DescriptorAllocator::PoolSizeRatio> poolSizeRatios = {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8.0f },
+		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f },
+	};
+	// One uniform buffer set, one culling set and one mesh shader set per frame
+	m_descriptorAllocator.init(vulkDevice, 3 * MAX_CONCURRENT_FRAMES, poolSizeRatios);
+	// The Hi-Z build sets of a frame, one per pyramid level (up to 16 levels for a 32k wide depth buffer)
+	for (DescriptorAllocator& frameDescriptorAllocator : m_frameDescriptorAllocators)
+	{
+		frameDescriptorAllocator.init(vulkDevice, 16, poolSizeRatios);
+	}
+	// With descriptor buffers the transient descriptors of a frame are written to its region of the descriptor buffer instead
+	if (m_descriptorBufferEnabled)
+	{
+		m_descriptorBuffer.create(m_vulkanDevice, DESCRIPTOR_BUFFER_REGION_SIZE, MAX_CONCURRENT_FRAMES);
+	}
 }
 
 // Descriptor set layouts define the interface between our application and the shader
 // Basically connects the different shader stages to descriptors for binding uniform buffers, image samplers, etc.
 // So every shader binding should map to one descriptor set layout binding
+// The bindings are taken from the reflected shaders (see ShaderReflection), so they always match the [[vk::binding]] declarations of the slang files
 void VulkanRender::createDescriptorSetLayout()
 {
-	// Binding 0: Uniform buffer (Vertex shader)
-	VkDescriptorSetLayoutBinding layoutBinding{};
-	layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	layoutBinding.descriptorCount = 1;
-	layoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	layoutBinding.pImmutableSamplers = nullptr;
-
-	VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
-	descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	descriptorLayoutCI.pNext = nullptr;
-	descriptorLayoutCI.bindingCount = 1;
-	descriptorLayoutCI.pBindings = &layoutBinding;
-	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(vulkDevice, &descriptorLayoutCI, nullptr, &vulkDescriptorSetLayout));
+	// Set 0 holds the uniform buffer (Vertex shader, culling compute shader reads the frustum planes, task and mesh shaders of the cluster culling path)
+	// The same descriptor set is bound with the scene, culling and mesh shader pipeline layouts, which requires an identical set layout in all of them,
+	// so the layout combines the set 0 bindings of every shader using it
+	std::vector<const ShaderReflection*> stages = { &getShaderReflection("triangle.vert.spv"), &getShaderReflection("triangle.frag.spv") };
+	if (m_gpuDriven)
+	{
+		stages.push_back(&getShaderReflection("cull.comp.spv"));
+	}
+	if (m_meshShaders)
+	{
+		stages.push_back(&getShaderReflection("meshlet.task.spv"));
+		stages.push_back(&getShaderReflection("meshlet.mesh.spv"));
+	}
+	vulkDescriptorSetLayout = m_layoutCache.getSetLayout(ShaderReflection::mergeBindings(stages, 0));
 }
 
 // Shaders access data using descriptor sets that "point" at our uniform buffers
 // The descriptor sets make use of the descriptor set layouts created above 
 void VulkanRender::createDescriptorSets()
 {
-	// Allocate one descriptor set per frame from the global descriptor pool
-	for (uint32_t i = 0; i < MAX_CONCURRENT_FRAMES; i++) {
-		VkDescriptorSetAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		allocInfo.descriptorPool = vulkDescriptorPool;
-		allocInfo.descriptorSetCount = 1;
-		allocInfo.pSetLayouts = &vulkDescriptorSetLayout;
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(vulkDevice, &allocInfo, &m_uniformBuffers[i].descriptorSet));
-
-		// Update the descriptor set determining the shader binding points
-		// For every binding point used in a shader there needs to be one
-		// descriptor set matching that binding point
-		VkWriteDescriptorSet writeDescriptorSet{};
+	// Binding 0 : Uniform buffer, written from its descriptor info through an update template
+	m_uniformUpdateTemplate = DescriptorAllocator::createUpdateTemplate(vulkDevice, vulkDescriptorSetLayout, {
+		DescriptorAllocator::templateEntry(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0),
+	});
 
+	// Allocate and write one descriptor set per frame
+	for (uint32_t i = 0; i < MAX_CONCURRENT_FRAMES; i++) {
 		// The buffer's information is passed using a descriptor info structure
 		VkDescriptorBufferInfo bufferInfo{};
 		bufferInfo.buffer = m_uniformBuffers[i].buffer;
 		bufferInfo.range = sizeof(ShaderData);
-
-		// Binding 0 : Uniform buffer
-		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		writeDescriptorSet.dstSet = m_uniformBuffers[i].descriptorSet;
-		writeDescriptorSet.descriptorCount = 1;
-		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		writeDescriptorSet.pBufferInfo = &bufferInfo;
-		writeDescriptorSet.dstBinding = 0;
-		vkUpdateDescriptorSets(vulkDevice, 1, &writeDescriptorSet, 0, nullptr);
+		m_uniformBuffers[i].descriptorSet = m_descriptorAllocator.allocate(vulkDescriptorSetLayout, m_uniformUpdateTemplate, &bufferInfo);
 	}
 }
 
-
-// Vulkan loads its shaders from an immediate binary representation called SPIR-V
-// Shaders are compiled offline from e.g. GLSL using the reference glslang compiler
-// This function loads such a shader from a binary file and returns a shader module structure
-VkShaderModule VulkanRender::loadSPIRVShader(const std::string& filename)
+// Textures, samplers and the material table of the scene, all written to the bindless descriptor set (see BindlessDescriptors)
+// The materials only reference them by their indices in the set, objects select their material with InstanceData::materialIndex
+void VulkanRender::createMaterials()
 {
-	size_t shaderSize;
-	char* shaderCode{ nullptr };
+	// Set 1 of the scene shaders, its runtime sized arrays are given a fixed capacity
+	const std::vector<VkDescriptorSetLayoutBinding> bindings = ShaderReflection::mergeBindings({ &getShaderReflection("triangle.vert.spv"), &getShaderReflection("triangle.frag.spv") }, BINDLESS_SET);
+	m_bindless.create(vulkDevice, m_layoutCache, bindings, BINDLESS_ARRAY_CAPACITY);
+
+	// Procedural grey scale patterns the materials tint with their base color: checkerboard, diagonal stripes, grid and dots
+	constexpr uint32_t textureSize = 64;
+	constexpr uint32_t textureCount = 4;
+	constexpr VkDeviceSize textureBytes = textureSize * textureSize * sizeof(uint32_t);
+	std::vector<uint32_t> pixels(textureCount * textureSize * textureSize);
+	for (uint32_t texture = 0; texture < textureCount; texture++)
+	{
+		for (uint32_t y = 0; y < textureSize; y++)
+		{
+			for (uint32_t x = 0; x < textureSize; x++)
+			{
+				bool bright;
+				switch (texture)
+				{
+				case 0:
+					bright = ((x / 8) + (y / 8)) % 2 == 0;
+					break;
+				case 1:
+					bright = ((x + y) / 8) % 2 == 0;
+					break;
+				case 2:
+					bright = (x % 16) < 2 || (y % 16) < 2;
+					break;
+				default:
+				{
+					const int32_t dx = static_cast<int32_t>(x % 16) - 8;
+					const int32_t dy = static_cast<int32_t>(y % 16) - 8;
+					bright = dx * dx + dy * dy < 25;
+					break;
+				}
+				}
+				const uint32_t value = bright ? 255 : 96;
+				pixels[(texture * textureSize + y) * textureSize + x] = value | (value << 8) | (value << 16) | 0xff000000u;
+			}
+		}
+	}
 
-	std::ifstream is(filename, std::ios::binary | std::ios::in | std::ios::ate);
+	vks::Buffer stagingBuffer;
+	VK_CHECK_RESULT(m_vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, pixels.size() * sizeof(uint32_t), pixels.data()));
 
-	if (is.is_open())
+	VkCommandBuffer copyCmd = m_vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	m_materialTextures.resize(textureCount);
+	for (uint32_t texture = 0; texture < textureCount; texture++)
 	{
-		shaderSize = is.tellg();
-		is.seekg(0, std::ios::beg);
-		// Copy file contents into a buffer
-		shaderCode = new char[shaderSize];
-		is.read(shaderCode, shaderSize);
-		is.close();
-		assert(shaderSize > 0);
+		MaterialTexture& materialTexture = m_materialTextures[texture];
+		VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = VK_FORMAT_R8G8B8A8_UNORM;
+		imageCI.extent = { textureSize, textureSize, 1 };
+		imageCI.mipLevels = 1;
+		imageCI.arrayLayers = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		VK_CHECK_RESULT(vkCreateImage(vulkDevice, &imageCI, nullptr, &materialTexture.image));
+
+		VkMemoryRequirements memReqs{};
+		vkGetImageMemoryRequirements(vulkDevice, materialTexture.image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = m_vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(vulkDevice, &memAlloc, nullptr, &materialTexture.memory));
+		VK_CHECK_RESULT(vkBindImageMemory(vulkDevice, materialTexture.image, materialTexture.memory, 0));
+
+		VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+		viewCI.image = materialTexture.image;
+		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCI.format = imageCI.format;
+		viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		VK_CHECK_RESULT(vkCreateImageView(vulkDevice, &viewCI, nullptr, &materialTexture.view));
+
+		vks::tools::setImageLayout(copyCmd, materialTexture.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		VkBufferImageCopy copyRegion{};
+		copyRegion.bufferOffset = texture * textureBytes;
+		copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		copyRegion.imageExtent = { textureSize, textureSize, 1 };
+		vkCmdCopyBufferToImage(copyCmd, stagingBuffer.buffer, materialTexture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+		vks::tools::setImageLayout(copyCmd, materialTexture.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 	}
+	m_vulkanDevice->flushCommandBuffer(copyCmd, vulkQueue);
+	stagingBuffer.destroy();
 
-	if (shaderCode)
+	// Smooth and blocky filtering, both repeat the textures
+	for (VkFilter filter : { VK_FILTER_LINEAR, VK_FILTER_NEAREST })
 	{
-		// Create a new shader module that will be used for pipeline creation
-		VkShaderModuleCreateInfo shaderModuleCI{};
-		shaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		shaderModuleCI.codeSize = shaderSize;
-		shaderModuleCI.pCode = (uint32_t*)shaderCode;
+		VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+		samplerCI.magFilter = filter;
+		samplerCI.minFilter = filter;
+		samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		VkSampler sampler;
+		VK_CHECK_RESULT(vkCreateSampler(vulkDevice, &samplerCI, nullptr, &sampler));
+		m_materialSamplers.push_back(sampler);
+	}
 
-		VkShaderModule shaderModule;
-		VK_CHECK_RESULT(vkCreateShaderModule(vulkDevice, &shaderModuleCI, nullptr, &shaderModule));
+	std::vector<uint32_t> textureIndices;
+	for (const MaterialTexture& materialTexture : m_materialTextures)
+	{
+		textureIndices.push_back(m_bindless.addImage(BINDLESS_BINDING_TEXTURES, vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, materialTexture.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)));
+	}
+	std::vector<uint32_t> samplerIndices;
+	for (VkSampler sampler : m_materialSamplers)
+	{
+		samplerIndices.push_back(m_bindless.addImage(BINDLESS_BINDING_SAMPLERS, vks::initializers::descriptorImageInfo(sampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED)));
+	}
+
+	// Every combination of pattern and filter, each with a color of its own
+	const std::array<glm::vec4, SCENE_MATERIAL_COUNT> baseColors{
+		glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), glm::vec4(1.0f, 0.6f, 0.3f, 1.0f), glm::vec4(0.4f, 0.8f, 1.0f, 1.0f), glm::vec4(0.6f, 1.0f, 0.5f, 1.0f),
+		glm::vec4(1.0f, 0.9f, 0.4f, 1.0f), glm::vec4(0.9f, 0.5f, 0.9f, 1.0f), glm::vec4(0.5f, 0.5f, 1.0f, 1.0f), glm::vec4(1.0f, 0.4f, 0.4f, 1.0f),
+	};
+	m_materials.resize(SCENE_MATERIAL_COUNT);
+	for (uint32_t i = 0; i < SCENE_MATERIAL_COUNT; i++)
+	{
+		m_materials[i].baseColor = baseColors[i];
+		m_materials[i].textureIndex = textureIndices[i % textureIndices.size()];
+		m_materials[i].samplerIndex = samplerIndices[(i / textureIndices.size()) % samplerIndices.size()];
+		m_materials[i].textureScale = 2.0f;
+	}
+	// Small and written once, like the mesh tables
+	VK_CHECK_RESULT(m_vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &m_materialBuffer, m_materials.size() * sizeof(Material), m_materials.data()));
+	m_bindless.addBuffer(BINDLESS_BINDING_MATERIALS, m_materialBuffer.descriptor);
 
-		delete[] shaderCode;
+	std::cout << "Bindless materials: " << m_materials.size() << " materials, " << m_bindless.getCount(BINDLESS_BINDING_TEXTURES) << " textures and "
+		<< m_bindless.getCount(BINDLESS_BINDING_SAMPLERS) << " samplers in one descriptor set\n";
+}
 
-		return shaderModule;
+void VulkanRender::destroyMaterials()
+{
+	m_bindless.destroy();
+	for (const MaterialTexture& materialTexture : m_materialTextures)
+	{
+		vkDestroyImageView(vulkDevice, materialTexture.view, nullptr);
+		vkDestroyImage(vulkDevice, materialTexture.image, nullptr);
+		vkFreeMemory(vulkDevice, materialTexture.memory, nullptr);
 	}
-	else
+	m_materialTextures.clear();
+	for (VkSampler sampler : m_materialSamplers)
 	{
-		std::cerr << "Error: Could not open shader file \"" << filename << "\"" << std::endl;
-		return VK_NULL_HANDLE;
+		vkDestroySampler(vulkDevice, sampler, nullptr);
 	}
+	m_materialSamplers.clear();
+	m_materialBuffer.destroy();
 }
 
-glm::vec3 gRotation = glm::vec3(0.0f, 0.0f, 0.0f);
-
-void VulkanRender::updateViewMatrix(float deltaTime)
-{
-	glm::mat4 currentMatrix = m_viewMatrix;
+// Push constants of cull.slang
+struct CullPushConstants {
+	uint32_t objectCount;
+	uint32_t phase;             // 0: early (frustum culling, or draw last frame's visible set), 1: late (Hi-Z test)
+	uint32_t occlusionCulling;
+	uint32_t clusterMode;       // See ClusterMode
+	uint32_t drawCapacity;      // Size of each draw list
+	float lodPixelScale;        // See VulkanRender::m_lodPixelScale
+	float lodThreshold;         // Largest projected error in pixels, 0 draws every object at full detail
+};
 
-	// update rotation
-	gRotation.x -= 160.0f * deltaTime;
-	gRotation.y += 25.0f * deltaTime;
+// How cull.slang handles the meshlets of the visible objects
+enum ClusterMode : uint32_t {
+	CLUSTER_MODE_OFF = 0,       // One draw per object
+	CLUSTER_MODE_DRAWS = 1,     // Cull the meshlets, one draw per visible meshlet
+	CLUSTER_MODE_TASKS = 2,     // One task work item per (up to) 32 meshlets, culled by the task shader
+};
 
-	glm::vec3 position = glm::vec3(0.0f, 0.0f, -2.0f);
+// Meshlets handled by a single task shader work group, see meshlet.slang
+constexpr uint32_t MESHLETS_PER_TASK = 32;
 
-	glm::mat4 rotM = glm::mat4(1.0f);
-	glm::mat4 transM;
+// Push constants of hiz.slang
+struct HiZPushConstants {
+	uint32_t sourceSize[2];
+	uint32_t destinationSize[2];
+	uint32_t fromDepth;
+};
 
-	rotM = glm::rotate(rotM, glm::radians(gRotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-	rotM = glm::rotate(rotM, glm::radians(gRotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-	rotM = glm::rotate(rotM, glm::radians(gRotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+// Descriptors of set 1 of cull.slang in binding order, the layout vkUpdateDescriptorSetWithTemplate reads them in (see m_cullUpdateTemplate)
+struct CullDescriptors {
+	VkDescriptorBufferInfo objects;
+	VkDescriptorBufferInfo meshes;
+	VkDescriptorBufferInfo drawCommands;
+	VkDescriptorBufferInfo counters;
+	VkDescriptorBufferInfo visibility;
+	VkDescriptorImageInfo hiZ;
+	VkDescriptorBufferInfo meshlets;
+	VkDescriptorBufferInfo taskItems;
+	VkDescriptorBufferInfo lods;
+};
 
-	glm::vec3 translation = position;
-	transM = glm::translate(glm::mat4(1.0f), translation);
+// Descriptors of set 2 of meshlet.slang in binding order
+struct MeshletDescriptors {
+	VkDescriptorBufferInfo objects;
+	VkDescriptorBufferInfo meshlets;
+	VkDescriptorBufferInfo meshletVertices;
+	VkDescriptorBufferInfo meshletTriangles;
+	VkDescriptorBufferInfo vertices;
+	VkDescriptorBufferInfo taskItems;
+	VkDescriptorBufferInfo counters;
+};
 
-	m_viewMatrix = transM * rotM;
+// Descriptors of a Hi-Z build set (hiz.slang)
+struct HiZDescriptors {
+	VkDescriptorImageInfo source;
+	VkDescriptorImageInfo destination;
 };
 
-void VulkanRender::HandleWindowResize(uint32_t destWidth, uint32_t destHeight)
+// GPU driven rendering
+// A compute shader (cull.slang) tests every object's bounding sphere against the frustum and appends a VkDrawIndexedIndirectCommand for each visible one
+// The renderer then issues a single vkCmdDrawIndexedIndirectCount, so the CPU never loops over the objects
+// The culling pipeline layout uses the regular descriptor set layout (the per-frame UBO) as set 0 and adds the culling buffers as set 1
+void VulkanRender::createCullingResources()
 {
-	if (!prepared) {
-		return;
+	// Mesh and meshlet tables of the geometry arena, small and written once
+	VK_CHECK_RESULT(m_vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &m_meshBuffer, m_meshes.size() * sizeof(MeshInfo), m_meshes.data()));
+	VK_CHECK_RESULT(m_vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &m_meshletBuffer, m_meshlets.size() * sizeof(MeshletInfo), m_meshlets.data()));
+	VK_CHECK_RESULT(m_vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &m_meshletVertexBuffer, m_meshletVertices.size() * sizeof(uint32_t), m_meshletVertices.data()));
+	VK_CHECK_RESULT(m_vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &m_meshletTriangleBuffer, m_meshletTriangles.size() * sizeof(uint32_t), m_meshletTriangles.data()));
+
+	// Worst case every object is visible, with cluster culling every meshlet of every object
+	m_drawCapacity = m_instanceCount;
+	if (m_clusterCulling)
+	{
+		m_drawCapacity = 0;
+		uint32_t taskCount = 0;
+		for (const InstanceData& instance : m_sceneInstances)
+		{
+			const uint32_t meshletCount = m_meshes[instance.meshIndex].meshletCount;
+			m_drawCapacity += meshletCount;
+			taskCount += (meshletCount + MESHLETS_PER_TASK - 1) / MESHLETS_PER_TASK;
+		}
+
+		// All task work groups are launched by a single indirect draw, fall back to the compute path if the device can't launch that many
+		if (m_meshShaders)
+		{
+			VkPhysicalDeviceMeshShaderPropertiesEXT meshShaderProperties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_PROPERTIES_EXT };
+			VkPhysicalDeviceProperties2 deviceProperties2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+			deviceProperties2.pNext = &meshShaderProperties;
+			vkGetPhysicalDeviceProperties2(vulkPhysicalDevice, &deviceProperties2);
+			if (taskCount > meshShaderProperties.maxTaskWorkGroupCount[0] || taskCount > meshShaderProperties.maxTaskWorkGroupTotalCount)
+			{
+				std::cerr << "The scene needs " << taskCount << " task work groups, more than the device supports, falling back to compute cluster culling\n";
+				m_meshShaders = false;
+			}
+		}
 	}
-	prepared = false;
-	resized = true;
 
-	// Ensure all operations on the device have been finished before destroying resources
-	vkDeviceWaitIdle(vulkDevice);
+	// With occlusion culling there is a second (late) draw list behind the first one
+	const uint32_t drawListCount = m_occlusionCulling ? 2 : 1;
+	for (auto& indirectDraw : m_indirectDraws)
+	{
+		VK_CHECK_RESULT(m_vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indirectDraw.commands, drawListCount * m_drawCapacity * sizeof(VkDrawIndexedIndirectCommand)));
+		VK_CHECK_RESULT(m_vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &indirectDraw.counters, sizeof(CullCounters)));
+		VK_CHECK_RESULT(indirectDraw.counters.map());
+		memset(indirectDraw.counters.mapped, 0, sizeof(CullCounters));
+	}
 
-	// Recreate swap chain
-	width = destWidth;
-	height = destHeight;
-	createSwapChain();
+	// Visibility of the last frame, starts with nothing visible so the first frame draws everything in the late pass
+	VK_CHECK_RESULT(m_vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &m_visibilityBuffer, m_instanceCount * sizeof(uint32_t)));
+	VkCommandBuffer fillCmd = m_vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	vkCmdFillBuffer(fillCmd, m_visibilityBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+	m_vulkanDevice->flushCommandBuffer(fillCmd, vulkQueue);
+
+	// Level of detail of the last frame, all objects start at full detail
+	VK_CHECK_RESULT(m_vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &m_lodBuffer, m_instanceCount * sizeof(uint32_t)));
+	fillCmd = m_vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	vkCmdFillBuffer(fillCmd, m_lodBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+	m_vulkanDevice->flushCommandBuffer(fillCmd, vulkQueue);
+
+	// Set 1: Binding 0 objects, binding 1 meshes, binding 2 draw commands, binding 3 counters, binding 4 visibility, binding 5 Hi-Z pyramid,
+	// binding 6 meshlets, binding 7 task work items (the draw command buffer, mesh shader path only), binding 8 levels of detail
+	// Set 0 is the uniform buffer set shared with the scene pipelines, set 1 and the push constants (object count and culling phase) are reflected
+	const ShaderReflection& cullReflection = getShaderReflection("cull.comp.spv");
+	if (cullReflection.pushConstantSize != sizeof(CullPushConstants))
+	{
+		throw std::runtime_error("The push constants of cull.comp.spv don't match CullPushConstants");
+	}
+	std::vector<VkDescriptorSetLayout> cullSetLayouts{ vulkDescriptorSetLayout };
+	m_cullPipelineLayout = m_layoutCache.getPipelineLayout({ &cullReflection }, cullSetLayouts);
+	m_cullDescriptorSetLayout = cullSetLayouts[1];
+
+	m_cullUpdateTemplate = DescriptorAllocator::createUpdateTemplate(vulkDevice, m_cullDescriptorSetLayout, {
+		DescriptorAllocator::templateEntry(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(CullDescriptors, objects)),
+		DescriptorAllocator::templateEntry(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(CullDescriptors, meshes)),
+		DescriptorAllocator::templateEntry(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(CullDescriptors, drawCommands)),
+		DescriptorAllocator::templateEntry(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(CullDescriptors, counters)),
+		DescriptorAllocator::templateEntry(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(CullDescriptors, visibility)),
+		DescriptorAllocator::templateEntry(5, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, offsetof(CullDescriptors, hiZ)),
+		DescriptorAllocator::templateEntry(6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(CullDescriptors, meshlets)),
+		DescriptorAllocator::templateEntry(7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(CullDescriptors, taskItems)),
+		DescriptorAllocator::templateEntry(8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(CullDescriptors, lods)),
+	});
+	// The sets are written by createHiZ, once the pyramid they point at exists
+	for (IndirectDrawBuffers& indirectDraw : m_indirectDraws)
+	{
+		indirectDraw.descriptorSet = m_descriptorAllocator.allocate(m_cullDescriptorSetLayout);
+	}
 
-	// Recreate the frame buffers
-	vkDestroyImageView(vulkDevice, depthStencil.view, nullptr);
-	vkDestroyImage(vulkDevice, depthStencil.image, nullptr);
-	vkFreeMemory(vulkDevice, depthStencil.memory, nullptr);
-	setupDepthStencil();
-	for (auto& frameBuffer : vulkFrameBuffers) {
-		vkDestroyFramebuffer(vulkDevice, frameBuffer, nullptr);
+	// Mesh shader path, set 2: Binding 0 objects, binding 1 meshlets, binding 2 meshlet vertices, binding 3 meshlet triangles, binding 4 vertices,
+	// binding 5 task work items, binding 6 counters
+	// Sets 0 and 1 are the same as in the scene pipeline layout, so they stay bound when the draws switch to the mesh shader pipeline
+	if (m_meshShaders)
+	{
+		std::vector<VkDescriptorSetLayout> meshletSetLayouts{ vulkDescriptorSetLayout, m_bindless.getSetLayout() };
+		m_meshletPipelineLayout = m_layoutCache.getPipelineLayout({ &getShaderReflection("meshlet.task.spv"), &getShaderReflection("meshlet.mesh.spv"), &getShaderReflection("triangle.frag.spv") }, meshletSetLayouts);
+		m_meshletDescriptorSetLayout = meshletSetLayouts[2];
+
+		m_meshletUpdateTemplate = DescriptorAllocator::createUpdateTemplate(vulkDevice, m_meshletDescriptorSetLayout, {
+			DescriptorAllocator::templateEntry(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(MeshletDescriptors, objects)),
+			DescriptorAllocator::templateEntry(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(MeshletDescriptors, meshlets)),
+			DescriptorAllocator::templateEntry(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(MeshletDescriptors, meshletVertices)),
+			DescriptorAllocator::templateEntry(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(MeshletDescriptors, meshletTriangles)),
+			DescriptorAllocator::templateEntry(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(MeshletDescriptors, vertices)),
+			DescriptorAllocator::templateEntry(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(MeshletDescriptors, taskItems)),
+			DescriptorAllocator::templateEntry(6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(MeshletDescriptors, counters)),
+		});
+		for (uint32_t i = 0; i < MAX_CONCURRENT_FRAMES; i++)
+		{
+			const MeshletDescriptors descriptors{
+				{ m_instanceBuffers[i].buffer, 0, VK_WHOLE_SIZE },
+				m_meshletBuffer.descriptor,
+				m_meshletVertexBuffer.descriptor,
+				m_meshletTriangleBuffer.descriptor,
+				{ m_vertices.buffer, 0, VK_WHOLE_SIZE },
+				m_indirectDraws[i].commands.descriptor,
+				m_indirectDraws[i].counters.descriptor,
+			};
+			m_indirectDraws[i].meshletDescriptorSet = m_descriptorAllocator.allocate(m_meshletDescriptorSetLayout, m_meshletUpdateTemplate, &descriptors);
+		}
+	}
+
+	m_pendingPipelines.push_back({ compileComputePipeline("cull.comp.spv", m_cullPipelineLayout), &m_cullPipeline });
+	assert(m_pendingPipelines.back().future.valid());
+	m_computePipelineShaders.push_back({ "cull.comp.spv", m_cullPipelineLayout, &m_cullPipeline });
+
+	// Hi-Z build pipeline: binding 0 the source (depth buffer or the previous level), binding 1 the level to write
+	if (m_occlusionCulling)
+	{
+		const ShaderReflection& hiZReflection = getShaderReflection("hiz.comp.spv");
+		if (hiZReflection.pushConstantSize != sizeof(HiZPushConstants))
+		{
+			throw std::runtime_error("The push constants of hiz.comp.spv don't match HiZPushConstants");
+		}
+		// The build sets are transient: with push descriptors set 0 is pushed per level, with descriptor buffers the set layout and the pipeline
+		// are created for them
+		const bool hiZDescriptorBuffer = m_descriptorBufferEnabled && !m_pushDescriptorsEnabled;
+		std::vector<VkDescriptorSetLayout> hiZSetLayouts;
+		if (hiZDescriptorBuffer)
+		{
+			hiZSetLayouts.push_back(m_layoutCache.getSetLayout(ShaderReflection::mergeBindings({ &hiZReflection }, 0), VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT, {}));
+		}
+		m_hiZPipelineLayout = m_layoutCache.getPipelineLayout({ &hiZReflection }, hiZSetLayouts, m_pushDescriptorsEnabled ? 0 : PipelineLayoutCache::NO_PUSH_DESCRIPTOR_SET);
+		m_hiZDescriptorSetLayout = hiZSetLayouts[0];
+		if (hiZDescriptorBuffer)
+		{
+			m_hiZDescriptorBufferLayout = m_descriptorBuffer.getSetLayout(m_hiZDescriptorSetLayout, 2);
+		}
+		else if (!m_pushDescriptorsEnabled)
+		{
+			m_hiZUpdateTemplate = DescriptorAllocator::createUpdateTemplate(vulkDevice, m_hiZDescriptorSetLayout, {
+				DescriptorAllocator::templateEntry(0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, offsetof(HiZDescriptors, source)),
+				DescriptorAllocator::templateEntry(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, offsetof(HiZDescriptors, destination)),
+			});
+		}
+
+		const VkPipelineCreateFlags hiZPipelineFlags = hiZDescriptorBuffer ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+		m_pendingPipelines.push_back({ compileComputePipeline("hiz.comp.spv", m_hiZPipelineLayout, hiZPipelineFlags), &m_hiZPipeline });
+		assert(m_pendingPipelines.back().future.valid());
+		m_computePipelineShaders.push_back({ "hiz.comp.spv", m_hiZPipelineLayout, &m_hiZPipeline, hiZPipelineFlags });
+	}
+
+	createHiZ();
+
+	// GPU timestamps around the draws and the occlusion culling work, used to report the GPU time
+	if (vulkDeviceProperties.limits.timestampComputeAndGraphics)
+	{
+		VkQueryPoolCreateInfo queryPoolCI{};
+		queryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolCI.queryCount = TIMESTAMPS_PER_FRAME * MAX_CONCURRENT_FRAMES;
+		VK_CHECK_RESULT(vkCreateQueryPool(vulkDevice, &queryPoolCI, nullptr, &m_timestampQueryPool));
+	}
+}
+
+// Create the Hi-Z pyramid for the current depth buffer size and point the culling descriptor sets at it
+void VulkanRender::createHiZ()
+{
+	// Without occlusion culling the pyramid is never read, a single texel keeps the culling descriptor valid
+	m_hiZ.width = m_occlusionCulling ? width : 1;
+	m_hiZ.height = m_occlusionCulling ? height : 1;
+	m_hiZ.mipCount = static_cast<uint32_t>(std::floor(std::log2(std::max(m_hiZ.width, m_hiZ.height)))) + 1;
+
+	VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+	imageCI.imageType = VK_IMAGE_TYPE_2D;
+	imageCI.format = VK_FORMAT_R32G32_SFLOAT;
+	imageCI.extent = { m_hiZ.width, m_hiZ.height, 1 };
+	imageCI.mipLevels = m_hiZ.mipCount;
+	imageCI.arrayLayers = 1;
+	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	VK_CHECK_RESULT(vkCreateImage(vulkDevice, &imageCI, nullptr, &m_hiZ.image));
+
+	VkMemoryRequirements memReqs{};
+	vkGetImageMemoryRequirements(vulkDevice, m_hiZ.image, &memReqs);
+	VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+	memAlloc.allocationSize = memReqs.size;
+	memAlloc.memoryTypeIndex = m_vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	VK_CHECK_RESULT(vkAllocateMemory(vulkDevice, &memAlloc, nullptr, &m_hiZ.memory));
+	VK_CHECK_RESULT(vkBindImageMemory(vulkDevice, m_hiZ.image, m_hiZ.memory, 0));
+
+	VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+	viewCI.image = m_hiZ.image;
+	viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCI.format = imageCI.format;
+	viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, m_hiZ.mipCount, 0, 1 };
+	VK_CHECK_RESULT(vkCreateImageView(vulkDevice, &viewCI, nullptr, &m_hiZ.view));
+	m_hiZ.levelViews.resize(m_hiZ.mipCount);
+	for (uint32_t level = 0; level < m_hiZ.mipCount; level++)
+	{
+		viewCI.subresourceRange.baseMipLevel = level;
+		viewCI.subresourceRange.levelCount = 1;
+		VK_CHECK_RESULT(vkCreateImageView(vulkDevice, &viewCI, nullptr, &m_hiZ.levelViews[level]));
+	}
+
+	// The pyramid stays in the general layout, it is written as storage image and read as sampled image
+	VkCommandBuffer layoutCmd = m_vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	const VkImageSubresourceRange allLevels{ VK_IMAGE_ASPECT_COLOR_BIT, 0, m_hiZ.mipCount, 0, 1 };
+	vks::tools::setImageLayout(layoutCmd, m_hiZ.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, allLevels);
+	m_vulkanDevice->flushCommandBuffer(layoutCmd, vulkQueue);
+
+	// The build descriptor sets are transient, recordHiZ allocates them every frame
+	writeCullDescriptorSets();
+}
+
+// Write the culling descriptor sets of all frames, each with a single vkUpdateDescriptorSetWithTemplate
+// Called whenever the Hi-Z pyramid has been (re)created, none of the sets may be in use
+void VulkanRender::writeCullDescriptorSets()
+{
+	for (uint32_t i = 0; i < MAX_CONCURRENT_FRAMES; i++)
+	{
+		const CullDescriptors descriptors{
+			{ m_instanceBuffers[i].buffer, 0, VK_WHOLE_SIZE },
+			m_meshBuffer.descriptor,
+			m_indirectDraws[i].commands.descriptor,
+			m_indirectDraws[i].counters.descriptor,
+			m_visibilityBuffer.descriptor,
+			vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, m_hiZ.view, VK_IMAGE_LAYOUT_GENERAL),
+			m_meshletBuffer.descriptor,
+			m_indirectDraws[i].commands.descriptor,
+			m_lodBuffer.descriptor,
+		};
+		vkUpdateDescriptorSetWithTemplate(vulkDevice, m_indirectDraws[i].descriptorSet, m_cullUpdateTemplate, &descriptors);
+	}
+}
+
+void VulkanRender::destroyHiZ()
+{
+	for (VkImageView levelView : m_hiZ.levelViews)
+	{
+		vkDestroyImageView(vulkDevice, levelView, nullptr);
+	}
+	vkDestroyImageView(vulkDevice, m_hiZ.view, nullptr);
+	vkDestroyImage(vulkDevice, m_hiZ.image, nullptr);
+	vkFreeMemory(vulkDevice, m_hiZ.memory, nullptr);
+	m_hiZ = {};
+}
+
+// Record the culling dispatch for the current frame, has to be called outside of a render pass
+// Phase 0 resets the counters, phase 1 (occlusion culling only) runs after the Hi-Z build
+void VulkanRender::recordCulling(VkCommandBuffer commandBuffer, uint32_t phase)
+{
+	const IndirectDrawBuffers& indirectDraw = m_indirectDraws[m_currentFrame];
+
+	if (phase == 0)
+	{
+		// Reset the counters, the barrier also orders this frame's visibility accesses after the previous frame's
+		vkCmdFillBuffer(commandBuffer, indirectDraw.counters.buffer, 0, sizeof(CullCounters), 0);
+		VkMemoryBarrier resetBarrier = vks::initializers::memoryBarrier();
+		resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &resetBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	const std::array<VkDescriptorSet, 2> descriptorSets{ m_uniformBuffers[m_currentFrame].descriptorSet, indirectDraw.descriptorSet };
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipelineLayout, 0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 0, nullptr);
+	const uint32_t clusterMode = meshShadersReady() ? CLUSTER_MODE_TASKS : (m_clusterCulling ? CLUSTER_MODE_DRAWS : CLUSTER_MODE_OFF);
+	const CullPushConstants pushConstants{ m_instanceCount, phase, m_occlusionCulling ? 1u : 0u, clusterMode, m_drawCapacity, m_lodPixelScale, m_levelOfDetail ? LOD_PIXEL_ERROR : 0.0f };
+	vkCmdPushConstants(commandBuffer, m_cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &pushConstants);
+	// cull.slang uses 64 threads per work group
+	vkCmdDispatch(commandBuffer, (m_instanceCount + 63) / 64, 1, 1);
+
+	// Make the draw commands and the draw count visible to the indirect draw, the counters to the host and the visibility to the next phase
+	// The task shaders of the mesh shader path read their work items and add to the cluster counter
+	VkMemoryBarrier cullBarrier = vks::initializers::memoryBarrier();
+	cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	if (meshShadersReady())
+	{
+		dstStageMask |= VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT;
+	}
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStageMask, 0, 1, &cullBarrier, 0, nullptr, 0, nullptr);
+}
+
+// Build the Hi-Z pyramid from the depth buffer of the early render pass, one dispatch per level
+void VulkanRender::recordHiZ(VkCommandBuffer commandBuffer)
+{
+	// The previous frame's late culling has to be done reading the pyramid before it is overwritten
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_hiZPipeline);
+	DescriptorAllocator& frameDescriptorAllocator = m_frameDescriptorAllocators[m_currentFrame];
+	const bool descriptorBuffer = m_descriptorBufferEnabled && !m_pushDescriptorsEnabled;
+	if (descriptorBuffer)
+	{
+		m_descriptorBuffer.bind(commandBuffer);
+	}
+	for (uint32_t level = 0; level < m_hiZ.mipCount; level++)
+	{
+		// Level 0 copies the depth buffer (left in read only layout by the early render pass), every other level reduces the one above
+		// The set is released with the rest of the frame's transient sets
+		HiZDescriptors descriptors{
+			(level == 0)
+				? vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, m_depthSampleView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL)
+				: vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, m_hiZ.levelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL),
+			vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, m_hiZ.levelViews[level], VK_IMAGE_LAYOUT_GENERAL),
+		};
+		if (m_pushDescriptorsEnabled)
+		{
+			// The descriptors are recorded with the dispatch, there is no set to allocate, update or release
+			const std::array<VkWriteDescriptorSet, 2> writeDescriptorSets = {
+				vks::initializers::writeDescriptorSet(VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 0, &descriptors.source),
+				vks::initializers::writeDescriptorSet(VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &descriptors.destination),
+			};
+			m_vkCmdPushDescriptorSetKHR(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_hiZPipelineLayout, 0, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data());
+			m_benchmark.pushDescriptorSets++;
+		}
+		else if (descriptorBuffer)
+		{
+			// Both descriptors are copied into the frame's region of the descriptor buffer, binding only sets the offset of the set
+			const VkDeviceSize setOffset = m_descriptorBuffer.allocate(m_currentFrame, m_hiZDescriptorBufferLayout);
+			m_descriptorBuffer.writeImage(setOffset, m_hiZDescriptorBufferLayout, 0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, descriptors.source);
+			m_descriptorBuffer.writeImage(setOffset, m_hiZDescriptorBufferLayout, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, descriptors.destination);
+			m_descriptorBuffer.bindSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_hiZPipelineLayout, 0, 1, &setOffset);
+		}
+		else
+		{
+			// Allocated and written with one call
+			const VkDescriptorSet descriptorSet = frameDescriptorAllocator.allocate(m_hiZDescriptorSetLayout, m_hiZUpdateTemplate, &descriptors);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_hiZPipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		}
+
+		HiZPushConstants pushConstants{};
+		pushConstants.destinationSize[0] = std::max(m_hiZ.width >> level, 1u);
+		pushConstants.destinationSize[1] = std::max(m_hiZ.height >> level, 1u);
+		pushConstants.sourceSize[0] = (level == 0) ? m_hiZ.width : std::max(m_hiZ.width >> (level - 1), 1u);
+		pushConstants.sourceSize[1] = (level == 0) ? m_hiZ.height : std::max(m_hiZ.height >> (level - 1), 1u);
+		pushConstants.fromDepth = (level == 0) ? 1 : 0;
+
+		vkCmdPushConstants(commandBuffer, m_hiZPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HiZPushConstants), &pushConstants);
+		// hiz.slang uses 8x8 threads per work group
+		vkCmdDispatch(commandBuffer, (pushConstants.destinationSize[0] + 7) / 8, (pushConstants.destinationSize[1] + 7) / 8, 1);
+
+		// The level is read by the next level's dispatch and finally by the culling pass
+		VkMemoryBarrier levelBarrier = vks::initializers::memoryBarrier();
+		levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+	}
+}
+
+// Record the scene's draws inside the current render pass
+// drawList selects the early (0) or late (1) draw list of the GPU driven path, the CPU driven path only has one
+void VulkanRender::recordSceneDraws(VkCommandBuffer commandBuffer, uint32_t drawList)
+{
+	// Update dynamic viewport state
+	VkViewport viewport{};
+	viewport.height = (float)height;
+	viewport.width = (float)width;
+	viewport.minDepth = (float)0.0f;
+	viewport.maxDepth = (float)1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	// Update dynamic scissor state
+	VkRect2D scissor{};
+	scissor.extent.width = width;
+	scissor.extent.height = height;
+	scissor.offset.x = 0;
+	scissor.offset.y = 0;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	if (!m_gpuDriven)
+	{
+		recordQueuedDraws(commandBuffer);
+		return;
+	}
+
+	// Bind descriptor set for the current frame's uniform buffer, so the shader uses the data from that buffer for this draw, and the bindless set
+	// These are all descriptor sets the scene draws use, the objects select their materials by index (InstanceData::materialIndex)
+	const std::array<VkDescriptorSet, 2> sceneDescriptorSets{ m_uniformBuffers[m_currentFrame].descriptorSet, m_bindless.getSet() };
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkPipelineLayout, 0, static_cast<uint32_t>(sceneDescriptorSets.size()), sceneDescriptorSets.data(), 0, nullptr);
+	m_benchmark.descriptorSetBinds++;
+	// Bind the rendering pipeline
+	// The pipeline (state object) contains all states of the rendering pipeline, binding it will set all the states specified at pipeline creation time
+	// apart from the dynamic ones, which are set with it
+	bindGraphicsPipeline(commandBuffer, &vulkPipeline);
+	// Bind the cube vertex buffer (binding 0, per vertex) and the current frame's instance buffer (binding 1, per instance)
+	const VkBuffer vertexBuffers[2]{ m_vertices.buffer, m_instanceBuffers[m_currentFrame].buffer };
+	VkDeviceSize offsets[2]{ 0, 0 };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+	// Bind triangle index buffer
+	vkCmdBindIndexBuffer(commandBuffer, m_indices.buffer, 0, VK_INDEX_TYPE_UINT16);
+	if (meshShadersReady())
+	{
+		// The culling pass counted the task work groups, the task shaders cull the meshlets and launch one mesh shader work group per visible meshlet
+		// Sets 0 and 1 are compatible with the scene pipeline layout and remain bound
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_meshletPipelineLayout, 2, 1, &m_indirectDraws[m_currentFrame].meshletDescriptorSet, 0, nullptr);
+		m_benchmark.descriptorSetBinds++;
+		bindGraphicsPipeline(commandBuffer, &m_meshletPipeline);
+		m_vkCmdDrawMeshTasksIndirectEXT(commandBuffer, m_indirectDraws[m_currentFrame].counters.buffer, offsetof(CullCounters, taskGroupCount), 1, sizeof(VkDrawMeshTasksIndirectCommandEXT));
+	}
+	else
+	{
+		// Draw commands and their count have been written by the culling pass, the CPU doesn't touch the individual objects
+		const VkDeviceSize commandOffset = drawList * m_drawCapacity * sizeof(VkDrawIndexedIndirectCommand);
+		const VkDeviceSize countOffset = (drawList == 0) ? offsetof(CullCounters, drawCount) : offsetof(CullCounters, lateDrawCount);
+		vkCmdDrawIndexedIndirectCount(commandBuffer, m_indirectDraws[m_currentFrame].commands.buffer, commandOffset, m_indirectDraws[m_currentFrame].counters.buffer, countOffset, m_drawCapacity, sizeof(VkDrawIndexedIndirectCommand));
+	}
+}
+
+// The CPU driven path: the instances that passed CPU culling are drawn with a single call per mesh and level of detail, firstInstance selects the
+// range of the instance buffer. The draws go through the render queue, which sorts them by their keys and only records the binds that change
+void VulkanRender::recordQueuedDraws(VkCommandBuffer commandBuffer)
+{
+	// Only the scene pipeline draws through the queue. The instances of a range have their own materials, read by index from the bindless set,
+	// so no material state changes between draws and the material field of the keys stays 0
+	constexpr uint32_t scenePipelineId = 0;
+	RenderQueue::Draw draw;
+	draw.pipeline = &vulkPipeline;
+	draw.pipelineLayout = vulkPipelineLayout;
+	draw.descriptorSetCount = 2;
+	draw.descriptorSets[0] = m_uniformBuffers[m_currentFrame].descriptorSet;
+	draw.descriptorSets[1] = m_bindless.getSet();
+	// The cube vertex buffer (binding 0, per vertex) and the current frame's instance buffer (binding 1, per instance)
+	draw.vertexBufferCount = 2;
+	draw.vertexBuffers[0] = m_vertices.buffer;
+	draw.vertexBuffers[1] = m_instanceBuffers[m_currentFrame].buffer;
+	draw.indexBuffer = m_indices.buffer;
+	draw.indexType = VK_INDEX_TYPE_UINT16;
+
+	m_renderQueue.clear();
+	for (size_t rangeIndex = 0; rangeIndex < m_meshDrawRanges.size(); rangeIndex++)
+	{
+		const MeshDrawRange& range = m_meshDrawRanges[rangeIndex];
+		if (range.instanceCount > 0)
+		{
+			const uint32_t meshIndex = static_cast<uint32_t>(rangeIndex / MAX_LOD_COUNT);
+			const MeshInfo& mesh = m_meshes[meshIndex];
+			const MeshLod& lod = mesh.lods[rangeIndex % MAX_LOD_COUNT];
+			draw.indexCount = lod.indexCount;
+			draw.instanceCount = range.instanceCount;
+			draw.firstIndex = lod.firstIndex;
+			draw.vertexOffset = mesh.vertexOffset;
+			draw.firstInstance = range.firstInstance;
+			m_renderQueue.push(RenderQueue::makeKey(scenePipelineId, 0, meshIndex, range.depth), draw);
+		}
+	}
+	m_renderQueue.sort();
+	// The pipeline is bound along with its dynamic states
+	m_renderQueue.execute(commandBuffer, [this](VkCommandBuffer queueCommandBuffer, const VkPipeline* pipeline) { bindGraphicsPipeline(queueCommandBuffer, pipeline); });
+
+	const RenderQueue::Stats& stats = m_renderQueue.getStats();
+	m_benchmark.queuedDraws += stats.draws;
+	m_benchmark.pipelineBindsSkipped += stats.pipelineBindsSkipped;
+	m_benchmark.descriptorSetBinds += stats.descriptorSetBinds;
+	m_benchmark.descriptorSetBindsSkipped += stats.descriptorSetBindsSkipped;
+	m_benchmark.vertexBufferBinds += stats.vertexBufferBinds;
+	m_benchmark.vertexBufferBindsSkipped += stats.vertexBufferBindsSkipped;
+}
+
+void VulkanRender::bindGraphicsPipeline(VkCommandBuffer commandBuffer, const VkPipeline* pipeline)
+{
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipeline);
+	m_benchmark.pipelineBinds++;
+	// The pipeline is shared by all keys that only differ in the dynamic states, they are set from the current key
+	for (const GraphicsPipelineKey& graphicsPipeline : m_graphicsPipelineKeys)
+	{
+		if (graphicsPipeline.pipeline == pipeline)
+		{
+			m_benchmark.dynamicStateCommands += m_dynamicState.record(commandBuffer, graphicsPipeline.key, m_pipelineRegistry.getDynamicStates(graphicsPipeline.key), graphicsPipeline.vertexInput);
+			return;
+		}
+	}
+}
+
+// Pipelines that have finished compiling replace their null handles, in order to be used from the next recorded frame on
+void VulkanRender::updatePendingPipelines(bool wait)
+{
+	if (m_pendingPipelines.empty())
+	{
+		return;
+	}
+	auto ready = std::remove_if(m_pendingPipelines.begin(), m_pendingPipelines.end(), [wait](const PendingPipeline& pending) {
+		if (!wait && pending.future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			return false;
+		}
+		// A pipeline that failed to compile stays null, the renderer goes on without it
+		try
+		{
+			*pending.pipeline = pending.future.get();
+		}
+		catch (const std::runtime_error& error)
+		{
+			std::cerr << "Error: " << error.what() << ", the pipeline is not available" << std::endl;
+			*pending.pipeline = VK_NULL_HANDLE;
+		}
+		return true;
+	});
+	if (ready == m_pendingPipelines.end())
+	{
+		return;
+	}
+	m_pendingPipelines.erase(ready, m_pendingPipelines.end());
+
+	if (m_pendingPipelines.empty())
+	{
+		// A warm cache skips the compilation of the shaders to device code, compare against the time of a cold start
+		const double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_pipelineCompileStart).count();
+		std::cout << "Pipelines ready after " << elapsedMs << " ms: " << m_pipelineCache.getCreationCount() << " pipelines, " << m_pipelineCache.getCreationMilliseconds()
+			<< " ms compile time on " << m_pipelineCompiler.getThreadCount() << " threads (" << (m_pipelineCache.isWarm() ? "warm" : "cold") << " pipeline cache), "
+			<< "pipeline registry: " << m_pipelineRegistry.getPipelineCount() << " pipelines, " << m_pipelineRegistry.getHitCount() << " hits, " << m_pipelineRegistry.getMissCount() << " misses\n";
+		if (m_graphicsPipelineLibrary)
+		{
+			// Compare against the compile time of the same pipelines without libraries (-nopipelinelibrary)
+			std::cout << "Pipeline libraries: " << m_pipelineLibrary.getPartCount() << " parts in " << m_pipelineLibrary.getPartMilliseconds() << " ms, "
+				<< m_pipelineLibrary.getLinkCount(false) << " fast links in " << m_pipelineLibrary.getLinkMilliseconds(false) << " ms, "
+				<< m_pipelineRegistry.getOptimizingCount() << " pipelines optimizing in the background\n";
+		}
+		m_pipelineCache.save();
+		m_pipelineRegistry.save(getCachePath(PIPELINE_KEYS_FILE));
+	}
+}
+
+// Like the shader hot reload at the start of a frame, the fast linked pipeline is retired until the frames in flight are done with it
+void VulkanRender::updateOptimizedPipelines()
+{
+	// A fast linked pipeline may still have to be written to its handle member
+	if (!m_pendingPipelines.empty())
+	{
+		return;
+	}
+	const std::vector<PipelineRegistry::OptimizedPipeline> optimizedPipelines = m_pipelineRegistry.takeOptimizedPipelines();
+	for (const PipelineRegistry::OptimizedPipeline& optimized : optimizedPipelines)
+	{
+		for (const GraphicsPipelineKey& graphicsPipeline : m_graphicsPipelineKeys)
+		{
+			if (optimized.pipeline != VK_NULL_HANDLE && *graphicsPipeline.pipeline == optimized.replaced)
+			{
+				*graphicsPipeline.pipeline = optimized.pipeline;
+			}
+		}
+		m_retiredPipelines.push_back({ optimized.replaced, m_frameNumber });
+	}
+	if (!optimizedPipelines.empty() && m_pipelineRegistry.getOptimizingCount() == 0)
+	{
+		const uint32_t fastLinkCount = std::max(1u, m_pipelineLibrary.getLinkCount(false));
+		const uint32_t optimizedLinkCount = std::max(1u, m_pipelineLibrary.getLinkCount(true));
+		std::cout << "Optimized pipelines swapped in: " << m_pipelineLibrary.getLinkCount(true) << " links in " << m_pipelineLibrary.getLinkMilliseconds(true) << " ms, "
+			<< m_pipelineLibrary.getLinkMilliseconds(true) / optimizedLinkCount << " ms per pipeline against " << m_pipelineLibrary.getLinkMilliseconds(false) / fastLinkCount
+			<< " ms per fast link\n";
+	}
+}
+
+// Loads the shader and queues the pipeline on the compiler, not valid if the shader can't be loaded
+std::shared_future<VkPipeline> VulkanRender::compileComputePipeline(const std::string& shader, VkPipelineLayout layout, VkPipelineCreateFlags flags)
+{
+	VkComputePipelineCreateInfo computePipelineCI = vks::initializers::computePipelineCreateInfo(layout, flags);
+	computePipelineCI.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	computePipelineCI.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	computePipelineCI.stage.module = loadSPIRVShader(shader);
+	computePipelineCI.stage.pName = "main";
+	if (computePipelineCI.stage.module == VK_NULL_HANDLE)
+	{
+		return {};
+	}
+	return m_pipelineCompiler.compile(computePipelineCI);
+}
+
+// Called at the start of a frame, before anything is recorded, so a frame either uses the old or the new pipelines
+// The pipelines are rebuilt on the compiler threads, the render thread only checks whether they are ready and never waits for the device
+void VulkanRender::updateShaderReload()
+{
+	// The initial pipelines have to be in place before they can be replaced, the changes wait in the watcher until then
+	if (!m_shaderWatcher.isRunning() || !m_pendingPipelines.empty())
+	{
+		return;
+	}
+
+	if (m_reloadedPipelines.empty())
+	{
+		for (const std::string& shader : m_shaderWatcher.takeChangedShaders())
+		{
+			reloadShader(shader);
+		}
+		return;
+	}
+
+	// All pipelines of a reload are swapped in the same frame, so no frame mixes old and new shaders
+	for (const ReloadedPipeline& reloaded : m_reloadedPipelines)
+	{
+		if (reloaded.future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			return;
+		}
+	}
+	uint32_t replacedCount = 0;
+	for (const ReloadedPipeline& reloaded : m_reloadedPipelines)
+	{
+		VkPipeline pipeline;
+		try
+		{
+			pipeline = reloaded.future.get();
+		}
+		catch (const std::runtime_error& error)
+		{
+			std::cerr << "Error: " << error.what() << ", keeping the current pipeline" << std::endl;
+			continue;
+		}
+		// The frames in flight may still use the replaced pipeline
+		// Meanwhile the renderer may have switched to the pipeline of another key (see SetShaderVariant), then only the registry is updated
+		const VkPipeline replaced = reloaded.registered ? m_pipelineRegistry.replace(reloaded.key, pipeline) : *reloaded.pipeline;
+		if (*reloaded.pipeline == replaced)
+		{
+			*reloaded.pipeline = pipeline;
+		}
+		m_retiredPipelines.push_back({ replaced, m_frameNumber });
+		replacedCount++;
+	}
+	std::cout << "Shader hot reload: " << replacedCount << " of " << m_reloadedPipelines.size() << " pipelines replaced\n";
+	m_reloadedPipelines.clear();
+	updateVertexInputs();
+}
+
+// Rebuilds the pipelines using the changed SPIR-V file, they are swapped in by updateShaderReload
+void VulkanRender::reloadShader(const std::string& filename)
+{
+	auto current = m_shaderReflections.find(filename);
+	if (current == m_shaderReflections.end())
+	{
+		// Not used by any pipeline in this configuration
+		return;
+	}
+	std::vector<uint32_t> shaderCode = readSPIRVFile(filename);
+	ShaderReflection reflection;
+	if (shaderCode.empty() || !reflection.reflect(shaderCode.data(), shaderCode.size()))
+	{
+		std::cerr << "Error: Could not reload shader file \"" << filename << "\"" << std::endl;
+		return;
+	}
+	// The descriptor sets and pipeline layouts stay as they are, the vertex inputs are matched again when the pipelines are built
+	if (!current->second.hasSameLayout(reflection))
+	{
+		std::cerr << "Error: The descriptor bindings or push constants of \"" << filename << "\" have changed, restart to apply the change" << std::endl;
+		return;
+	}
+	current->second = std::move(reflection);
+	m_pipelineRegistry.invalidateShader(filename);
+
+	const size_t reloadedCount = m_reloadedPipelines.size();
+	for (const GraphicsPipelineKey& graphicsPipeline : m_graphicsPipelineKeys)
+	{
+		if (m_pipelineRegistry.usesShader(graphicsPipeline.key, filename))
+		{
+			std::shared_future<VkPipeline> future = m_pipelineRegistry.rebuild(graphicsPipeline.key);
+			if (future.valid())
+			{
+				m_reloadedPipelines.push_back({ future, graphicsPipeline.pipeline, graphicsPipeline.key, true });
+			}
+		}
+	}
+	for (const ComputePipelineShader& computePipeline : m_computePipelineShaders)
+	{
+		if (computePipeline.shader == filename)
+		{
+			std::shared_future<VkPipeline> future = compileComputePipeline(computePipeline.shader, computePipeline.layout, computePipeline.flags);
+			if (future.valid())
+			{
+				m_reloadedPipelines.push_back({ future, computePipeline.pipeline, {}, false });
+			}
+		}
+	}
+	std::cout << "Shader hot reload: \"" << filename << "\" changed, rebuilding " << m_reloadedPipelines.size() - reloadedCount << " pipelines\n";
+}
+
+// A pipeline replaced at the start of frame n is only used by the frames before n. Frame m waits for the fence of frame m - MAX_CONCURRENT_FRAMES,
+// so once frame n + MAX_CONCURRENT_FRAMES - 1 has waited for its fence all of them have finished
+void VulkanRender::destroyRetiredPipelines(bool all)
+{
+	auto retired = std::remove_if(m_retiredPipelines.begin(), m_retiredPipelines.end(), [this, all](const RetiredPipeline& retired) {
+		if (!all && m_frameNumber + 1 < retired.frameNumber + MAX_CONCURRENT_FRAMES)
+		{
+			return false;
+		}
+		vkDestroyPipeline(vulkDevice, retired.pipeline, nullptr);
+		return true;
+	});
+	m_retiredPipelines.erase(retired, m_retiredPipelines.end());
+}
+
+bool VulkanRender::scenePipelinesReady() const
+{
+	if (vulkPipeline == VK_NULL_HANDLE)
+	{
+		return false;
+	}
+	if (m_gpuDriven && m_cullPipeline == VK_NULL_HANDLE)
+	{
+		return false;
+	}
+	return !m_occlusionCulling || m_hiZPipeline != VK_NULL_HANDLE;
+}
+
+// Read back the GPU timestamps of the current frame slot (its fence has signaled) and add them to the benchmark
+void VulkanRender::readTimestamps()
+{
+	if (m_timestampQueryPool == VK_NULL_HANDLE || !m_timestampsWritten[m_currentFrame])
+	{
+		return;
+	}
+
+	std::array<uint64_t, TIMESTAMPS_PER_FRAME> timestamps{};
+	if (vkGetQueryPoolResults(vulkDevice, m_timestampQueryPool, m_currentFrame * TIMESTAMPS_PER_FRAME, TIMESTAMPS_PER_FRAME, sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+	{
+		return;
+	}
+
+	// Timestamps are counted in device ticks of timestampPeriod nanoseconds
+	const double ticksToMilliseconds = vulkDeviceProperties.limits.timestampPeriod / 1000000.0;
+	m_benchmark.timedFrames++;
+	m_benchmark.drawTime += ((timestamps[1] - timestamps[0]) + (timestamps[3] - timestamps[2])) * ticksToMilliseconds;
+	m_benchmark.occlusionTime += (timestamps[2] - timestamps[1]) * ticksToMilliseconds;
+	m_benchmark.drawnObjects += m_cullStats.drawCount + m_cullStats.lateDrawCount;
+	m_benchmark.occludedObjects += m_cullStats.occludedCount;
+}
+
+
+// Path of a cache file in the directory of the executable (the working directory if it is not known)
+std::string VulkanRender::getCachePath(const char* filename) const
+{
+	return (std::filesystem::path(m_cacheDirectory) / filename).string();
+}
+
+// Vulkan loads its shaders from an immediate binary representation called SPIR-V
+// Shaders are compiled offline from slang by shadercompile.bat, which also embeds them into the executable
+// This function loads such a shader (by the name of its SPIR-V file) and returns a shader module structure
+// The shader's resource interface is reflected from the same code (see getShaderReflection)
+VkShaderModule VulkanRender::loadSPIRVShader(const std::string& filename)
+{
+	std::vector<uint32_t> shaderCode = getSPIRVCode(filename);
+
+	if (!shaderCode.empty())
+	{
+		if (!reflectSPIRVShader(filename, shaderCode))
+		{
+			return VK_NULL_HANDLE;
+		}
+
+		// Create a new shader module that will be used for pipeline creation
+		VkShaderModuleCreateInfo shaderModuleCI{};
+		shaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		shaderModuleCI.codeSize = shaderCode.size() * sizeof(uint32_t);
+		shaderModuleCI.pCode = shaderCode.data();
+
+		VkShaderModule shaderModule;
+		VK_CHECK_RESULT(vkCreateShaderModule(vulkDevice, &shaderModuleCI, nullptr, &shaderModule));
+
+		return shaderModule;
+	}
+	else
+	{
+		std::cerr << "Error: Could not open shader file \"" << filename << "\"" << std::endl;
+		return VK_NULL_HANDLE;
+	}
+}
+
+// Shaders that aren't embedded (e.g. when they failed to compile while building) are read from disk as well
+std::vector<uint32_t> VulkanRender::getSPIRVCode(const std::string& filename)
+{
+	if (!m_shadersFromDisk && !m_shaderHotReload)
+	{
+		const std::span<const uint32_t> embeddedCode = findEmbeddedShader(filename);
+		if (!embeddedCode.empty())
+		{
+			return std::vector<uint32_t>(embeddedCode.begin(), embeddedCode.end());
+		}
+	}
+	return readSPIRVFile(filename);
+}
+
+// SPIR-V is a stream of 32 bit words, empty if the file could not be read
+std::vector<uint32_t> VulkanRender::readSPIRVFile(const std::string& filename)
+{
+	std::vector<uint32_t> shaderCode;
+	std::ifstream is(filename, std::ios::binary | std::ios::in | std::ios::ate);
+	if (is.is_open())
+	{
+		const size_t shaderSize = is.tellg();
+		is.seekg(0, std::ios::beg);
+		shaderCode.resize(shaderSize / sizeof(uint32_t));
+		is.read(reinterpret_cast<char*>(shaderCode.data()), shaderCode.size() * sizeof(uint32_t));
+	}
+	return shaderCode;
+}
+
+// Reflects the shader code unless the file has been reflected before
+bool VulkanRender::reflectSPIRVShader(const std::string& filename, const std::vector<uint32_t>& shaderCode)
+{
+	if (m_shaderReflections.contains(filename))
+	{
+		return true;
+	}
+	ShaderReflection reflection;
+	if (!reflection.reflect(shaderCode.data(), shaderCode.size()))
+	{
+		std::cerr << "Error: Could not reflect shader file \"" << filename << "\"" << std::endl;
+		return false;
+	}
+	m_shaderReflections.emplace(filename, std::move(reflection));
+	return true;
+}
+
+// The layouts are created before the pipelines, so the first request for a shader reflects its code without creating a module
+const ShaderReflection& VulkanRender::getShaderReflection(const std::string& filename)
+{
+	if (!m_shaderReflections.contains(filename) && !reflectSPIRVShader(filename, getSPIRVCode(filename)))
+	{
+		throw std::runtime_error("Could not reflect shader file " + filename);
+	}
+	return m_shaderReflections.at(filename);
+}
+
+void VulkanRender::updateViewMatrix(const glm::vec3& cameraRotation)
+{
+	// The rotation is advanced by the simulation and interpolated between its last two steps (see SimulationSnapshot)
+	// The stress scene is a lot bigger than the default scene, so move the camera back to see all of it
+	glm::vec3 position = glm::vec3(0.0f, 0.0f, m_stressScene ? -150.0f : -3.0f);
+
+	glm::mat4 rotM = glm::mat4(1.0f);
+	glm::mat4 transM;
+
+	rotM = glm::rotate(rotM, glm::radians(cameraRotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+	rotM = glm::rotate(rotM, glm::radians(cameraRotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+	rotM = glm::rotate(rotM, glm::radians(cameraRotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+
+	glm::vec3 translation = position;
+	transM = glm::translate(glm::mat4(1.0f), translation);
+
+	m_viewMatrix = transM * rotM;
+};
+
+// Build the scene's instances and register their world space bounds with the CPU culler
+// The default scene is a cube next to the dense sphere, the stress scene lays out STRESS_SCENE_INSTANCE_COUNT objects on a regular grid
+// Every STRESS_SCENE_SPHERE_INTERVAL-th object of the stress scene is a sphere, so the levels of detail have something to reduce
+// The instance transforms are nodes of the scene graph below a common root, the stress scene groups each z slice of the grid under its own node
+void VulkanRender::createScene()
+{
+	m_instanceCount = m_stressScene ? STRESS_SCENE_INSTANCE_COUNT : 2;
+	m_sceneInstances.resize(m_instanceCount);
+
+	m_sceneGraph.clear();
+	m_sceneGraph.reserve(m_instanceCount + 64);
+	m_nodeInstances.clear();
+	const uint32_t rootNode = m_sceneGraph.addNode(SceneGraph::INVALID_NODE, glm::vec3(0.0f));
+	auto addInstanceNode = [&](uint32_t instance, uint32_t parent, const glm::vec3& position) {
+		const uint32_t node = m_sceneGraph.addNode(parent, position);
+		m_nodeInstances.resize(node + 1, SceneGraph::INVALID_NODE);
+		m_nodeInstances[node] = instance;
+	};
+
+	if (!m_stressScene)
+	{
+		addInstanceNode(0, rootNode, glm::vec3(-0.75f, 0.0f, 0.0f));
+		m_sceneInstances[0].meshIndex = 0;
+		m_sceneInstances[0].materialIndex = 0;
+		addInstanceNode(1, rootNode, glm::vec3(0.75f, 0.0f, 0.0f));
+		m_sceneInstances[1].meshIndex = 1;
+		m_sceneInstances[1].materialIndex = 5;
+	}
+	else
+	{
+		constexpr uint32_t gridX = 50;
+		constexpr uint32_t gridY = 40;
+		constexpr uint32_t gridZ = STRESS_SCENE_INSTANCE_COUNT / (gridX * gridY);
+		constexpr float spacing = 2.0f;
+		const glm::vec3 origin = -0.5f * spacing * glm::vec3(gridX - 1, gridY - 1, gridZ - 1);
+
+		uint32_t index = 0;
+		for (uint32_t z = 0; z < gridZ; z++)
+		{
+			const uint32_t sliceNode = m_sceneGraph.addNode(rootNode, glm::vec3(0.0f, 0.0f, origin.z + spacing * z));
+			for (uint32_t y = 0; y < gridY; y++)
+			{
+				for (uint32_t x = 0; x < gridX; x++)
+				{
+					addInstanceNode(index, sliceNode, glm::vec3(origin.x + spacing * x, origin.y + spacing * y, 0.0f));
+					m_sceneInstances[index].meshIndex = (index % STRESS_SCENE_SPHERE_INTERVAL == 0) ? 1 : 0;
+					// Neighbouring objects differ in material, so the draws of every mesh mix all materials
+					m_sceneInstances[index].materialIndex = (x + y + z) % SCENE_MATERIAL_COUNT;
+					index++;
+				}
+			}
+		}
+	}
+	m_nodeInstances.resize(m_sceneGraph.size(), SceneGraph::INVALID_NODE);
+
+	m_objectLods.assign(m_instanceCount, 0);
+
+	m_frustumCuller.clear();
+	m_frustumCuller.reserve(m_instanceCount);
+	for (InstanceData& instance : m_sceneInstances)
+	{
+		instance.boundingSphere = glm::vec4(0.0f, 0.0f, 0.0f, m_meshes[instance.meshIndex].boundingRadius);
+		// Placeholder bounds, the first updateSceneTransforms writes the real transforms and bounds
+		m_frustumCuller.add(glm::vec3(0.0f), glm::vec3(0.0f));
+	}
+	updateSceneTransforms();
+}
+
+// Recompute the world transforms of the scene graph nodes changed since the last call
+// and copy them to the instances of those nodes, along with their new world space bounds for the CPU culler
+void VulkanRender::updateSceneTransforms()
+{
+	m_changedNodes.clear();
+	if (m_sceneGraph.update(&m_changedNodes, m_jobSystem.get()) == 0)
+	{
+		return;
+	}
+
+	// The world space AABBs of the changed instances are computed in batches with the SIMD kernels, the meshes' object space AABBs are centered at the origin
+	// Every changed node belongs to a different instance, so the batches run as parallel jobs
+	constexpr uint32_t BATCH_SIZE = 256;
+	m_jobSystem->parallelFor(static_cast<uint32_t>(m_changedNodes.size()), BATCH_SIZE, [this](uint32_t first, uint32_t last) {
+		std::array<uint32_t, BATCH_SIZE> batchInstances;
+		std::array<glm::mat4, BATCH_SIZE> batchMatrices;
+		std::array<glm::vec3, BATCH_SIZE> batchLocalMin;
+		std::array<glm::vec3, BATCH_SIZE> batchLocalMax;
+		std::array<glm::vec3, BATCH_SIZE> batchWorldMin;
+		std::array<glm::vec3, BATCH_SIZE> batchWorldMax;
+		uint32_t batchCount = 0;
+		for (uint32_t i = first; i < last; i++)
+		{
+			const uint32_t node = m_changedNodes[i];
+			const uint32_t instanceIndex = m_nodeInstances[node];
+			if (instanceIndex == SceneGraph::INVALID_NODE)
+			{
+				continue;
+			}
+			InstanceData& instance = m_sceneInstances[instanceIndex];
+			instance.modelMatrix = m_sceneGraph.getWorldTransform(node);
+			batchInstances[batchCount] = instanceIndex;
+			batchMatrices[batchCount] = instance.modelMatrix;
+			batchLocalMin[batchCount] = -m_meshExtents[instance.meshIndex];
+			batchLocalMax[batchCount] = m_meshExtents[instance.meshIndex];
+			batchCount++;
+		}
+		MatrixKernels::transformAabbs(batchMatrices.data(), batchLocalMin.data(), batchLocalMax.data(), batchWorldMin.data(), batchWorldMax.data(), batchCount);
+		for (uint32_t i = 0; i < batchCount; i++)
+		{
+			m_frustumCuller.setBounds(batchInstances[i], batchWorldMin[i], batchWorldMax[i]);
+		}
+	});
+
+	// Every frame's instance buffer has to pick up the new transforms
+	m_instanceVersion++;
+	for (InstanceBuffer& instanceBuffer : m_instanceBuffers)
+	{
+		if (instanceBuffer.allDirty)
+		{
+			continue;
+		}
+		for (const uint32_t node : m_changedNodes)
+		{
+			if (m_nodeInstances[node] != SceneGraph::INVALID_NODE)
+			{
+				instanceBuffer.dirtyInstances.push_back(m_nodeInstances[node]);
+			}
+		}
+		if (instanceBuffer.dirtyInstances.size() > m_instanceCount / 2)
+		{
+			instanceBuffer.allDirty = true;
+			instanceBuffer.dirtyInstances.clear();
+		}
+	}
+}
+
+// Level of detail of an object for this frame, the same selection as selectLod in cull.slang
+// Each level's error is projected at the point of the object's bounding sphere closest to the camera, the coarsest level within LOD_PIXEL_ERROR pixels is drawn
+// An object refines as soon as its current level is too coarse, but only coarsens to levels within LOD_HYSTERESIS times the threshold
+uint32_t VulkanRender::selectLod(const MeshInfo& mesh, uint32_t currentLod, const glm::mat4& modelMatrix, const glm::vec4& boundingSphere, const glm::vec3& cameraPosition) const
+{
+	if (!m_levelOfDetail)
+	{
+		return 0;
+	}
+
+	const float scale = std::max(glm::length(glm::vec3(modelMatrix[0])), std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+	const glm::vec3 center(modelMatrix * glm::vec4(glm::vec3(boundingSphere), 1.0f));
+	const float distance = glm::length(center - cameraPosition) - boundingSphere.w * scale;
+	if (distance <= 0.0f)
+	{
+		// The camera is inside the bounding sphere
+		return 0;
+	}
+
+	const float pixelsPerUnit = m_lodPixelScale * scale / distance;
+	uint32_t lod = 0;
+	uint32_t relaxedLod = 0;
+	for (uint32_t i = 1; i < mesh.lodCount; i++)
+	{
+		const float pixels = mesh.lods[i].error * pixelsPerUnit;
+		if (pixels <= LOD_PIXEL_ERROR)
+		{
+			lod = i;
+		}
+		if (pixels <= LOD_PIXEL_ERROR * LOD_HYSTERESIS)
+		{
+			relaxedLod = i;
+		}
+	}
+	return (currentLod > lod) ? lod : std::max(currentLod, relaxedLod);
+}
+
+// Write the instances to draw this frame into the (mapped) instance buffer
+// The GPU driven path culls on its own and needs all objects, only the ones changed since the buffer was last written are copied
+// Otherwise the CPU culls and only the visible instances are written (compacted), unless the buffer still holds them from an earlier frame
+// The visible instances are grouped by mesh and level of detail (counting sort), so each of them is drawn with a single instanced draw
+void VulkanRender::updateInstances(const Frustum& frustum, const glm::vec3& cameraPosition, InstanceBuffer& instanceBuffer)
+{
+	InstanceData* instances = instanceBuffer.mapped;
+	if (m_gpuDriven)
+	{
+		if (instanceBuffer.allDirty)
+		{
+			memcpy(instances, m_sceneInstances.data(), m_instanceCount * sizeof(InstanceData));
+			m_benchmark.uploadedInstances += m_instanceCount;
+		}
+		else
+		{
+			for (const uint32_t instanceIndex : instanceBuffer.dirtyInstances)
+			{
+				instances[instanceIndex] = m_sceneInstances[instanceIndex];
+			}
+			m_benchmark.uploadedInstances += instanceBuffer.dirtyInstances.size();
+		}
+		instanceBuffer.dirtyInstances.clear();
+		instanceBuffer.allDirty = false;
+		m_drawInstanceCount = m_instanceCount;
+		return;
+	}
+
+	// The visible instances, their levels of detail and their order only depend on the transforms and the view
+	// The levels of detail settle after one selection (see selectLod), so the draw ranges of the last frame of a version also fit every buffer written with it
+	const bool viewChanged = !std::equal(std::begin(frustum.planes), std::end(frustum.planes), std::begin(m_instanceFrustum.planes))
+		|| cameraPosition != m_instanceCameraPosition || m_lodPixelScale != m_instanceLodPixelScale || m_levelOfDetail != m_instanceLevelOfDetail;
+	if (viewChanged)
+	{
+		m_instanceFrustum = frustum;
+		m_instanceCameraPosition = cameraPosition;
+		m_instanceLodPixelScale = m_lodPixelScale;
+		m_instanceLevelOfDetail = m_levelOfDetail;
+		m_instanceVersion++;
+	}
+	if (instanceBuffer.version == m_instanceVersion)
+	{
+		return;
+	}
+	instanceBuffer.version = m_instanceVersion;
+
+	m_drawInstanceCount = m_frustumCuller.cull(frustum, m_visibleInstances, FrustumCuller::BoundingVolume::AABB, m_jobSystem.get());
+
+	// The visible instances are processed in batches on all workers: the first pass selects the levels of detail and counts each batch's instances per draw range,
+	// then the batches get consecutive slots inside every range, so the second pass writes all instances without any synchronization
+	constexpr uint32_t BATCH_SIZE = 4096;
+	const uint32_t rangeCount = static_cast<uint32_t>(m_meshes.size()) * MAX_LOD_COUNT;
+	const uint32_t batchCount = (m_drawInstanceCount + BATCH_SIZE - 1) / BATCH_SIZE;
+	m_instanceBatchOffsets.assign(static_cast<size_t>(batchCount) * rangeCount, 0);
+	m_instanceBatchTriangles.assign(batchCount, glm::uvec2(0));
+	m_instanceBatchDepths.assign(static_cast<size_t>(batchCount) * rangeCount, std::numeric_limits<float>::max());
+	m_jobSystem->parallelFor(batchCount, 1, [&](uint32_t firstBatch, uint32_t lastBatch) {
+		for (uint32_t batch = firstBatch; batch < lastBatch; batch++)
+		{
+			uint32_t* rangeCounts = &m_instanceBatchOffsets[static_cast<size_t>(batch) * rangeCount];
+			float* rangeDepths = &m_instanceBatchDepths[static_cast<size_t>(batch) * rangeCount];
+			glm::uvec2 triangles(0);
+			for (uint32_t i = batch * BATCH_SIZE; i < std::min(m_drawInstanceCount, (batch + 1) * BATCH_SIZE); i++)
+			{
+				const uint32_t objectIndex = m_visibleInstances[i];
+				const InstanceData& instance = m_sceneInstances[objectIndex];
+				const MeshInfo& mesh = m_meshes[instance.meshIndex];
+				const uint32_t lod = selectLod(mesh, m_objectLods[objectIndex], instance.modelMatrix, instance.boundingSphere, cameraPosition);
+				m_objectLods[objectIndex] = static_cast<uint8_t>(lod);
+				const uint32_t range = instance.meshIndex * MAX_LOD_COUNT + lod;
+				rangeCounts[range]++;
+				const glm::vec3 offset = glm::vec3(instance.modelMatrix[3]) - cameraPosition;
+				rangeDepths[range] = std::min(rangeDepths[range], glm::dot(offset, offset));
+				triangles += glm::uvec2(mesh.lods[lod].indexCount / 3, mesh.indexCount / 3);
+			}
+			m_instanceBatchTriangles[batch] = triangles;
+		}
+	});
+
+	m_meshDrawRanges.assign(rangeCount, MeshDrawRange{});
+	uint32_t firstInstance = 0;
+	for (uint32_t range = 0; range < rangeCount; range++)
+	{
+		m_meshDrawRanges[range].firstInstance = firstInstance;
+		float depth = std::numeric_limits<float>::max();
+		for (uint32_t batch = 0; batch < batchCount; batch++)
+		{
+			uint32_t& offset = m_instanceBatchOffsets[static_cast<size_t>(batch) * rangeCount + range];
+			const uint32_t count = offset;
+			offset = firstInstance;
+			firstInstance += count;
+			depth = std::min(depth, m_instanceBatchDepths[static_cast<size_t>(batch) * rangeCount + range]);
+		}
+		m_meshDrawRanges[range].depth = depth;
+		m_meshDrawRanges[range].instanceCount = firstInstance - m_meshDrawRanges[range].firstInstance;
+	}
+	m_drawTriangleCount = 0;
+	m_fullDetailTriangleCount = 0;
+	for (const glm::uvec2& triangles : m_instanceBatchTriangles)
+	{
+		m_drawTriangleCount += triangles.x;
+		m_fullDetailTriangleCount += triangles.y;
+	}
+
+	m_jobSystem->parallelFor(batchCount, 1, [&](uint32_t firstBatch, uint32_t lastBatch) {
+		for (uint32_t batch = firstBatch; batch < lastBatch; batch++)
+		{
+			uint32_t* rangeOffsets = &m_instanceBatchOffsets[static_cast<size_t>(batch) * rangeCount];
+			for (uint32_t i = batch * BATCH_SIZE; i < std::min(m_drawInstanceCount, (batch + 1) * BATCH_SIZE); i++)
+			{
+				const uint32_t objectIndex = m_visibleInstances[i];
+				const InstanceData& instance = m_sceneInstances[objectIndex];
+				instances[rangeOffsets[instance.meshIndex * MAX_LOD_COUNT + m_objectLods[objectIndex]]++] = instance;
+			}
+		}
+	});
+	m_benchmark.uploadedInstances += m_drawInstanceCount;
+}
+
+// Simple draw throughput benchmark, reports frames, draw calls and instances per second once a second
+// The triangles per frame are reported along with the triangles the same objects have at full detail, the difference is the saving of the levels of detail
+void VulkanRender::updateBenchmark(float deltaTime, uint32_t drawCalls, uint32_t instances, uint32_t triangles, uint32_t fullDetailTriangles)
+{
+	m_benchmark.elapsed += deltaTime;
+	m_benchmark.frames++;
+	m_benchmark.drawCalls += drawCalls;
+	m_benchmark.instances += instances;
+	m_benchmark.triangles += triangles;
+	m_benchmark.fullDetailTriangles += fullDetailTriangles;
+
+	if (m_benchmark.elapsed >= 1.0f)
+	{
+		std::cout << "Benchmark: " << m_benchmark.frames / m_benchmark.elapsed << " fps, "
+			<< m_benchmark.drawCalls / m_benchmark.elapsed << " draws/s, "
+			<< m_benchmark.instances / m_benchmark.elapsed << " instances/s (" << double(m_benchmark.uploadedInstances) / m_benchmark.frames << " uploaded/frame), "
+			<< m_benchmark.triangles / m_benchmark.frames << " triangles/frame (" << m_benchmark.fullDetailTriangles / m_benchmark.frames << " without LODs)";
+		// Pipelines compiled so far and the state changes of the scene draws per frame
+		std::cout << ", " << m_pipelineRegistry.getPipelineCount() << " pipelines, " << double(m_benchmark.pipelineBinds) / m_benchmark.frames << " pipeline binds/frame, "
+			<< double(m_benchmark.descriptorSetBinds) / m_benchmark.frames << " descriptor set binds/frame, " << double(m_benchmark.dynamicStateCommands) / m_benchmark.frames << " dynamic state commands/frame";
+		// Descriptor sets allocated per frame from the transient allocators and the pools all allocators have chained so far
+		uint32_t descriptorPoolCount = m_descriptorAllocator.getPoolCount();
+		for (const DescriptorAllocator& frameDescriptorAllocator : m_frameDescriptorAllocators)
+		{
+			descriptorPoolCount += frameDescriptorAllocator.getPoolCount();
+		}
+		std::cout << ", " << double(m_benchmark.transientDescriptorSets) / m_benchmark.frames << " transient descriptor sets/frame" << (m_descriptorBufferEnabled ? " (descriptor buffer), " : ", ")
+			<< double(m_benchmark.pushDescriptorSets) / m_benchmark.frames << " pushed descriptor sets/frame, " << descriptorPoolCount << " descriptor pools";
+		if (!m_gpuDriven)
+		{
+			// Binds per frame recorded / skipped by the render queue (vertex buffers include the index buffer)
+			std::cout << ", render queue: " << double(m_benchmark.queuedDraws) / m_benchmark.frames << " draws/frame, binds issued/skipped: pipeline "
+				<< double(m_benchmark.pipelineBinds) / m_benchmark.frames << "/" << double(m_benchmark.pipelineBindsSkipped) / m_benchmark.frames << ", descriptor sets "
+				<< double(m_benchmark.descriptorSetBinds) / m_benchmark.frames << "/" << double(m_benchmark.descriptorSetBindsSkipped) / m_benchmark.frames << ", vertex buffers "
+				<< double(m_benchmark.vertexBufferBinds) / m_benchmark.frames << "/" << double(m_benchmark.vertexBufferBindsSkipped) / m_benchmark.frames;
+		}
+		if (m_gpuDriven)
+		{
+			std::cout << ", GPU culling: " << m_cullStats.drawCount + m_cullStats.lateDrawCount << " visible, " << m_cullStats.culledCount << " culled";
+			if (m_occlusionCulling)
+			{
+				std::cout << ", " << m_cullStats.occludedCount << " occluded";
+			}
+			if (m_clusterCulling)
+			{
+				std::cout << ", " << m_cullStats.clusterCulledCount << " meshlets culled";
+			}
+		}
+		if (m_benchmark.timedFrames > 0)
+		{
+			const double drawTime = m_benchmark.drawTime / m_benchmark.timedFrames;
+			std::cout << ", GPU draw " << drawTime << " ms";
+			if (m_occlusionCulling)
+			{
+				// The saving is estimated from the average GPU cost of a drawn object, minus the cost of the Hi-Z build and the late culling pass
+				const double occlusionTime = m_benchmark.occlusionTime / m_benchmark.timedFrames;
+				const uint64_t testedObjects = m_benchmark.drawnObjects + m_benchmark.occludedObjects;
+				const double occludedRatio = testedObjects > 0 ? double(m_benchmark.occludedObjects) / testedObjects : 0.0;
+				const double objectTime = m_benchmark.drawnObjects > 0 ? m_benchmark.drawTime / m_benchmark.drawnObjects : 0.0;
+				const double savedTime = objectTime * m_benchmark.occludedObjects / m_benchmark.timedFrames - occlusionTime;
+				std::cout << ", occluded " << occludedRatio * 100.0 << "% of the objects in the frustum, Hi-Z + late cull " << occlusionTime << " ms, est. GPU time saved " << savedTime << " ms";
+			}
+		}
+		// Share of the second every job system worker spent running jobs (worker 0 is the render thread)
+		std::cout << ", CPU workers busy";
+		for (const JobSystem::WorkerStats& stats : m_jobSystem->getStats())
+		{
+			std::cout << " " << static_cast<uint32_t>(100.0 * stats.busySeconds / m_benchmark.elapsed + 0.5) << "%";
+		}
+		m_jobSystem->resetStats();
+		std::cout << "\n";
+		m_benchmark = {};
+	}
+}
+
+// Descriptor microbenchmark: setCount transient sets of four storage buffers (like per object data of a draw) are written and bound into a
+// command buffer, once allocated from a per-frame descriptor allocator and written through an update template, once written into a descriptor
+// buffer and once pushed (if enabled), then released as at the start of a frame. Logs the best CPU time per set out of a few runs of each backend
+void VulkanRender::runDescriptorBenchmark(uint32_t setCount)
+{
+	constexpr uint32_t bindingCount = 4;
+	constexpr uint32_t iterations = 10;
+	// Every set points at its own ranges of one buffer, the offsets meet any storage buffer offset alignment
+	constexpr VkDeviceSize rangeSize = 256;
+	constexpr uint32_t rangeCount = 1024;
+
+	std::vector<VkDescriptorSetLayoutBinding> bindings;
+	for (uint32_t binding = 0; binding < bindingCount; binding++)
+	{
+		bindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, binding));
+	}
+	vks::Buffer storageBuffer;
+	const VkBufferUsageFlags storageUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | (m_descriptorBufferEnabled ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : 0);
+	VK_CHECK_RESULT(m_vulkanDevice->createBuffer(storageUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &storageBuffer, rangeCount * rangeSize));
+
+	// Runs record(commandBuffer) in a command buffer that is never submitted, followed by release(), and returns the best time in ns per set
+	auto measure = [&](auto record, auto release) {
+		double bestNs = 1e30;
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			VkCommandBuffer commandBuffer = m_vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			auto tStart = std::chrono::high_resolution_clock::now();
+			record(commandBuffer);
+			release();
+			auto tEnd = std::chrono::high_resolution_clock::now();
+			VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+			vkFreeCommandBuffers(vulkDevice, m_vulkanDevice->commandPool, 1, &commandBuffer);
+			bestNs = std::min(bestNs, std::chrono::duration<double, std::nano>(tEnd - tStart).count() / setCount);
+		}
+		return bestNs;
+	};
+
+	std::cout << "Descriptor benchmark, " << setCount << " transient sets of " << bindingCount << " storage buffers written and bound: ";
+
+	// Descriptor pools: one allocation and one templated update per set, the pools are reset as a whole
+	{
+		const VkDescriptorSetLayout setLayout = m_layoutCache.getSetLayout(bindings);
+		const VkPipelineLayout pipelineLayout = m_layoutCache.getPipelineLayout(std::vector<VkDescriptorSetLayout>{ setLayout }, {});
+		std::vector<VkDescriptorUpdateTemplateEntry> entries;
+		for (uint32_t binding = 0; binding < bindingCount; binding++)
+		{
+			entries.push_back(DescriptorAllocator::templateEntry(binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, binding * sizeof(VkDescriptorBufferInfo)));
+		}
+		const VkDescriptorUpdateTemplate updateTemplate = DescriptorAllocator::createUpdateTemplate(vulkDevice, setLayout, entries);
+		DescriptorAllocator allocator;
+		allocator.init(vulkDevice, 1024, { { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, static_cast<float>(bindingCount) } });
+
+		const double poolNs = measure([&](VkCommandBuffer commandBuffer) {
+			for (uint32_t set = 0; set < setCount; set++)
+			{
+				std::array<VkDescriptorBufferInfo, bindingCount> bufferInfos;
+				for (uint32_t binding = 0; binding < bindingCount; binding++)
+				{
+					bufferInfos[binding] = { storageBuffer.buffer, ((set * bindingCount + binding) % rangeCount) * rangeSize, rangeSize };
+				}
+				const VkDescriptorSet descriptorSet = allocator.allocate(setLayout, updateTemplate, bufferInfos.data());
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+			}
+		}, [&]() { allocator.reset(); });
+		std::cout << "descriptor pools " << poolNs << " ns/set (" << allocator.getPoolCount() << " pools)";
+
+		allocator.destroy();
+		vkDestroyDescriptorUpdateTemplate(vulkDevice, updateTemplate, nullptr);
+	}
+
+	// Descriptor buffer: the descriptors are copied into the buffer and binding a set records its offset, the region is reset as a whole
+	if (m_descriptorBufferEnabled)
+	{
+		const VkDescriptorSetLayout setLayout = m_layoutCache.getSetLayout(bindings, VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT, {});
+		const VkPipelineLayout pipelineLayout = m_layoutCache.getPipelineLayout(std::vector<VkDescriptorSetLayout>{ setLayout }, {});
+		const DescriptorBuffer::SetLayout bufferLayout = m_descriptorBuffer.getSetLayout(setLayout, bindingCount);
+		DescriptorBuffer descriptorBuffer;
+		descriptorBuffer.create(m_vulkanDevice, setCount * bufferLayout.size, 1);
+
+		VkBufferDeviceAddressInfo addressInfo{ VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO };
+		addressInfo.buffer = storageBuffer.buffer;
+		const VkDeviceAddress storageAddress = vkGetBufferDeviceAddress(vulkDevice, &addressInfo);
+
+		const double bufferNs = measure([&](VkCommandBuffer commandBuffer) {
+			descriptorBuffer.bind(commandBuffer);
+			for (uint32_t set = 0; set < setCount; set++)
+			{
+				const VkDeviceSize setOffset = descriptorBuffer.allocate(0, bufferLayout);
+				for (uint32_t binding = 0; binding < bindingCount; binding++)
+				{
+					const VkDeviceAddress address = storageAddress + ((set * bindingCount + binding) % rangeCount) * rangeSize;
+					descriptorBuffer.writeBuffer(setOffset, bufferLayout, binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, address, rangeSize);
+				}
+				descriptorBuffer.bindSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &setOffset);
+			}
+		}, [&]() { descriptorBuffer.reset(0); });
+		std::cout << ", descriptor buffer " << bufferNs << " ns/set (" << bufferLayout.size << " bytes/set)";
+
+		descriptorBuffer.destroy();
+	}
+	else
+	{
+		std::cout << ", descriptor buffer not enabled";
+	}
+
+	// Push descriptors: the writes go straight into the command buffer, there is nothing to allocate, update or release
+	if (m_pushDescriptorsEnabled)
+	{
+		const VkDescriptorSetLayout setLayout = m_layoutCache.getSetLayout(bindings, VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR, {});
+		const VkPipelineLayout pipelineLayout = m_layoutCache.getPipelineLayout(std::vector<VkDescriptorSetLayout>{ setLayout }, {});
+
+		const double pushNs = measure([&](VkCommandBuffer commandBuffer) {
+			for (uint32_t set = 0; set < setCount; set++)
+			{
+				std::array<VkDescriptorBufferInfo, bindingCount> bufferInfos;
+				std::array<VkWriteDescriptorSet, bindingCount> writeDescriptorSets;
+				for (uint32_t binding = 0; binding < bindingCount; binding++)
+				{
+					bufferInfos[binding] = { storageBuffer.buffer, ((set * bindingCount + binding) % rangeCount) * rangeSize, rangeSize };
+					writeDescriptorSets[binding] = vks::initializers::writeDescriptorSet(VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, binding, &bufferInfos[binding]);
+				}
+				m_vkCmdPushDescriptorSetKHR(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, bindingCount, writeDescriptorSets.data());
+			}
+		}, []() {});
+		std::cout << ", push descriptors " << pushNs << " ns/set\n";
+	}
+	else
+	{
+		std::cout << ", push descriptors not enabled\n";
+	}
+
+	storageBuffer.destroy();
+}
+
+void VulkanRender::HandleWindowResize(uint32_t destWidth, uint32_t destHeight)
+{
+	if (!prepared) {
+		return;
+	}
+	prepared = false;
+	resized = true;
+
+	// Ensure all operations on the device have been finished before destroying resources
+	vkDeviceWaitIdle(vulkDevice);
+
+	// Recreate swap chain
+	width = destWidth;
+	height = destHeight;
+	createSwapChain();
+
+	// Recreate the frame buffers
+	vkDestroyImageView(vulkDevice, depthStencil.view, nullptr);
+	vkDestroyImageView(vulkDevice, m_depthSampleView, nullptr);
+	vkDestroyImage(vulkDevice, depthStencil.image, nullptr);
+	vkFreeMemory(vulkDevice, depthStencil.memory, nullptr);
+	setupDepthStencil();
+	for (auto& frameBuffer : vulkFrameBuffers) {
+		vkDestroyFramebuffer(vulkDevice, frameBuffer, nullptr);
+	}
+	setupFrameBuffer();
+
+	// The Hi-Z pyramid matches the depth buffer size
+	if (m_occlusionCulling)
+	{
+		destroyHiZ();
+		createHiZ();
 	}
-	setupFrameBuffer();
 
 	//if ((width > 0.0f) && (height > 0.0f)) {
 	//	if (settings.overlay) {
@@ -2,12 +2,37 @@
 
 #include <vector>
 #include <array>
+#include <memory>
+#include <future>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <limits>
 
 #include "vulkan/vulkan.h"
 
 #include "VulkanBase/VulkanDevice.h"
 #include "VulkanBase/VulkanSwapChain.h"
 
+#include "FrustumCulling.h"
+#include "MeshletBuilder.h"
+#include "MeshSimplifier.h"
+#include "SceneGraph.h"
+#include "MatrixKernels.h"
+#include "JobSystem.h"
+#include "Simulation.h"
+#include "PipelineCache.h"
+#include "PipelineCompiler.h"
+#include "PipelineRegistry.h"
+#include "PipelineDynamicState.h"
+#include "PipelineLayoutCache.h"
+#include "BindlessDescriptors.h"
+#include "DescriptorAllocator.h"
+#include "DescriptorBuffer.h"
+#include "RenderQueue.h"
+#include "ShaderReflection.h"
+#include "ShaderWatcher.h"
+
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -18,6 +43,60 @@
 // Increasing this number may improve performance but will also introduce additional latency
 constexpr auto MAX_CONCURRENT_FRAMES = 2;
 
+// Number of objects drawn by the stress scene (cubes, every STRESS_SCENE_SPHERE_INTERVAL-th one is a dense sphere)
+constexpr uint32_t STRESS_SCENE_INSTANCE_COUNT = 100000;
+constexpr uint32_t STRESS_SCENE_SPHERE_INTERVAL = 16;
+// Number of materials the objects of the scenes cycle through (see createMaterials)
+constexpr uint32_t SCENE_MATERIAL_COUNT = 8;
+
+// Level of detail selection: the coarsest level whose error projects to at most LOD_PIXEL_ERROR pixels on screen is drawn
+// An object only switches to a coarser level once that level's error is below LOD_HYSTERESIS times the threshold, so it doesn't flicker between two levels at the boundary
+constexpr float LOD_PIXEL_ERROR = 1.0f;
+constexpr float LOD_HYSTERESIS = 0.75f;
+
+// The pipeline cache file next to the executable, written on shutdown and every PIPELINE_CACHE_SAVE_INTERVAL seconds if pipelines were added
+constexpr const char* PIPELINE_CACHE_FILE = "pipeline.cache";
+constexpr float PIPELINE_CACHE_SAVE_INTERVAL = 30.0f;
+// The state keys of all pipelines of the last run, compiled at startup before they are requested
+constexpr const char* PIPELINE_KEYS_FILE = "pipeline.keys";
+
+// Renderer defined ids in the pipeline state keys (see PipelineStateKey and buildPipelineDescription)
+enum class PipelineVertexLayout : uint8_t {
+    None,           // Mesh shaders fetch their vertices on their own
+    MeshInstances,  // Vertex (binding 0) and InstanceData (binding 1)
+};
+enum class PipelineLayoutId : uint8_t {
+    Scene,          // vulkPipelineLayout
+    Meshlet,        // m_meshletPipelineLayout
+};
+
+// Feature variant of the scene shaders, baked into their pipelines as the specialization constants of triangle.slang (PipelineStateKey::specialization)
+// The driver removes the branches of the disabled features when it specializes the shaders, so there is one shader file for all variants
+constexpr uint32_t MAX_SHADER_LIGHT_COUNT = 4;      // MAX_LIGHT_COUNT in triangle.slang
+enum class ShaderNormalMode : uint8_t {
+    Vertex,         // Interpolated vertex normals
+    Flat,           // Face normals from the screen space derivatives of the position
+};
+enum class ShaderDebugView : uint8_t {
+    None,
+    Normals,
+    Unlit,          // Material color without lighting
+};
+struct ShaderVariant {
+    bool specular{ true };
+    uint8_t lightCount{ 1 };    // 1 to MAX_SHADER_LIGHT_COUNT
+    ShaderNormalMode normalMode{ ShaderNormalMode::Vertex };
+    ShaderDebugView debugView{ ShaderDebugView::None };
+};
+
+// Fixed function states of the scene pipelines that can be switched between frames
+// Where the extended dynamic states are supported they are set in the command buffer and all combinations share one pipeline,
+// otherwise every combination is a pipeline of its own
+struct SceneRenderState {
+    bool wireframe{ false };        // Needs the fillModeNonSolid device feature
+    bool backfaceCulling{ false };
+};
+
 /** @brief Default depth stencil attachment used by the default render pass */
 struct {
     VkImage image;
@@ -42,6 +121,133 @@ struct Vertex {
     float normal[3];
 };
 
+// Per-instance data, fed to the vertex shader through a second vertex binding with VK_VERTEX_INPUT_RATE_INSTANCE
+// The model matrix occupies four consecutive attribute locations (one per column)
+// The same buffer is read as the object storage buffer by the GPU culling pass, see ObjectData in cull.slang
+struct InstanceData {
+    glm::mat4 modelMatrix;
+    glm::vec4 boundingSphere;   // Object space center (xyz) and radius (w)
+    uint32_t meshIndex;
+    uint32_t materialIndex;     // Into the material table of the bindless descriptor set, also read by the vertex shader (instance attribute)
+    uint32_t padding[2];
+};
+
+// Bindless descriptor set (set 1 of the scene and mesh shader pipeline layouts): the material table, every texture and every sampler
+// The arrays are runtime sized in triangle.slang, they get BINDLESS_ARRAY_CAPACITY elements (see BindlessDescriptors)
+constexpr uint32_t BINDLESS_SET = 1;
+constexpr uint32_t BINDLESS_BINDING_MATERIALS = 0;
+constexpr uint32_t BINDLESS_BINDING_TEXTURES = 1;
+constexpr uint32_t BINDLESS_BINDING_SAMPLERS = 2;
+constexpr uint32_t BINDLESS_ARRAY_CAPACITY = 4096;
+
+// Surface of an object, an entry of the material table, see Material in triangle.slang
+// The texture and sampler are selected by their indices in the bindless descriptor arrays, so objects with different materials need no descriptor binds
+struct Material {
+    glm::vec4 baseColor;
+    uint32_t textureIndex;
+    uint32_t samplerIndex;
+    float textureScale;         // Texture repeats per object space unit (the meshes have no texture coordinates, see sampleMaterial)
+    uint32_t padding;
+};
+
+// Texture of the materials, sampled through the bindless descriptor set
+struct MaterialTexture {
+    VkImage image{ VK_NULL_HANDLE };
+    VkDeviceMemory memory{ VK_NULL_HANDLE };
+    VkImageView view{ VK_NULL_HANDLE };
+};
+
+// A level of detail of a mesh, a range of the index buffer using the mesh's vertices, see MeshLod in cull.slang
+struct MeshLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;                // Estimated object space deviation from the full detail mesh (see MeshLodLevel)
+    uint32_t padding;
+};
+
+// Location of a mesh inside the geometry arena (the shared vertex and index buffers), see MeshData in cull.slang
+// indexCount and firstIndex are the full detail mesh, which is also lods[0]
+struct MeshInfo {
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    float boundingRadius;
+    uint32_t firstMeshlet;      // Range of the mesh's meshlets in the MeshletInfo table (built from the full detail mesh)
+    uint32_t meshletCount;
+    uint32_t lodCount;
+    uint32_t padding;
+    MeshLod lods[MAX_LOD_COUNT];
+};
+
+// A meshlet of the geometry arena, see MeshletData in cull.slang and meshlet.slang
+// Its triangles are stored twice: as a range of the index buffer (in meshlet order) for indexed draws, and as
+// local vertex list plus packed local triangles (one uint32 per triangle, 8 bits per corner) for mesh shaders
+struct MeshletInfo {
+    glm::vec4 boundingSphere;   // Object space center (xyz) and radius (w)
+    glm::vec4 cone;             // Object space normal cone axis (xyz) and cutoff (w), see MeshletBounds
+    uint32_t firstIndex;
+    uint32_t triangleCount;
+    uint32_t firstVertex;       // First entry in the meshlet vertex buffer (mesh relative vertex indices)
+    uint32_t vertexCount;
+    uint32_t firstTriangle;     // First entry in the meshlet triangle buffer
+    uint32_t padding[3];
+};
+
+// Counters written by the GPU culling pass, see CullCounters in cull.slang
+// drawCount and lateDrawCount are also the count buffers for vkCmdDrawIndexedIndirectCount
+// taskGroupCount is the VkDrawMeshTasksIndirectCommandEXT of the mesh shader path
+struct CullCounters {
+    uint32_t drawCount;
+    uint32_t culledCount;
+    uint32_t lateDrawCount;     // Occlusion culling only: objects found visible by the Hi-Z test that were not drawn in the first pass
+    uint32_t occludedCount;     // Occlusion culling only: objects inside the frustum that failed the Hi-Z test
+    uint32_t clusterCulledCount;    // Cluster culling only: meshlets of visible objects rejected by the frustum or normal cone test
+    uint32_t taskGroupCount[3];
+    uint32_t triangleCount;             // Triangles submitted for drawing (after level of detail selection and cluster culling)
+    uint32_t fullDetailTriangleCount;   // Triangles the emitted objects have at full detail
+};
+
+// Per-frame buffers of the GPU driven path
+struct IndirectDrawBuffers {
+    vks::Buffer commands;           // VkDrawIndexedIndirectCommand per visible object (or meshlet), written by the culling compute shader (the late draw list follows the early one)
+                                    // The mesh shader path stores its task work items here instead
+    vks::Buffer counters;           // CullCounters, host visible so the statistics can be read back once the frame's fence has signaled
+    VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
+    VkDescriptorSet meshletDescriptorSet{ VK_NULL_HANDLE };    // Mesh shader path only
+};
+
+// Instances of one level of detail of a mesh inside the (mesh and level sorted) instance buffer of the CPU driven path
+struct MeshDrawRange {
+    uint32_t firstInstance{ 0 };
+    uint32_t instanceCount{ 0 };
+    float depth{ 0.0f };        // Squared distance of the nearest instance to the camera, the depth of the range's sort key
+};
+
+// Hierarchical depth (Hi-Z) pyramid used for occlusion culling, a R32G32 (min, max depth) image with a full mip chain
+// Level 0 has the size of the depth buffer, so it is recreated on resize
+struct HiZPyramid {
+    VkImage image{ VK_NULL_HANDLE };
+    VkDeviceMemory memory{ VK_NULL_HANDLE };
+    VkImageView view{ VK_NULL_HANDLE };             // All levels, read by the culling shader
+    std::vector<VkImageView> levelViews;            // One view per level, written by the build pass and read when building the next level
+    uint32_t width{ 0 };
+    uint32_t height{ 0 };
+    uint32_t mipCount{ 0 };
+};
+
+// Per-instance transform stream
+struct InstanceBuffer {
+    VkDeviceMemory memory{ VK_NULL_HANDLE };
+    VkBuffer buffer{ VK_NULL_HANDLE };
+    // The buffer stays mapped for its whole lifetime, instance transforms are written straight into it
+    InstanceData* mapped{ nullptr };
+    // GPU driven path: the instances changed since the buffer was last written, all of them once more than half have changed
+    std::vector<uint32_t> dirtyInstances;
+    bool allDirty{ false };
+    // CPU driven path: VulkanRender::m_instanceVersion of the visible instances the buffer holds
+    uint64_t version{ 0 };
+};
+
 
 
 class VulkanRender
@@ -49,17 +255,67 @@ class VulkanRender
 public:
     bool Init(HINSTANCE instance, HWND hwnd, uint32_t destWidth, uint32_t destHeight);
 
-    void RenderFrame(float deltaTime);
+    // Renders one frame of the simulation state in snapshot, deltaTime is the time since the previous frame (only used for the frame rate statistics)
+    void RenderFrame(float deltaTime, const SimulationSnapshot& snapshot);
 
     void HandleWindowResize(uint32_t destWidth, uint32_t destHeight);
 
     void Finalize();
 
+    // Draw STRESS_SCENE_INSTANCE_COUNT objects instead of the default scene and log the instance throughput, must be set before Init
+    void SetStressScene(bool enable) { m_stressScene = enable; }
+    // Cull on the GPU and draw with vkCmdDrawIndexedIndirectCount (if supported by the device), must be set before Init
+    void SetGpuDrivenRendering(bool enable) { m_gpuDrivenRequested = enable; }
+    // Two phase Hi-Z occlusion culling on top of the GPU driven path (which has to be enabled as well), must be set before Init
+    void SetOcclusionCulling(bool enable) { m_occlusionCullingRequested = enable; }
+    // Cull every meshlet of the visible objects by frustum and normal cone on top of the GPU driven path (which has to be enabled as well)
+    // Uses task and mesh shaders where VK_EXT_mesh_shader is supported, otherwise one indirect draw per visible meshlet, must be set before Init
+    void SetClusterCulling(bool enable) { m_clusterCullingRequested = enable; }
+    // Select a level of detail per object by its projected error (on by default), without it every object is drawn at full detail
+    // Can also be toggled between frames on the render thread
+    void SetLevelOfDetail(bool enable) { m_levelOfDetail = enable; }
+    bool GetLevelOfDetail() const { return m_levelOfDetail; }
+    // Number of job system workers including the render thread, 0 (default) uses one per hardware thread and 1 runs all jobs on the render thread, must be set before Init
+    void SetWorkerCount(uint32_t count) { m_workerCount = count; }
+    // Recompile changed shaders and replace the pipelines using them while running (see ShaderWatcher), must be set before Init
+    void SetShaderHotReload(bool enable) { m_shaderHotReload = enable; }
+    // Read the SPIR-V files from the working directory instead of using the code embedded in the executable (see EmbeddedShaders.h)
+    // Always the case with shader hot reload, must be set before Init
+    void SetShadersFromDisk(bool enable) { m_shadersFromDisk = enable; }
+    // Variant of the scene shaders, can also be switched between frames on the render thread
+    // The pipelines of the new variant are requested from the pipeline registry, the current ones draw until they are ready
+    void SetShaderVariant(const ShaderVariant& variant);
+    // Link the graphics pipelines from VK_EXT_graphics_pipeline_library parts where supported (default), must be set before Init
+    // Off every pipeline is compiled as a whole, to compare the time until the pipelines are ready
+    void SetPipelineLibrary(bool enable) { m_pipelineLibraryRequested = enable; }
+    const ShaderVariant& GetShaderVariant() const { return m_shaderVariant; }
+    // Rasterization states of the scene, can also be switched between frames on the render thread
+    void SetSceneRenderState(const SceneRenderState& renderState);
+    const SceneRenderState& GetSceneRenderState() const { return m_sceneRenderState; }
+    // Set the states of VK_EXT_extended_dynamic_state 1 to 3 and VK_EXT_vertex_input_dynamic_state in the command buffer where supported (default),
+    // must be set before Init. Off every combination of these states is a pipeline of its own
+    void SetExtendedDynamicState(bool enable) { m_dynamicStateRequested = enable; }
+    // Write the transient descriptors of a frame into a VK_EXT_descriptor_buffer buffer where supported (default) instead of allocating sets from
+    // the per-frame descriptor pools, must be set before Init
+    void SetDescriptorBuffer(bool enable) { m_descriptorBufferRequested = enable; }
+    // Push the descriptors of passes that bind new resources for every dispatch into the command buffer with VK_KHR_push_descriptor where
+    // supported (default), must be set before Init. Takes precedence over the descriptor buffer for these passes
+    void SetPushDescriptors(bool enable) { m_pushDescriptorsRequested = enable; }
+    // Run the descriptor microbenchmark (see runDescriptorBenchmark) at the end of Init, must be set before Init
+    void SetDescriptorBenchmark(bool enable) { m_descriptorBenchmark = enable; }
+
+    // Number of objects that passed / failed GPU culling in the most recently completed frame
+    uint32_t GetVisibleObjectCount() const { return m_cullStats.drawCount + m_cullStats.lateDrawCount; }
+    uint32_t GetCulledObjectCount() const { return m_cullStats.culledCount; }
+    uint32_t GetOccludedObjectCount() const { return m_cullStats.occludedCount; }
+    uint32_t GetClusterCulledCount() const { return m_cullStats.clusterCulledCount; }
+
     bool IsPrepared() { return prepared; }
     void ClearPrepared() { prepared = false; }
 
 private:
     void initVulkan();
+    void getEnabledFeatures();
     VkResult createInstance();
     void createSurface(HINSTANCE hInstance, HWND hwnd);
     void createSwapChain();
@@ -67,18 +323,72 @@ private:
     void setupDepthStencil();
     void createCommandBuffers();
     void setupRenderPass();
+    void setupOcclusionRenderPasses();
     void setupFrameBuffer();
     void createUniformBuffers();
+    void createInstanceBuffers();
     void createPipelines();
     void createVertexBuffer();
     void createDescriptorPool();
     void createDescriptorSetLayout();
     void createDescriptorSets();
-
+    void createMaterials();
+    void destroyMaterials();
+    void createCullingResources();
+    void recordCulling(VkCommandBuffer commandBuffer, uint32_t phase);
+    void writeCullDescriptorSets();
+    void createHiZ();
+    void destroyHiZ();
+    void recordHiZ(VkCommandBuffer commandBuffer);
+    void recordSceneDraws(VkCommandBuffer commandBuffer, uint32_t drawList);
+    void recordQueuedDraws(VkCommandBuffer commandBuffer);
+    bool buildPipelineDescription(const PipelineStateKey& key, GraphicsPipelineDescription& description);
+    void readTimestamps();
+    // Writes and binds setCount transient descriptor sets with every available backend and logs the CPU time per set
+    void runDescriptorBenchmark(uint32_t setCount);
+    // Takes over the pipelines that have finished compiling, with wait it blocks until all have
+    void updatePendingPipelines(bool wait);
+    // Everything the scene draws need has been compiled, until then frames are only cleared
+    bool scenePipelinesReady() const;
+    // The task and mesh shader pipeline has been compiled, until then cluster culling falls back to indirect draws per meshlet
+    bool meshShadersReady() const { return m_meshShaders && m_meshletPipeline != VK_NULL_HANDLE; }
+    // Sets the specialization constants of key to the shader variant
+    void applyShaderVariant(PipelineStateKey& key) const;
+    // Sets the rasterization states of key to the scene render state
+    void applySceneRenderState(PipelineStateKey& key) const;
+    // Requests the pipelines of the current keys (after a variant or render state switch), the current ones draw until they are ready
+    void requestGraphicsPipelines();
+    // Binds the graphics pipeline at the handle member and sets the dynamic states of its key
+    void bindGraphicsPipeline(VkCommandBuffer commandBuffer, const VkPipeline* pipeline);
+    // Vertex input bindings and the attributes of them the vertex shader of key reads, false if they don't match
+    bool getVertexInput(const PipelineStateKey& key, std::vector<VkVertexInputBindingDescription>& bindings, std::vector<VkVertexInputAttributeDescription>& attributes);
+    // Sets the dynamic vertex input of the graphics pipelines from the current vertex shaders
+    void updateVertexInputs();
+    std::shared_future<VkPipeline> compileComputePipeline(const std::string& shader, VkPipelineLayout layout, VkPipelineCreateFlags flags = 0);
+    // Shader hot reload: rebuilds the pipelines of changed shaders and swaps them in at the start of a frame
+    void updateShaderReload();
+    void reloadShader(const std::string& filename);
+    // Swaps the link time optimized pipelines in for the fast linked ones
+    void updateOptimizedPipelines();
+    // Destroys the replaced pipelines no frame in flight uses anymore, with all every one of them (at shutdown)
+    void destroyRetiredPipelines(bool all);
+
+    // Also reflects the shader, see getShaderReflection
     VkShaderModule loadSPIRVShader(const std::string& filename);
+    // Resource interface of a SPIR-V file, reflected once when it is first loaded
+    const ShaderReflection& getShaderReflection(const std::string& filename);
+    // The embedded code of the shader, or the file if the shaders are read from disk
+    std::vector<uint32_t> getSPIRVCode(const std::string& filename);
+    std::vector<uint32_t> readSPIRVFile(const std::string& filename);
+    bool reflectSPIRVShader(const std::string& filename, const std::vector<uint32_t>& shaderCode);
     uint32_t getMemoryTypeIndex(uint32_t typeBits, VkMemoryPropertyFlags properties);
 
-    void updateViewMatrix(float deltaTime);
+    void updateViewMatrix(const glm::vec3& cameraRotation);
+    void createScene();
+    void updateSceneTransforms();
+    void updateInstances(const Frustum& frustum, const glm::vec3& cameraPosition, InstanceBuffer& instanceBuffer);
+    uint32_t selectLod(const MeshInfo& mesh, uint32_t currentLod, const glm::mat4& modelMatrix, const glm::vec4& boundingSphere, const glm::vec3& cameraPosition) const;
+    void updateBenchmark(float deltaTime, uint32_t drawCalls, uint32_t instances, uint32_t triangles, uint32_t fullDetailTriangles);
 
 private:
     VkInstance vulkInstance{ VK_NULL_HANDLE };
@@ -103,13 +413,91 @@ private:
     // The descriptor set layout describes the shader binding layout (without actually referencing descriptor)
     // Like the pipeline layout it's pretty much a blueprint and can be used with different descriptor sets as long as their layout matches
     VkDescriptorSetLayout vulkDescriptorSetLayout{ VK_NULL_HANDLE };
-    VkPipelineCache vulkPipelineCache{ VK_NULL_HANDLE };    // Pipeline cache object
+    // The pipeline and meshlet caches are kept in the directory of the executable, so they don't depend on the working directory
+    std::string m_cacheDirectory;
+    std::string getCachePath(const char* filename) const;
+    // All pipelines are created through the pipeline cache, which persists across runs (see PipelineCache)
+    PipelineCache m_pipelineCache;
+    float m_pipelineCacheSaveTimer{ 0.0f };
+    // Pipelines are compiled in the background, each pending one is written to its handle member once it is ready
+    PipelineCompiler m_pipelineCompiler;
+    // Graphics pipelines are fast linked from shared parts where VK_EXT_graphics_pipeline_library is supported (on by default)
+    bool m_pipelineLibraryRequested{ true };
+    bool m_graphicsPipelineLibrary{ false };
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT m_enabledGraphicsPipelineLibraryFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT };
+    PipelineLibrary m_pipelineLibrary;
+    // States set in the command buffer instead of being baked into the pipelines, where supported (on by default)
+    bool m_dynamicStateRequested{ true };
+    PipelineDynamicState m_dynamicState;
+    // Owns the graphics pipelines, identical state keys share one pipeline
+    PipelineRegistry m_pipelineRegistry;
+    // Owns the descriptor set and pipeline layouts, which are built from the reflected shaders
+    PipelineLayoutCache m_layoutCache;
+    std::unordered_map<std::string, ShaderReflection> m_shaderReflections;
+    struct PendingPipeline {
+        std::shared_future<VkPipeline> future;
+        VkPipeline* pipeline;
+    };
+    std::vector<PendingPipeline> m_pendingPipelines;
+    std::chrono::time_point<std::chrono::high_resolution_clock> m_pipelineCompileStart;
+    // Shader hot reload, the pipelines rebuilt from a changed shader replace the current ones in the same frame once all of them have compiled
+    bool m_shaderHotReload{ false };
+    bool m_shadersFromDisk{ false };
+    ShaderWatcher m_shaderWatcher;
+    // The pipelines in use and what they are built from
+    struct GraphicsPipelineKey {
+        PipelineStateKey key;
+        VkPipeline* pipeline;
+        PipelineDynamicState::VertexInput vertexInput;      // With dynamic vertex input
+    };
+    std::vector<GraphicsPipelineKey> m_graphicsPipelineKeys;
+    struct ComputePipelineShader {
+        std::string shader;
+        VkPipelineLayout layout;
+        VkPipeline* pipeline;
+        VkPipelineCreateFlags flags{ 0 };
+    };
+    std::vector<ComputePipelineShader> m_computePipelineShaders;
+    struct ReloadedPipeline {
+        std::shared_future<VkPipeline> future;
+        VkPipeline* pipeline;
+        PipelineStateKey key;
+        bool registered;    // Graphics pipelines are owned by the registry
+    };
+    std::vector<ReloadedPipeline> m_reloadedPipelines;
+    // Frames recorded before a pipeline was replaced may still use it
+    struct RetiredPipeline {
+        VkPipeline pipeline;
+        uint64_t frameNumber;
+    };
+    std::vector<RetiredPipeline> m_retiredPipelines;
+    uint64_t m_frameNumber{ 0 };
     // Pipelines (often called "pipeline state objects") are used to bake all states that affect a pipeline
     // While in OpenGL every state can be changed at (almost) any time, Vulkan requires to layout the graphics (and compute) pipeline states upfront
     // So for each combination of non-dynamic pipeline states you need a new pipeline (there are a few exceptions to this not discussed here)
     // Even though this adds a new dimension of planning ahead, it's a great opportunity for performance optimizations by the driver
     VkPipeline vulkPipeline{ VK_NULL_HANDLE };
-    VkDescriptorPool vulkDescriptorPool{ VK_NULL_HANDLE };  // Descriptor set pool
+    // Descriptor sets that live as long as the renderer, from a chain of pools that grows when it runs out
+    DescriptorAllocator m_descriptorAllocator;
+    // Transient descriptor sets allocated while recording a frame, released all at once when the frame's fence has been waited on
+    std::array<DescriptorAllocator, MAX_CONCURRENT_FRAMES> m_frameDescriptorAllocators;
+    VkDescriptorUpdateTemplate m_uniformUpdateTemplate{ VK_NULL_HANDLE };  // Writes the set 0 of a frame from a VkDescriptorBufferInfo
+    // Descriptor buffer backend of the transient descriptors, one region per frame in flight reset along with the frame's descriptor allocator
+    bool m_descriptorBufferRequested{ true };
+    bool m_descriptorBufferEnabled{ false };    // Requested and supported by the device
+    DescriptorBuffer m_descriptorBuffer;
+    static constexpr VkDeviceSize DESCRIPTOR_BUFFER_REGION_SIZE = 64 * 1024;
+    // Push descriptors: the descriptors of a dispatch are recorded with it, nothing is allocated from a pool or written to a set beforehand
+    bool m_pushDescriptorsRequested{ true };
+    bool m_pushDescriptorsEnabled{ false };     // Requested and supported by the device
+    PFN_vkCmdPushDescriptorSetKHR m_vkCmdPushDescriptorSetKHR{ nullptr };
+    bool m_descriptorBenchmark{ false };
+    // Textures, samplers and the material table of all materials are in one descriptor set that is bound once per pass
+    BindlessDescriptors m_bindless;
+    std::vector<MaterialTexture> m_materialTextures;
+    std::vector<VkSampler> m_materialSamplers;
+    std::vector<Material> m_materials;
+    vks::Buffer m_materialBuffer;
 
 
 
@@ -137,6 +525,125 @@ private:
 
     std::array<UniformBuffer, MAX_CONCURRENT_FRAMES> m_uniformBuffers;    // We use one UBO per frame, so we can have a frame overlap and make sure that uniforms aren't updated while still in use
 
+    std::array<InstanceBuffer, MAX_CONCURRENT_FRAMES> m_instanceBuffers;  // One instance buffer per frame, so the CPU can write the next frame's transforms while the GPU still reads the previous ones
+    uint32_t m_instanceCount{ 1 };      // Number of objects in the scene
+    uint32_t m_drawInstanceCount{ 1 };  // Number of instances written to the current frame's instance buffer
+    std::vector<InstanceData> m_sceneInstances;
+    // Transform hierarchy of the scene, the world transforms of the nodes holding an instance are copied to m_sceneInstances when they change
+    SceneGraph m_sceneGraph;
+    std::vector<uint32_t> m_nodeInstances;     // Scene graph node -> instance index (SceneGraph::INVALID_NODE for nodes without an instance)
+    std::vector<uint32_t> m_changedNodes;
+    // CPU culling (used when not GPU driven), holds the world space bounds of m_sceneInstances
+    FrustumCuller m_frustumCuller;
+    std::vector<uint32_t> m_visibleInstances;
+    std::vector<MeshDrawRange> m_meshDrawRanges;   // One instanced draw per level of detail of each mesh with visible instances (mesh * MAX_LOD_COUNT + level)
+    uint32_t m_drawTriangleCount{ 0 };              // Triangles drawn by the CPU driven path this frame
+    uint32_t m_fullDetailTriangleCount{ 0 };        // Triangles the same instances have at full detail
+    bool m_stressScene{ false };
+    // Scratch of the parallel instance writing: per batch of visible instances its instance count per draw range (then its first slot in each range) and triangle counts
+    std::vector<uint32_t> m_instanceBatchOffsets;
+    std::vector<glm::uvec2> m_instanceBatchTriangles;
+    std::vector<float> m_instanceBatchDepths;       // Per batch the depth of its nearest instance in each draw range
+    // The draws of the CPU driven path, sorted by pipeline, material, mesh and depth and recorded without redundant binds
+    RenderQueue m_renderQueue;
+
+    // Culling, transform updates, instance writing and the mesh preprocessing fan out over the workers of the job system
+    uint32_t m_workerCount{ 0 };
+    std::unique_ptr<JobSystem> m_jobSystem;
+
+    // Level of detail: every mesh has a chain of simplified index ranges (MeshInfo::lods), each object keeps its current level for the hysteresis
+    bool m_levelOfDetail{ true };
+    ShaderVariant m_shaderVariant;
+    SceneRenderState m_sceneRenderState;
+    float m_lodPixelScale{ 0.0f };      // Pixels covered by one unit at distance one, from the projection matrix and the viewport height
+    std::vector<uint8_t> m_objectLods;  // CPU driven path, the GPU driven path keeps the levels in m_lodBuffer
+    // CPU driven path: bumped whenever the transforms, the view or the level of detail selection change, a frame whose instance buffer already
+    // holds the current version neither culls nor writes the instances again
+    uint64_t m_instanceVersion{ 1 };
+    Frustum m_instanceFrustum{};
+    glm::vec3 m_instanceCameraPosition{ 0.0f };
+    float m_instanceLodPixelScale{ 0.0f };
+    bool m_instanceLevelOfDetail{ true };
+
+    // GPU driven rendering: a compute pass culls the objects and writes the indirect draws consumed by vkCmdDrawIndexedIndirectCount
+    bool m_gpuDrivenRequested{ false };
+    bool m_gpuDriven{ false };          // Requested and supported by the device
+    VkPhysicalDeviceVulkan12Features m_enabledVulkan12Features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };    // Also descriptor indexing, see BindlessDescriptors
+    vks::Buffer m_meshBuffer;           // MeshInfo table of the geometry arena
+    std::array<IndirectDrawBuffers, MAX_CONCURRENT_FRAMES> m_indirectDraws;
+    VkDescriptorSetLayout m_cullDescriptorSetLayout{ VK_NULL_HANDLE };
+    VkDescriptorUpdateTemplate m_cullUpdateTemplate{ VK_NULL_HANDLE };
+    VkPipelineLayout m_cullPipelineLayout{ VK_NULL_HANDLE };
+    VkPipeline m_cullPipeline{ VK_NULL_HANDLE };
+    CullCounters m_cullStats{};
+    vks::Buffer m_lodBuffer;            // Per object level of detail of the last frame, shared by all frames in flight like the visibility
+    uint32_t m_drawCapacity{ 0 };       // Size of each draw list: one draw per object, or per meshlet with cluster culling
+
+    // Cluster culling: the meshlets of every visible object are culled individually
+    // With VK_EXT_mesh_shader the culling pass only emits task work items (object, meshlet range), task shaders cull the meshlets and mesh shaders draw them
+    bool m_clusterCullingRequested{ false };
+    bool m_clusterCulling{ false };     // Requested and GPU driven
+    bool m_meshShaders{ false };        // Cluster culling with task / mesh shaders
+    VkPhysicalDeviceMeshShaderFeaturesEXT m_enabledMeshShaderFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT };
+    PFN_vkCmdDrawMeshTasksIndirectEXT m_vkCmdDrawMeshTasksIndirectEXT{ nullptr };
+    vks::Buffer m_meshletBuffer;            // MeshletInfo table
+    vks::Buffer m_meshletVertexBuffer;      // Meshlet local vertex -> mesh vertex index
+    vks::Buffer m_meshletTriangleBuffer;    // Packed meshlet local triangles
+    VkDescriptorSetLayout m_meshletDescriptorSetLayout{ VK_NULL_HANDLE };
+    VkDescriptorUpdateTemplate m_meshletUpdateTemplate{ VK_NULL_HANDLE };
+    VkPipelineLayout m_meshletPipelineLayout{ VK_NULL_HANDLE };
+    VkPipeline m_meshletPipeline{ VK_NULL_HANDLE };
+
+    // Occlusion culling: the objects visible last frame are drawn first, their depth is reduced into the Hi-Z pyramid,
+    // then all remaining objects are tested against it and the newly visible ones are drawn in a second render pass
+    bool m_occlusionCullingRequested{ false };
+    bool m_occlusionCulling{ false };   // Requested and supported (implies m_gpuDriven)
+    VkRenderPass m_earlyRenderPass{ VK_NULL_HANDLE };  // Clears and keeps the depth for the Hi-Z build
+    VkRenderPass m_lateRenderPass{ VK_NULL_HANDLE };   // Loads the attachments of the early pass and presents
+    VkImageView m_depthSampleView{ VK_NULL_HANDLE };   // Depth aspect only view of the depth buffer for sampling
+    vks::Buffer m_visibilityBuffer;     // Per object visibility of the last frame, shared by all frames in flight as they execute in order
+    HiZPyramid m_hiZ;
+    VkDescriptorSetLayout m_hiZDescriptorSetLayout{ VK_NULL_HANDLE };
+    VkDescriptorUpdateTemplate m_hiZUpdateTemplate{ VK_NULL_HANDLE };   // The build sets are transient, allocated per level and frame
+    DescriptorBuffer::SetLayout m_hiZDescriptorBufferLayout;            // Descriptor buffer backend
+    // With push descriptors set 0 of the build pipeline is a push descriptor set, neither of the above is used
+    VkPipelineLayout m_hiZPipelineLayout{ VK_NULL_HANDLE };
+    VkPipeline m_hiZPipeline{ VK_NULL_HANDLE };
+
+    // GPU timestamps (GPU driven path): before the first draw, after the early pass, after the Hi-Z build and late cull, after the last draw
+    static constexpr uint32_t TIMESTAMPS_PER_FRAME = 4;
+    VkQueryPool m_timestampQueryPool{ VK_NULL_HANDLE };
+    std::array<bool, MAX_CONCURRENT_FRAMES> m_timestampsWritten{};
+
+    // Draw throughput, accumulated over one second and then written to the log
+    struct {
+        float elapsed{ 0.0f };
+        uint32_t frames{ 0 };
+        uint64_t drawCalls{ 0 };
+        uint64_t instances{ 0 };
+        uint64_t uploadedInstances{ 0 };    // Written to the instance buffers
+        uint64_t triangles{ 0 };
+        uint64_t fullDetailTriangles{ 0 };
+        // GPU times in milliseconds, summed over the frames with timestamps
+        uint32_t timedFrames{ 0 };
+        double drawTime{ 0.0 };
+        double occlusionTime{ 0.0 };
+        uint64_t drawnObjects{ 0 };
+        uint64_t occludedObjects{ 0 };
+        // Commands recorded by the scene draws
+        uint64_t pipelineBinds{ 0 };
+        uint64_t descriptorSetBinds{ 0 };
+        uint64_t dynamicStateCommands{ 0 };
+        uint64_t transientDescriptorSets{ 0 };  // Allocated from the per-frame descriptor allocators
+        uint64_t pushDescriptorSets{ 0 };       // Pushed into the command buffers instead
+        // Binds the render queue recorded and skipped because the state was already bound (CPU driven path)
+        uint64_t queuedDraws{ 0 };
+        uint64_t pipelineBindsSkipped{ 0 };
+        uint64_t descriptorSetBindsSkipped{ 0 };
+        uint64_t vertexBufferBinds{ 0 };
+        uint64_t vertexBufferBindsSkipped{ 0 };
+    } m_benchmark;
+
     glm::mat4 m_viewMatrix;
 
     // Vertex buffer and attributes
@@ -152,4 +659,12 @@ private:
         uint32_t count{ 0 };
     } m_indices;
 
+    // Meshes stored in the geometry arena (m_vertices / m_indices)
+    std::vector<MeshInfo> m_meshes;
+    std::vector<glm::vec3> m_meshExtents;   // Half extents of each mesh's object space AABB (centered at the origin)
+    // Meshlets of all meshes, see MeshletInfo
+    std::vector<MeshletInfo> m_meshlets;
+    std::vector<uint32_t> m_meshletVertices;
+    std::vector<uint32_t> m_meshletTriangles;
+
 };
@@ -2,7 +2,7 @@
 setlocal
 
 :: List of input:output shader pairs
-set "FILES=triangle.slang:triangle.vert.spv:vertexMain:vertex triangle.slang:triangle.frag.spv:fragmentMain:fragment"
+set "FILES=triangle.slang:triangle.vert.spv:vertexMain:vertex triangle.slang:triangle.frag.spv:fragmentMain:fragment cull.slang:cull.comp.spv:cullMain:compute hiz.slang:hiz.comp.spv:hizMain:compute meshlet.slang:meshlet.task.spv:taskMain:amplification meshlet.slang:meshlet.mesh.spv:meshMain:mesh"
 
 :: Loop through each pair
 for %%F in (%FILES%) do (
@@ -16,6 +16,9 @@ for %%F in (%FILES%) do (
     )
 )
 
+:: Embed the SPIR-V into the executable (see EmbeddedShaders.h)
+powershell -NoProfile -ExecutionPolicy Bypass -File "%~dp0shaderembed.ps1" triangle.vert.spv triangle.frag.spv cull.comp.spv hiz.comp.spv meshlet.task.spv meshlet.mesh.spv
+
 goto :eof
 
 :processFile
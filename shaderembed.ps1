@@ -0,0 +1,53 @@
+# Embeds SPIR-V files into the executable (see EmbeddedShaders.h), called by shadercompile.bat with the files it builds
+# Writes EmbeddedShaders.generated.h: one aligned constexpr uint32_t array per file and the embeddedShaders table to look them up by file name
+
+$output = Join-Path $PSScriptRoot "EmbeddedShaders.generated.h"
+$lines = [System.Collections.Generic.List[string]]::new()
+$lines.Add("// Generated by shaderembed.ps1, do not edit")
+$lines.Add("#pragma once")
+$lines.Add("")
+
+$embedded = @()
+foreach ($shader in $args)
+{
+    $path = Join-Path $PSScriptRoot $shader
+    if (-not (Test-Path $path))
+    {
+        # The shader failed to compile, the renderer falls back to reading it from disk
+        Write-Warning "$shader not found, not embedded"
+        continue
+    }
+    $bytes = [System.IO.File]::ReadAllBytes($path)
+    if ($bytes.Length -eq 0 -or $bytes.Length % 4 -ne 0)
+    {
+        Write-Warning "$shader is not SPIR-V, not embedded"
+        continue
+    }
+
+    $name = "spirv_" + ($shader -replace "[^A-Za-z0-9]", "_")
+    $lines.Add("alignas(16) constexpr uint32_t $name[] = {")
+    for ($i = 0; $i -lt $bytes.Length; $i += 32)
+    {
+        $end = [Math]::Min($i + 32, $bytes.Length)
+        $words = for ($j = $i; $j -lt $end; $j += 4) { "0x{0:x8}," -f [BitConverter]::ToUInt32($bytes, $j) }
+        $lines.Add("    " + ($words -join " "))
+    }
+    $lines.Add("};")
+    $lines.Add("")
+    $embedded += ,@($shader, $name)
+}
+
+$lines.Add("constexpr EmbeddedShader embeddedShaders[] = {")
+foreach ($entry in $embedded)
+{
+    $lines.Add("    { `"" + $entry[0] + "`", " + $entry[1] + " },")
+}
+# An empty array is ill-formed, the entry without code is never found by name
+if ($embedded.Count -eq 0)
+{
+    $lines.Add("    { `"`", {} },")
+}
+$lines.Add("};")
+
+[System.IO.File]::WriteAllLines($output, $lines)
+Write-Output "Embedded $($embedded.Count) shaders in EmbeddedShaders.generated.h"
@@ -1,2 +1,6 @@
 %VULKAN_SDK%\Bin\slangc triangle.slang -profile spirv_1_4 -matrix-layout-column-major -target spirv -o triangle.vert.spv -entry vertexMain -stage vertex -warnings-disable 39001
-%VULKAN_SDK%\Bin\slangc triangle.slang -profile spirv_1_4 -matrix-layout-column-major -target spirv -o triangle.frag.spv -entry fragmentMain -stage fragment -warnings-disable 39001
\ No newline at end of file
+%VULKAN_SDK%\Bin\slangc triangle.slang -profile spirv_1_4 -matrix-layout-column-major -target spirv -o triangle.frag.spv -entry fragmentMain -stage fragment -warnings-disable 39001
+%VULKAN_SDK%\Bin\slangc cull.slang -profile spirv_1_4 -matrix-layout-column-major -target spirv -o cull.comp.spv -entry cullMain -stage compute -warnings-disable 39001
+%VULKAN_SDK%\Bin\slangc hiz.slang -profile spirv_1_4 -matrix-layout-column-major -target spirv -o hiz.comp.spv -entry hizMain -stage compute -warnings-disable 39001
+%VULKAN_SDK%\Bin\slangc meshlet.slang -profile spirv_1_4 -matrix-layout-column-major -target spirv -o meshlet.task.spv -entry taskMain -stage amplification -warnings-disable 39001
+%VULKAN_SDK%\Bin\slangc meshlet.slang -profile spirv_1_4 -matrix-layout-column-major -target spirv -o meshlet.mesh.spv -entry meshMain -stage mesh -warnings-disable 39001
\ No newline at end of file